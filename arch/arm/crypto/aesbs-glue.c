@@ -0,0 +1,456 @@
+/*
+ * Glue code for the bit-sliced NEON AES implementation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The NEON code handles ECB, CBC decryption, CTR and XTS eight blocks
+ * at a time.  CBC encryption is inherently serial and gains nothing from
+ * bit slicing, so it goes to the generic implementation, as does every
+ * request made from interrupt context, where NEON cannot be used.
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/types.h>
+#include <linux/crypto.h>
+#include <linux/hardirq.h>
+#include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <asm/neon.h>
+
+#include "aesbs-neon.h"
+
+#define AESBS_MAX_ROUND_KEYS	(AES_MAX_KEYLENGTH / AES_BLOCK_SIZE)
+
+struct aesbs_ctx {
+	int			rounds;
+	u8			rk[AESBS_MAX_ROUND_KEYS * AESBS_ROUND_KEY_SIZE];
+	struct crypto_blkcipher	*fallback;
+	struct crypto_cipher	*tweak;		/* XTS only */
+};
+
+/* spread bit j of each round key byte over byte p of row j */
+static int aesbs_expand_key(struct aesbs_ctx *ctx, const u8 *in_key,
+			    unsigned int key_len)
+{
+	struct crypto_aes_ctx rk;
+	const u32 *w = rk.key_enc;
+	u8 *out = ctx->rk;
+	int r, j, p;
+
+	if (crypto_aes_expand_key(&rk, in_key, key_len))
+		return -EINVAL;
+
+	ctx->rounds = 6 + key_len / 4;
+	for (r = 0; r <= ctx->rounds; r++, w += 4)
+		for (j = 0; j < 8; j++, out += 16)
+			for (p = 0; p < 16; p++)
+				out[p] = -((w[p / 4] >> (8 * (p % 4) + j)) & 1);
+
+	memset(&rk, 0, sizeof(rk));
+	return 0;
+}
+
+static int aesbs_set_fallback_key(struct crypto_tfm *tfm, const u8 *in_key,
+				  unsigned int key_len)
+{
+	struct aesbs_ctx *ctx = crypto_tfm_ctx(tfm);
+	int err;
+
+	crypto_blkcipher_clear_flags(ctx->fallback, CRYPTO_TFM_REQ_MASK);
+	crypto_blkcipher_set_flags(ctx->fallback,
+				   tfm->crt_flags & CRYPTO_TFM_REQ_MASK);
+	err = crypto_blkcipher_setkey(ctx->fallback, in_key, key_len);
+	tfm->crt_flags &= ~CRYPTO_TFM_RES_MASK;
+	tfm->crt_flags |= crypto_blkcipher_get_flags(ctx->fallback) &
+			  CRYPTO_TFM_RES_MASK;
+	return err;
+}
+
+static int aesbs_setkey(struct crypto_tfm *tfm, const u8 *in_key,
+			unsigned int key_len)
+{
+	struct aesbs_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	if (aesbs_expand_key(ctx, in_key, key_len)) {
+		tfm->crt_flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return -EINVAL;
+	}
+
+	return aesbs_set_fallback_key(tfm, in_key, key_len);
+}
+
+static int aesbs_xts_setkey(struct crypto_tfm *tfm, const u8 *in_key,
+			    unsigned int key_len)
+{
+	struct aesbs_ctx *ctx = crypto_tfm_ctx(tfm);
+	int err;
+
+	if (key_len % 2 || aesbs_expand_key(ctx, in_key, key_len / 2)) {
+		tfm->crt_flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return -EINVAL;
+	}
+
+	err = crypto_cipher_setkey(ctx->tweak, in_key + key_len / 2,
+				   key_len / 2);
+	if (err)
+		return err;
+
+	return aesbs_set_fallback_key(tfm, in_key, key_len);
+}
+
+static int fallback_encrypt(struct blkcipher_desc *desc,
+			    struct scatterlist *dst, struct scatterlist *src,
+			    unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct crypto_blkcipher *tfm = desc->tfm;
+	int err;
+
+	desc->tfm = ctx->fallback;
+	err = crypto_blkcipher_encrypt_iv(desc, dst, src, nbytes);
+	desc->tfm = tfm;
+	return err;
+}
+
+static int fallback_decrypt(struct blkcipher_desc *desc,
+			    struct scatterlist *dst, struct scatterlist *src,
+			    unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct crypto_blkcipher *tfm = desc->tfm;
+	int err;
+
+	desc->tfm = ctx->fallback;
+	err = crypto_blkcipher_decrypt_iv(desc, dst, src, nbytes);
+	desc->tfm = tfm;
+	return err;
+}
+
+static int ecb_crypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		     struct scatterlist *src, unsigned int nbytes, int enc)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+	desc->flags &= ~CRYPTO_TFM_REQ_MAY_SLEEP;
+
+	kernel_neon_begin();
+	while ((nbytes = walk.nbytes)) {
+		if (enc)
+			aesbs_ecb_encrypt(walk.dst.virt.addr,
+					  walk.src.virt.addr, ctx->rk,
+					  ctx->rounds, nbytes / AES_BLOCK_SIZE);
+		else
+			aesbs_ecb_decrypt(walk.dst.virt.addr,
+					  walk.src.virt.addr, ctx->rk,
+					  ctx->rounds, nbytes / AES_BLOCK_SIZE);
+		err = blkcipher_walk_done(desc, &walk,
+					  nbytes % AES_BLOCK_SIZE);
+	}
+	kernel_neon_end();
+
+	return err;
+}
+
+static int ecb_encrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	if (in_interrupt())
+		return fallback_encrypt(desc, dst, src, nbytes);
+
+	return ecb_crypt(desc, dst, src, nbytes, 1);
+}
+
+static int ecb_decrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	if (in_interrupt())
+		return fallback_decrypt(desc, dst, src, nbytes);
+
+	return ecb_crypt(desc, dst, src, nbytes, 0);
+}
+
+static int cbc_decrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	int err;
+
+	if (in_interrupt())
+		return fallback_decrypt(desc, dst, src, nbytes);
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+	desc->flags &= ~CRYPTO_TFM_REQ_MAY_SLEEP;
+
+	kernel_neon_begin();
+	while ((nbytes = walk.nbytes)) {
+		aesbs_cbc_decrypt(walk.dst.virt.addr, walk.src.virt.addr,
+				  ctx->rk, ctx->rounds,
+				  nbytes / AES_BLOCK_SIZE, walk.iv);
+		err = blkcipher_walk_done(desc, &walk,
+					  nbytes % AES_BLOCK_SIZE);
+	}
+	kernel_neon_end();
+
+	return err;
+}
+
+static int ctr_crypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		     struct scatterlist *src, unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	u8 tail[AES_BLOCK_SIZE];
+	int err;
+
+	if (in_interrupt())
+		return fallback_encrypt(desc, dst, src, nbytes);
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt_block(desc, &walk, AES_BLOCK_SIZE);
+	desc->flags &= ~CRYPTO_TFM_REQ_MAY_SLEEP;
+
+	kernel_neon_begin();
+	while ((nbytes = walk.nbytes) >= AES_BLOCK_SIZE) {
+		aesbs_ctr_encrypt(walk.dst.virt.addr, walk.src.virt.addr,
+				  ctx->rk, ctx->rounds,
+				  nbytes / AES_BLOCK_SIZE, walk.iv);
+		err = blkcipher_walk_done(desc, &walk,
+					  nbytes % AES_BLOCK_SIZE);
+	}
+	if (walk.nbytes) {
+		nbytes = walk.nbytes;
+		memcpy(tail, walk.src.virt.addr, nbytes);
+		aesbs_ctr_encrypt(tail, tail, ctx->rk, ctx->rounds, 1,
+				  walk.iv);
+		memcpy(walk.dst.virt.addr, tail, nbytes);
+		err = blkcipher_walk_done(desc, &walk, 0);
+	}
+	kernel_neon_end();
+
+	return err;
+}
+
+static int xts_crypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		     struct scatterlist *src, unsigned int nbytes, int enc)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+	desc->flags &= ~CRYPTO_TFM_REQ_MAY_SLEEP;
+
+	/* generate the initial tweak */
+	crypto_cipher_encrypt_one(ctx->tweak, walk.iv, walk.iv);
+
+	kernel_neon_begin();
+	while ((nbytes = walk.nbytes)) {
+		if (enc)
+			aesbs_xts_encrypt(walk.dst.virt.addr,
+					  walk.src.virt.addr, ctx->rk,
+					  ctx->rounds, nbytes / AES_BLOCK_SIZE,
+					  walk.iv);
+		else
+			aesbs_xts_decrypt(walk.dst.virt.addr,
+					  walk.src.virt.addr, ctx->rk,
+					  ctx->rounds, nbytes / AES_BLOCK_SIZE,
+					  walk.iv);
+		err = blkcipher_walk_done(desc, &walk,
+					  nbytes % AES_BLOCK_SIZE);
+	}
+	kernel_neon_end();
+
+	return err;
+}
+
+static int xts_encrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	if (in_interrupt())
+		return fallback_encrypt(desc, dst, src, nbytes);
+
+	return xts_crypt(desc, dst, src, nbytes, 1);
+}
+
+static int xts_decrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	if (in_interrupt())
+		return fallback_decrypt(desc, dst, src, nbytes);
+
+	return xts_crypt(desc, dst, src, nbytes, 0);
+}
+
+static int aesbs_init(struct crypto_tfm *tfm)
+{
+	const char *name = crypto_tfm_alg_name(tfm);
+	struct aesbs_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	ctx->fallback = crypto_alloc_blkcipher(name, 0,
+			CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK);
+	if (IS_ERR(ctx->fallback)) {
+		printk(KERN_ERR "aesbs: error allocating fallback %s\n", name);
+		return PTR_ERR(ctx->fallback);
+	}
+
+	return 0;
+}
+
+static void aesbs_exit(struct crypto_tfm *tfm)
+{
+	struct aesbs_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_blkcipher(ctx->fallback);
+}
+
+static int aesbs_xts_init(struct crypto_tfm *tfm)
+{
+	struct aesbs_ctx *ctx = crypto_tfm_ctx(tfm);
+	int err;
+
+	err = aesbs_init(tfm);
+	if (err)
+		return err;
+
+	ctx->tweak = crypto_alloc_cipher("aes", 0, 0);
+	if (IS_ERR(ctx->tweak)) {
+		crypto_free_blkcipher(ctx->fallback);
+		return PTR_ERR(ctx->tweak);
+	}
+
+	return 0;
+}
+
+static void aesbs_xts_exit(struct crypto_tfm *tfm)
+{
+	struct aesbs_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_cipher(ctx->tweak);
+	aesbs_exit(tfm);
+}
+
+static struct crypto_alg aesbs_algs[] = { {
+	.cra_name		= "ecb(aes)",
+	.cra_driver_name	= "ecb-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER |
+				  CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_alignmask		= 0,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aesbs_init,
+	.cra_exit		= aesbs_exit,
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.setkey		= aesbs_setkey,
+			.encrypt	= ecb_encrypt,
+			.decrypt	= ecb_decrypt,
+		},
+	},
+}, {
+	.cra_name		= "cbc(aes)",
+	.cra_driver_name	= "cbc-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER |
+				  CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_alignmask		= 0,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aesbs_init,
+	.cra_exit		= aesbs_exit,
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_setkey,
+			.encrypt	= fallback_encrypt,
+			.decrypt	= cbc_decrypt,
+		},
+	},
+}, {
+	.cra_name		= "ctr(aes)",
+	.cra_driver_name	= "ctr-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER |
+				  CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= 1,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_alignmask		= 0,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aesbs_init,
+	.cra_exit		= aesbs_exit,
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_setkey,
+			.encrypt	= ctr_crypt,
+			.decrypt	= ctr_crypt,
+		},
+	},
+}, {
+	.cra_name		= "xts(aes)",
+	.cra_driver_name	= "xts-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER |
+				  CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_alignmask		= 0,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= aesbs_xts_init,
+	.cra_exit		= aesbs_xts_exit,
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= 2 * AES_MIN_KEY_SIZE,
+			.max_keysize	= 2 * AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_xts_setkey,
+			.encrypt	= xts_encrypt,
+			.decrypt	= xts_decrypt,
+		},
+	},
+} };
+
+static int __init aesbs_mod_init(void)
+{
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	return crypto_register_algs(aesbs_algs, ARRAY_SIZE(aesbs_algs));
+}
+
+static void __exit aesbs_mod_exit(void)
+{
+	crypto_unregister_algs(aesbs_algs, ARRAY_SIZE(aesbs_algs));
+}
+
+module_init(aesbs_mod_init);
+module_exit(aesbs_mod_exit);
+
+MODULE_DESCRIPTION("Bit sliced AES in ECB/CBC/CTR/XTS modes using NEON");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("ecb(aes)");
+MODULE_ALIAS("cbc(aes)");
+MODULE_ALIAS("ctr(aes)");
+MODULE_ALIAS("xts(aes)");
@@ -0,0 +1,584 @@
+/*
+ * Bit-sliced AES using NEON
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Eight blocks are processed in parallel.  They are transposed so that
+ * register j holds bit j of every byte of every block: byte p of x[j]
+ * collects bit j of state byte p of blocks 0-7.  In that form SubBytes
+ * is a boolean circuit operating on whole registers, ShiftRows and the
+ * column rotations of MixColumns are byte permutations and AddRoundKey
+ * is an XOR with a key that has been expanded the same way.  No table
+ * lookups depend on secret data, so this is constant time as well.
+ *
+ * The S-box inverts in GF(((2^2)^2)^2): w^2 = w + 1 over GF(2),
+ * Z^2 = Z + w over GF(4) and Y^2 = Y + 9 over GF(16).  The AES field
+ * is mapped onto this tower by sending x to the root 0x6b of the AES
+ * polynomial, and the affine transformation is folded into the basis
+ * change on the way out.
+ *
+ * Everything in this file may be compiled into NEON instructions, so it
+ * must only be called between kernel_neon_begin() and kernel_neon_end().
+ */
+
+#include <arm_neon.h>
+
+#include "aesbs-neon.h"
+
+struct gf4 {
+	uint8x16_t hi, lo;
+};
+
+struct gf16 {
+	struct gf4 hi, lo;
+};
+
+struct gf256 {
+	struct gf16 hi, lo;
+};
+
+static inline __attribute__((always_inline))
+struct gf4 gf4_add(struct gf4 a, struct gf4 b)
+{
+	struct gf4 r = { veorq_u8(a.hi, b.hi), veorq_u8(a.lo, b.lo) };
+
+	return r;
+}
+
+static inline __attribute__((always_inline))
+struct gf4 gf4_mul(struct gf4 a, struct gf4 b)
+{
+	uint8x16_t p = vandq_u8(a.hi, b.hi);
+	uint8x16_t q = vandq_u8(a.lo, b.lo);
+	uint8x16_t s = vandq_u8(veorq_u8(a.hi, a.lo), veorq_u8(b.hi, b.lo));
+	struct gf4 r = { veorq_u8(s, q), veorq_u8(p, q) };
+
+	return r;
+}
+
+/* x^2, which is also the inverse of x in GF(4) */
+static inline __attribute__((always_inline))
+struct gf4 gf4_sq(struct gf4 a)
+{
+	struct gf4 r = { a.hi, veorq_u8(a.hi, a.lo) };
+
+	return r;
+}
+
+/* w * x */
+static inline __attribute__((always_inline))
+struct gf4 gf4_mulw(struct gf4 a)
+{
+	struct gf4 r = { veorq_u8(a.hi, a.lo), a.hi };
+
+	return r;
+}
+
+static inline __attribute__((always_inline))
+struct gf16 gf16_add(struct gf16 a, struct gf16 b)
+{
+	struct gf16 r = { gf4_add(a.hi, b.hi), gf4_add(a.lo, b.lo) };
+
+	return r;
+}
+
+static inline __attribute__((always_inline))
+struct gf16 gf16_mul(struct gf16 a, struct gf16 b)
+{
+	struct gf4 p = gf4_mul(a.hi, b.hi);
+	struct gf4 q = gf4_mul(a.lo, b.lo);
+	struct gf4 s = gf4_mul(gf4_add(a.hi, a.lo), gf4_add(b.hi, b.lo));
+	struct gf16 r = { gf4_add(s, q), gf4_add(q, gf4_mulw(p)) };
+
+	return r;
+}
+
+static inline __attribute__((always_inline))
+struct gf16 gf16_inv(struct gf16 a)
+{
+	struct gf4 d, t;
+	struct gf16 r;
+
+	/* d = w * a.hi^2 + a.lo * (a.hi + a.lo); w * x^2 swaps the bits */
+	t.hi = a.hi.lo;
+	t.lo = a.hi.hi;
+	d = gf4_add(t, gf4_mul(a.lo, gf4_add(a.hi, a.lo)));
+	d = gf4_sq(d);
+
+	r.hi = gf4_mul(a.hi, d);
+	r.lo = gf4_mul(gf4_add(a.hi, a.lo), d);
+	return r;
+}
+
+/* 9 * x^2 */
+static inline __attribute__((always_inline))
+struct gf16 gf16_sq_scl(struct gf16 a)
+{
+	struct gf16 r;
+
+	r.hi.hi = a.lo.lo;
+	r.hi.lo = a.lo.hi;
+	r.lo.hi = veorq_u8(a.lo.hi, a.hi.hi);
+	r.lo.lo = veorq_u8(veorq_u8(a.lo.lo, a.lo.hi),
+			   veorq_u8(a.hi.lo, a.hi.hi));
+	return r;
+}
+
+static inline __attribute__((always_inline))
+struct gf256 gf256_inv(struct gf256 a)
+{
+	struct gf16 d;
+	struct gf256 r;
+
+	d = gf16_add(gf16_sq_scl(a.hi), gf16_mul(a.lo, gf16_add(a.hi, a.lo)));
+	d = gf16_inv(d);
+
+	r.hi = gf16_mul(a.hi, d);
+	r.lo = gf16_mul(gf16_add(a.hi, a.lo), d);
+	return r;
+}
+
+static inline __attribute__((always_inline))
+struct gf256 to_gf256(const uint8x16_t t[8])
+{
+	struct gf256 a;
+
+	a.hi.hi.hi = t[7];
+	a.hi.hi.lo = t[6];
+	a.hi.lo.hi = t[5];
+	a.hi.lo.lo = t[4];
+	a.lo.hi.hi = t[3];
+	a.lo.hi.lo = t[2];
+	a.lo.lo.hi = t[1];
+	a.lo.lo.lo = t[0];
+	return a;
+}
+
+static inline __attribute__((always_inline))
+void from_gf256(uint8x16_t t[8], struct gf256 a)
+{
+	t[7] = a.hi.hi.hi;
+	t[6] = a.hi.hi.lo;
+	t[5] = a.hi.lo.hi;
+	t[4] = a.hi.lo.lo;
+	t[3] = a.lo.hi.hi;
+	t[2] = a.lo.hi.lo;
+	t[1] = a.lo.lo.hi;
+	t[0] = a.lo.lo.lo;
+}
+
+static void sub_bytes(uint8x16_t x[8])
+{
+	uint8x16_t t[8], z[8];
+	uint8x16_t x13 = veorq_u8(x[1], x[3]);
+	uint8x16_t x46 = veorq_u8(x[4], x[6]);
+	uint8x16_t x67 = veorq_u8(x[6], x[7]);
+	uint8x16_t z07, z23, z27;
+
+	/* map into the tower field */
+	t[0] = veorq_u8(veorq_u8(x13, x[0]), veorq_u8(x[2], x[7]));
+	t[1] = x13;
+	t[2] = veorq_u8(x[3], x46);
+	t[3] = veorq_u8(veorq_u8(x[1], x[2]), x67);
+	t[4] = veorq_u8(veorq_u8(x[2], x[3]), veorq_u8(x46, x[7]));
+	t[5] = veorq_u8(veorq_u8(x[1], x[4]), x67);
+	t[6] = veorq_u8(veorq_u8(x13, x[2]), veorq_u8(x46, x[5]));
+	t[7] = veorq_u8(x[5], x[7]);
+
+	from_gf256(z, gf256_inv(to_gf256(t)));
+
+	/* map back, apply the affine transformation and add 0x63 */
+	z07 = veorq_u8(z[0], z[7]);
+	z23 = veorq_u8(z[2], z[3]);
+	z27 = veorq_u8(z[2], z[7]);
+	x[0] = vmvnq_u8(veorq_u8(z[0], z[6]));
+	x[1] = vmvnq_u8(veorq_u8(veorq_u8(z07, z[1]), z[3]));
+	x[2] = veorq_u8(veorq_u8(z[0], z[1]), veorq_u8(z23, z[4]));
+	x[3] = z[0];
+	x[4] = veorq_u8(veorq_u8(z[0], z23), veorq_u8(z[4], z[5]));
+	x[5] = vmvnq_u8(veorq_u8(z23, z[7]));
+	x[6] = vmvnq_u8(veorq_u8(z[4], z[7]));
+	x[7] = z27;
+}
+
+static void inv_sub_bytes(uint8x16_t x[8])
+{
+	uint8x16_t t[8], z[8];
+	uint8x16_t x12 = veorq_u8(x[1], x[2]);
+	uint8x16_t x56 = veorq_u8(x[5], x[6]);
+	uint8x16_t x126 = veorq_u8(x12, x[6]);
+	uint8x16_t z14, z25, z67;
+
+	/* undo the affine transformation and map into the tower field */
+	t[0] = x[3];
+	t[1] = veorq_u8(veorq_u8(x[2], x[3]), x56);
+	t[2] = x126;
+	t[3] = vmvnq_u8(veorq_u8(x[5], x[7]));
+	t[4] = vmvnq_u8(veorq_u8(x12, x[7]));
+	t[5] = veorq_u8(veorq_u8(x[3], x[4]), x56);
+	t[6] = vmvnq_u8(veorq_u8(x[0], x[3]));
+	t[7] = veorq_u8(x126, x[7]);
+
+	from_gf256(z, gf256_inv(to_gf256(t)));
+
+	/* map back */
+	z14 = veorq_u8(z[1], z[4]);
+	z25 = veorq_u8(z[2], z[5]);
+	z67 = veorq_u8(z[6], z[7]);
+	x[0] = veorq_u8(veorq_u8(z[0], z14), z[2]);
+	x[1] = veorq_u8(z[4], z67);
+	x[2] = veorq_u8(z14, z[5]);
+	x[3] = veorq_u8(z14, z67);
+	x[4] = veorq_u8(z14, z[3]);
+	x[5] = veorq_u8(veorq_u8(z[1], z25), z[7]);
+	x[6] = veorq_u8(veorq_u8(z[2], z[3]), z67);
+	x[7] = veorq_u8(z[1], z25);
+}
+
+static const uint8_t shift_rows_idx[16] = {
+	0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11
+};
+
+static const uint8_t inv_shift_rows_idx[16] = {
+	0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3
+};
+
+static void permute_bytes(uint8x16_t x[8], const uint8_t idx[16])
+{
+	uint8x8_t lo = vld1_u8(idx);
+	uint8x8_t hi = vld1_u8(idx + 8);
+	uint8x8x2_t t;
+	int j;
+
+	for (j = 0; j < 8; j++) {
+		t.val[0] = vget_low_u8(x[j]);
+		t.val[1] = vget_high_u8(x[j]);
+		x[j] = vcombine_u8(vtbl2_u8(t, lo), vtbl2_u8(t, hi));
+	}
+}
+
+/* byte 4c + r of the state receives byte 4c + (r + n) mod 4 */
+static inline __attribute__((always_inline))
+uint8x16_t rot_col1(uint8x16_t x)
+{
+	uint32x4_t w = vreinterpretq_u32_u8(x);
+
+	return vreinterpretq_u8_u32(vorrq_u32(vshrq_n_u32(w, 8),
+					      vshlq_n_u32(w, 24)));
+}
+
+static inline __attribute__((always_inline))
+uint8x16_t rot_col2(uint8x16_t x)
+{
+	return vreinterpretq_u8_u16(vrev32q_u16(vreinterpretq_u16_u8(x)));
+}
+
+/* multiply every byte by x modulo x^8 + x^4 + x^3 + x + 1 */
+static inline __attribute__((always_inline))
+void xtime(uint8x16_t y[8], const uint8x16_t x[8])
+{
+	y[7] = x[6];
+	y[6] = x[5];
+	y[5] = x[4];
+	y[4] = veorq_u8(x[3], x[7]);
+	y[3] = veorq_u8(x[2], x[7]);
+	y[2] = x[1];
+	y[1] = veorq_u8(x[0], x[7]);
+	y[0] = x[7];
+}
+
+/* b = 2 * (a ^ rot1(a)) ^ rot1(a) ^ rot2(a) ^ rot3(a) */
+static void mix_columns(uint8x16_t x[8])
+{
+	uint8x16_t r[8], t[8], y[8];
+	int j;
+
+	for (j = 0; j < 8; j++) {
+		r[j] = rot_col1(x[j]);
+		t[j] = veorq_u8(x[j], r[j]);
+	}
+	xtime(y, t);
+	for (j = 0; j < 8; j++)
+		x[j] = veorq_u8(veorq_u8(y[j], r[j]), rot_col2(t[j]));
+}
+
+/*
+ * InvMixColumns is MixColumns applied after multiplying each column by
+ * 4x^2 + 5, i.e. after a ^= 4 * (a ^ rot2(a)).
+ */
+static void inv_mix_columns(uint8x16_t x[8])
+{
+	uint8x16_t t[8], y[8];
+	int j;
+
+	for (j = 0; j < 8; j++)
+		t[j] = veorq_u8(x[j], rot_col2(x[j]));
+	xtime(y, t);
+	xtime(t, y);
+	for (j = 0; j < 8; j++)
+		x[j] = veorq_u8(x[j], t[j]);
+	mix_columns(x);
+}
+
+static inline __attribute__((always_inline))
+void add_round_key(uint8x16_t x[8], const uint8_t *rk)
+{
+	int j;
+
+	for (j = 0; j < 8; j++)
+		x[j] = veorq_u8(x[j], vld1q_u8(rk + j * 16));
+}
+
+/* exchange the bits of a selected by mask with the bits n above them in b */
+static inline __attribute__((always_inline))
+void swapmove(uint8x16_t *a, uint8x16_t *b, int n, uint8x16_t mask)
+{
+	uint64x2_t a64 = vreinterpretq_u64_u8(*a);
+	uint64x2_t b64 = vreinterpretq_u64_u8(*b);
+	uint8x16_t t;
+
+	switch (n) {
+	case 1:
+		t = vreinterpretq_u8_u64(vshrq_n_u64(b64, 1));
+		break;
+	case 2:
+		t = vreinterpretq_u8_u64(vshrq_n_u64(b64, 2));
+		break;
+	default:
+		t = vreinterpretq_u8_u64(vshrq_n_u64(b64, 4));
+		break;
+	}
+	t = vandq_u8(veorq_u8(t, *a), mask);
+	*a = veorq_u8(*a, t);
+	a64 = vreinterpretq_u64_u8(t);
+	switch (n) {
+	case 1:
+		t = vreinterpretq_u8_u64(vshlq_n_u64(a64, 1));
+		break;
+	case 2:
+		t = vreinterpretq_u8_u64(vshlq_n_u64(a64, 2));
+		break;
+	default:
+		t = vreinterpretq_u8_u64(vshlq_n_u64(a64, 4));
+		break;
+	}
+	*b = veorq_u8(*b, t);
+}
+
+/*
+ * Transpose the 8x8 bit matrix formed by byte p of x[0..7], for all p.
+ * This is its own inverse, so it converts in both directions.
+ */
+static void bitslice(uint8x16_t x[8])
+{
+	uint8x16_t m1 = vdupq_n_u8(0x55);
+	uint8x16_t m2 = vdupq_n_u8(0x33);
+	uint8x16_t m4 = vdupq_n_u8(0x0f);
+
+	swapmove(&x[1], &x[0], 1, m1);
+	swapmove(&x[3], &x[2], 1, m1);
+	swapmove(&x[5], &x[4], 1, m1);
+	swapmove(&x[7], &x[6], 1, m1);
+
+	swapmove(&x[2], &x[0], 2, m2);
+	swapmove(&x[3], &x[1], 2, m2);
+	swapmove(&x[6], &x[4], 2, m2);
+	swapmove(&x[7], &x[5], 2, m2);
+
+	swapmove(&x[4], &x[0], 4, m4);
+	swapmove(&x[5], &x[1], 4, m4);
+	swapmove(&x[6], &x[2], 4, m4);
+	swapmove(&x[7], &x[3], 4, m4);
+}
+
+static void encrypt8(uint8x16_t x[8], const uint8_t *rk, int rounds)
+{
+	int r;
+
+	bitslice(x);
+	add_round_key(x, rk);
+	for (r = 1; r < rounds; r++) {
+		sub_bytes(x);
+		permute_bytes(x, shift_rows_idx);
+		mix_columns(x);
+		add_round_key(x, rk + r * AESBS_ROUND_KEY_SIZE);
+	}
+	sub_bytes(x);
+	permute_bytes(x, shift_rows_idx);
+	add_round_key(x, rk + rounds * AESBS_ROUND_KEY_SIZE);
+	bitslice(x);
+}
+
+static void decrypt8(uint8x16_t x[8], const uint8_t *rk, int rounds)
+{
+	int r;
+
+	bitslice(x);
+	add_round_key(x, rk + rounds * AESBS_ROUND_KEY_SIZE);
+	for (r = rounds - 1; r > 0; r--) {
+		permute_bytes(x, inv_shift_rows_idx);
+		inv_sub_bytes(x);
+		add_round_key(x, rk + r * AESBS_ROUND_KEY_SIZE);
+		inv_mix_columns(x);
+	}
+	permute_bytes(x, inv_shift_rows_idx);
+	inv_sub_bytes(x);
+	add_round_key(x, rk);
+	bitslice(x);
+}
+
+static inline __attribute__((always_inline))
+int load_blocks(uint8x16_t x[8], const uint8_t *in, int blocks)
+{
+	int n = blocks < 8 ? blocks : 8;
+	int i;
+
+	for (i = 0; i < n; i++)
+		x[i] = vld1q_u8(in + i * 16);
+	for (; i < 8; i++)
+		x[i] = vdupq_n_u8(0);
+	return n;
+}
+
+static inline __attribute__((always_inline))
+void store_blocks(uint8_t *out, const uint8x16_t x[8], int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		vst1q_u8(out + i * 16, x[i]);
+}
+
+void aesbs_ecb_encrypt(uint8_t out[], const uint8_t in[], const uint8_t rk[],
+		       int rounds, int blocks)
+{
+	uint8x16_t x[8];
+	int n;
+
+	for (; blocks > 0; blocks -= n, in += n * 16, out += n * 16) {
+		n = load_blocks(x, in, blocks);
+		encrypt8(x, rk, rounds);
+		store_blocks(out, x, n);
+	}
+}
+
+void aesbs_ecb_decrypt(uint8_t out[], const uint8_t in[], const uint8_t rk[],
+		       int rounds, int blocks)
+{
+	uint8x16_t x[8];
+	int n;
+
+	for (; blocks > 0; blocks -= n, in += n * 16, out += n * 16) {
+		n = load_blocks(x, in, blocks);
+		decrypt8(x, rk, rounds);
+		store_blocks(out, x, n);
+	}
+}
+
+void aesbs_cbc_decrypt(uint8_t out[], const uint8_t in[], const uint8_t rk[],
+		       int rounds, int blocks, uint8_t iv[])
+{
+	uint8x16_t x[8], c[8];
+	uint8x16_t prev = vld1q_u8(iv);
+	int i, n;
+
+	for (; blocks > 0; blocks -= n, in += n * 16, out += n * 16) {
+		n = load_blocks(x, in, blocks);
+		for (i = 0; i < 8; i++)
+			c[i] = x[i];
+		decrypt8(x, rk, rounds);
+		for (i = 0; i < n; i++) {
+			x[i] = veorq_u8(x[i], prev);
+			prev = c[i];
+		}
+		store_blocks(out, x, n);
+	}
+	vst1q_u8(iv, prev);
+}
+
+/* increment a 128-bit big endian counter */
+static void ctr_inc(uint8_t ctr[16])
+{
+	int i;
+
+	for (i = 15; i >= 0; i--)
+		if (++ctr[i])
+			break;
+}
+
+/*
+ * A trailing partial block is passed as a whole block; the caller must
+ * provide room for it in out[] and use as much of it as it needs.
+ */
+void aesbs_ctr_encrypt(uint8_t out[], const uint8_t in[], const uint8_t rk[],
+		       int rounds, int blocks, uint8_t ctr[])
+{
+	uint8x16_t x[8];
+	int i, n;
+
+	for (; blocks > 0; blocks -= n, in += n * 16, out += n * 16) {
+		n = blocks < 8 ? blocks : 8;
+		for (i = 0; i < 8; i++) {
+			x[i] = vld1q_u8(ctr);
+			if (i < n)
+				ctr_inc(ctr);
+		}
+		encrypt8(x, rk, rounds);
+		for (i = 0; i < n; i++)
+			vst1q_u8(out + i * 16,
+				 veorq_u8(x[i], vld1q_u8(in + i * 16)));
+	}
+}
+
+/* multiply the tweak by x in GF(2^128), least significant bit first */
+static inline __attribute__((always_inline))
+uint8x16_t xts_next(uint8x16_t t)
+{
+	uint64x2_t t64 = vreinterpretq_u64_u8(t);
+	uint64_t lo = vgetq_lane_u64(t64, 0);
+	uint64_t hi = vgetq_lane_u64(t64, 1);
+	uint64_t carry = (hi >> 63) * 0x87;
+
+	hi = (hi << 1) | (lo >> 63);
+	lo = (lo << 1) ^ carry;
+	return vreinterpretq_u8_u64(vcombine_u64(vcreate_u64(lo),
+						 vcreate_u64(hi)));
+}
+
+static void aesbs_xts_crypt(uint8_t out[], const uint8_t in[],
+			    const uint8_t rk[], int rounds, int blocks,
+			    uint8_t iv[],
+			    void (*crypt8)(uint8x16_t *, const uint8_t *, int))
+{
+	uint8x16_t x[8], t[8];
+	uint8x16_t tweak = vld1q_u8(iv);
+	int i, n;
+
+	for (; blocks > 0; blocks -= n, in += n * 16, out += n * 16) {
+		n = load_blocks(x, in, blocks);
+		for (i = 0; i < n; i++) {
+			t[i] = tweak;
+			x[i] = veorq_u8(x[i], tweak);
+			tweak = xts_next(tweak);
+		}
+		crypt8(x, rk, rounds);
+		for (i = 0; i < n; i++)
+			x[i] = veorq_u8(x[i], t[i]);
+		store_blocks(out, x, n);
+	}
+	vst1q_u8(iv, tweak);
+}
+
+void aesbs_xts_encrypt(uint8_t out[], const uint8_t in[], const uint8_t rk[],
+		       int rounds, int blocks, uint8_t iv[])
+{
+	aesbs_xts_crypt(out, in, rk, rounds, blocks, iv, encrypt8);
+}
+
+void aesbs_xts_decrypt(uint8_t out[], const uint8_t in[], const uint8_t rk[],
+		       int rounds, int blocks, uint8_t iv[])
+{
+	aesbs_xts_crypt(out, in, rk, rounds, blocks, iv, decrypt8);
+}
@@ -0,0 +1,28 @@
+/*
+ * Bit-sliced AES using NEON
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _AESBS_NEON_H
+#define _AESBS_NEON_H
+
+/* one round key: bit j of key byte p, replicated, is byte p of row j */
+#define AESBS_ROUND_KEY_SIZE	(8 * 16)
+
+void aesbs_ecb_encrypt(uint8_t out[], const uint8_t in[], const uint8_t rk[],
+		       int rounds, int blocks);
+void aesbs_ecb_decrypt(uint8_t out[], const uint8_t in[], const uint8_t rk[],
+		       int rounds, int blocks);
+void aesbs_cbc_decrypt(uint8_t out[], const uint8_t in[], const uint8_t rk[],
+		       int rounds, int blocks, uint8_t iv[]);
+void aesbs_ctr_encrypt(uint8_t out[], const uint8_t in[], const uint8_t rk[],
+		       int rounds, int blocks, uint8_t ctr[]);
+void aesbs_xts_encrypt(uint8_t out[], const uint8_t in[], const uint8_t rk[],
+		       int rounds, int blocks, uint8_t iv[]);
+void aesbs_xts_decrypt(uint8_t out[], const uint8_t in[], const uint8_t rk[],
+		       int rounds, int blocks, uint8_t iv[]);
+
+#endif /* _AESBS_NEON_H */
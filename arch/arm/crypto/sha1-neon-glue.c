@@ -0,0 +1,155 @@
+/*
+ * Glue code for the SHA-1 NEON implementation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The state is the one of sha1-generic, so requests made from interrupt
+ * context, where NEON cannot be used, go to crypto_sha1_update().
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/types.h>
+#include <linux/hardirq.h>
+#include <crypto/internal/hash.h>
+#include <crypto/sha.h>
+#include <asm/byteorder.h>
+#include <asm/neon.h>
+
+#include "sha1-neon.h"
+
+static int sha1_neon_init(struct shash_desc *desc)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+
+	*sctx = (struct sha1_state){
+		.state = { SHA1_H0, SHA1_H1, SHA1_H2, SHA1_H3, SHA1_H4 },
+	};
+
+	return 0;
+}
+
+static void __sha1_neon_update(struct sha1_state *sctx, const u8 *data,
+			       unsigned int len, unsigned int partial)
+{
+	unsigned int done = 0;
+
+	sctx->count += len;
+
+	if (partial) {
+		done = SHA1_BLOCK_SIZE - partial;
+		memcpy(sctx->buffer + partial, data, done);
+		sha1_transform_neon(sctx->state, sctx->buffer, 1);
+	}
+
+	if (len - done >= SHA1_BLOCK_SIZE) {
+		const unsigned int blocks = (len - done) / SHA1_BLOCK_SIZE;
+
+		sha1_transform_neon(sctx->state, data + done, blocks);
+		done += blocks * SHA1_BLOCK_SIZE;
+	}
+
+	memcpy(sctx->buffer, data + done, len - done);
+}
+
+static int sha1_neon_update(struct shash_desc *desc, const u8 *data,
+			    unsigned int len)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+	unsigned int partial = sctx->count % SHA1_BLOCK_SIZE;
+
+	if (partial + len < SHA1_BLOCK_SIZE) {
+		sctx->count += len;
+		memcpy(sctx->buffer + partial, data, len);
+		return 0;
+	}
+
+	if (in_interrupt())
+		return crypto_sha1_update(desc, data, len);
+
+	kernel_neon_begin();
+	__sha1_neon_update(sctx, data, len, partial);
+	kernel_neon_end();
+
+	return 0;
+}
+
+static int sha1_neon_final(struct shash_desc *desc, u8 *out)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+	unsigned int i, index, padlen;
+	__be32 *dst = (__be32 *)out;
+	__be64 bits;
+	static const u8 padding[SHA1_BLOCK_SIZE] = { 0x80, };
+
+	bits = cpu_to_be64(sctx->count << 3);
+
+	index = sctx->count % SHA1_BLOCK_SIZE;
+	padlen = (index < 56) ? (56 - index) : ((SHA1_BLOCK_SIZE + 56) - index);
+	sha1_neon_update(desc, padding, padlen);
+	sha1_neon_update(desc, (const u8 *)&bits, sizeof(bits));
+
+	for (i = 0; i < 5; i++)
+		dst[i] = cpu_to_be32(sctx->state[i]);
+
+	memset(sctx, 0, sizeof(*sctx));
+
+	return 0;
+}
+
+static int sha1_neon_export(struct shash_desc *desc, void *out)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+
+	memcpy(out, sctx, sizeof(*sctx));
+	return 0;
+}
+
+static int sha1_neon_import(struct shash_desc *desc, const void *in)
+{
+	struct sha1_state *sctx = shash_desc_ctx(desc);
+
+	memcpy(sctx, in, sizeof(*sctx));
+	return 0;
+}
+
+static struct shash_alg sha1_neon_alg = {
+	.digestsize	= SHA1_DIGEST_SIZE,
+	.init		= sha1_neon_init,
+	.update		= sha1_neon_update,
+	.final		= sha1_neon_final,
+	.export		= sha1_neon_export,
+	.import		= sha1_neon_import,
+	.descsize	= sizeof(struct sha1_state),
+	.statesize	= sizeof(struct sha1_state),
+	.base		= {
+		.cra_name		= "sha1",
+		.cra_driver_name	= "sha1-neon",
+		.cra_priority		= 250,
+		.cra_flags		= CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize		= SHA1_BLOCK_SIZE,
+		.cra_module		= THIS_MODULE,
+	},
+};
+
+static int __init sha1_neon_mod_init(void)
+{
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	return crypto_register_shash(&sha1_neon_alg);
+}
+
+static void __exit sha1_neon_mod_exit(void)
+{
+	crypto_unregister_shash(&sha1_neon_alg);
+}
+
+module_init(sha1_neon_mod_init);
+module_exit(sha1_neon_mod_exit);
+
+MODULE_DESCRIPTION("SHA1 Secure Hash Algorithm, NEON message schedule");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("sha1");
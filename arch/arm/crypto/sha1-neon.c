@@ -0,0 +1,121 @@
+/*
+ * SHA-1 block transform using NEON
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The rounds form a single dependency chain and stay on the integer
+ * core, where the rotations come for free with the barrel shifter.  The
+ * message schedule does not depend on them, so NEON computes W[t] + K[t]
+ * for the whole block, four words at a time, before the rounds start.
+ *
+ * W[t] = rol(W[t-3] ^ W[t-8] ^ W[t-14] ^ W[t-16], 1) makes the last lane
+ * of every vector depend on the first.  That lane is patched up after
+ * the fact for t < 32; from there on the equivalent
+ * W[t] = rol(W[t-6] ^ W[t-16] ^ W[t-28] ^ W[t-32], 2) has no such
+ * dependency.
+ *
+ * Everything in this file may be compiled into NEON instructions, so it
+ * must only be called between kernel_neon_begin() and kernel_neon_end().
+ */
+
+#include <arm_neon.h>
+
+#include "sha1-neon.h"
+
+#define rol(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+#define vrolq(x, n)	vsriq_n_u32(vshlq_n_u32(x, n), x, 32 - (n))
+
+static const uint32_t sha1_k[4] = {
+	0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6,
+};
+
+static inline __attribute__((always_inline))
+void sha1_expand(uint32_t wk[80], const uint8_t *data)
+{
+	uint32x4_t w[20], t, r;
+	uint32x4_t zero = vdupq_n_u32(0);
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		uint8x16_t b = vrev32q_u8(vld1q_u8(data + 16 * i));
+
+		w[i] = vreinterpretq_u32_u8(b);
+	}
+
+	for (i = 4; i < 8; i++) {
+		t = veorq_u32(w[i - 4], vextq_u32(w[i - 4], w[i - 3], 2));
+		t = veorq_u32(t, w[i - 2]);
+		t = veorq_u32(t, vextq_u32(w[i - 1], zero, 1));
+		r = vrolq(t, 1);
+		t = vextq_u32(zero, r, 1);
+		w[i] = veorq_u32(r, vrolq(t, 1));
+	}
+
+	for (i = 8; i < 20; i++) {
+		t = veorq_u32(vextq_u32(w[i - 2], w[i - 1], 2), w[i - 4]);
+		t = veorq_u32(t, w[i - 7]);
+		t = veorq_u32(t, w[i - 8]);
+		w[i] = vrolq(t, 2);
+	}
+
+	for (i = 0; i < 20; i++)
+		vst1q_u32(wk + 4 * i,
+			  vaddq_u32(w[i], vdupq_n_u32(sha1_k[i / 5])));
+}
+
+#define F1(b, c, d)	(((c ^ d) & b) ^ d)
+#define F2(b, c, d)	(b ^ c ^ d)
+#define F3(b, c, d)	((b & c) + (d & (b ^ c)))
+
+#define R(t, f, a, b, c, d, e)	do {		\
+	e += wk[t] + rol(a, 5) + f(b, c, d);	\
+	b = rol(b, 30);				\
+} while (0)
+
+#define R5(t, f)	do {		\
+	R(t, f, a, b, c, d, e);		\
+	R(t + 1, f, e, a, b, c, d);	\
+	R(t + 2, f, d, e, a, b, c);	\
+	R(t + 3, f, c, d, e, a, b);	\
+	R(t + 4, f, b, c, d, e, a);	\
+} while (0)
+
+void sha1_transform_neon(uint32_t *digest, const uint8_t *data, int blocks)
+{
+	uint32_t wk[80];
+	uint32_t a, b, c, d, e;
+	int t;
+
+	while (blocks--) {
+		sha1_expand(wk, data);
+		data += 64;
+
+		a = digest[0];
+		b = digest[1];
+		c = digest[2];
+		d = digest[3];
+		e = digest[4];
+
+		for (t = 0; t < 20; t += 5)
+			R5(t, F1);
+		for (; t < 40; t += 5)
+			R5(t, F2);
+		for (; t < 60; t += 5)
+			R5(t, F3);
+		for (; t < 80; t += 5)
+			R5(t, F2);
+
+		digest[0] += a;
+		digest[1] += b;
+		digest[2] += c;
+		digest[3] += d;
+		digest[4] += e;
+	}
+
+	/* the schedule is derived from the message, don't leave it behind */
+	for (t = 0; t < 80; t++)
+		wk[t] = 0;
+	__asm__ __volatile__("" : : "r" (wk) : "memory");
+}
@@ -0,0 +1,210 @@
+/*
+ * Glue code for the SHA-256 NEON implementation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The state is the one of sha256-generic, so requests made from interrupt
+ * context, where NEON cannot be used, go to crypto_sha256_update().
+ */
+
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/types.h>
+#include <linux/hardirq.h>
+#include <crypto/internal/hash.h>
+#include <crypto/sha.h>
+#include <asm/byteorder.h>
+#include <asm/neon.h>
+
+#include "sha256-neon.h"
+
+static int sha224_neon_init(struct shash_desc *desc)
+{
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+
+	*sctx = (struct sha256_state){
+		.state = { SHA224_H0, SHA224_H1, SHA224_H2, SHA224_H3,
+			   SHA224_H4, SHA224_H5, SHA224_H6, SHA224_H7 },
+	};
+
+	return 0;
+}
+
+static int sha256_neon_init(struct shash_desc *desc)
+{
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+
+	*sctx = (struct sha256_state){
+		.state = { SHA256_H0, SHA256_H1, SHA256_H2, SHA256_H3,
+			   SHA256_H4, SHA256_H5, SHA256_H6, SHA256_H7 },
+	};
+
+	return 0;
+}
+
+static void __sha256_neon_update(struct sha256_state *sctx, const u8 *data,
+				 unsigned int len, unsigned int partial)
+{
+	unsigned int done = 0;
+
+	sctx->count += len;
+
+	if (partial) {
+		done = SHA256_BLOCK_SIZE - partial;
+		memcpy(sctx->buf + partial, data, done);
+		sha256_transform_neon(sctx->state, sctx->buf, 1);
+	}
+
+	if (len - done >= SHA256_BLOCK_SIZE) {
+		const unsigned int blocks = (len - done) / SHA256_BLOCK_SIZE;
+
+		sha256_transform_neon(sctx->state, data + done, blocks);
+		done += blocks * SHA256_BLOCK_SIZE;
+	}
+
+	memcpy(sctx->buf, data + done, len - done);
+}
+
+static int sha256_neon_update(struct shash_desc *desc, const u8 *data,
+			      unsigned int len)
+{
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+	unsigned int partial = sctx->count % SHA256_BLOCK_SIZE;
+
+	if (partial + len < SHA256_BLOCK_SIZE) {
+		sctx->count += len;
+		memcpy(sctx->buf + partial, data, len);
+		return 0;
+	}
+
+	if (in_interrupt())
+		return crypto_sha256_update(desc, data, len);
+
+	kernel_neon_begin();
+	__sha256_neon_update(sctx, data, len, partial);
+	kernel_neon_end();
+
+	return 0;
+}
+
+static int sha256_neon_final(struct shash_desc *desc, u8 *out)
+{
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+	unsigned int i, index, padlen;
+	__be32 *dst = (__be32 *)out;
+	__be64 bits;
+	static const u8 padding[SHA256_BLOCK_SIZE] = { 0x80, };
+
+	bits = cpu_to_be64(sctx->count << 3);
+
+	index = sctx->count % SHA256_BLOCK_SIZE;
+	padlen = (index < 56) ? (56 - index) :
+				((SHA256_BLOCK_SIZE + 56) - index);
+	sha256_neon_update(desc, padding, padlen);
+	sha256_neon_update(desc, (const u8 *)&bits, sizeof(bits));
+
+	for (i = 0; i < 8; i++)
+		dst[i] = cpu_to_be32(sctx->state[i]);
+
+	memset(sctx, 0, sizeof(*sctx));
+
+	return 0;
+}
+
+static int sha224_neon_final(struct shash_desc *desc, u8 *out)
+{
+	u8 D[SHA256_DIGEST_SIZE];
+
+	sha256_neon_final(desc, D);
+
+	memcpy(out, D, SHA224_DIGEST_SIZE);
+	memset(D, 0, SHA256_DIGEST_SIZE);
+
+	return 0;
+}
+
+static int sha256_neon_export(struct shash_desc *desc, void *out)
+{
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+
+	memcpy(out, sctx, sizeof(*sctx));
+	return 0;
+}
+
+static int sha256_neon_import(struct shash_desc *desc, const void *in)
+{
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+
+	memcpy(sctx, in, sizeof(*sctx));
+	return 0;
+}
+
+static struct shash_alg sha256_neon_algs[] = { {
+	.digestsize	= SHA256_DIGEST_SIZE,
+	.init		= sha256_neon_init,
+	.update		= sha256_neon_update,
+	.final		= sha256_neon_final,
+	.export		= sha256_neon_export,
+	.import		= sha256_neon_import,
+	.descsize	= sizeof(struct sha256_state),
+	.statesize	= sizeof(struct sha256_state),
+	.base		= {
+		.cra_name		= "sha256",
+		.cra_driver_name	= "sha256-neon",
+		.cra_priority		= 250,
+		.cra_flags		= CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize		= SHA256_BLOCK_SIZE,
+		.cra_module		= THIS_MODULE,
+	},
+}, {
+	.digestsize	= SHA224_DIGEST_SIZE,
+	.init		= sha224_neon_init,
+	.update		= sha256_neon_update,
+	.final		= sha224_neon_final,
+	.export		= sha256_neon_export,
+	.import		= sha256_neon_import,
+	.descsize	= sizeof(struct sha256_state),
+	.statesize	= sizeof(struct sha256_state),
+	.base		= {
+		.cra_name		= "sha224",
+		.cra_driver_name	= "sha224-neon",
+		.cra_priority		= 250,
+		.cra_flags		= CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize		= SHA224_BLOCK_SIZE,
+		.cra_module		= THIS_MODULE,
+	},
+} };
+
+static int __init sha256_neon_mod_init(void)
+{
+	int err;
+
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	err = crypto_register_shash(&sha256_neon_algs[0]);
+	if (err)
+		return err;
+
+	err = crypto_register_shash(&sha256_neon_algs[1]);
+	if (err)
+		crypto_unregister_shash(&sha256_neon_algs[0]);
+
+	return err;
+}
+
+static void __exit sha256_neon_mod_exit(void)
+{
+	crypto_unregister_shash(&sha256_neon_algs[1]);
+	crypto_unregister_shash(&sha256_neon_algs[0]);
+}
+
+module_init(sha256_neon_mod_init);
+module_exit(sha256_neon_mod_exit);
+
+MODULE_DESCRIPTION("SHA-224/256 Secure Hash Algorithm, NEON message schedule");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("sha224");
+MODULE_ALIAS("sha256");
@@ -0,0 +1,144 @@
+/*
+ * SHA-256 block transform using NEON
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * As for SHA-1, the rounds run on the integer core and NEON computes
+ * W[t] + K[t] for the whole block beforehand, four words at a time.
+ * W[t] depends on W[t-2], so each vector is finished in two halves: the
+ * sigma1 terms of its first two lanes come from the previous vector and
+ * those of the last two from the first half.
+ *
+ * Everything in this file may be compiled into NEON instructions, so it
+ * must only be called between kernel_neon_begin() and kernel_neon_end().
+ */
+
+#include <arm_neon.h>
+
+#include "sha256-neon.h"
+
+#define ror(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+#define vrorq(x, n)	vsriq_n_u32(vshlq_n_u32(x, 32 - (n)), x, n)
+#define vror(x, n)	vsri_n_u32(vshl_n_u32(x, 32 - (n)), x, n)
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline __attribute__((always_inline))
+uint32x4_t sigma0(uint32x4_t x)
+{
+	return veorq_u32(veorq_u32(vrorq(x, 7), vrorq(x, 18)),
+			 vshrq_n_u32(x, 3));
+}
+
+static inline __attribute__((always_inline))
+uint32x2_t sigma1(uint32x2_t x)
+{
+	return veor_u32(veor_u32(vror(x, 17), vror(x, 19)),
+			vshr_n_u32(x, 10));
+}
+
+static inline __attribute__((always_inline))
+void sha256_expand(uint32_t wk[64], const uint8_t *data)
+{
+	uint32x4_t w[16], t;
+	uint32x2_t lo, hi;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		uint8x16_t b = vrev32q_u8(vld1q_u8(data + 16 * i));
+
+		w[i] = vreinterpretq_u32_u8(b);
+	}
+
+	for (i = 4; i < 16; i++) {
+		t = vaddq_u32(w[i - 4], vextq_u32(w[i - 2], w[i - 1], 1));
+		t = vaddq_u32(t, sigma0(vextq_u32(w[i - 4], w[i - 3], 1)));
+		lo = vget_high_u32(w[i - 1]);
+		lo = vadd_u32(vget_low_u32(t), sigma1(lo));
+		hi = vadd_u32(vget_high_u32(t), sigma1(lo));
+		w[i] = vcombine_u32(lo, hi);
+	}
+
+	for (i = 0; i < 16; i++)
+		vst1q_u32(wk + 4 * i,
+			  vaddq_u32(w[i], vld1q_u32(sha256_k + 4 * i)));
+}
+
+#define S0(x)		(ror(x, 2) ^ ror(x, 13) ^ ror(x, 22))
+#define S1(x)		(ror(x, 6) ^ ror(x, 11) ^ ror(x, 25))
+#define Ch(x, y, z)	(z ^ (x & (y ^ z)))
+#define Maj(x, y, z)	((x & y) | (z & (x | y)))
+
+#define R(t, a, b, c, d, e, f, g, h)	do {	\
+	h += wk[t] + S1(e) + Ch(e, f, g);	\
+	d += h;					\
+	h += S0(a) + Maj(a, b, c);		\
+} while (0)
+
+#define R8(t)	do {					\
+	R(t, a, b, c, d, e, f, g, h);			\
+	R(t + 1, h, a, b, c, d, e, f, g);		\
+	R(t + 2, g, h, a, b, c, d, e, f);		\
+	R(t + 3, f, g, h, a, b, c, d, e);		\
+	R(t + 4, e, f, g, h, a, b, c, d);		\
+	R(t + 5, d, e, f, g, h, a, b, c);		\
+	R(t + 6, c, d, e, f, g, h, a, b);		\
+	R(t + 7, b, c, d, e, f, g, h, a);		\
+} while (0)
+
+void sha256_transform_neon(uint32_t *digest, const uint8_t *data, int blocks)
+{
+	uint32_t wk[64];
+	uint32_t a, b, c, d, e, f, g, h;
+	int t;
+
+	while (blocks--) {
+		sha256_expand(wk, data);
+		data += 64;
+
+		a = digest[0];
+		b = digest[1];
+		c = digest[2];
+		d = digest[3];
+		e = digest[4];
+		f = digest[5];
+		g = digest[6];
+		h = digest[7];
+
+		for (t = 0; t < 64; t += 8)
+			R8(t);
+
+		digest[0] += a;
+		digest[1] += b;
+		digest[2] += c;
+		digest[3] += d;
+		digest[4] += e;
+		digest[5] += f;
+		digest[6] += g;
+		digest[7] += h;
+	}
+
+	/* the schedule is derived from the message, don't leave it behind */
+	for (t = 0; t < 64; t++)
+		wk[t] = 0;
+	__asm__ __volatile__("" : : "r" (wk) : "memory");
+}
@@ -0,0 +1,14 @@
+/*
+ * SHA-256 block transform using NEON
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _SHA256_NEON_H
+#define _SHA256_NEON_H
+
+void sha256_transform_neon(uint32_t *digest, const uint8_t *data, int blocks);
+
+#endif /* _SHA256_NEON_H */
@@ -0,0 +1,25 @@
+/*
+ * linux/arch/arm/include/asm/neon.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __ASM_NEON_H
+#define __ASM_NEON_H
+
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+/*
+ * NEON may only be used in process context, between kernel_neon_begin()
+ * and kernel_neon_end(), which must not sleep.  Only code built with
+ * -mfpu=neon in a unit of its own should run in between, so that the
+ * compiler cannot move NEON instructions outside of the region.
+ */
+void kernel_neon_begin(void);
+void kernel_neon_end(void);
+
+#endif /* __ASM_NEON_H */
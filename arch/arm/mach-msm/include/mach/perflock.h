@@ -20,6 +20,7 @@
 #define __ARCH_ARM_MACH_PERF_LOCK_H
 
 #include <linux/list.h>
+#include <linux/plist.h>
 #include <linux/cpufreq.h>
 
 
@@ -39,6 +40,7 @@ enum {
 
 struct perf_lock {
 	struct list_head link;
+	struct plist_node node;
 	unsigned int flags;
 	unsigned int level;
 	const char *name;
@@ -63,10 +65,7 @@ static inline void perf_lock(struct perf_lock *lock) { return; }
 static inline void perf_unlock(struct perf_lock *lock) { return; }
 static inline int is_perf_lock_active(struct perf_lock *lock) { return 0; }
 static inline int is_perf_locked(void) { return 0; }
-static inline void perflock_scaling_max_freq(unsigned int freq, unsigned int cpu) { return; }
-static inline void perflock_scaling_min_freq(unsigned int freq, unsigned int cpu) { return; }
 static inline void htc_print_active_perf_locks(void) { return; }
-static inline int perflock_override(const struct cpufreq_policy *policy) { return 0; }
 static inline struct perf_lock *perflock_acquire(const char *name) { return NULL; }
 static inline int perflock_release(const char *name) { return 0; }
 #else
@@ -76,9 +75,6 @@ extern void perf_lock(struct perf_lock *lock);
 extern void perf_unlock(struct perf_lock *lock);
 extern int is_perf_lock_active(struct perf_lock *lock);
 extern int is_perf_locked(void);
-extern void perflock_scaling_max_freq(unsigned int freq, unsigned int cpu);
-extern void perflock_scaling_min_freq(unsigned int freq, unsigned int cpu);
-extern int perflock_override(const struct cpufreq_policy *policy, const unsigned int new_freq);
 extern void htc_print_active_perf_locks(void);
 extern struct perf_lock *perflock_acquire(const char *name);
 extern int perflock_release(const char *name);
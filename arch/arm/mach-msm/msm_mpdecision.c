@@ -0,0 +1,484 @@
+/*
+ * In-kernel CPU hotplug policy driven by the run queue average.
+ *
+ * Every sample_ms the tick of the timekeeping CPU takes the run queue
+ * average collected by msm_rq_stats, the way the MPDecision daemon reads
+ * run_queue_avg.  With n cores online, a core is added once the average
+ * has stayed above up_threshold[n - 1] for up_time_ms[n - 1], and one is
+ * removed once it has stayed below down_threshold[n - 1] for
+ * down_time_ms[n - 1].  Averages are in tenths of a task.  The number of
+ * cores is kept within the limits set through pnpmgr, and the hotplug
+ * itself is done by a SCHED_FIFO thread.
+ *
+ * Writing a trace of run queue averages, one per sample, to
+ * /sys/kernel/debug/msm_mpdecision/replay runs it through the policy
+ * without touching the cores; reading the file back shows when each
+ * decision would have been taken.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/cpu.h>
+#include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/rq_stats.h>
+
+#define DEFAULT_SAMPLE_MS		20
+#define REPLAY_BUF_SIZE			PAGE_SIZE
+/* the defaults below are for up to four cores */
+#define MPDEC_NR_LEVELS			(NR_CPUS > 4 ? NR_CPUS : 4)
+
+static bool enabled = 1;
+module_param(enabled, bool, 0644);
+
+static unsigned int sample_ms = DEFAULT_SAMPLE_MS;
+module_param(sample_ms, uint, 0644);
+
+static unsigned int up_threshold[MPDEC_NR_LEVELS] = { 19, 27, 35 };
+module_param_array(up_threshold, uint, NULL, 0644);
+
+static unsigned int up_time_ms[MPDEC_NR_LEVELS] = { 140, 140, 140 };
+module_param_array(up_time_ms, uint, NULL, 0644);
+
+static unsigned int down_threshold[MPDEC_NR_LEVELS] = { 0, 11, 21, 31 };
+module_param_array(down_threshold, uint, NULL, 0644);
+
+static unsigned int down_time_ms[MPDEC_NR_LEVELS] = { 0, 190, 190, 190 };
+module_param_array(down_time_ms, uint, NULL, 0644);
+
+struct mpdec_state {
+	u64 above_since;
+	u64 below_since;
+	int min_cpus;
+	int max_cpus;
+};
+
+struct mpdec_stats {
+	unsigned int nr_up;
+	unsigned int nr_down;
+	unsigned int nr_failed;
+	/* from the decision to the core being online, in usecs */
+	u64 up_exec_us_sum;
+	u64 up_exec_us_max;
+	/* from the load crossing the threshold to the core being online */
+	u64 up_total_us_sum;
+	u64 up_total_us_max;
+};
+
+static struct mpdec {
+	spinlock_t lock;
+	struct mpdec_state state;
+	unsigned long next_sample;
+
+	/* request to the hotplug thread */
+	bool busy;
+	int target;
+	u64 trigger_ns;
+	u64 decided_ns;
+
+	struct task_struct *thread;
+	struct mpdec_stats stats;
+
+	struct mutex replay_lock;
+	char *replay_buf;
+	size_t replay_len;
+} mpdec = {
+	.lock = __SPIN_LOCK_UNLOCKED(mpdec.lock),
+	.replay_lock = __MUTEX_INITIALIZER(mpdec.replay_lock),
+};
+
+static inline u64 mpdec_now(void)
+{
+	return ktime_to_ns(ktime_get());
+}
+
+/*
+ * Return the number of cores @rq_avg calls for with @online of them up.
+ * The time the average has been over or under the thresholds is kept in
+ * @s, and *@trigger is set to when it crossed the one that fired.
+ */
+static int mpdec_evaluate(struct mpdec_state *s, unsigned int rq_avg,
+			  int online, u64 now, u64 *trigger)
+{
+	int n = online - 1;
+
+	*trigger = now;
+	if (online < s->min_cpus || online > s->max_cpus) {
+		s->above_since = s->below_since = 0;
+		return clamp(online, s->min_cpus, s->max_cpus);
+	}
+
+	if (online < s->max_cpus && rq_avg > up_threshold[n]) {
+		s->below_since = 0;
+		if (!s->above_since)
+			s->above_since = now;
+		if (now - s->above_since < (u64)up_time_ms[n] * NSEC_PER_MSEC)
+			return online;
+		*trigger = s->above_since;
+		s->above_since = 0;
+		return online + 1;
+	}
+	s->above_since = 0;
+
+	if (online > s->min_cpus && rq_avg < down_threshold[n]) {
+		if (!s->below_since)
+			s->below_since = now;
+		if (now - s->below_since < (u64)down_time_ms[n] * NSEC_PER_MSEC)
+			return online;
+		*trigger = s->below_since;
+		s->below_since = 0;
+		return online - 1;
+	}
+	s->below_since = 0;
+
+	return online;
+}
+
+/* Called with mpdec.lock held. */
+static void mpdec_request(int target, u64 trigger, u64 now)
+{
+	if (mpdec.busy || !mpdec.thread)
+		return;
+
+	mpdec.busy = true;
+	mpdec.target = target;
+	mpdec.trigger_ns = trigger;
+	mpdec.decided_ns = now;
+	wake_up_process(mpdec.thread);
+}
+
+/*
+ * Called from the tick of the timekeeping CPU, right after the run queue
+ * average has been updated.
+ */
+void msm_mpdec_tick(void)
+{
+	unsigned int rq_avg;
+	unsigned long flags;
+	u64 now, trigger;
+	int online, target;
+
+	if (!enabled)
+		return;
+
+	spin_lock_irqsave(&mpdec.lock, flags);
+	if (!mpdec.thread || time_before(jiffies, mpdec.next_sample)) {
+		spin_unlock_irqrestore(&mpdec.lock, flags);
+		return;
+	}
+	mpdec.next_sample = jiffies + msecs_to_jiffies(sample_ms);
+	spin_unlock_irqrestore(&mpdec.lock, flags);
+
+	spin_lock_irqsave(&rq_lock, flags);
+	rq_avg = rq_info.rq_avg;
+	rq_info.rq_avg = 0;
+	spin_unlock_irqrestore(&rq_lock, flags);
+
+	spin_lock_irqsave(&mpdec.lock, flags);
+	if (!mpdec.busy) {
+		now = mpdec_now();
+		online = num_online_cpus();
+		target = mpdec_evaluate(&mpdec.state, rq_avg, online, now,
+					&trigger);
+		if (target != online)
+			mpdec_request(target, trigger, now);
+	}
+	spin_unlock_irqrestore(&mpdec.lock, flags);
+}
+
+/*
+ * Limits from pnpmgr; anything out of range means no limit.  Cores that
+ * the new limits call for are brought up or down right away rather than
+ * at the next sample.
+ */
+void msm_mpdec_set_cpu_limits(int min_cpus, int max_cpus)
+{
+	unsigned long flags;
+	u64 now;
+	int online;
+
+	if (min_cpus < 1 || min_cpus > nr_cpu_ids)
+		min_cpus = 1;
+	if (max_cpus < min_cpus || max_cpus > nr_cpu_ids)
+		max_cpus = nr_cpu_ids;
+
+	spin_lock_irqsave(&mpdec.lock, flags);
+	mpdec.state.min_cpus = min_cpus;
+	mpdec.state.max_cpus = max_cpus;
+
+	online = num_online_cpus();
+	if (enabled && (online < min_cpus || online > max_cpus)) {
+		now = mpdec_now();
+		mpdec_request(clamp(online, min_cpus, max_cpus), now, now);
+	}
+	spin_unlock_irqrestore(&mpdec.lock, flags);
+}
+
+static void mpdec_account_up(u64 online_ns)
+{
+	struct mpdec_stats *st = &mpdec.stats;
+	u64 exec_us = div_u64(online_ns - mpdec.decided_ns, NSEC_PER_USEC);
+	u64 total_us = div_u64(online_ns - mpdec.trigger_ns, NSEC_PER_USEC);
+
+	st->nr_up++;
+	st->up_exec_us_sum += exec_us;
+	st->up_exec_us_max = max(st->up_exec_us_max, exec_us);
+	st->up_total_us_sum += total_us;
+	st->up_total_us_max = max(st->up_total_us_max, total_us);
+}
+
+/* Move one core towards the target. */
+static void mpdec_hotplug(void)
+{
+	unsigned long flags;
+	int target, online, cpu, last = -1;
+	int ret = 0;
+
+	spin_lock_irqsave(&mpdec.lock, flags);
+	target = mpdec.target;
+	spin_unlock_irqrestore(&mpdec.lock, flags);
+
+	online = num_online_cpus();
+	if (target > online) {
+		for_each_present_cpu(cpu) {
+			if (!cpu_online(cpu))
+				break;
+		}
+		ret = cpu < nr_cpu_ids ? cpu_up(cpu) : -ENODEV;
+	} else if (target < online) {
+		for_each_online_cpu(cpu)
+			last = cpu;
+		ret = last > 0 ? cpu_down(last) : -ENODEV;
+	}
+
+	spin_lock_irqsave(&mpdec.lock, flags);
+	if (ret)
+		mpdec.stats.nr_failed++;
+	else if (target > online)
+		mpdec_account_up(mpdec_now());
+	else if (target < online)
+		mpdec.stats.nr_down++;
+	mpdec.state.above_since = mpdec.state.below_since = 0;
+	mpdec.busy = false;
+	spin_unlock_irqrestore(&mpdec.lock, flags);
+}
+
+static int mpdec_thread(void *data)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO - 1 };
+
+	sched_setscheduler(current, SCHED_FIFO, &param);
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		if (!mpdec.busy) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+		mpdec_hotplug();
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static int mpdec_stats_show(struct seq_file *m, void *unused)
+{
+	struct mpdec_stats st;
+	unsigned long flags;
+
+	spin_lock_irqsave(&mpdec.lock, flags);
+	st = mpdec.stats;
+	spin_unlock_irqrestore(&mpdec.lock, flags);
+
+	seq_printf(m, "online:        %u (min %d max %d)\n", num_online_cpus(),
+		   mpdec.state.min_cpus, mpdec.state.max_cpus);
+	seq_printf(m, "up:            %u\n", st.nr_up);
+	seq_printf(m, "down:          %u\n", st.nr_down);
+	seq_printf(m, "failed:        %u\n", st.nr_failed);
+	if (st.nr_up) {
+		seq_printf(m, "up exec us:    avg %llu max %llu\n",
+			   div_u64(st.up_exec_us_sum, st.nr_up),
+			   st.up_exec_us_max);
+		seq_printf(m, "up total us:   avg %llu max %llu\n",
+			   div_u64(st.up_total_us_sum, st.nr_up),
+			   st.up_total_us_max);
+	}
+	return 0;
+}
+
+static int mpdec_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mpdec_stats_show, NULL);
+}
+
+static ssize_t mpdec_stats_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&mpdec.lock, flags);
+	memset(&mpdec.stats, 0, sizeof(mpdec.stats));
+	spin_unlock_irqrestore(&mpdec.lock, flags);
+
+	return count;
+}
+
+static const struct file_operations mpdec_stats_fops = {
+	.open		= mpdec_stats_open,
+	.read		= seq_read,
+	.write		= mpdec_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * Replay @trace through the policy, starting with one core online and the
+ * current limits, a sample every sample_ms and the decisions taking effect
+ * at once.
+ */
+static void mpdec_replay(char *trace)
+{
+	struct mpdec_state s = {
+		.min_cpus = mpdec.state.min_cpus,
+		.max_cpus = mpdec.state.max_cpus,
+	};
+	u64 now = 0, trigger;
+	unsigned int rq_avg, nr = 0;
+	int online = 1, target;
+	char *tok;
+	size_t len = 0;
+
+	while ((tok = strsep(&trace, " \t\n")) != NULL) {
+		if (!*tok)
+			continue;
+		if (kstrtouint(tok, 10, &rq_avg)) {
+			len += scnprintf(mpdec.replay_buf + len,
+					 REPLAY_BUF_SIZE - len,
+					 "bad sample \"%s\"\n", tok);
+			break;
+		}
+
+		now += (u64)sample_ms * NSEC_PER_MSEC;
+		nr++;
+		target = mpdec_evaluate(&s, rq_avg, online, now, &trigger);
+		if (target == online)
+			continue;
+
+		len += scnprintf(mpdec.replay_buf + len, REPLAY_BUF_SIZE - len,
+				 "%8llu ms  rq_avg %u.%u  cpus %d -> %d  after %llu ms\n",
+				 div_u64(now, NSEC_PER_MSEC), rq_avg / 10,
+				 rq_avg % 10, online, target,
+				 div_u64(now - trigger, NSEC_PER_MSEC));
+		online = target;
+		s.above_since = s.below_since = 0;
+	}
+
+	len += scnprintf(mpdec.replay_buf + len, REPLAY_BUF_SIZE - len,
+			 "%u samples, %d cpus at the end\n", nr, online);
+	mpdec.replay_len = len;
+}
+
+static ssize_t mpdec_replay_write(struct file *file, const char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	char *trace;
+
+	if (count >= PAGE_SIZE)
+		return -EINVAL;
+
+	trace = kmalloc(count + 1, GFP_KERNEL);
+	if (!trace)
+		return -ENOMEM;
+	if (copy_from_user(trace, buf, count)) {
+		kfree(trace);
+		return -EFAULT;
+	}
+	trace[count] = '\0';
+
+	mutex_lock(&mpdec.replay_lock);
+	mpdec_replay(trace);
+	mutex_unlock(&mpdec.replay_lock);
+
+	kfree(trace);
+	return count;
+}
+
+static ssize_t mpdec_replay_read(struct file *file, char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	ssize_t ret;
+
+	mutex_lock(&mpdec.replay_lock);
+	ret = simple_read_from_buffer(buf, count, ppos, mpdec.replay_buf,
+				      mpdec.replay_len);
+	mutex_unlock(&mpdec.replay_lock);
+
+	return ret;
+}
+
+static const struct file_operations mpdec_replay_fops = {
+	.write		= mpdec_replay_write,
+	.read		= mpdec_replay_read,
+	.llseek		= default_llseek,
+};
+
+static void mpdec_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	mpdec.replay_buf = kzalloc(REPLAY_BUF_SIZE, GFP_KERNEL);
+	if (!mpdec.replay_buf)
+		return;
+
+	dir = debugfs_create_dir("msm_mpdecision", NULL);
+	if (IS_ERR_OR_NULL(dir))
+		return;
+	debugfs_create_file("stats", S_IRUGO | S_IWUSR, dir, NULL,
+			    &mpdec_stats_fops);
+	debugfs_create_file("replay", S_IRUGO | S_IWUSR, dir, NULL,
+			    &mpdec_replay_fops);
+}
+
+static int __init msm_mpdecision_init(void)
+{
+	struct task_struct *thread;
+
+	if (!rq_info.init)
+		return -ENODEV;
+
+	mpdec.state.min_cpus = 1;
+	mpdec.state.max_cpus = nr_cpu_ids;
+
+	thread = kthread_run(mpdec_thread, NULL, "msm_mpdecision");
+	if (IS_ERR(thread))
+		return PTR_ERR(thread);
+
+	spin_lock_irq(&mpdec.lock);
+	mpdec.thread = thread;
+	spin_unlock_irq(&mpdec.lock);
+
+	mpdec_debugfs_init();
+	return 0;
+}
+late_initcall(msm_mpdecision_init);
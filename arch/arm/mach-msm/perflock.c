@@ -21,6 +21,8 @@
 #include <linux/debugfs.h>
 #include <linux/earlysuspend.h>
 #include <linux/cpufreq.h>
+#include <linux/mutex.h>
+#include <linux/pm_qos.h>
 #include <linux/timer.h>
 #include <linux/slab.h>
 #include <mach/perflock.h>
@@ -37,18 +39,42 @@ enum {
 	PERF_SCREEN_ON_POLICY_DEBUG = 1U << 4,
 };
 
-static LIST_HEAD(active_perf_locks);
-static LIST_HEAD(inactive_perf_locks);
-static LIST_HEAD(active_cpufreq_ceiling_locks);
-static LIST_HEAD(inactive_cpufreq_ceiling_locks);
+/*
+ * Active locks sit on a PM QoS constraint list per type, a plist ordered
+ * by speed in kHz, so the speed of a type is its first or last node.
+ * Adding a lock walks the distinct speeds already on the list, which is
+ * linear in their number rather than logarithmic, and removing one is
+ * constant time; with a handful of table frequencies either is cheap.
+ * The highest floor and the highest ceiling are then passed on as
+ * perflock's single request in the cpu_freq_min and cpu_freq_max
+ * classes, which the cpufreq core applies to the policy of every CPU
+ * whatever the governor.
+ */
+static BLOCKING_NOTIFIER_HEAD(perf_floor_notifier);
+static struct pm_qos_constraints perf_floor_constraints = {
+	.list = PLIST_HEAD_INIT(perf_floor_constraints.list),
+	.type = PM_QOS_MAX,
+	.notifiers = &perf_floor_notifier,
+};
+
+static BLOCKING_NOTIFIER_HEAD(perf_ceiling_notifier);
+static struct pm_qos_constraints perf_ceiling_constraints = {
+	.list = PLIST_HEAD_INIT(perf_ceiling_constraints.list),
+	.type = PM_QOS_MAX,
+	.notifiers = &perf_ceiling_notifier,
+};
+
+static struct pm_qos_request perf_floor_req;
+static struct pm_qos_request perf_ceiling_req;
+
+static LIST_HEAD(perf_locks);
 static DEFINE_SPINLOCK(list_lock);
-static DEFINE_SPINLOCK(policy_update_lock);
+static DEFINE_MUTEX(perflock_mutex);
 static int initialized;
 static int cpufreq_ceiling_initialized;
 static unsigned int *perf_acpu_table;
 static unsigned int *cpufreq_ceiling_acpu_table;
 static unsigned int table_size;
-static struct workqueue_struct *perflock_setrate_workqueue;
 
 
 #ifdef CONFIG_PERF_LOCK_DEBUG
@@ -65,17 +91,92 @@ static struct kernel_param_ops param_ops_str = {
 
 module_param_cb(debug_mask, &param_ops_str, &debug_mask, S_IWUSR | S_IRUGO);
 
+static unsigned int get_perflock_speed(void);
+static unsigned int get_cpufreq_ceiling_speed(void);
+static void print_active_locks(void);
+
 #ifdef CONFIG_HTC_PNPMGR
 static int legacy_mode = 1;
-module_param_cb(legacy_mode, &param_ops_str, &legacy_mode, S_IWUSR | S_IRUGO);
 extern struct kobject *cpufreq_kobj;
 #endif
 
-static unsigned int get_perflock_speed(void);
-static unsigned int get_cpufreq_ceiling_speed(void);
-static void print_active_locks(void);
+static void perflock_update_request(struct pm_qos_request *req,
+				    unsigned int speed)
+{
+#ifdef CONFIG_HTC_PNPMGR
+	if (!legacy_mode)
+		speed = 0;
+#endif
+	if (pm_qos_request_active(req))
+		pm_qos_update_request(req, speed ? speed : PM_QOS_DEFAULT_VALUE);
+}
+
+static int perf_floor_notify(struct notifier_block *nb,
+			     unsigned long speed, void *data)
+{
+	if (debug_mask & PERF_CPUFREQ_LOCK_DEBUG) {
+		pr_info("%s: cpufreq lock speed %lu\n", __func__, speed);
+		print_active_locks();
+	}
+#ifdef CONFIG_HTC_PNPMGR
+	if (!legacy_mode)
+		sysfs_notify(cpufreq_kobj, NULL, "perflock_scaling_min");
+#endif
+	perflock_update_request(&perf_floor_req, speed);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block perf_floor_nb = {
+	.notifier_call = perf_floor_notify,
+};
+
+static int perf_ceiling_notify(struct notifier_block *nb,
+			       unsigned long speed, void *data)
+{
+	if (debug_mask & PERF_CPUFREQ_LOCK_DEBUG) {
+		pr_info("%s: cpufreq_ceiling speed %lu\n", __func__, speed);
+		print_active_locks();
+	}
+#ifdef CONFIG_HTC_PNPMGR
+	if (!legacy_mode)
+		sysfs_notify(cpufreq_kobj, NULL, "perflock_scaling_max");
+#endif
+	perflock_update_request(&perf_ceiling_req, speed);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block perf_ceiling_nb = {
+	.notifier_call = perf_ceiling_notify,
+};
+
+#ifdef CONFIG_HTC_PNPMGR
+static int param_set_legacy_mode(const char *val,
+				 const struct kernel_param *kp)
+{
+	int ret;
+
+	mutex_lock(&perflock_mutex);
+	ret = param_set_int(val, kp);
+	if (!ret) {
+		perflock_update_request(&perf_floor_req, get_perflock_speed() / 1000);
+		perflock_update_request(&perf_ceiling_req,
+				get_cpufreq_ceiling_speed() / 1000);
+	}
+	mutex_unlock(&perflock_mutex);
+	return ret;
+}
+
+static struct kernel_param_ops param_ops_legacy_mode = {
+	.set = param_set_legacy_mode,
+	.get = param_get_int,
+};
+
+module_param_cb(legacy_mode, &param_ops_legacy_mode, &legacy_mode,
+		S_IWUSR | S_IRUGO);
+#endif
 
 #ifdef CONFIG_PERFLOCK_SCREEN_POLICY
+static DEFINE_SPINLOCK(policy_update_lock);
 static unsigned int screen_off_policy_req;
 static unsigned int screen_on_policy_req;
 static void perflock_early_suspend(struct early_suspend *handler)
@@ -188,130 +289,14 @@ module_param_call(min_cpu_khz, param_set_cpu_min_max, param_get_int,
 module_param_call(max_cpu_khz, param_set_cpu_min_max, param_get_int,
 	&policy_max, S_IWUSR | S_IRUGO);
 
-static DEFINE_PER_CPU(int, stored_policy_min);
-static DEFINE_PER_CPU(int, stored_policy_max);
-int perflock_override(const struct cpufreq_policy *policy, const unsigned int new_freq)
-{
-	unsigned int target_min_freq = 0, target_max_freq = 0;
-	unsigned int lock_speed = 0;
-	unsigned int cpufreq_ceiling_speed = 0;
-	unsigned long irqflags;
-	unsigned int policy_min;
-	unsigned int policy_max;
-
-#ifdef CONFIG_HTC_PNPMGR
-	if (!legacy_mode)
-		return 0;
-#endif
-	if (policy != NULL) {
-		
-		if (strncmp("ondemand", policy->governor->name, 8) != 0)
-			return 0;
-		policy_min = policy->min;
-		policy_max = policy->max;
-		perflock_scaling_min_freq(policy_min, policy->cpu);
-		perflock_scaling_max_freq(policy_max, policy->cpu);
-	} else {
-		policy_min = per_cpu(stored_policy_min, smp_processor_id());
-		policy_max = per_cpu(stored_policy_max, smp_processor_id());
-	}
-
-	spin_lock_irqsave(&policy_update_lock, irqflags);
-
-	if ((lock_speed = (get_perflock_speed() / 1000))) {
-		target_min_freq = lock_speed > policy_min? lock_speed : policy_min;
-		target_max_freq = policy_max;
-		
-		if (target_min_freq > target_max_freq)
-			target_min_freq = target_max_freq;
-		if (debug_mask & PERF_CPUFREQ_LOCK_DEBUG) {
-			pr_info("%s: cpufreq lock speed %d\n",
-					__func__, lock_speed);
-			print_active_locks();
-		}
-	} else if ((cpufreq_ceiling_speed = (get_cpufreq_ceiling_speed() / 1000))) {
-		target_max_freq = cpufreq_ceiling_speed > policy_max? policy_max : cpufreq_ceiling_speed;
-		target_min_freq = policy_min;
-		
-		if (target_max_freq < target_min_freq)
-			target_max_freq = target_min_freq;
-		if (debug_mask & PERF_CPUFREQ_LOCK_DEBUG) {
-			pr_info("%s: cpufreq_ceiling speed %d\n",
-					__func__, cpufreq_ceiling_speed);
-			print_active_locks();
-		}
-	} else {
-		
-		spin_unlock_irqrestore(&policy_update_lock, irqflags);
-		return 0;
-	}
-	spin_unlock_irqrestore(&policy_update_lock, irqflags);
-
-	if (debug_mask & PERF_CPUFREQ_LOCK_DEBUG)
-		pr_info("%s: target freq = %d\n", __func__, new_freq);
-
-	if (new_freq >= target_max_freq)
-		return target_max_freq;
-	else if (new_freq <= target_min_freq)
-		return target_min_freq;
-	else
-		return new_freq;
-	
-	return 0;
-}
-
-void perflock_scaling_max_freq(unsigned int freq, unsigned int cpu)
-{
-	if (debug_mask & PERF_LOCK_DEBUG)
-		pr_info("%s, freq=%u, cpu%u\n", __func__, freq, cpu);
-	per_cpu(stored_policy_max, cpu) = freq;
-}
-
-void perflock_scaling_min_freq(unsigned int freq, unsigned int cpu)
-{
-	if (debug_mask & PERF_LOCK_DEBUG)
-		pr_info("%s, freq=%u, cpu%u\n", __func__, freq, cpu);
-	per_cpu(stored_policy_min, cpu) = freq;
-}
-
 static unsigned int get_perflock_speed(void)
 {
-	unsigned long irqflags;
-	struct perf_lock *lock;
-	unsigned int perf_level = 0;
-
-	
-	if (list_empty(&active_perf_locks))
-		return 0;
-
-	spin_lock_irqsave(&list_lock, irqflags);
-	list_for_each_entry(lock, &active_perf_locks, link) {
-		if (lock->level > perf_level)
-			perf_level = lock->level;
-	}
-	spin_unlock_irqrestore(&list_lock, irqflags);
-
-	return perf_acpu_table[perf_level];
+	return pm_qos_read_value(&perf_floor_constraints) * 1000;
 }
 
 static unsigned int get_cpufreq_ceiling_speed(void)
 {
-	unsigned long irqflags;
-	struct perf_lock *lock;
-	unsigned int perf_level = 0;
-
-	
-	if (list_empty(&active_cpufreq_ceiling_locks))
-		return 0;
-
-	spin_lock_irqsave(&list_lock, irqflags);
-	list_for_each_entry(lock, &active_cpufreq_ceiling_locks, link) {
-		if (lock->level > perf_level)
-			perf_level = lock->level;
-	}
-	spin_unlock_irqrestore(&list_lock, irqflags);
-
-	return cpufreq_ceiling_acpu_table[perf_level];
+	return pm_qos_read_value(&perf_ceiling_constraints) * 1000;
 }
 
 static void print_active_locks(void)
@@ -320,11 +305,13 @@ static void print_active_locks(void)
 	struct perf_lock *lock;
 
 	spin_lock_irqsave(&list_lock, irqflags);
-	list_for_each_entry(lock, &active_perf_locks, link) {
-		pr_info("active perf lock '%s'\n", lock->name);
-	}
-	list_for_each_entry(lock, &active_cpufreq_ceiling_locks, link) {
-		pr_info("active cpufreq_ceiling_locks '%s'\n", lock->name);
+	list_for_each_entry(lock, &perf_locks, link) {
+		if (!(lock->flags & PERF_LOCK_ACTIVE))
+			continue;
+		if (lock->type == TYPE_PERF_LOCK)
+			pr_info("active perf lock '%s'\n", lock->name);
+		else
+			pr_info("active cpufreq_ceiling_locks '%s'\n", lock->name);
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
@@ -335,17 +322,21 @@ void htc_print_active_perf_locks(void)
 	struct perf_lock *lock;
 
 	spin_lock_irqsave(&list_lock, irqflags);
-	if (!list_empty(&active_perf_locks)) {
+	if (get_perflock_speed()) {
 		pr_info("perf_lock:");
-		list_for_each_entry(lock, &active_perf_locks, link) {
-			pr_info(" '%s' ", lock->name);
+		list_for_each_entry(lock, &perf_locks, link) {
+			if ((lock->flags & PERF_LOCK_ACTIVE) &&
+			    lock->type == TYPE_PERF_LOCK)
+				pr_info(" '%s' ", lock->name);
 		}
 		pr_info("\n");
 	}
-	if (!list_empty(&active_cpufreq_ceiling_locks)) {
+	if (get_cpufreq_ceiling_speed()) {
 		printk(KERN_WARNING"ceiling_lock:");
-		list_for_each_entry(lock, &active_cpufreq_ceiling_locks, link) {
-			printk(KERN_WARNING" '%s' ", lock->name);
+		list_for_each_entry(lock, &perf_locks, link) {
+			if ((lock->flags & PERF_LOCK_ACTIVE) &&
+			    lock->type == TYPE_CPUFREQ_CEILING)
+				printk(KERN_WARNING" '%s' ", lock->name);
 		}
 		pr_info("\n");
 	}
@@ -375,41 +366,27 @@ void perf_lock_init(struct perf_lock *lock, unsigned int type,
 
 	INIT_LIST_HEAD(&lock->link);
 	spin_lock_irqsave(&list_lock, irqflags);
-	if (lock->type == TYPE_PERF_LOCK)
-		list_add(&lock->link, &inactive_perf_locks);
-	if (lock->type == TYPE_CPUFREQ_CEILING)
-		list_add(&lock->link, &inactive_cpufreq_ceiling_locks);
+	list_add(&lock->link, &perf_locks);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
 EXPORT_SYMBOL(perf_lock_init);
 
-#ifdef CONFIG_CPU_FREQ_GOV_ONDEMAND
-extern bool is_governor_ondemand(void);
-extern bool is_ondemand_locked(void);
-#endif
-static void do_set_rate_fn(struct work_struct *work)
+static struct pm_qos_constraints *perf_lock_constraints(struct perf_lock *lock,
+		unsigned int *speed)
 {
-	struct cpufreq_freqs freqs;
-	int ret = 0;
-#ifdef CONFIG_CPU_FREQ_GOV_ONDEMAND
-	if(is_governor_ondemand() && is_ondemand_locked()) {
-		pr_info("[K] perflock ignore setrate, ondemand governor locked\n");
-		return;
+	if (lock->type == TYPE_CPUFREQ_CEILING) {
+		*speed = cpufreq_ceiling_acpu_table[lock->level] / 1000;
+		return &perf_ceiling_constraints;
 	}
-#endif
-	freqs.new = perflock_override(NULL, 0);
-	freqs.cpu = smp_processor_id();
-	cpufreq_notify_transition(&freqs, CPUFREQ_PRECHANGE);
-	ret = acpuclk_set_rate(freqs.cpu, freqs.new, SETRATE_CPUFREQ);
-	if (!ret)
-		cpufreq_notify_transition(&freqs, CPUFREQ_POSTCHANGE);
+	*speed = perf_acpu_table[lock->level] / 1000;
+	return &perf_floor_constraints;
 }
 
-static DECLARE_WORK(do_setrate_work, do_set_rate_fn);
 void perf_lock(struct perf_lock *lock)
 {
+	struct pm_qos_constraints *c;
 	unsigned long irqflags;
-	int cpu;
+	unsigned int speed;
 
 	WARN_ON((lock->flags & PERF_LOCK_INITIALIZED) == 0);
 	WARN_ON(lock->flags & PERF_LOCK_ACTIVE);
@@ -429,41 +406,30 @@ void perf_lock(struct perf_lock *lock)
 		}
 	}
 
-	spin_lock_irqsave(&list_lock, irqflags);
+	mutex_lock(&perflock_mutex);
 	if (debug_mask & PERF_LOCK_DEBUG)
 		pr_info("%s: '%s', flags %d level %d type %u\n",
 			__func__, lock->name, lock->flags, lock->level, lock->type);
 	if (lock->flags & PERF_LOCK_ACTIVE) {
 		pr_err("%s:type(%u) over-locked\n", __func__, lock->type);
-		spin_unlock_irqrestore(&list_lock, irqflags);
+		mutex_unlock(&perflock_mutex);
 		return;
 	}
+	spin_lock_irqsave(&list_lock, irqflags);
 	lock->flags |= PERF_LOCK_ACTIVE;
-	list_del(&lock->link);
-	if (lock->type == TYPE_PERF_LOCK)
-		list_add(&lock->link, &active_perf_locks);
-	else if (lock->type == TYPE_CPUFREQ_CEILING)
-		list_add(&lock->link, &active_cpufreq_ceiling_locks);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 
-#ifdef CONFIG_HTC_PNPMGR
-	if (!legacy_mode) {
-		if (lock->type == TYPE_PERF_LOCK)
-			sysfs_notify(cpufreq_kobj, NULL, "perflock_scaling_min");
-		else if (lock->type == TYPE_CPUFREQ_CEILING)
-			sysfs_notify(cpufreq_kobj, NULL, "perflock_scaling_max");
-		return;
-	}
-#endif
-	for_each_online_cpu(cpu) {
-		queue_work_on(cpu, perflock_setrate_workqueue, &do_setrate_work);
-	}
+	c = perf_lock_constraints(lock, &speed);
+	pm_qos_update_target(c, &lock->node, PM_QOS_ADD_REQ, speed);
+	mutex_unlock(&perflock_mutex);
 }
 EXPORT_SYMBOL(perf_lock);
 
 void perf_unlock(struct perf_lock *lock)
 {
+	struct pm_qos_constraints *c;
 	unsigned long irqflags;
+	unsigned int speed;
 
 	WARN_ON(!initialized);
 	WARN_ON((lock->flags & PERF_LOCK_ACTIVE) == 0);
@@ -484,30 +450,23 @@ void perf_unlock(struct perf_lock *lock)
 		}
 	}
 
-	spin_lock_irqsave(&list_lock, irqflags);
+	mutex_lock(&perflock_mutex);
 	if (debug_mask & PERF_LOCK_DEBUG)
 		pr_info("%s: '%s', flags %d level %d\n",
 			__func__, lock->name, lock->flags, lock->level);
 	if (!(lock->flags & PERF_LOCK_ACTIVE)) {
 		pr_err("%s: under-locked\n", __func__);
-		spin_unlock_irqrestore(&list_lock, irqflags);
+		mutex_unlock(&perflock_mutex);
 		return;
 	}
+	spin_lock_irqsave(&list_lock, irqflags);
 	lock->flags &= ~PERF_LOCK_ACTIVE;
-	list_del(&lock->link);
-	if (lock->type == TYPE_PERF_LOCK)
-		list_add(&lock->link, &inactive_perf_locks);
-	else if (lock->type == TYPE_CPUFREQ_CEILING)
-		list_add(&lock->link, &inactive_cpufreq_ceiling_locks);
 	spin_unlock_irqrestore(&list_lock, irqflags);
-#ifdef CONFIG_HTC_PNPMGR
-	if (!legacy_mode) {
-		if (lock->type == TYPE_PERF_LOCK)
-			sysfs_notify(cpufreq_kobj, NULL, "perflock_scaling_min");
-		else if (lock->type == TYPE_CPUFREQ_CEILING)
-			sysfs_notify(cpufreq_kobj, NULL, "perflock_scaling_max");
-	}
-#endif
+
+	c = perf_lock_constraints(lock, &speed);
+	pm_qos_update_target(c, &lock->node, PM_QOS_REMOVE_REQ,
+			     PM_QOS_DEFAULT_VALUE);
+	mutex_unlock(&perflock_mutex);
 }
 EXPORT_SYMBOL(perf_unlock);
 
@@ -519,7 +478,7 @@ EXPORT_SYMBOL(is_perf_lock_active);
 
 int is_perf_locked(void)
 {
-	return (!list_empty(&active_perf_locks));
+	return get_perflock_speed() != 0;
 }
 EXPORT_SYMBOL(is_perf_locked);
 
@@ -529,25 +488,7 @@ static struct perf_lock *perflock_find(const char *name)
 	unsigned long irqflags;
 
 	spin_lock_irqsave(&list_lock, irqflags);
-	list_for_each_entry(lock, &active_perf_locks, link) {
-		if(!strcmp(lock->name, name)) {
-			spin_unlock_irqrestore(&list_lock, irqflags);
-			return lock;
-		}
-	}
-	list_for_each_entry(lock, &inactive_perf_locks, link) {
-		if(!strcmp(lock->name, name)) {
-			spin_unlock_irqrestore(&list_lock, irqflags);
-			return lock;
-		}
-	}
-	list_for_each_entry(lock, &active_cpufreq_ceiling_locks, link) {
-		if(!strcmp(lock->name, name)) {
-			spin_unlock_irqrestore(&list_lock, irqflags);
-			return lock;
-		}
-	}
-	list_for_each_entry(lock, &inactive_cpufreq_ceiling_locks, link) {
+	list_for_each_entry(lock, &perf_locks, link) {
 		if(!strcmp(lock->name, name)) {
 			spin_unlock_irqrestore(&list_lock, irqflags);
 			return lock;
@@ -649,27 +590,6 @@ static void cpufreq_ceiling_acpu_table_fixup(void)
 	}
 }
 
-static inline void init_local_freq_policy(unsigned int cpu_min
-		, unsigned int cpu_max)
-{
-	int cpu;
-	if (unlikely(per_cpu(stored_policy_max, 0) == 0)) {
-		if (debug_mask & PERF_LOCK_DEBUG)
-			pr_info("%s, initialize max%u\n", __func__, cpu_max);
-		for_each_present_cpu(cpu) {
-			per_cpu(stored_policy_max, cpu) = policy_max;
-		}
-	}
-	if (unlikely(per_cpu(stored_policy_min, 0) == 0)) {
-		if (debug_mask & PERF_LOCK_DEBUG)
-			pr_info("%s, initilize min=%u\n", __func__, cpu_min);
-		for_each_present_cpu(cpu) {
-			per_cpu(stored_policy_min, cpu) = policy_min;
-		}
-	}
-}
-
-
 static void perflock_floor_init(struct perflock_data *pdata)
 {
 	struct cpufreq_policy policy;
@@ -691,9 +611,10 @@ static void perflock_floor_init(struct perflock_data *pdata)
 		goto invalid_config;
 
 	perf_acpu_table_fixup();
-	perflock_setrate_workqueue = create_workqueue("perflock_setrate_wq");
 
-	init_local_freq_policy(policy_min, policy_max);
+	blocking_notifier_chain_register(&perf_floor_notifier, &perf_floor_nb);
+	pm_qos_add_request(&perf_floor_req, PM_QOS_CPU_FREQ_MIN,
+			   PM_QOS_DEFAULT_VALUE);
 	initialized = 1;
 	pr_info("perflock floor init done\n");
 #ifdef CONFIG_PERFLOCK_BOOT_LOCK
@@ -733,7 +654,10 @@ static void cpufreq_ceiling_init(struct perflock_data *pdata)
 
 	cpufreq_ceiling_acpu_table_fixup();
 
-	init_local_freq_policy(policy_min, policy_max);
+	blocking_notifier_chain_register(&perf_ceiling_notifier,
+					 &perf_ceiling_nb);
+	pm_qos_add_request(&perf_ceiling_req, PM_QOS_CPU_FREQ_MAX,
+			   PM_QOS_DEFAULT_VALUE);
 	cpufreq_ceiling_initialized = 1;
 	pr_info("perflock ceiling init done\n");
 	return;
@@ -369,9 +369,12 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 	if (err)
 		goto fail_id;
 
-	if (blk_throtl_init(q))
+	if (blk_lat_hist_init(q))
 		goto fail_id;
 
+	if (blk_throtl_init(q))
+		goto fail_hist;
+
 	setup_timer(&q->backing_dev_info.laptop_mode_wb_timer,
 		    laptop_mode_timer_fn, (unsigned long) q);
 	setup_timer(&q->timeout, blk_rq_timed_out_timer, (unsigned long) q);
@@ -391,6 +394,8 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 
 	return q;
 
+fail_hist:
+	blk_lat_hist_exit(q);
 fail_id:
 	ida_simple_remove(&blk_queue_ida, q->id);
 fail_q:
@@ -1349,6 +1354,49 @@ static void blk_account_io_completion(struct request *req, unsigned int bytes)
 	}
 }
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static inline int blk_lat_bucket(u64 ns)
+{
+	u32 us = ns < (u64)UINT_MAX ? (u32)ns / NSEC_PER_USEC : UINT_MAX;
+
+	return min(fls(us), BLK_LAT_BUCKETS - 1);
+}
+
+/* Called with interrupts off, so the per-CPU counters need no locking. */
+static void blk_account_io_latency(struct request *req)
+{
+	struct blk_lat_hist *hist;
+	u64 now, queued, service;
+	int type;
+
+	if (!blk_account_rq(req) || (req->cmd_flags & REQ_FLUSH_SEQ))
+		return;
+
+	if (req->cmd_flags & REQ_DISCARD)
+		type = BLK_LAT_DISCARD;
+	else if (rq_data_dir(req) == READ)
+		type = BLK_LAT_READ;
+	else if (req->cmd_flags & REQ_SYNC)
+		type = BLK_LAT_SYNC_WRITE;
+	else
+		type = BLK_LAT_WRITE;
+
+	now = sched_clock();
+	queued = req->io_start_time_ns > req->start_time_ns ?
+		 req->io_start_time_ns - req->start_time_ns : 0;
+	service = now > req->io_start_time_ns ?
+		  now - req->io_start_time_ns : 0;
+
+	hist = this_cpu_ptr(req->q->lat_hist);
+	hist->queue[type][blk_lat_bucket(queued)]++;
+	hist->service[type][blk_lat_bucket(service)]++;
+	hist->queue_ns[type] += queued;
+	hist->service_ns[type] += service;
+}
+#else
+static inline void blk_account_io_latency(struct request *req) { }
+#endif
+
 static void blk_account_io_done(struct request *req)
 {
 	if (blk_do_io_stat(req) && !(req->cmd_flags & REQ_FLUSH_SEQ)) {
@@ -1626,6 +1674,7 @@ static void blk_finish_request(struct request *req, int error)
 
 
 	blk_account_io_done(req);
+	blk_account_io_latency(req);
 
 	if (req->end_io)
 		req->end_io(req, error);
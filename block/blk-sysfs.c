@@ -270,6 +270,92 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static const char *blk_lat_type_names[BLK_LAT_TYPES] = {
+	[BLK_LAT_READ]		= "read",
+	[BLK_LAT_WRITE]		= "write",
+	[BLK_LAT_SYNC_WRITE]	= "sync",
+	[BLK_LAT_DISCARD]	= "discard",
+};
+
+/*
+ * One row per bucket with the queue and service time counts of every
+ * request type, then the mean latencies in usecs.
+ */
+static ssize_t queue_lat_hist_show(struct request_queue *q, char *page)
+{
+	struct blk_lat_hist *sum;
+	ssize_t len = 0;
+	int cpu, t, b;
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_lat_hist *hist = per_cpu_ptr(q->lat_hist, cpu);
+
+		for (t = 0; t < BLK_LAT_TYPES; t++) {
+			for (b = 0; b < BLK_LAT_BUCKETS; b++) {
+				sum->queue[t][b] += hist->queue[t][b];
+				sum->service[t][b] += hist->service[t][b];
+			}
+			sum->queue_ns[t] += hist->queue_ns[t];
+			sum->service_ns[t] += hist->service_ns[t];
+		}
+	}
+
+	len += sprintf(page + len, "%9s", "usecs");
+	for (t = 0; t < BLK_LAT_TYPES; t++)
+		len += sprintf(page + len, " %8s_q %8s_s",
+			       blk_lat_type_names[t], blk_lat_type_names[t]);
+	len += sprintf(page + len, "\n");
+
+	for (b = 0; b < BLK_LAT_BUCKETS; b++) {
+		if (b < BLK_LAT_BUCKETS - 1)
+			len += sprintf(page + len, "<%8u", 1U << b);
+		else
+			len += sprintf(page + len, ">=%7u", 1U << (b - 1));
+		for (t = 0; t < BLK_LAT_TYPES; t++)
+			len += sprintf(page + len, " %10u %10u",
+				       sum->queue[t][b], sum->service[t][b]);
+		len += sprintf(page + len, "\n");
+	}
+
+	len += sprintf(page + len, "%9s", "mean");
+	for (t = 0; t < BLK_LAT_TYPES; t++) {
+		u64 nr = 0;
+
+		for (b = 0; b < BLK_LAT_BUCKETS; b++)
+			nr += sum->queue[t][b];
+		if (nr) {
+			nr *= NSEC_PER_USEC;
+			len += sprintf(page + len, " %10llu %10llu",
+				       div64_u64(sum->queue_ns[t], nr),
+				       div64_u64(sum->service_ns[t], nr));
+		} else {
+			len += sprintf(page + len, " %10u %10u", 0, 0);
+		}
+	}
+	len += sprintf(page + len, "\n");
+
+	kfree(sum);
+	return len;
+}
+
+static ssize_t
+queue_lat_hist_store(struct request_queue *q, const char *page, size_t count)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(q->lat_hist, cpu), 0,
+		       sizeof(struct blk_lat_hist));
+
+	return count;
+}
+#endif
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -384,6 +470,14 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static struct queue_sysfs_entry queue_lat_hist_entry = {
+	.attr = {.name = "latency_hist", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_lat_hist_show,
+	.store = queue_lat_hist_store,
+};
+#endif
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -406,6 +500,9 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	&queue_lat_hist_entry.attr,
+#endif
 	NULL,
 };
 
@@ -477,6 +574,7 @@ static void blk_release_queue(struct kobject *kobj)
 		__blk_queue_free_tags(q);
 
 	blk_throtl_release(q);
+	blk_lat_hist_exit(q);
 	blk_trace_shutdown(q);
 
 	bdi_destroy(&q->backing_dev_info);
@@ -156,6 +156,22 @@ static inline struct io_context *create_io_context(struct task_struct *task,
 	return task->io_context;
 }
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static inline int blk_lat_hist_init(struct request_queue *q)
+{
+	q->lat_hist = alloc_percpu(struct blk_lat_hist);
+	return q->lat_hist ? 0 : -ENOMEM;
+}
+
+static inline void blk_lat_hist_exit(struct request_queue *q)
+{
+	free_percpu(q->lat_hist);
+}
+#else
+static inline int blk_lat_hist_init(struct request_queue *q) { return 0; }
+static inline void blk_lat_hist_exit(struct request_queue *q) { }
+#endif
+
 #ifdef CONFIG_BLK_DEV_THROTTLING
 extern bool blk_throtl_bio(struct request_queue *q, struct bio *bio);
 extern void blk_throtl_drain(struct request_queue *q);
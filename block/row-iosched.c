@@ -0,0 +1,352 @@
+/*
+ *  ROW (READ Over WRITE) i/o scheduler for flash storage.
+ *
+ *  Requests are kept in one FIFO per class: reads, synchronous writes and
+ *  asynchronous writes.  The classes are served in that order, each for at
+ *  most its quantum of requests per round, and a lower class that has been
+ *  passed over too often while it had requests pending goes next no matter
+ *  what.  Flash has no seek penalty, so the scheduler never idles waiting
+ *  for a process to send more requests; whatever is queued is dispatched.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+
+enum row_queue_prio {
+	ROWQ_PRIO_READ,
+	ROWQ_PRIO_SYNC_WRITE,
+	ROWQ_PRIO_ASYNC_WRITE,
+	ROWQ_MAX_PRIO,
+};
+
+static const int row_quantum[ROWQ_MAX_PRIO] = {
+	[ROWQ_PRIO_READ]	= 100,
+	[ROWQ_PRIO_SYNC_WRITE]	= 8,
+	[ROWQ_PRIO_ASYNC_WRITE]	= 2,
+};
+
+/* dispatches of other classes a pending class sits out; 0 is no limit */
+static const int row_starvation_limit[ROWQ_MAX_PRIO] = {
+	[ROWQ_PRIO_READ]	= 0,
+	[ROWQ_PRIO_SYNC_WRITE]	= 32,
+	[ROWQ_PRIO_ASYNC_WRITE]	= 128,
+};
+
+struct row_queue {
+	struct list_head fifo;
+	struct rb_root sort_list;
+	unsigned int nr_dispatched;	/* in the current round */
+	unsigned int starved;
+	int quantum;
+	int starvation_limit;
+};
+
+struct row_data {
+	struct row_queue queues[ROWQ_MAX_PRIO];
+	unsigned int nr_reqs;
+	int front_merges;
+};
+
+static inline enum row_queue_prio row_bio_prio(struct bio *bio)
+{
+	if (bio_data_dir(bio) == READ)
+		return ROWQ_PRIO_READ;
+	if (bio->bi_rw & REQ_SYNC)
+		return ROWQ_PRIO_SYNC_WRITE;
+	return ROWQ_PRIO_ASYNC_WRITE;
+}
+
+static inline enum row_queue_prio row_rq_prio(struct request *rq)
+{
+	return (enum row_queue_prio)(long)rq->elv.priv[0];
+}
+
+static inline struct row_queue *
+row_rq_queue(struct row_data *rd, struct request *rq)
+{
+	return &rd->queues[row_rq_prio(rq)];
+}
+
+static void row_add_request(struct request_queue *q, struct request *rq)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	enum row_queue_prio prio;
+	struct row_queue *rqueue;
+
+	if (rq_data_dir(rq) == READ)
+		prio = ROWQ_PRIO_READ;
+	else if (rq_is_sync(rq))
+		prio = ROWQ_PRIO_SYNC_WRITE;
+	else
+		prio = ROWQ_PRIO_ASYNC_WRITE;
+	rq->elv.priv[0] = (void *)(long)prio;
+
+	rqueue = &rd->queues[prio];
+	elv_rb_add(&rqueue->sort_list, rq);
+	list_add_tail(&rq->queuelist, &rqueue->fifo);
+	rd->nr_reqs++;
+}
+
+static void row_remove_request(struct row_data *rd, struct request *rq)
+{
+	rq_fifo_clear(rq);
+	elv_rb_del(&row_rq_queue(rd, rq)->sort_list, rq);
+	rd->nr_reqs--;
+}
+
+static int
+row_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	struct row_queue *rqueue = &rd->queues[row_bio_prio(bio)];
+	sector_t sector = bio->bi_sector + bio_sectors(bio);
+	struct request *__rq;
+
+	if (!rd->front_merges)
+		return ELEVATOR_NO_MERGE;
+
+	__rq = elv_rb_find(&rqueue->sort_list, sector);
+	if (__rq && elv_rq_merge_ok(__rq, bio)) {
+		*req = __rq;
+		return ELEVATOR_FRONT_MERGE;
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void row_merged_request(struct request_queue *q, struct request *req,
+			       int type)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	struct row_queue *rqueue = row_rq_queue(rd, req);
+
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(&rqueue->sort_list, req);
+		elv_rb_add(&rqueue->sort_list, req);
+	}
+}
+
+static void row_merged_requests(struct request_queue *q, struct request *req,
+				struct request *next)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+
+	/* the merged request keeps the place of the one queued first */
+	if (row_rq_prio(req) == row_rq_prio(next) &&
+	    time_before(next->start_time, req->start_time)) {
+		list_move(&req->queuelist, &next->queuelist);
+		req->start_time = next->start_time;
+	}
+
+	row_remove_request(rd, next);
+}
+
+/*
+ * Pick the class to serve next: a class over its starvation limit first,
+ * then the highest class with quantum left in this round.  When every
+ * pending class has used up its quantum a new round starts.
+ */
+static int row_select_queue(struct row_data *rd)
+{
+	int i;
+
+	for (i = ROWQ_PRIO_READ + 1; i < ROWQ_MAX_PRIO; i++) {
+		struct row_queue *rqueue = &rd->queues[i];
+
+		if (!list_empty(&rqueue->fifo) && rqueue->starvation_limit &&
+		    rqueue->starved >= rqueue->starvation_limit)
+			return i;
+	}
+
+	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+		struct row_queue *rqueue = &rd->queues[i];
+
+		if (!list_empty(&rqueue->fifo) &&
+		    rqueue->nr_dispatched < rqueue->quantum)
+			return i;
+	}
+
+	for (i = 0; i < ROWQ_MAX_PRIO; i++)
+		rd->queues[i].nr_dispatched = 0;
+
+	for (i = 0; i < ROWQ_MAX_PRIO; i++)
+		if (!list_empty(&rd->queues[i].fifo))
+			return i;
+
+	return -1;
+}
+
+static int row_dispatch_requests(struct request_queue *q, int force)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	struct request *rq;
+	int prio, i;
+
+	if (!rd->nr_reqs)
+		return 0;
+
+	prio = row_select_queue(rd);
+	BUG_ON(prio < 0);
+
+	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+		struct row_queue *rqueue = &rd->queues[i];
+
+		if (i == prio) {
+			rqueue->starved = 0;
+			rqueue->nr_dispatched++;
+		} else if (!list_empty(&rqueue->fifo)) {
+			rqueue->starved++;
+		}
+	}
+
+	rq = rq_entry_fifo(rd->queues[prio].fifo.next);
+	row_remove_request(rd, rq);
+	elv_dispatch_add_tail(q, rq);
+
+	return 1;
+}
+
+static void row_exit_queue(struct elevator_queue *e)
+{
+	struct row_data *rd = e->elevator_data;
+	int i;
+
+	for (i = 0; i < ROWQ_MAX_PRIO; i++)
+		BUG_ON(!list_empty(&rd->queues[i].fifo));
+
+	kfree(rd);
+}
+
+static void *row_init_queue(struct request_queue *q)
+{
+	struct row_data *rd;
+	int i;
+
+	rd = kmalloc_node(sizeof(*rd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!rd)
+		return NULL;
+
+	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+		INIT_LIST_HEAD(&rd->queues[i].fifo);
+		rd->queues[i].sort_list = RB_ROOT;
+		rd->queues[i].quantum = row_quantum[i];
+		rd->queues[i].starvation_limit = row_starvation_limit[i];
+	}
+	rd->front_merges = 1;
+	return rd;
+}
+
+
+static ssize_t
+row_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+row_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR)					\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct row_data *rd = e->elevator_data;				\
+	return row_var_show(__VAR, (page));				\
+}
+SHOW_FUNCTION(row_read_quantum_show, rd->queues[ROWQ_PRIO_READ].quantum);
+SHOW_FUNCTION(row_sync_write_quantum_show,
+	      rd->queues[ROWQ_PRIO_SYNC_WRITE].quantum);
+SHOW_FUNCTION(row_async_write_quantum_show,
+	      rd->queues[ROWQ_PRIO_ASYNC_WRITE].quantum);
+SHOW_FUNCTION(row_sync_write_starvation_show,
+	      rd->queues[ROWQ_PRIO_SYNC_WRITE].starvation_limit);
+SHOW_FUNCTION(row_async_write_starvation_show,
+	      rd->queues[ROWQ_PRIO_ASYNC_WRITE].starvation_limit);
+SHOW_FUNCTION(row_front_merges_show, rd->front_merges);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX)				\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct row_data *rd = e->elevator_data;				\
+	int __data;							\
+	int ret = row_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	*(__PTR) = __data;						\
+	return ret;							\
+}
+STORE_FUNCTION(row_read_quantum_store,
+	       &rd->queues[ROWQ_PRIO_READ].quantum, 1, INT_MAX);
+STORE_FUNCTION(row_sync_write_quantum_store,
+	       &rd->queues[ROWQ_PRIO_SYNC_WRITE].quantum, 1, INT_MAX);
+STORE_FUNCTION(row_async_write_quantum_store,
+	       &rd->queues[ROWQ_PRIO_ASYNC_WRITE].quantum, 1, INT_MAX);
+STORE_FUNCTION(row_sync_write_starvation_store,
+	       &rd->queues[ROWQ_PRIO_SYNC_WRITE].starvation_limit, 0, INT_MAX);
+STORE_FUNCTION(row_async_write_starvation_store,
+	       &rd->queues[ROWQ_PRIO_ASYNC_WRITE].starvation_limit, 0, INT_MAX);
+STORE_FUNCTION(row_front_merges_store, &rd->front_merges, 0, 1);
+#undef STORE_FUNCTION
+
+#define ROW_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
+				      row_##name##_store)
+
+static struct elv_fs_entry row_attrs[] = {
+	ROW_ATTR(read_quantum),
+	ROW_ATTR(sync_write_quantum),
+	ROW_ATTR(async_write_quantum),
+	ROW_ATTR(sync_write_starvation),
+	ROW_ATTR(async_write_starvation),
+	ROW_ATTR(front_merges),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_row = {
+	.ops = {
+		.elevator_merge_fn =		row_merge,
+		.elevator_merged_fn =		row_merged_request,
+		.elevator_merge_req_fn =	row_merged_requests,
+		.elevator_dispatch_fn =		row_dispatch_requests,
+		.elevator_add_req_fn =		row_add_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_init_fn =		row_init_queue,
+		.elevator_exit_fn =		row_exit_queue,
+	},
+
+	.elevator_attrs = row_attrs,
+	.elevator_name = "row",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init row_init(void)
+{
+	return elv_register(&iosched_row);
+}
+
+static void __exit row_exit(void)
+{
+	elv_unregister(&iosched_row);
+}
+
+module_init(row_init);
+module_exit(row_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("ROW (READ Over WRITE) IO scheduler");
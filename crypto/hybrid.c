@@ -0,0 +1,379 @@
+/*
+ * Hybrid software/asynchronous cipher scheduler.
+ *
+ * hybrid(sync,async) pairs a synchronous software implementation of a
+ * cipher with an asynchronous one, usually a hardware engine, and picks
+ * one of the two for every request.  Offloading a single sector costs
+ * more in setup and completion latency than the CPU takes to encrypt
+ * it, so small requests run inline on the CPU.  Large requests go to
+ * the engine, as do small ones once every online CPU is already busy
+ * with this cipher.  The engine is bypassed while its queue is full or
+ * while its measured completion latency is over budget; an idle engine
+ * always gets the next request so that the estimate stays current.
+ *
+ * For a one argument hybrid(name) the asynchronous implementation is
+ * looked up under the same name.  The instance is registered under the
+ * cra_name of its children with a higher priority, so that once created
+ * it serves every user of that name, dm-crypt included.  cryptd can
+ * stand in for the hardware, e.g.
+ *
+ *	hybrid(cbc(aes-generic),cryptd(cbc(aes-generic)))
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#include <crypto/algapi.h>
+#include <crypto/internal/skcipher.h>
+#include <linux/cpumask.h>
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+static unsigned int hybrid_min_bytes = 8192;
+module_param_named(min_bytes, hybrid_min_bytes, uint, 0644);
+MODULE_PARM_DESC(min_bytes, "Smallest request sent to an idle engine");
+
+static unsigned int hybrid_max_depth = 64;
+module_param_named(max_depth, hybrid_max_depth, uint, 0644);
+MODULE_PARM_DESC(max_depth, "Engine requests in flight before using the CPU");
+
+static unsigned int hybrid_max_latency = 5000;
+module_param_named(max_latency_us, hybrid_max_latency, uint, 0644);
+MODULE_PARM_DESC(max_latency_us, "Engine latency above which the CPU is used");
+
+struct hybrid_instance_ctx {
+	struct crypto_skcipher_spawn sync;
+	struct crypto_skcipher_spawn async;
+	atomic_t sync_depth;
+	atomic_t async_depth;
+	unsigned long async_latency;	/* moving average, in usecs */
+};
+
+struct hybrid_ctx {
+	struct crypto_ablkcipher *sync;
+	struct crypto_ablkcipher *async;
+	bool no_async;
+};
+
+struct hybrid_request_ctx {
+	ktime_t start;
+	struct ablkcipher_request subreq;
+};
+
+static inline struct hybrid_instance_ctx *hybrid_ictx(
+	struct crypto_ablkcipher *tfm)
+{
+	return crypto_instance_ctx(crypto_tfm_alg_instance(
+		crypto_ablkcipher_tfm(tfm)));
+}
+
+static int hybrid_setkey(struct crypto_ablkcipher *parent, const u8 *key,
+			 unsigned int keylen)
+{
+	struct hybrid_ctx *ctx = crypto_ablkcipher_ctx(parent);
+	u32 flags = crypto_ablkcipher_get_flags(parent) & CRYPTO_TFM_REQ_MASK;
+	int err;
+
+	crypto_ablkcipher_clear_flags(ctx->sync, CRYPTO_TFM_REQ_MASK);
+	crypto_ablkcipher_set_flags(ctx->sync, flags);
+	err = crypto_ablkcipher_setkey(ctx->sync, key, keylen);
+	crypto_ablkcipher_set_flags(parent, crypto_ablkcipher_get_flags(
+		ctx->sync) & CRYPTO_TFM_RES_MASK);
+	if (err)
+		return err;
+
+	/*
+	 * Engines often support only some key sizes; the software side
+	 * then simply handles everything for this tfm.
+	 */
+	crypto_ablkcipher_clear_flags(ctx->async, CRYPTO_TFM_REQ_MASK);
+	crypto_ablkcipher_set_flags(ctx->async, flags);
+	ctx->no_async = crypto_ablkcipher_setkey(ctx->async, key, keylen) != 0;
+
+	return 0;
+}
+
+static bool hybrid_use_async(struct hybrid_instance_ctx *ictx,
+			     unsigned int nbytes)
+{
+	unsigned int depth = atomic_read(&ictx->async_depth);
+	unsigned int busy = atomic_read(&ictx->sync_depth);
+
+	if (depth >= hybrid_max_depth)
+		return false;
+	if (depth && ACCESS_ONCE(ictx->async_latency) > hybrid_max_latency)
+		return false;
+	if (nbytes >= hybrid_min_bytes)
+		return true;
+
+	return busy >= num_online_cpus();
+}
+
+static void hybrid_async_account(struct hybrid_instance_ctx *ictx,
+				 struct hybrid_request_ctx *rctx, int err)
+{
+	unsigned long lat, avg;
+
+	/*
+	 * Only completed requests say anything about the engine; one that
+	 * was turned away right at submission would drag the average down.
+	 * Racy updates only lose a sample.
+	 */
+	if (!err) {
+		lat = ktime_us_delta(ktime_get(), rctx->start);
+		avg = ACCESS_ONCE(ictx->async_latency);
+		ictx->async_latency = avg - avg / 8 + lat / 8;
+	}
+	atomic_dec(&ictx->async_depth);
+}
+
+static void hybrid_async_done(struct crypto_async_request *areq, int err)
+{
+	struct ablkcipher_request *req = areq->data;
+	struct hybrid_request_ctx *rctx = ablkcipher_request_ctx(req);
+
+	if (err != -EINPROGRESS)
+		hybrid_async_account(hybrid_ictx(crypto_ablkcipher_reqtfm(req)),
+				     rctx, err);
+
+	ablkcipher_request_complete(req, err);
+}
+
+static inline int hybrid_submit(struct ablkcipher_request *subreq, int enc)
+{
+	return enc ? crypto_ablkcipher_encrypt(subreq) :
+		     crypto_ablkcipher_decrypt(subreq);
+}
+
+static int hybrid_crypt(struct ablkcipher_request *req, int enc)
+{
+	struct crypto_ablkcipher *tfm = crypto_ablkcipher_reqtfm(req);
+	struct hybrid_instance_ctx *ictx = hybrid_ictx(tfm);
+	struct hybrid_ctx *ctx = crypto_ablkcipher_ctx(tfm);
+	struct hybrid_request_ctx *rctx = ablkcipher_request_ctx(req);
+	struct ablkcipher_request *subreq = &rctx->subreq;
+	int err;
+
+	ablkcipher_request_set_crypt(subreq, req->src, req->dst, req->nbytes,
+				     req->info);
+
+	if (!ctx->no_async && hybrid_use_async(ictx, req->nbytes)) {
+		ablkcipher_request_set_tfm(subreq, ctx->async);
+		ablkcipher_request_set_callback(subreq, req->base.flags,
+						hybrid_async_done, req);
+		rctx->start = ktime_get();
+		atomic_inc(&ictx->async_depth);
+
+		err = hybrid_submit(subreq, enc);
+		if (err == -EINPROGRESS ||
+		    (err == -EBUSY &&
+		     (req->base.flags & CRYPTO_TFM_REQ_MAY_BACKLOG)))
+			return err;
+
+		hybrid_async_account(ictx, rctx, err);
+		/* a full engine queue without backlog is not an error here */
+		if (err != -EBUSY)
+			return err;
+	}
+
+	ablkcipher_request_set_tfm(subreq, ctx->sync);
+	ablkcipher_request_set_callback(subreq,
+					req->base.flags & CRYPTO_TFM_REQ_MAY_SLEEP,
+					NULL, NULL);
+	atomic_inc(&ictx->sync_depth);
+	err = hybrid_submit(subreq, enc);
+	atomic_dec(&ictx->sync_depth);
+
+	return err;
+}
+
+static int hybrid_encrypt(struct ablkcipher_request *req)
+{
+	return hybrid_crypt(req, 1);
+}
+
+static int hybrid_decrypt(struct ablkcipher_request *req)
+{
+	return hybrid_crypt(req, 0);
+}
+
+static int hybrid_init_tfm(struct crypto_tfm *tfm)
+{
+	struct crypto_instance *inst = crypto_tfm_alg_instance(tfm);
+	struct hybrid_instance_ctx *ictx = crypto_instance_ctx(inst);
+	struct hybrid_ctx *ctx = crypto_tfm_ctx(tfm);
+	struct crypto_ablkcipher *sync, *async;
+
+	sync = crypto_spawn_skcipher(&ictx->sync);
+	if (IS_ERR(sync))
+		return PTR_ERR(sync);
+
+	async = crypto_spawn_skcipher(&ictx->async);
+	if (IS_ERR(async)) {
+		crypto_free_ablkcipher(sync);
+		return PTR_ERR(async);
+	}
+
+	ctx->sync = sync;
+	ctx->async = async;
+	tfm->crt_ablkcipher.reqsize = sizeof(struct hybrid_request_ctx) +
+		max(crypto_ablkcipher_reqsize(sync),
+		    crypto_ablkcipher_reqsize(async));
+	return 0;
+}
+
+static void hybrid_exit_tfm(struct crypto_tfm *tfm)
+{
+	struct hybrid_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_ablkcipher(ctx->async);
+	crypto_free_ablkcipher(ctx->sync);
+}
+
+static int hybrid_create(struct crypto_template *tmpl, struct rtattr **tb)
+{
+	struct hybrid_instance_ctx *ictx;
+	struct crypto_instance *inst;
+	struct crypto_alg *sync, *async;
+	const char *sync_name, *async_name;
+	int err;
+
+	err = crypto_check_attr_type(tb, CRYPTO_ALG_TYPE_ABLKCIPHER);
+	if (err)
+		return err;
+
+	sync_name = crypto_attr_alg_name(tb[1]);
+	if (IS_ERR(sync_name))
+		return PTR_ERR(sync_name);
+
+	async_name = crypto_attr_alg_name(tb[2]);
+	if (IS_ERR(async_name)) {
+		if (PTR_ERR(async_name) != -ENOENT)
+			return PTR_ERR(async_name);
+		async_name = sync_name;
+	}
+
+	inst = kzalloc(sizeof(*inst) + sizeof(*ictx), GFP_KERNEL);
+	if (!inst)
+		return -ENOMEM;
+
+	ictx = crypto_instance_ctx(inst);
+
+	crypto_set_skcipher_spawn(&ictx->sync, inst);
+	err = crypto_grab_skcipher(&ictx->sync, sync_name, 0, CRYPTO_ALG_ASYNC);
+	if (err)
+		goto out_free_inst;
+
+	crypto_set_skcipher_spawn(&ictx->async, inst);
+	err = crypto_grab_skcipher(&ictx->async, async_name, CRYPTO_ALG_ASYNC,
+				   CRYPTO_ALG_ASYNC);
+	if (err)
+		goto out_drop_sync;
+
+	sync = crypto_skcipher_spawn_alg(&ictx->sync);
+	async = crypto_skcipher_spawn_alg(&ictx->async);
+
+	/*
+	 * Both halves must compute the same thing, and an existing hybrid
+	 * instance must not end up scheduling onto itself.
+	 */
+	err = -EINVAL;
+	if (strcmp(sync->cra_name, async->cra_name) ||
+	    sync->cra_blocksize != async->cra_blocksize ||
+	    strstr(async->cra_driver_name, "hybrid("))
+		goto out_drop_async;
+
+	err = -ENAMETOOLONG;
+	if (snprintf(inst->alg.cra_driver_name, CRYPTO_MAX_ALG_NAME,
+		     "hybrid(%s,%s)", sync->cra_driver_name,
+		     async->cra_driver_name) >= CRYPTO_MAX_ALG_NAME)
+		goto out_drop_async;
+
+	memcpy(inst->alg.cra_name, sync->cra_name, CRYPTO_MAX_ALG_NAME);
+
+	inst->alg.cra_flags = CRYPTO_ALG_TYPE_ABLKCIPHER | CRYPTO_ALG_ASYNC;
+	inst->alg.cra_type = &crypto_ablkcipher_type;
+	inst->alg.cra_priority = max(sync->cra_priority,
+				     async->cra_priority) + 50;
+	inst->alg.cra_blocksize = sync->cra_blocksize;
+	inst->alg.cra_alignmask = sync->cra_alignmask | async->cra_alignmask;
+
+	if ((sync->cra_flags & CRYPTO_ALG_TYPE_MASK) ==
+	    CRYPTO_ALG_TYPE_BLKCIPHER) {
+		inst->alg.cra_ablkcipher.ivsize = sync->cra_blkcipher.ivsize;
+		inst->alg.cra_ablkcipher.min_keysize =
+			sync->cra_blkcipher.min_keysize;
+		inst->alg.cra_ablkcipher.max_keysize =
+			sync->cra_blkcipher.max_keysize;
+	} else {
+		inst->alg.cra_ablkcipher.ivsize = sync->cra_ablkcipher.ivsize;
+		inst->alg.cra_ablkcipher.min_keysize =
+			sync->cra_ablkcipher.min_keysize;
+		inst->alg.cra_ablkcipher.max_keysize =
+			sync->cra_ablkcipher.max_keysize;
+	}
+
+	inst->alg.cra_ctxsize = sizeof(struct hybrid_ctx);
+
+	inst->alg.cra_init = hybrid_init_tfm;
+	inst->alg.cra_exit = hybrid_exit_tfm;
+
+	inst->alg.cra_ablkcipher.setkey = hybrid_setkey;
+	inst->alg.cra_ablkcipher.encrypt = hybrid_encrypt;
+	inst->alg.cra_ablkcipher.decrypt = hybrid_decrypt;
+
+	err = crypto_register_instance(tmpl, inst);
+	if (err)
+		goto out_drop_async;
+
+	return 0;
+
+out_drop_async:
+	crypto_drop_skcipher(&ictx->async);
+out_drop_sync:
+	crypto_drop_skcipher(&ictx->sync);
+out_free_inst:
+	kfree(inst);
+	return err;
+}
+
+static void hybrid_free(struct crypto_instance *inst)
+{
+	struct hybrid_instance_ctx *ictx = crypto_instance_ctx(inst);
+
+	crypto_drop_skcipher(&ictx->async);
+	crypto_drop_skcipher(&ictx->sync);
+	kfree(inst);
+}
+
+static struct crypto_template hybrid_tmpl = {
+	.name = "hybrid",
+	.create = hybrid_create,
+	.free = hybrid_free,
+	.module = THIS_MODULE,
+};
+
+static int __init hybrid_init(void)
+{
+	return crypto_register_template(&hybrid_tmpl);
+}
+
+static void __exit hybrid_exit(void)
+{
+	crypto_unregister_template(&hybrid_tmpl);
+}
+
+module_init(hybrid_init);
+module_exit(hybrid_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Hybrid software/asynchronous cipher scheduler");
@@ -1563,6 +1563,19 @@ static int do_test(int m)
 				   speed_template_32_64);
 		break;
 
+	case 504:
+		test_acipher_speed("cbc(aes-generic)", ENCRYPT, sec, NULL, 0,
+				   speed_template_16_24_32);
+		test_acipher_speed("cryptd(cbc(aes-generic))", ENCRYPT, sec,
+				   NULL, 0, speed_template_16_24_32);
+		test_acipher_speed("hybrid(cbc(aes-generic),"
+				   "cryptd(cbc(aes-generic)))", ENCRYPT, sec,
+				   NULL, 0, speed_template_16_24_32);
+		test_acipher_speed("hybrid(cbc(aes-generic),"
+				   "cryptd(cbc(aes-generic)))", DECRYPT, sec,
+				   NULL, 0, speed_template_16_24_32);
+		break;
+
 	case 1000:
 		test_available();
 		break;
@@ -28,6 +28,7 @@
 #include <linux/cpu.h>
 #include <linux/completion.h>
 #include <linux/mutex.h>
+#include <linux/pm_qos.h>
 #include <linux/syscore_ops.h>
 
 #include <trace/events/power.h>
@@ -353,6 +354,7 @@ static ssize_t store_##file_name					\
 (struct cpufreq_policy *policy, const char *buf, size_t count)		\
 {									\
 	unsigned int ret = -EINVAL;					\
+	unsigned int user;						\
 	struct cpufreq_policy new_policy;				\
 									\
 	ret = cpufreq_get_policy(&new_policy, policy->cpu);		\
@@ -363,8 +365,11 @@ static ssize_t store_##file_name					\
 	if (ret != 1)							\
 		return -EINVAL;						\
 									\
+	/* the PM QoS clamp must not become the user's limit */		\
+	user = new_policy.object;					\
 	ret = __cpufreq_set_policy(policy, &new_policy);		\
-	policy->user_policy.object = policy->object;			\
+	if (!ret)							\
+		policy->user_policy.object = user;			\
 									\
 	return ret ? ret : count;					\
 }
@@ -987,8 +992,8 @@ static int __cpufreq_remove_dev(struct device *dev, struct subsys_interface *sif
 #ifdef CONFIG_HOTPLUG_CPU
 	strncpy(per_cpu(cpufreq_policy_save, cpu).gov, data->governor->name,
 			CPUFREQ_NAME_LEN);
-	per_cpu(cpufreq_policy_save, cpu).min = data->min;
-	per_cpu(cpufreq_policy_save, cpu).max = data->max;
+	per_cpu(cpufreq_policy_save, cpu).min = data->user_policy.min;
+	per_cpu(cpufreq_policy_save, cpu).max = data->user_policy.max;
 	pr_debug("Saving CPU%d policy min %d and max %d\n",
 			cpu, data->min, data->max);
 #endif
@@ -1011,8 +1016,10 @@ static int __cpufreq_remove_dev(struct device *dev, struct subsys_interface *sif
 #ifdef CONFIG_HOTPLUG_CPU
 			strncpy(per_cpu(cpufreq_policy_save, j).gov,
 				data->governor->name, CPUFREQ_NAME_LEN);
-			per_cpu(cpufreq_policy_save, j).min = data->min;
-			per_cpu(cpufreq_policy_save, j).max = data->max;
+			per_cpu(cpufreq_policy_save, j).min =
+				data->user_policy.min;
+			per_cpu(cpufreq_policy_save, j).max =
+				data->user_policy.max;
 			pr_debug("Saving CPU%d policy min %d and max %d\n",
 					j, data->min, data->max);
 #endif
@@ -1471,6 +1478,32 @@ int cpufreq_get_policy(struct cpufreq_policy *policy, unsigned int cpu)
 }
 EXPORT_SYMBOL(cpufreq_get_policy);
 
+/*
+ * Clamp a new policy to the PM QoS frequency bounds of its CPUs.  A floor
+ * never raises the policy above its own max; below that, a floor above a
+ * ceiling wins, as perflock's lock speed did over its ceiling.
+ */
+static void cpufreq_qos_limits(struct cpufreq_policy *policy)
+{
+	unsigned int min = 0, max = UINT_MAX;
+	unsigned int j;
+
+	for_each_cpu(j, policy->cpus) {
+		min = max_t(unsigned int, min,
+			    pm_qos_cpu_request(PM_QOS_CPU_FREQ_MIN, j));
+		max = min_t(unsigned int, max,
+			    pm_qos_cpu_request(PM_QOS_CPU_FREQ_MAX, j));
+	}
+
+	if (min > policy->max)
+		min = policy->max;
+	if (policy->max > max)
+		policy->max = max;
+	if (policy->min < min)
+		policy->min = min;
+	if (policy->max < policy->min)
+		policy->max = policy->min;
+}
 
 static int __cpufreq_set_policy(struct cpufreq_policy *data,
 				struct cpufreq_policy *policy)
@@ -1493,6 +1526,8 @@ static int __cpufreq_set_policy(struct cpufreq_policy *data,
 	if (ret)
 		goto error_out;
 
+	cpufreq_qos_limits(policy);
+
 	
 	blocking_notifier_call_chain(&cpufreq_policy_notifier_list,
 			CPUFREQ_ADJUST, policy);
@@ -1722,6 +1757,33 @@ int cpufreq_unregister_driver(struct cpufreq_driver *driver)
 }
 EXPORT_SYMBOL_GPL(cpufreq_unregister_driver);
 
+/* re-evaluate every policy when a frequency bound changes */
+static int cpufreq_qos_notify(struct notifier_block *nb,
+			      unsigned long value, void *data)
+{
+	struct cpufreq_policy *policy;
+	unsigned int cpu;
+
+	for_each_online_cpu(cpu) {
+		policy = cpufreq_cpu_get(cpu);
+		if (!policy)
+			continue;
+		if (policy->cpu == cpu)
+			schedule_work(&policy->update);
+		cpufreq_cpu_put(policy);
+	}
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block cpufreq_qos_min_nb = {
+	.notifier_call = cpufreq_qos_notify,
+};
+
+static struct notifier_block cpufreq_qos_max_nb = {
+	.notifier_call = cpufreq_qos_notify,
+};
+
 static int __init cpufreq_core_init(void)
 {
 	int cpu;
@@ -1738,6 +1800,9 @@ static int __init cpufreq_core_init(void)
 	BUG_ON(!cpufreq_global_kobject);
 	register_syscore_ops(&cpufreq_syscore_ops);
 
+	pm_qos_add_notifier(PM_QOS_CPU_FREQ_MIN, &cpufreq_qos_min_nb);
+	pm_qos_add_notifier(PM_QOS_CPU_FREQ_MAX, &cpufreq_qos_max_nb);
+
 	return 0;
 }
 core_initcall(cpufreq_core_init);
@@ -0,0 +1,384 @@
+/*
+ *  drivers/cpufreq/cpufreq_sched.c
+ *
+ *  A cpufreq governor driven by the scheduler.  Instead of sampling the
+ *  idle time from a timer, it is told about the utilization of every CPU
+ *  when tasks are enqueued or dequeued and on the tick, so it can raise
+ *  the frequency as soon as work shows up.  The frequency change itself is
+ *  done by a real-time kthread bound to the policy CPU, which lets drivers
+ *  that switch the clock of the calling CPU do so without another hop.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpu.h>
+#include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+#define DEF_UP_RATE_LIMIT_US		500
+#define DEF_DOWN_RATE_LIMIT_US		20000
+
+struct sg_policy {
+	struct cpufreq_policy	*policy;
+	raw_spinlock_t		update_lock;
+	u64			last_freq_update_time;
+	unsigned int		next_freq;
+	bool			work_in_progress;
+	/* requests in (freq_lo, freq_hi] resolve to the current frequency */
+	unsigned int		freq_lo;
+	unsigned int		freq_hi;
+
+	struct irq_work		irq_work;
+	struct kthread_work	work;
+	struct kthread_worker	worker;
+	struct task_struct	*thread;
+	struct mutex		work_lock;
+};
+
+struct sg_cpu {
+	struct update_util_data	update_util;
+	struct sg_policy	*sg_policy;
+	unsigned long		util;
+	unsigned int		flags;
+	u64			last_update;
+};
+
+static DEFINE_PER_CPU(struct sg_cpu, sg_cpu);
+
+static struct sg_tuners {
+	unsigned int up_rate_limit_us;
+	unsigned int down_rate_limit_us;
+} sg_tuners_ins = {
+	.up_rate_limit_us = DEF_UP_RATE_LIMIT_US,
+	.down_rate_limit_us = DEF_DOWN_RATE_LIMIT_US,
+};
+
+static DEFINE_MUTEX(sg_mutex);
+static int sg_enable;
+
+/*
+ * The busiest CPU of the policy sets the pace.  Its utilization is the
+ * share of time it was busy at the current frequency, so the request is
+ * scaled from policy->cur, with 25% headroom so that a CPU that is fully
+ * busy asks for more than what it currently has.  A CPU that has not
+ * reported for a couple of ticks is idle with the tick stopped and does
+ * not count.
+ */
+static unsigned int sg_next_freq(struct sg_policy *sg_policy, u64 time)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned long util = 0;
+	unsigned int j, freq;
+
+	for_each_cpu(j, policy->cpus) {
+		struct sg_cpu *j_sg_cpu = &per_cpu(sg_cpu, j);
+
+		if ((s64)(time - j_sg_cpu->last_update) > 2 * TICK_NSEC)
+			continue;
+		if (j_sg_cpu->flags & SCHED_CPUFREQ_RT)
+			return policy->max;
+		util = max(util, j_sg_cpu->util);
+	}
+
+	freq = ((u64)policy->cur * (util + (util >> 2))) >> SCHED_POWER_SHIFT;
+	return clamp(freq, policy->min, policy->max);
+}
+
+/*
+ * Called with the runqueue lock held, so the frequency table is not
+ * searched here: the kthread leaves behind the range of requests that
+ * would end up at the current frequency anyway.
+ */
+static bool sg_should_update(struct sg_policy *sg_policy, u64 time,
+			     unsigned int freq)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned int limit_us;
+	s64 delta_ns;
+
+	if (sg_policy->work_in_progress)
+		return false;
+	if (freq > sg_policy->freq_lo && freq <= sg_policy->freq_hi)
+		return false;
+
+	limit_us = freq > policy->cur ? sg_tuners_ins.up_rate_limit_us :
+					sg_tuners_ins.down_rate_limit_us;
+	delta_ns = time - sg_policy->last_freq_update_time;
+	return delta_ns >= (s64)limit_us * NSEC_PER_USEC;
+}
+
+static void sg_update(struct update_util_data *data, u64 time,
+		      unsigned long util, unsigned int flags)
+{
+	struct sg_cpu *sg_cpu = container_of(data, struct sg_cpu, update_util);
+	struct sg_policy *sg_policy = sg_cpu->sg_policy;
+	unsigned int next_freq;
+
+	raw_spin_lock(&sg_policy->update_lock);
+
+	sg_cpu->util = util;
+	sg_cpu->flags = flags;
+	sg_cpu->last_update = time;
+
+	next_freq = sg_next_freq(sg_policy, time);
+	if (sg_should_update(sg_policy, time, next_freq)) {
+		sg_policy->next_freq = next_freq;
+		sg_policy->last_freq_update_time = time;
+		sg_policy->work_in_progress = true;
+		irq_work_queue(&sg_policy->irq_work);
+	}
+
+	raw_spin_unlock(&sg_policy->update_lock);
+}
+
+/*
+ * With CPUFREQ_RELATION_L every request above the next lower table entry,
+ * up to the current frequency, selects the current frequency again.  If
+ * the current frequency is not in the table, nothing does.  Called with
+ * work_lock held.
+ */
+static void sg_update_range(struct sg_policy *sg_policy, bool done)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	struct cpufreq_frequency_table *table;
+	unsigned int hi = policy->cur, lo = hi - 1;
+	unsigned long flags;
+	bool found = false;
+	int i;
+
+	table = cpufreq_frequency_get_table(policy->cpu);
+	if (table) {
+		lo = 0;
+		for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++) {
+			unsigned int freq = table[i].frequency;
+
+			if (freq == CPUFREQ_ENTRY_INVALID)
+				continue;
+			if (freq == hi)
+				found = true;
+			else if (freq < hi && freq > lo)
+				lo = freq;
+		}
+		if (!found)
+			lo = hi;
+	}
+
+	raw_spin_lock_irqsave(&sg_policy->update_lock, flags);
+	sg_policy->freq_lo = lo;
+	sg_policy->freq_hi = hi;
+	if (done)
+		sg_policy->work_in_progress = false;
+	raw_spin_unlock_irqrestore(&sg_policy->update_lock, flags);
+}
+
+static void sg_work(struct kthread_work *work)
+{
+	struct sg_policy *sg_policy = container_of(work, struct sg_policy, work);
+
+	mutex_lock(&sg_policy->work_lock);
+	__cpufreq_driver_target(sg_policy->policy, sg_policy->next_freq,
+				CPUFREQ_RELATION_L);
+	sg_update_range(sg_policy, true);
+	mutex_unlock(&sg_policy->work_lock);
+}
+
+/* The runqueue lock is held in sg_update(), so the wakeup is deferred. */
+static void sg_irq_work(struct irq_work *irq_work)
+{
+	struct sg_policy *sg_policy =
+		container_of(irq_work, struct sg_policy, irq_work);
+
+	queue_kthread_work(&sg_policy->worker, &sg_policy->work);
+}
+
+#define show_one(file_name, object)					\
+static ssize_t show_##file_name						\
+(struct kobject *kobj, struct attribute *attr, char *buf)		\
+{									\
+	return sprintf(buf, "%u\n", sg_tuners_ins.object);		\
+}
+show_one(up_rate_limit_us, up_rate_limit_us);
+show_one(down_rate_limit_us, down_rate_limit_us);
+
+#define store_one(file_name, object)					\
+static ssize_t store_##file_name					\
+(struct kobject *a, struct attribute *b, const char *buf, size_t count)	\
+{									\
+	unsigned int input;						\
+	int ret;							\
+	ret = sscanf(buf, "%u", &input);				\
+	if (ret != 1)							\
+		return -EINVAL;						\
+	sg_tuners_ins.object = input;					\
+	return count;							\
+}
+store_one(up_rate_limit_us, up_rate_limit_us);
+store_one(down_rate_limit_us, down_rate_limit_us);
+
+define_one_global_rw(up_rate_limit_us);
+define_one_global_rw(down_rate_limit_us);
+
+static struct attribute *sg_attributes[] = {
+	&up_rate_limit_us.attr,
+	&down_rate_limit_us.attr,
+	NULL
+};
+
+static struct attribute_group sg_attr_group = {
+	.attrs = sg_attributes,
+	.name = "sched",
+};
+
+static struct sg_policy *sg_policy_alloc(struct cpufreq_policy *policy)
+{
+	struct sched_param param = { .sched_priority = MAX_USER_RT_PRIO / 2 };
+	struct sg_policy *sg_policy;
+
+	sg_policy = kzalloc(sizeof(*sg_policy), GFP_KERNEL);
+	if (!sg_policy)
+		return NULL;
+
+	sg_policy->policy = policy;
+	raw_spin_lock_init(&sg_policy->update_lock);
+	mutex_init(&sg_policy->work_lock);
+	init_irq_work(&sg_policy->irq_work, sg_irq_work);
+	init_kthread_work(&sg_policy->work, sg_work);
+	init_kthread_worker(&sg_policy->worker);
+
+	sg_policy->thread = kthread_create(kthread_worker_fn,
+					   &sg_policy->worker,
+					   "cpufreq_sched/%u", policy->cpu);
+	if (IS_ERR(sg_policy->thread)) {
+		kfree(sg_policy);
+		return NULL;
+	}
+	sched_setscheduler_nocheck(sg_policy->thread, SCHED_FIFO, &param);
+	kthread_bind(sg_policy->thread, policy->cpu);
+	wake_up_process(sg_policy->thread);
+
+	return sg_policy;
+}
+
+static void sg_policy_free(struct sg_policy *sg_policy)
+{
+	flush_kthread_worker(&sg_policy->worker);
+	kthread_stop(sg_policy->thread);
+	mutex_destroy(&sg_policy->work_lock);
+	kfree(sg_policy);
+}
+
+static int cpufreq_governor_sched(struct cpufreq_policy *policy,
+				  unsigned int event)
+{
+	unsigned int cpu = policy->cpu;
+	struct sg_policy *sg_policy = per_cpu(sg_cpu, cpu).sg_policy;
+	unsigned int j;
+	int rc;
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if (!cpu_online(cpu) || !policy->cur)
+			return -EINVAL;
+
+		mutex_lock(&sg_mutex);
+		if (!sg_enable) {
+			rc = sysfs_create_group(cpufreq_global_kobject,
+						&sg_attr_group);
+			if (rc) {
+				mutex_unlock(&sg_mutex);
+				return rc;
+			}
+		}
+		sg_enable++;
+		mutex_unlock(&sg_mutex);
+
+		sg_policy = sg_policy_alloc(policy);
+		if (!sg_policy) {
+			mutex_lock(&sg_mutex);
+			if (!--sg_enable)
+				sysfs_remove_group(cpufreq_global_kobject,
+						   &sg_attr_group);
+			mutex_unlock(&sg_mutex);
+			return -ENOMEM;
+		}
+
+		mutex_lock(&sg_policy->work_lock);
+		sg_update_range(sg_policy, false);
+		mutex_unlock(&sg_policy->work_lock);
+
+		for_each_cpu(j, policy->cpus) {
+			struct sg_cpu *j_sg_cpu = &per_cpu(sg_cpu, j);
+
+			memset(j_sg_cpu, 0, sizeof(*j_sg_cpu));
+			j_sg_cpu->sg_policy = sg_policy;
+			j_sg_cpu->update_util.func = sg_update;
+			cpufreq_set_update_util_data(j, &j_sg_cpu->update_util);
+		}
+		break;
+
+	case CPUFREQ_GOV_STOP:
+		if (!sg_policy)
+			break;
+
+		for_each_cpu(j, policy->cpus)
+			cpufreq_set_update_util_data(j, NULL);
+		synchronize_sched();
+		irq_work_sync(&sg_policy->irq_work);
+
+		for_each_cpu(j, policy->cpus)
+			per_cpu(sg_cpu, j).sg_policy = NULL;
+		sg_policy_free(sg_policy);
+
+		mutex_lock(&sg_mutex);
+		if (!--sg_enable)
+			sysfs_remove_group(cpufreq_global_kobject,
+					   &sg_attr_group);
+		mutex_unlock(&sg_mutex);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		if (!sg_policy)
+			break;
+
+		mutex_lock(&sg_policy->work_lock);
+		if (policy->max < policy->cur)
+			__cpufreq_driver_target(policy, policy->max,
+						CPUFREQ_RELATION_H);
+		else if (policy->min > policy->cur)
+			__cpufreq_driver_target(policy, policy->min,
+						CPUFREQ_RELATION_L);
+		sg_update_range(sg_policy, false);
+		mutex_unlock(&sg_policy->work_lock);
+		break;
+	}
+	return 0;
+}
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED
+static
+#endif
+struct cpufreq_governor cpufreq_gov_sched = {
+	.name			= "sched",
+	.governor		= cpufreq_governor_sched,
+	.owner			= THIS_MODULE,
+};
+
+static int __init cpufreq_gov_sched_init(void)
+{
+	return cpufreq_register_governor(&cpufreq_gov_sched);
+}
+
+MODULE_DESCRIPTION("'cpufreq_sched' - A cpufreq governor driven by "
+	"scheduler utilization updates");
+MODULE_LICENSE("GPL");
+
+fs_initcall(cpufreq_gov_sched_init);
@@ -0,0 +1,120 @@
+/*
+ * drivers/gpu/ion/ion_page_pool.c
+ *
+ * Copyright (C) 2011 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include "ion_priv.h"
+
+static void ion_page_pool_zero(struct ion_page_pool *pool, struct page *page)
+{
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++)
+		clear_highpage(page + i);
+}
+
+struct page *ion_page_pool_alloc(struct ion_page_pool *pool)
+{
+	struct page *page = NULL;
+
+	mutex_lock(&pool->mutex);
+	if (pool->count) {
+		page = list_first_entry(&pool->items, struct page, lru);
+		list_del(&page->lru);
+		pool->count--;
+	}
+	mutex_unlock(&pool->mutex);
+
+	if (!page)
+		page = alloc_pages(pool->gfp_mask | __GFP_ZERO, pool->order);
+
+	return page;
+}
+
+/*
+ * Pages are zeroed before they go back into the pool, so that the next
+ * allocation can hand them out straight away.
+ */
+void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
+{
+	ion_page_pool_zero(pool, page);
+
+	mutex_lock(&pool->mutex);
+	list_add(&page->lru, &pool->items);
+	pool->count++;
+	mutex_unlock(&pool->mutex);
+}
+
+/* Returns the number of blocks in the pool */
+int ion_page_pool_count(struct ion_page_pool *pool)
+{
+	int count;
+
+	mutex_lock(&pool->mutex);
+	count = pool->count;
+	mutex_unlock(&pool->mutex);
+
+	return count;
+}
+
+/*
+ * Frees blocks while they fit in what is left of @nr_to_scan pages, so
+ * a block larger than the request is kept. Returns the number of pages
+ * (of order 0) freed.
+ */
+int ion_page_pool_shrink(struct ion_page_pool *pool, int nr_to_scan)
+{
+	struct page *page;
+	int freed = 0;
+
+	mutex_lock(&pool->mutex);
+	while (pool->count && nr_to_scan - freed >= (1 << pool->order)) {
+		page = list_first_entry(&pool->items, struct page, lru);
+		list_del(&page->lru);
+		pool->count--;
+		__free_pages(page, pool->order);
+		freed += 1 << pool->order;
+	}
+	mutex_unlock(&pool->mutex);
+
+	return freed;
+}
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
+{
+	struct ion_page_pool *pool;
+
+	pool = kmalloc(sizeof(struct ion_page_pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	pool->count = 0;
+	INIT_LIST_HEAD(&pool->items);
+	mutex_init(&pool->mutex);
+	pool->gfp_mask = gfp_mask;
+	pool->order = order;
+
+	return pool;
+}
+
+void ion_page_pool_destroy(struct ion_page_pool *pool)
+{
+	ion_page_pool_shrink(pool, INT_MAX);
+	kfree(pool);
+}
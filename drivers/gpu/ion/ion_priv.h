@@ -158,6 +158,33 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
 		       unsigned long size);
 
 
+/**
+ * struct ion_page_pool - pool of zeroed pages of one order
+ * @count:	number of blocks in the pool
+ * @items:	blocks, linked through page->lru of their first page
+ * @mutex:	protects count and items
+ * @gfp_mask:	used when the pool is empty
+ * @order:	order of the blocks
+ *
+ * Allocating from the pool skips the page allocator and zeroing; blocks
+ * are zeroed when they are freed back. Heaps using pools should give
+ * memory back through ion_page_pool_shrink() from a shrinker.
+ */
+struct ion_page_pool {
+	int count;
+	struct list_head items;
+	struct mutex mutex;
+	gfp_t gfp_mask;
+	unsigned int order;
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
+void ion_page_pool_destroy(struct ion_page_pool *pool);
+struct page *ion_page_pool_alloc(struct ion_page_pool *pool);
+void ion_page_pool_free(struct ion_page_pool *pool, struct page *page);
+int ion_page_pool_count(struct ion_page_pool *pool);
+int ion_page_pool_shrink(struct ion_page_pool *pool, int nr_to_scan);
+
 struct ion_heap *msm_get_contiguous_heap(void);
 #define ION_CARVEOUT_ALLOCATE_FAIL -1
 #define ION_CP_ALLOCATE_FAIL -1
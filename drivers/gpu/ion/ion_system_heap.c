@@ -16,6 +16,7 @@
  */
 
 #include <linux/err.h>
+#include <linux/highmem.h>
 #include <linux/ion.h>
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
@@ -33,49 +34,141 @@ static atomic_t system_contig_heap_allocated;
 static unsigned int system_heap_has_outer_cache;
 static unsigned int system_heap_contig_has_outer_cache;
 
+/*
+ * Buffers are built from the largest of these orders that still fit,
+ * each backed by a pool of zeroed blocks. High order blocks are only
+ * taken if the page allocator has them at hand; otherwise the next
+ * smaller order is used.
+ */
+static const unsigned int orders[] = {8, 4, 0};
+#define NUM_ORDERS ARRAY_SIZE(orders)
+
+static const gfp_t high_order_gfp_flags = (GFP_KERNEL | __GFP_NOWARN |
+					   __GFP_NORETRY) & ~__GFP_WAIT;
+static const gfp_t low_order_gfp_flags = GFP_KERNEL;
+
+struct ion_system_heap {
+	struct ion_heap heap;
+	struct ion_page_pool *pools[NUM_ORDERS];
+	struct shrinker shrinker;
+};
+
+static int order_to_index(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		if (order == orders[i])
+			return i;
+	BUG();
+	return -1;
+}
+
+static inline unsigned int order_to_size(int order)
+{
+	return PAGE_SIZE << order;
+}
+
+static struct page *alloc_largest_available(struct ion_system_heap *heap,
+					    unsigned long size,
+					    unsigned int max_order)
+{
+	struct page *page;
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (size < order_to_size(orders[i]))
+			continue;
+		if (max_order < orders[i])
+			continue;
+
+		page = ion_page_pool_alloc(heap->pools[i]);
+		if (!page)
+			continue;
+
+		/* Remember the order until the page is added to the table */
+		set_page_private(page, orders[i]);
+		return page;
+	}
+
+	return NULL;
+}
+
 static int ion_system_heap_allocate(struct ion_heap *heap,
 				     struct ion_buffer *buffer,
 				     unsigned long size, unsigned long align,
 				     unsigned long flags)
 {
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
 	struct sg_table *table;
 	struct scatterlist *sg;
-	int i, j;
-	int npages = PAGE_ALIGN(size) / PAGE_SIZE;
+	struct list_head pages;
+	struct page *page, *tmp_page;
+	unsigned long size_remaining = PAGE_ALIGN(size);
+	unsigned int max_order = orders[0];
+	unsigned int order;
+	int i = 0;
+
+	INIT_LIST_HEAD(&pages);
+	while (size_remaining > 0) {
+		page = alloc_largest_available(sys_heap, size_remaining,
+					       max_order);
+		if (!page)
+			goto err;
+		list_add_tail(&page->lru, &pages);
+		order = page_private(page);
+		size_remaining -= order_to_size(order);
+		max_order = order;
+		i++;
+	}
 
 	table = kmalloc(sizeof(struct sg_table), GFP_KERNEL);
 	if (!table)
-		return -ENOMEM;
-	i = sg_alloc_table(table, npages, GFP_KERNEL);
-	if (i)
-		goto err0;
-	for_each_sg(table->sgl, sg, table->nents, i) {
-		struct page *page;
-		page = alloc_page(GFP_KERNEL|__GFP_ZERO);
-		if (!page)
-			goto err1;
-		sg_set_page(sg, page, PAGE_SIZE, 0);
+		goto err;
+	if (sg_alloc_table(table, i, GFP_KERNEL))
+		goto err1;
+
+	sg = table->sgl;
+	list_for_each_entry_safe(page, tmp_page, &pages, lru) {
+		order = page_private(page);
+		set_page_private(page, 0);
+		list_del(&page->lru);
+		sg_set_page(sg, page, order_to_size(order), 0);
+		sg = sg_next(sg);
 	}
+
 	buffer->priv_virt = table;
 	atomic_add(size, &system_heap_allocated);
 	return 0;
 err1:
-	for_each_sg(table->sgl, sg, i, j)
-		__free_page(sg_page(sg));
-	sg_free_table(table);
-err0:
 	kfree(table);
+err:
+	list_for_each_entry_safe(page, tmp_page, &pages, lru) {
+		order = page_private(page);
+		set_page_private(page, 0);
+		list_del(&page->lru);
+		__free_pages(page, order);
+	}
 	return -ENOMEM;
 }
 
 void ion_system_heap_free(struct ion_buffer *buffer)
 {
+	struct ion_system_heap *sys_heap = container_of(buffer->heap,
+							struct ion_system_heap,
+							heap);
 	int i;
 	struct scatterlist *sg;
 	struct sg_table *table = buffer->priv_virt;
 
-	for_each_sg(table->sgl, sg, table->nents, i)
-		__free_page(sg_page(sg));
+	for_each_sg(table->sgl, sg, table->nents, i) {
+		unsigned int order = get_order(sg->length);
+
+		ion_page_pool_free(sys_heap->pools[order_to_index(order)],
+				   sg_page(sg));
+	}
 	if (buffer->sg_table)
 		sg_free_table(buffer->sg_table);
 	kfree(buffer->sg_table);
@@ -102,17 +195,24 @@ void *ion_system_heap_map_kernel(struct ion_heap *heap,
 		return ERR_PTR(-EINVAL);
 	} else {
 		struct scatterlist *sg;
-		int i;
+		int i, j, npages = 0;
 		void *vaddr;
 		struct sg_table *table = buffer->priv_virt;
-		struct page **pages = kmalloc(
-					sizeof(struct page *) * table->nents,
-					GFP_KERNEL);
+		struct page **pages = vmalloc(sizeof(struct page *) *
+					      PAGE_ALIGN(buffer->size) /
+					      PAGE_SIZE);
 
-		for_each_sg(table->sgl, sg, table->nents, i)
-			pages[i] = sg_page(sg);
-		vaddr = vmap(pages, table->nents, VM_MAP, PAGE_KERNEL);
-		kfree(pages);
+		if (!pages)
+			return ERR_PTR(-ENOMEM);
+
+		for_each_sg(table->sgl, sg, table->nents, i) {
+			struct page *page = sg_page(sg);
+
+			for (j = 0; j < sg->length / PAGE_SIZE; j++)
+				pages[npages++] = page + j;
+		}
+		vaddr = vmap(pages, npages, VM_MAP, PAGE_KERNEL);
+		vfree(pages);
 
 		return vaddr;
 	}
@@ -159,17 +259,35 @@ int ion_system_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 	} else {
 		struct sg_table *table = buffer->priv_virt;
 		unsigned long addr = vma->vm_start;
-		unsigned long offset = vma->vm_pgoff;
+		unsigned long offset = vma->vm_pgoff * PAGE_SIZE;
 		struct scatterlist *sg;
-		int i;
+		int i, ret;
 
+		/*
+		 * Buffers are made of high order blocks whose tail pages
+		 * have no reference count of their own, so map them by pfn
+		 * rather than with vm_insert_page().
+		 */
 		for_each_sg(table->sgl, sg, table->nents, i) {
-			if (offset) {
-				offset--;
+			struct page *page = sg_page(sg);
+			unsigned long len = sg->length;
+
+			if (offset >= sg->length) {
+				offset -= sg->length;
 				continue;
+			} else if (offset) {
+				page += offset / PAGE_SIZE;
+				len = sg->length - offset;
+				offset = 0;
 			}
-			vm_insert_page(vma, addr, sg_page(sg));
-			addr += PAGE_SIZE;
+			len = min(len, vma->vm_end - addr);
+			ret = remap_pfn_range(vma, addr, page_to_pfn(page), len,
+					      vma->vm_page_prot);
+			if (ret)
+				return ret;
+			addr += len;
+			if (addr >= vma->vm_end)
+				break;
 		}
 		return 0;
 	}
@@ -210,7 +328,7 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 				WARN(1, "Could not translate virtual address to physical address\n");
 				return -EINVAL;
 			}
-			outer_cache_op(pstart, pstart + PAGE_SIZE);
+			outer_cache_op(pstart, pstart + sg->length);
 		}
 	}
 	return 0;
@@ -219,9 +337,23 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 static int ion_system_print_debug(struct ion_heap *heap, struct seq_file *s,
 				  const struct rb_root *unused)
 {
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	int i;
+
 	seq_printf(s, "total bytes currently allocated: %lx\n",
 			(unsigned long) atomic_read(&system_heap_allocated));
 
+	for (i = 0; i < NUM_ORDERS; i++) {
+		struct ion_page_pool *pool = sys_heap->pools[i];
+		int count = ion_page_pool_count(pool);
+
+		seq_printf(s, "%d order %u pages in pool = %lu total\n",
+			   count, pool->order,
+			   (unsigned long)count * order_to_size(pool->order));
+	}
+
 	return 0;
 }
 
@@ -305,22 +437,80 @@ static struct ion_heap_ops vmalloc_ops = {
 	.unmap_iommu = ion_system_heap_unmap_iommu,
 };
 
+static int ion_system_heap_shrink(struct shrinker *shrinker,
+				  struct shrink_control *sc)
+{
+	struct ion_system_heap *sys_heap = container_of(shrinker,
+							struct ion_system_heap,
+							shrinker);
+	int nr_to_scan = sc->nr_to_scan;
+	int nr_total = 0;
+	int i;
+
+	/*
+	 * High order blocks go first, the page allocator misses them most.
+	 * Blocks that no longer fit in the request are left for later calls.
+	 */
+	for (i = 0; i < NUM_ORDERS && nr_to_scan > 0; i++)
+		nr_to_scan -= ion_page_pool_shrink(sys_heap->pools[i],
+						   nr_to_scan);
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		struct ion_page_pool *pool = sys_heap->pools[i];
+
+		nr_total += ion_page_pool_count(pool) << pool->order;
+	}
+
+	return nr_total;
+}
+
 struct ion_heap *ion_system_heap_create(struct ion_platform_heap *pheap)
 {
-	struct ion_heap *heap;
+	struct ion_system_heap *heap;
+	int i;
 
-	heap = kzalloc(sizeof(struct ion_heap), GFP_KERNEL);
+	heap = kzalloc(sizeof(struct ion_system_heap), GFP_KERNEL);
 	if (!heap)
 		return ERR_PTR(-ENOMEM);
-	heap->ops = &vmalloc_ops;
-	heap->type = ION_HEAP_TYPE_SYSTEM;
+	heap->heap.ops = &vmalloc_ops;
+	heap->heap.type = ION_HEAP_TYPE_SYSTEM;
 	system_heap_has_outer_cache = pheap->has_outer_cache;
-	return heap;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		gfp_t gfp_flags = low_order_gfp_flags;
+
+		if (orders[i])
+			gfp_flags = high_order_gfp_flags;
+		heap->pools[i] = ion_page_pool_create(gfp_flags, orders[i]);
+		if (!heap->pools[i])
+			goto err;
+	}
+
+	heap->shrinker.shrink = ion_system_heap_shrink;
+	heap->shrinker.seeks = DEFAULT_SEEKS;
+	/* Ask for at least one block of the highest order at a time */
+	heap->shrinker.batch = 1 << orders[0];
+	register_shrinker(&heap->shrinker);
+
+	return &heap->heap;
+err:
+	while (i--)
+		ion_page_pool_destroy(heap->pools[i]);
+	kfree(heap);
+	return ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_destroy(struct ion_heap *heap)
 {
-	kfree(heap);
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	int i;
+
+	unregister_shrinker(&sys_heap->shrinker);
+	for (i = 0; i < NUM_ORDERS; i++)
+		ion_page_pool_destroy(sys_heap->pools[i]);
+	kfree(sys_heap);
 }
 
 static int ion_system_contig_heap_allocate(struct ion_heap *heap,
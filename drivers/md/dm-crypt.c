@@ -17,6 +17,8 @@
 #include <linux/slab.h>
 #include <linux/crypto.h>
 #include <linux/workqueue.h>
+#include <linux/kthread.h>
+#include <linux/rbtree.h>
 #include <linux/backing-dev.h>
 #include <linux/atomic.h>
 #include <linux/scatterlist.h>
@@ -39,8 +41,10 @@ struct convert_context {
 	unsigned int idx_in;
 	unsigned int idx_out;
 	sector_t sector;
+	unsigned int blocks;
 	atomic_t cc_pending;
 	struct ablkcipher_request *req;
+	struct convert_context *parent;
 };
 
 struct dm_crypt_io {
@@ -54,6 +58,16 @@ struct dm_crypt_io {
 	int error;
 	sector_t sector;
 	struct dm_crypt_io *base_io;
+	struct rb_node rb_node;
+};
+
+/*
+ * A share of a large conversion handed to another kcryptd worker.  It
+ * counts as one pending request of its parent context.
+ */
+struct crypt_part {
+	struct work_struct work;
+	struct convert_context ctx;
 };
 
 struct dm_crypt_request {
@@ -101,11 +115,16 @@ struct crypt_config {
 	mempool_t *io_pool;
 	mempool_t *req_pool;
 	mempool_t *page_pool;
+	mempool_t *part_pool;
 	struct bio_set *bs;
 
 	struct workqueue_struct *io_queue;
 	struct workqueue_struct *crypt_queue;
 
+	struct task_struct *write_thread;
+	wait_queue_head_t write_thread_wait;
+	struct rb_root write_tree;
+
 	char *cipher;
 	char *cipher_string;
 
@@ -125,6 +144,9 @@ struct crypt_config {
 
 	unsigned int dmreq_start;
 
+	unsigned int sector_size;
+	unsigned int sector_shift;
+
 	unsigned long flags;
 	unsigned int key_size;
 	unsigned int key_parts;
@@ -133,11 +155,13 @@ struct crypt_config {
 
 #define MIN_IOS        16
 #define MIN_POOL_PAGES 32
+#define MIN_PART_SIZE  (16 * 1024)
 
 static struct kmem_cache *_crypt_io_pool;
 
 static void clone_init(struct dm_crypt_io *, struct bio *);
 static void kcryptd_queue_crypt(struct dm_crypt_io *io);
+static void kcryptd_crypt_part(struct work_struct *work);
 static u8 *iv_of_dmreq(struct crypt_config *cc, struct dm_crypt_request *dmreq);
 
 static struct crypto_ablkcipher *any_tfm(struct crypt_config *cc)
@@ -564,9 +588,19 @@ static void crypt_convert_init(struct crypt_config *cc,
 	ctx->idx_in = bio_in ? bio_in->bi_idx : 0;
 	ctx->idx_out = bio_out ? bio_out->bi_idx : 0;
 	ctx->sector = sector + cc->iv_offset;
+	ctx->blocks = 0;
+	ctx->parent = NULL;
 	init_completion(&ctx->restart);
 }
 
+static struct dm_crypt_io *io_of_ctx(struct convert_context *ctx)
+{
+	if (ctx->parent)
+		ctx = ctx->parent;
+
+	return container_of(ctx, struct dm_crypt_io, ctx);
+}
+
 static struct dm_crypt_request *dmreq_of_req(struct crypt_config *cc,
 					     struct ablkcipher_request *req)
 {
@@ -586,6 +620,32 @@ static u8 *iv_of_dmreq(struct crypt_config *cc,
 		crypto_ablkcipher_alignmask(any_tfm(cc)) + 1);
 }
 
+/*
+ * Move past one block.  IVs are always counted in 512 byte sectors, so
+ * larger blocks use the number of their first sector.
+ */
+static void crypt_convert_advance(struct crypt_config *cc,
+				  struct convert_context *ctx)
+{
+	struct bio_vec *bv_in = bio_iovec_idx(ctx->bio_in, ctx->idx_in);
+	struct bio_vec *bv_out = bio_iovec_idx(ctx->bio_out, ctx->idx_out);
+
+	ctx->offset_in += cc->sector_size;
+	if (ctx->offset_in >= bv_in->bv_len) {
+		ctx->offset_in = 0;
+		ctx->idx_in++;
+	}
+
+	ctx->offset_out += cc->sector_size;
+	if (ctx->offset_out >= bv_out->bv_len) {
+		ctx->offset_out = 0;
+		ctx->idx_out++;
+	}
+
+	ctx->sector += cc->sector_size >> SECTOR_SHIFT;
+	ctx->blocks--;
+}
+
 static int crypt_convert_block(struct crypt_config *cc,
 			       struct convert_context *ctx,
 			       struct ablkcipher_request *req)
@@ -602,24 +662,14 @@ static int crypt_convert_block(struct crypt_config *cc,
 	dmreq->iv_sector = ctx->sector;
 	dmreq->ctx = ctx;
 	sg_init_table(&dmreq->sg_in, 1);
-	sg_set_page(&dmreq->sg_in, bv_in->bv_page, 1 << SECTOR_SHIFT,
+	sg_set_page(&dmreq->sg_in, bv_in->bv_page, cc->sector_size,
 		    bv_in->bv_offset + ctx->offset_in);
 
 	sg_init_table(&dmreq->sg_out, 1);
-	sg_set_page(&dmreq->sg_out, bv_out->bv_page, 1 << SECTOR_SHIFT,
+	sg_set_page(&dmreq->sg_out, bv_out->bv_page, cc->sector_size,
 		    bv_out->bv_offset + ctx->offset_out);
 
-	ctx->offset_in += 1 << SECTOR_SHIFT;
-	if (ctx->offset_in >= bv_in->bv_len) {
-		ctx->offset_in = 0;
-		ctx->idx_in++;
-	}
-
-	ctx->offset_out += 1 << SECTOR_SHIFT;
-	if (ctx->offset_out >= bv_out->bv_len) {
-		ctx->offset_out = 0;
-		ctx->idx_out++;
-	}
+	crypt_convert_advance(cc, ctx);
 
 	if (cc->iv_gen_ops) {
 		r = cc->iv_gen_ops->generator(cc, iv, dmreq);
@@ -628,7 +678,7 @@ static int crypt_convert_block(struct crypt_config *cc,
 	}
 
 	ablkcipher_request_set_crypt(req, &dmreq->sg_in, &dmreq->sg_out,
-				     1 << SECTOR_SHIFT, iv);
+				     cc->sector_size, iv);
 
 	if (bio_data_dir(ctx->bio_in) == WRITE)
 		r = crypto_ablkcipher_encrypt(req);
@@ -658,6 +708,50 @@ static void crypt_alloc_req(struct crypt_config *cc,
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->req));
 }
 
+/*
+ * Hand all but the last share of a large conversion to other kcryptd
+ * workers.  The parent context skips over the shares it gave away and
+ * converts the last one itself, so it still ends where the whole
+ * conversion ends.
+ */
+static void crypt_split_convert(struct crypt_config *cc,
+				struct convert_context *ctx)
+{
+	struct crypt_part *part;
+	unsigned int nr_parts, share, i;
+
+	nr_parts = min_t(unsigned int, num_online_cpus(),
+			 (ctx->blocks << cc->sector_shift) / MIN_PART_SIZE);
+	if (nr_parts < 2)
+		return;
+
+	share = ctx->blocks / nr_parts;
+	while (--nr_parts) {
+		part = mempool_alloc(cc->part_pool, GFP_NOWAIT);
+		if (!part)
+			return;
+
+		part->ctx.bio_in = ctx->bio_in;
+		part->ctx.bio_out = ctx->bio_out;
+		part->ctx.offset_in = ctx->offset_in;
+		part->ctx.offset_out = ctx->offset_out;
+		part->ctx.idx_in = ctx->idx_in;
+		part->ctx.idx_out = ctx->idx_out;
+		part->ctx.sector = ctx->sector;
+		part->ctx.blocks = share;
+		part->ctx.req = NULL;
+		part->ctx.parent = ctx;
+		init_completion(&part->ctx.restart);
+
+		atomic_inc(&ctx->cc_pending);
+		INIT_WORK(&part->work, kcryptd_crypt_part);
+		queue_work(cc->crypt_queue, &part->work);
+
+		for (i = 0; i < share; i++)
+			crypt_convert_advance(cc, ctx);
+	}
+}
+
 static int crypt_convert(struct crypt_config *cc,
 			 struct convert_context *ctx)
 {
@@ -665,8 +759,10 @@ static int crypt_convert(struct crypt_config *cc,
 
 	atomic_set(&ctx->cc_pending, 1);
 
-	while(ctx->idx_in < ctx->bio_in->bi_vcnt &&
-	      ctx->idx_out < ctx->bio_out->bi_vcnt) {
+	if (!ctx->parent)
+		crypt_split_convert(cc, ctx);
+
+	while (ctx->blocks) {
 
 		crypt_alloc_req(cc, ctx);
 
@@ -682,13 +778,11 @@ static int crypt_convert(struct crypt_config *cc,
 			
 		case -EINPROGRESS:
 			ctx->req = NULL;
-			ctx->sector++;
 			continue;
 
 		
 		case 0:
 			atomic_dec(&ctx->cc_pending);
-			ctx->sector++;
 			cond_resched();
 			continue;
 
@@ -883,13 +977,73 @@ static void kcryptd_io(struct work_struct *work)
 {
 	struct dm_crypt_io *io = container_of(work, struct dm_crypt_io, work);
 
-	if (bio_data_dir(io->base_bio) == READ) {
-		crypt_inc_pending(io);
-		if (kcryptd_io_read(io, GFP_NOIO))
-			io->error = -ENOMEM;
-		crypt_dec_pending(io);
-	} else
-		kcryptd_io_write(io);
+	crypt_inc_pending(io);
+	if (kcryptd_io_read(io, GFP_NOIO))
+		io->error = -ENOMEM;
+	crypt_dec_pending(io);
+}
+
+#define crypt_io_from_node(node) rb_entry((node), struct dm_crypt_io, rb_node)
+
+/*
+ * Writes finish encryption in no particular order once they are spread
+ * over several workers.  They are queued here and submitted in sector
+ * order, under a plug, so the device still sees sequential streams.
+ */
+static int dmcrypt_write(void *data)
+{
+	struct crypt_config *cc = data;
+	struct dm_crypt_io *io;
+
+	while (1) {
+		struct rb_root write_tree;
+		struct blk_plug plug;
+
+		DECLARE_WAITQUEUE(wait, current);
+
+		spin_lock_irq(&cc->write_thread_wait.lock);
+continue_locked:
+
+		if (!RB_EMPTY_ROOT(&cc->write_tree))
+			goto pop_from_list;
+
+		__set_current_state(TASK_INTERRUPTIBLE);
+		__add_wait_queue(&cc->write_thread_wait, &wait);
+
+		spin_unlock_irq(&cc->write_thread_wait.lock);
+
+		if (unlikely(kthread_should_stop())) {
+			set_task_state(current, TASK_RUNNING);
+			remove_wait_queue(&cc->write_thread_wait, &wait);
+			break;
+		}
+
+		schedule();
+
+		set_task_state(current, TASK_RUNNING);
+		spin_lock_irq(&cc->write_thread_wait.lock);
+		__remove_wait_queue(&cc->write_thread_wait, &wait);
+		goto continue_locked;
+
+pop_from_list:
+		write_tree = cc->write_tree;
+		cc->write_tree = RB_ROOT;
+		spin_unlock_irq(&cc->write_thread_wait.lock);
+
+		/*
+		 * The tree cannot be walked with rb_next() because an io
+		 * may be freed as soon as its clone has been submitted.
+		 */
+		blk_start_plug(&plug);
+		do {
+			io = crypt_io_from_node(rb_first(&write_tree));
+			rb_erase(&io->rb_node, &write_tree);
+			kcryptd_io_write(io);
+		} while (!RB_EMPTY_ROOT(&write_tree));
+		blk_finish_plug(&plug);
+	}
+
+	return 0;
 }
 
 static void kcryptd_queue_io(struct dm_crypt_io *io)
@@ -900,10 +1054,12 @@ static void kcryptd_queue_io(struct dm_crypt_io *io)
 	queue_work(cc->io_queue, &io->work);
 }
 
-static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
+static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io)
 {
 	struct bio *clone = io->ctx.bio_out;
 	struct crypt_config *cc = io->target->private;
+	struct rb_node **rbp, *parent;
+	unsigned long flags;
 
 	if (unlikely(io->error < 0)) {
 		crypt_free_buffer_pages(cc, clone);
@@ -917,10 +1073,20 @@ static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
 
 	clone->bi_sector = cc->start + io->sector;
 
-	if (async)
-		kcryptd_queue_io(io);
-	else
-		generic_make_request(clone);
+	spin_lock_irqsave(&cc->write_thread_wait.lock, flags);
+	rbp = &cc->write_tree.rb_node;
+	parent = NULL;
+	while (*rbp) {
+		parent = *rbp;
+		if (io->sector < crypt_io_from_node(parent)->sector)
+			rbp = &(*rbp)->rb_left;
+		else
+			rbp = &(*rbp)->rb_right;
+	}
+	rb_link_node(&io->rb_node, parent, rbp);
+	rb_insert_color(&io->rb_node, &cc->write_tree);
+	wake_up_locked(&cc->write_thread_wait);
+	spin_unlock_irqrestore(&cc->write_thread_wait.lock, flags);
 }
 
 static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
@@ -946,6 +1112,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 
 		io->ctx.bio_out = clone;
 		io->ctx.idx_out = 0;
+		io->ctx.blocks = clone->bi_size >> cc->sector_shift;
 
 		remaining -= clone->bi_size;
 		sector += bio_sectors(clone);
@@ -959,18 +1126,20 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 
 		
 		if (crypt_finished) {
-			kcryptd_crypt_write_io_submit(io, 0);
+			kcryptd_crypt_write_io_submit(io);
 
 			if (unlikely(r < 0))
 				break;
-
-			io->sector = sector;
 		}
 
 		if (unlikely(out_of_pages))
 			congestion_wait(BLK_RW_ASYNC, HZ/100);
 
-		if (unlikely(!crypt_finished && remaining)) {
+		/*
+		 * The io now belongs to the write thread or to the pending
+		 * conversion, so continue with a new one.
+		 */
+		if (unlikely(remaining)) {
 			new_io = crypt_io_alloc(io->target, io->base_bio,
 						sector);
 			crypt_inc_pending(new_io);
@@ -1008,6 +1177,7 @@ static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 
 	crypt_convert_init(cc, &io->ctx, io->base_bio, io->base_bio,
 			   io->sector);
+	io->ctx.blocks = io->base_bio->bi_size >> cc->sector_shift;
 
 	r = crypt_convert(cc, &io->ctx);
 
@@ -1020,12 +1190,52 @@ static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 	crypt_dec_pending(io);
 }
 
+/*
+ * Called once a context has no conversions pending.  A part hands over
+ * to its parent, which completes the io when its last part is done.
+ */
+static void kcryptd_crypt_convert_done(struct convert_context *ctx)
+{
+	struct dm_crypt_io *io = io_of_ctx(ctx);
+	struct crypt_config *cc = io->target->private;
+	struct convert_context *parent = ctx->parent;
+
+	if (parent) {
+		if (ctx->req)
+			mempool_free(ctx->req, cc->req_pool);
+		mempool_free(container_of(ctx, struct crypt_part, ctx),
+			     cc->part_pool);
+
+		if (!atomic_dec_and_test(&parent->cc_pending))
+			return;
+	}
+
+	if (bio_data_dir(io->base_bio) == READ)
+		kcryptd_crypt_read_done(io);
+	else
+		kcryptd_crypt_write_io_submit(io);
+}
+
+static void kcryptd_crypt_part(struct work_struct *work)
+{
+	struct crypt_part *part = container_of(work, struct crypt_part, work);
+	struct convert_context *ctx = &part->ctx;
+	struct dm_crypt_io *io = io_of_ctx(ctx);
+	struct crypt_config *cc = io->target->private;
+
+	if (crypt_convert(cc, ctx) < 0)
+		io->error = -EIO;
+
+	if (atomic_dec_and_test(&ctx->cc_pending))
+		kcryptd_crypt_convert_done(ctx);
+}
+
 static void kcryptd_async_done(struct crypto_async_request *async_req,
 			       int error)
 {
 	struct dm_crypt_request *dmreq = async_req->data;
 	struct convert_context *ctx = dmreq->ctx;
-	struct dm_crypt_io *io = container_of(ctx, struct dm_crypt_io, ctx);
+	struct dm_crypt_io *io = io_of_ctx(ctx);
 	struct crypt_config *cc = io->target->private;
 
 	if (error == -EINPROGRESS) {
@@ -1044,10 +1254,7 @@ static void kcryptd_async_done(struct crypto_async_request *async_req,
 	if (!atomic_dec_and_test(&ctx->cc_pending))
 		return;
 
-	if (bio_data_dir(io->base_bio) == READ)
-		kcryptd_crypt_read_done(io);
-	else
-		kcryptd_crypt_write_io_submit(io, 1);
+	kcryptd_crypt_convert_done(ctx);
 }
 
 static void kcryptd_crypt(struct work_struct *work)
@@ -1199,6 +1406,9 @@ static void crypt_dtr(struct dm_target *ti)
 	if (!cc)
 		return;
 
+	if (cc->write_thread)
+		kthread_stop(cc->write_thread);
+
 	if (cc->io_queue)
 		destroy_workqueue(cc->io_queue);
 	if (cc->crypt_queue)
@@ -1209,6 +1419,8 @@ static void crypt_dtr(struct dm_target *ti)
 	if (cc->bs)
 		bioset_free(cc->bs);
 
+	if (cc->part_pool)
+		mempool_destroy(cc->part_pool);
 	if (cc->page_pool)
 		mempool_destroy(cc->page_pool);
 	if (cc->req_pool)
@@ -1380,7 +1592,7 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	char dummy;
 
 	static struct dm_arg _args[] = {
-		{0, 1, "Invalid number of feature args"},
+		{0, 2, "Invalid number of feature args"},
 	};
 
 	if (argc < 5) {
@@ -1396,6 +1608,8 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		return -ENOMEM;
 	}
 	cc->key_size = key_size;
+	cc->sector_size = 1 << SECTOR_SHIFT;
+	cc->sector_shift = SECTOR_SHIFT;
 
 	ti->private = cc;
 	ret = crypt_ctr_cipher(ti, argv[0], argv[1]);
@@ -1428,6 +1642,13 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		goto bad;
 	}
 
+	cc->part_pool = mempool_create_kmalloc_pool(MIN_IOS,
+						    sizeof(struct crypt_part));
+	if (!cc->part_pool) {
+		ti->error = "Cannot allocate crypt part mempool";
+		goto bad;
+	}
+
 	cc->bs = bioset_create(MIN_IOS, 0);
 	if (!cc->bs) {
 		ti->error = "Cannot allocate crypt bioset";
@@ -1464,14 +1685,42 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		if (ret)
 			goto bad;
 
-		opt_string = dm_shift_arg(&as);
+		ret = -EINVAL;
+		while (opt_params--) {
+			opt_string = dm_shift_arg(&as);
+			if (!opt_string) {
+				ti->error = "Not enough feature arguments";
+				goto bad;
+			}
 
-		if (opt_params == 1 && opt_string &&
-		    !strcasecmp(opt_string, "allow_discards"))
-			ti->num_discard_requests = 1;
-		else if (opt_params) {
-			ret = -EINVAL;
-			ti->error = "Invalid feature arguments";
+			if (!strcasecmp(opt_string, "allow_discards"))
+				ti->num_discard_requests = 1;
+			else if (sscanf(opt_string, "sector_size:%u%c",
+					&cc->sector_size, &dummy) == 1) {
+				if (cc->sector_size < (1 << SECTOR_SHIFT) ||
+				    cc->sector_size > PAGE_SIZE ||
+				    !is_power_of_2(cc->sector_size)) {
+					ti->error = "Invalid feature value for sector_size";
+					goto bad;
+				}
+				cc->sector_shift = __ffs(cc->sector_size);
+			} else {
+				ti->error = "Invalid feature arguments";
+				goto bad;
+			}
+		}
+	}
+
+	if (cc->sector_size != (1 << SECTOR_SHIFT)) {
+		ret = -EINVAL;
+		if (ti->len & ((cc->sector_size >> SECTOR_SHIFT) - 1)) {
+			ti->error = "Device size is not multiple of sector_size feature";
+			goto bad;
+		}
+		/* both work on 512 byte sectors */
+		if (cc->iv_gen_ops == &crypt_iv_lmk_ops ||
+		    cc->tfms_count > 1) {
+			ti->error = "sector_size feature is incompatible with lmk and keycount";
 			goto bad;
 		}
 	}
@@ -1487,15 +1736,26 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	}
 
 	cc->crypt_queue = alloc_workqueue("kcryptd",
-					  WQ_NON_REENTRANT|
-					  WQ_CPU_INTENSIVE|
+					  WQ_UNBOUND|
 					  WQ_MEM_RECLAIM,
-					  1);
+					  num_online_cpus());
 	if (!cc->crypt_queue) {
 		ti->error = "Couldn't create kcryptd queue";
 		goto bad;
 	}
 
+	init_waitqueue_head(&cc->write_thread_wait);
+	cc->write_tree = RB_ROOT;
+
+	cc->write_thread = kthread_create(dmcrypt_write, cc, "dmcrypt_write");
+	if (IS_ERR(cc->write_thread)) {
+		ret = PTR_ERR(cc->write_thread);
+		cc->write_thread = NULL;
+		ti->error = "Couldn't spawn write thread";
+		goto bad;
+	}
+	wake_up_process(cc->write_thread);
+
 	ti->num_flush_requests = 1;
 	ti->discard_zeroes_data_unsupported = 1;
 
@@ -1506,20 +1766,41 @@ bad:
 	return ret;
 }
 
+/* blocks larger than a sector must not straddle bio_vecs */
+static bool crypt_bio_aligned(struct crypt_config *cc, struct bio *bio,
+			      sector_t sector)
+{
+	struct bio_vec *bv;
+	int i;
+
+	if ((sector & ((cc->sector_size >> SECTOR_SHIFT) - 1)) ||
+	    (bio->bi_size & (cc->sector_size - 1)))
+		return false;
+
+	bio_for_each_segment(bv, bio, i)
+		if (bv->bv_len & (cc->sector_size - 1))
+			return false;
+
+	return true;
+}
+
 static int crypt_map(struct dm_target *ti, struct bio *bio,
 		     union map_info *map_context)
 {
+	struct crypt_config *cc = ti->private;
 	struct dm_crypt_io *io;
-	struct crypt_config *cc;
 
 	if (unlikely(bio->bi_rw & (REQ_FLUSH | REQ_DISCARD))) {
-		cc = ti->private;
 		bio->bi_bdev = cc->dev->bdev;
 		if (bio_sectors(bio))
 			bio->bi_sector = cc->start + dm_target_offset(ti, bio->bi_sector);
 		return DM_MAPIO_REMAPPED;
 	}
 
+	if (unlikely(cc->sector_size != (1 << SECTOR_SHIFT)) &&
+	    !crypt_bio_aligned(cc, bio, dm_target_offset(ti, bio->bi_sector)))
+		return -EIO;
+
 	io = crypt_io_alloc(ti, bio, dm_target_offset(ti, bio->bi_sector));
 
 	if (bio_data_dir(io->base_bio) == READ) {
@@ -1536,6 +1817,7 @@ static int crypt_status(struct dm_target *ti, status_type_t type,
 {
 	struct crypt_config *cc = ti->private;
 	unsigned int sz = 0;
+	int num_feature_args;
 
 	switch (type) {
 	case STATUSTYPE_INFO:
@@ -1560,8 +1842,15 @@ static int crypt_status(struct dm_target *ti, status_type_t type,
 		DMEMIT(" %llu %s %llu", (unsigned long long)cc->iv_offset,
 				cc->dev->name, (unsigned long long)cc->start);
 
-		if (ti->num_discard_requests)
-			DMEMIT(" 1 allow_discards");
+		num_feature_args = !!ti->num_discard_requests;
+		num_feature_args += cc->sector_size != (1 << SECTOR_SHIFT);
+		if (num_feature_args) {
+			DMEMIT(" %d", num_feature_args);
+			if (ti->num_discard_requests)
+				DMEMIT(" allow_discards");
+			if (cc->sector_size != (1 << SECTOR_SHIFT))
+				DMEMIT(" sector_size:%u", cc->sector_size);
+		}
 
 		break;
 	}
@@ -1653,9 +1942,23 @@ static int crypt_iterate_devices(struct dm_target *ti,
 	return fn(ti, cc->dev, cc->start, ti->len, data);
 }
 
+static void crypt_io_hints(struct dm_target *ti, struct queue_limits *limits)
+{
+	struct crypt_config *cc = ti->private;
+
+	limits->logical_block_size = max_t(unsigned short,
+					   limits->logical_block_size,
+					   cc->sector_size);
+	limits->physical_block_size = max_t(unsigned int,
+					    limits->physical_block_size,
+					    cc->sector_size);
+	blk_limits_io_min(limits, max_t(unsigned int, limits->io_min,
+					cc->sector_size));
+}
+
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 11, 0},
+	.version = {1, 12, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
@@ -1667,6 +1970,7 @@ static struct target_type crypt_target = {
 	.message = crypt_message,
 	.merge  = crypt_merge,
 	.iterate_devices = crypt_iterate_devices,
+	.io_hints = crypt_io_hints,
 };
 
 static int __init dm_crypt_init(void)
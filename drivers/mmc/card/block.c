@@ -64,6 +64,7 @@ MODULE_ALIAS("mmc:block");
 			(rq_data_dir(req) == WRITE))
 #define PACKED_CMD_VER		0x01
 #define PACKED_CMD_WR		0x02
+#define MMC_BLK_MAX_MERGED_READS	32
 #define MMC_BLK_UPDATE_STOP_REASON(stats, reason)			\
 	do {								\
 		if (stats->enabled)					\
@@ -149,6 +150,15 @@ enum {
 module_param(perdev_minors, int, 0444);
 MODULE_PARM_DESC(perdev_minors, "Minors numbers to allocate per device");
 
+#define MMC_BLK_MIN_REQS_TO_START_PACK	2
+#define MMC_BLK_MAX_REQS_TO_START_PACK	64
+#define MMC_BLK_MIN_PACKED_WRITES	2
+
+static unsigned int pack_read_latency = 10000;
+module_param(pack_read_latency, uint, 0644);
+MODULE_PARM_DESC(pack_read_latency,
+		 "Read latency in usecs above which fewer writes are packed");
+
 static inline void mmc_blk_clear_packed(struct mmc_queue_req *mqrq)
 {
         mqrq->packed_cmd = MMC_PACKED_NONE;
@@ -1357,6 +1367,8 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	struct mmc_blk_request *brq = &mqrq->brq;
 	struct request *req = mqrq->req;
 	struct mmc_blk_data *md = mq->data;
+	unsigned int sectors = mqrq->packed_cmd == MMC_PACKED_READ ?
+			       mqrq->packed_blocks : blk_rq_sectors(req);
 	bool do_data_tag;
 
 	bool do_rel_wr = ((req->cmd_flags & REQ_FUA) ||
@@ -1376,7 +1388,7 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	brq->stop.opcode = MMC_STOP_TRANSMISSION;
 	brq->stop.arg = 0;
 	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
-	brq->data.blocks = blk_rq_sectors(req);
+	brq->data.blocks = sectors;
 
 	if (brq->data.blocks > card->host->max_blk_count)
 		brq->data.blocks = card->host->max_blk_count;
@@ -1435,7 +1447,7 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	brq->data.sg = mqrq->sg;
 	brq->data.sg_len = mmc_queue_map_sg(mq, mqrq);
 
-	if (brq->data.blocks != blk_rq_sectors(req)) {
+	if (brq->data.blocks != sectors) {
 		int i, data_size = brq->data.blocks << 9;
 		struct scatterlist *sg;
 
@@ -1491,6 +1503,22 @@ static void mmc_blk_write_packing_control(struct mmc_queue *mq,
 		mq->num_of_potential_packed_wr_reqs++;
 	}
 
+	/*
+	 * Writeback that already has other writes staged behind it is a
+	 * bulk stream, there is no point in waiting for the threshold.
+	 */
+	if (!rq_is_sync(req)) {
+		unsigned int writes;
+
+		spin_lock_irq(mq->queue->queue_lock);
+		writes = mmc_queue_staged_writes(mq);
+		spin_unlock_irq(mq->queue->queue_lock);
+		if (writes >= MMC_BLK_MIN_PACKED_WRITES) {
+			mq->wr_packing_enabled = true;
+			return;
+		}
+	}
+
 	if (mq->num_of_potential_packed_wr_reqs >
 			mq->num_wr_reqs_to_start_packing)
 		mq->wr_packing_enabled = true;
@@ -1579,6 +1607,10 @@ void print_mmc_packing_stats(struct mmc_card *card)
 		pr_info("%s: %d times: Threshold\n",
 			mmc_hostname(card->host),
 			card->wr_pack_stats.pack_stop_reason[THRESHOLD]);
+	if (card->wr_pack_stats.pack_stop_reason[READ_PENDING])
+		pr_info("%s: %d times: read pending\n",
+			mmc_hostname(card->host),
+			card->wr_pack_stats.pack_stop_reason[READ_PENDING]);
 
 	spin_unlock(&card->wr_pack_stats.lock);
 }
@@ -1611,6 +1643,15 @@ static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
 			(card->host->caps2 & MMC_CAP2_PACKED_WR))
 		max_packed_rw = card->ext_csd.max_packed_writes;
 
+	if (card->host->caps2 & MMC_CAP2_PACKED_WR_CONTROL) {
+		max_packed_rw = min_t(unsigned int, max_packed_rw,
+				      mq->wr_pack_max);
+		spin_lock_irq(q->queue_lock);
+		if (mmc_queue_read_pending(mq))
+			max_packed_rw = 0;
+		spin_unlock_irq(q->queue_lock);
+	}
+
 	if (max_packed_rw == 0)
 		goto no_packed;
 
@@ -1638,7 +1679,13 @@ static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
 
 	while (reqs < max_packed_rw - 1) {
 		spin_lock_irq(q->queue_lock);
-		next = blk_fetch_request(q);
+		if ((card->host->caps2 & MMC_CAP2_PACKED_WR_CONTROL) &&
+		    mmc_queue_read_pending(mq)) {
+			spin_unlock_irq(q->queue_lock);
+			MMC_BLK_UPDATE_STOP_REASON(stats, READ_PENDING);
+			break;
+		}
+		next = mmc_queue_fetch_next(mq);
 		spin_unlock_irq(q->queue_lock);
 		if (!next) {
 			MMC_BLK_UPDATE_STOP_REASON(stats, EMPTY_QUEUE);
@@ -1690,7 +1737,7 @@ static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
 
 	if (put_back) {
 		spin_lock_irq(q->queue_lock);
-		blk_requeue_request(q, next);
+		mmc_queue_requeue(mq, next);
 		spin_unlock_irq(q->queue_lock);
 	}
 
@@ -1714,6 +1761,83 @@ no_packed:
 	return 0;
 }
 
+/*
+ * Reads that are adjacent on the card but were not merged by the block
+ * layer, typically because the first one was already dispatched, are
+ * issued as a single multiple block read and completed one by one.
+ */
+static void mmc_blk_prep_merged_read(struct mmc_queue *mq, struct request *req)
+{
+	struct request_queue *q = mq->queue;
+	struct mmc_queue_req *mqrq = mq->mqrq_cur;
+	struct mmc_host *host = mq->card->host;
+	unsigned int max_blk_count, max_phys_segs;
+	unsigned int sectors, phys_segments;
+	struct request *next;
+	u8 reqs = 1;
+
+	if (rq_data_dir(req) != READ || (host->caps2 & MMC_CAP2_NO_MULTI_READ))
+		return;
+
+	max_blk_count = min(host->max_blk_count, host->max_req_size >> 9);
+	max_blk_count = min(max_blk_count, queue_max_hw_sectors(q));
+	max_phys_segs = queue_max_segments(q);
+	sectors = blk_rq_sectors(req);
+	phys_segments = req->nr_phys_segments;
+
+	spin_lock_irq(q->queue_lock);
+	while (reqs < MMC_BLK_MAX_MERGED_READS) {
+		next = mmc_queue_fetch_read_at(mq, blk_rq_pos(req) + sectors);
+		if (!next)
+			break;
+
+		if (sectors + blk_rq_sectors(next) > max_blk_count ||
+		    phys_segments + next->nr_phys_segments > max_phys_segs) {
+			mmc_queue_requeue(mq, next);
+			break;
+		}
+
+		if (reqs == 1)
+			list_add(&req->queuelist, &mqrq->packed_list);
+		list_add_tail(&next->queuelist, &mqrq->packed_list);
+		sectors += blk_rq_sectors(next);
+		phys_segments += next->nr_phys_segments;
+		reqs++;
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	if (reqs == 1)
+		return;
+
+	mqrq->packed_cmd = MMC_PACKED_READ;
+	mqrq->packed_num = reqs;
+	mqrq->packed_blocks = sectors;
+	mqrq->packed_fail_idx = MMC_PACKED_N_IDX;
+}
+
+/*
+ * A merged read that did not complete in full is retried one request at a
+ * time: the first one is reissued on its own, the others go back to the
+ * software queue.
+ */
+static void mmc_blk_unmerge_read(struct mmc_queue *mq,
+				 struct mmc_queue_req *mqrq)
+{
+	struct request *prq;
+
+	spin_lock_irq(mq->queue->queue_lock);
+	while (!list_empty(&mqrq->packed_list)) {
+		prq = list_entry_rq(mqrq->packed_list.prev);
+		list_del_init(&prq->queuelist);
+		if (prq != mqrq->req)
+			mmc_queue_requeue(mq, prq);
+	}
+	spin_unlock_irq(mq->queue->queue_lock);
+
+	mmc_blk_clear_packed(mqrq);
+	mqrq->brq.data.bytes_xfered = 0;
+}
+
 static void mmc_blk_packed_hdr_wrq_prep(struct mmc_queue_req *mqrq,
 					struct mmc_card *card,
 					struct mmc_queue *mq)
@@ -1842,6 +1966,90 @@ static int mmc_blk_end_packed_req(struct mmc_queue *mq,
 	return ret;
 }
 
+/*
+ * Feed the outcome of a request into the packing policy: compare the write
+ * throughput with and without packing to move the threshold, and shrink
+ * the packs while reads issued right after them wait too long.
+ */
+static void mmc_blk_update_pack_policy(struct mmc_queue *mq,
+				       struct mmc_queue_req *mqrq)
+{
+	struct mmc_card *card = mq->card;
+	bool packed = mqrq->packed_cmd == MMC_PACKED_WRITE;
+	ktime_t now = ktime_get();
+	ktime_t start = mqrq->issue_time;
+	unsigned int kbps, avg;
+	s64 us;
+
+	if (!(card->host->caps2 & MMC_CAP2_PACKED_WR_CONTROL))
+		return;
+
+	/* the previous request may have kept the card busy past our issue */
+	if (ktime_to_ns(mq->last_done) > ktime_to_ns(start))
+		start = mq->last_done;
+	us = ktime_us_delta(now, start);
+	mq->last_done = now;
+
+	if (rq_data_dir(mqrq->req) == READ) {
+		if (mq->last_was_packed) {
+			avg = mq->rd_lat_after_pack;
+			mq->rd_lat_after_pack = avg - avg / 4 +
+				ktime_us_delta(now, mqrq->issue_time) / 4;
+			if (mq->rd_lat_after_pack > pack_read_latency)
+				mq->wr_pack_max = max_t(unsigned int,
+						mq->wr_pack_max / 2,
+						MMC_BLK_MIN_PACKED_WRITES);
+			else if (mq->rd_lat_after_pack < pack_read_latency / 2 &&
+				 mq->wr_pack_max <
+				 card->ext_csd.max_packed_writes)
+				mq->wr_pack_max++;
+		}
+		mq->last_was_packed = false;
+		return;
+	}
+
+	mq->last_was_packed = packed;
+	if (us <= 0 || !mqrq->brq.data.bytes_xfered)
+		return;
+
+	kbps = div_u64((u64)(mqrq->brq.data.bytes_xfered >> 10) *
+		       USEC_PER_SEC, us);
+	avg = mq->wr_tput[packed];
+	mq->wr_tput[packed] = avg ? avg - avg / 8 + kbps / 8 : kbps;
+
+	if (!mq->wr_tput[0] || !mq->wr_tput[1])
+		return;
+
+	/* pack sooner while it pays off, later while it does not */
+	if (mq->wr_tput[1] > mq->wr_tput[0] + mq->wr_tput[0] / 8)
+		mq->num_wr_reqs_to_start_packing =
+			max(mq->num_wr_reqs_to_start_packing / 2,
+			    MMC_BLK_MIN_REQS_TO_START_PACK);
+	else if (mq->wr_tput[1] < mq->wr_tput[0])
+		mq->num_wr_reqs_to_start_packing =
+			min(mq->num_wr_reqs_to_start_packing * 2,
+			    MMC_BLK_MAX_REQS_TO_START_PACK);
+}
+
+static void mmc_blk_update_lat_stats(struct mmc_card *card,
+				     struct mmc_queue_req *mqrq)
+{
+	struct mmc_req_lat_stats *stats = &card->req_lat_stats;
+	int dir = rq_data_dir(mqrq->req);
+	u32 us;
+
+	if (!stats->enabled)
+		return;
+
+	us = ktime_us_delta(ktime_get(), mqrq->issue_time);
+
+	spin_lock(&stats->lock);
+	stats->hist[dir][min(fls(us >> 6), MMC_LAT_BUCKETS - 1)]++;
+	if (us > stats->max_us[dir])
+		stats->max_us[dir] = us;
+	spin_unlock(&stats->lock);
+}
+
 static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 {
 	struct mmc_blk_data *md = mq->data;
@@ -1858,8 +2066,11 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 	if (!rqc && !mq->mqrq_prev->req)
 		return 0;
 
-	if (rqc)
+	if (rqc) {
 		reqs = mmc_blk_prep_packed_list(mq, rqc);
+		if (!reqs)
+			mmc_blk_prep_merged_read(mq, rqc);
+	}
 
 	do {
 		if (rqc) {
@@ -1868,6 +2079,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 						card, mq);
 			else
 				mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
+			mq->mqrq_cur->issue_time = ktime_get();
 			areq = &mq->mqrq_cur->mmc_active;
 		} else
 			areq = NULL;
@@ -1880,11 +2092,20 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 		req = mq_rq->req;
 		type = rq_data_dir(req) == READ ? MMC_BLK_READ : MMC_BLK_WRITE;
 		mmc_queue_bounce_post(mq_rq);
+		mmc_blk_update_lat_stats(card, mq_rq);
+		mmc_blk_update_pack_policy(mq, mq_rq);
 
 		if (mmc_card_mmc(card) &&
 			(brq->cmd.resp[0] & R1_EXCEPTION_EVENT))
 			mmc_card_set_check_bkops(card);
 
+		if (mq_rq->packed_cmd == MMC_PACKED_READ &&
+		    status != MMC_BLK_SUCCESS) {
+			mmc_blk_unmerge_read(mq, mq_rq);
+			if (status == MMC_BLK_PARTIAL)
+				status = MMC_BLK_RETRY;
+		}
+
 		switch (status) {
 		case MMC_BLK_SUCCESS:
 		case MMC_BLK_PARTIAL:
@@ -1989,7 +2210,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 						&mq->mqrq_cur->packed_list) {
 					list_del_init(&prq->queuelist);
 					spin_lock_irq(mq->queue->queue_lock);
-					blk_requeue_request(mq->queue, prq);
+					mmc_queue_requeue(mq, prq);
 					spin_unlock_irq(mq->queue->queue_lock);
 				} else {
 					list_del_init(&prq->queuelist);
@@ -2090,6 +2311,7 @@ static int sd_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 						card, mq);
 			else
 				mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
+			mq->mqrq_cur->issue_time = ktime_get();
 			areq = &mq->mqrq_cur->mmc_active;
 		} else
 			areq = NULL;
@@ -2102,6 +2324,8 @@ static int sd_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 		req = mq_rq->req;
 		type = rq_data_dir(req) == READ ? MMC_BLK_READ : MMC_BLK_WRITE;
 		mmc_queue_bounce_post(mq_rq);
+		mmc_blk_update_lat_stats(card, mq_rq);
+		mmc_blk_update_pack_policy(mq, mq_rq);
 
 		if (mmc_card_mmc(card) &&
 			(brq->cmd.resp[0] & R1_EXCEPTION_EVENT))
@@ -2273,7 +2497,7 @@ recovery:
 						&mq->mqrq_cur->packed_list) {
 					list_del_init(&prq->queuelist);
 					spin_lock_irq(mq->queue->queue_lock);
-					blk_requeue_request(mq->queue, prq);
+					mmc_queue_requeue(mq, prq);
 					spin_unlock_irq(mq->queue->queue_lock);
 				} else {
 					list_del_init(&prq->queuelist);
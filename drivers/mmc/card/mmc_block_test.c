@@ -0,0 +1,303 @@
+/*
+ * MMC block test: replays read/write traces through test-iosched
+ *
+ * Each trace is queued in one go, so the block driver sees the same mix of
+ * writeback and reads every run, and reports how long the card took, how
+ * the writes were packed and how long the reads had to wait.  Select the
+ * test scheduler on the eMMC and point it at a scratch area, then start a
+ * trace by writing the number of runs to its file:
+ *
+ *   echo test-iosched > /sys/block/mmcblk0/queue/scheduler
+ *   echo 4194304 > /sys/kernel/debug/test-iosched/utils/start_sector
+ *   echo 1 > /sys/module/mmc_block_test/parameters/allow_writes
+ *   echo 1 > /sys/kernel/debug/test-iosched/tests/mixed_trace
+ *
+ * The written area is overwritten with test patterns, so nothing runs
+ * until allow_writes has been set.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/test-iosched.h>
+#include <linux/mmc/card.h>
+#include <linux/mmc/host.h>
+
+#include "queue.h"
+
+#define MODULE_NAME			"mmc_block_test"
+#define TEST_TIMEOUT_MSEC		60000
+
+/* every test BIO carries one page */
+#define BIO_SECTORS			((BIO_U32_SIZE * sizeof(u32)) >> 9)
+#define WRITE_BIOS			4
+#define READ_BIOS			1
+/* reads are kept clear of the area the trace writes to */
+#define READ_AREA_OFFSET		(64 << 11)
+
+#define test_pr_info(fmt, args...) pr_info(MODULE_NAME ": " fmt, ##args)
+#define test_pr_err(fmt, args...) pr_err(MODULE_NAME ": " fmt, ##args)
+
+enum mmc_block_test_testcases {
+	TEST_WRITEBACK,
+	TEST_MIXED,
+	TEST_READ_DURING_WRITEBACK,
+	NUM_TESTCASES,
+};
+
+struct mmc_block_test_trace {
+	const char *name;
+	int rounds;
+	int writes;	/* per round, issued before the reads */
+	int reads;	/* per round */
+};
+
+static const struct mmc_block_test_trace traces[NUM_TESTCASES] = {
+	[TEST_WRITEBACK] = {
+		.name = "writeback_trace", .rounds = 1, .writes = 128,
+	},
+	[TEST_MIXED] = {
+		.name = "mixed_trace", .rounds = 32, .writes = 2, .reads = 1,
+	},
+	[TEST_READ_DURING_WRITEBACK] = {
+		.name = "read_during_writeback_trace", .rounds = 4,
+		.writes = 32, .reads = 8,
+	},
+};
+
+struct mmc_block_test_data {
+	struct blk_dev_test_type bdt;
+	struct dentry *debug_files[NUM_TESTCASES];
+	struct test_info test_info;
+	struct mmc_card *card;
+	ktime_t start;
+	unsigned long bytes;
+};
+
+static struct mmc_block_test_data *mbtd;
+
+static bool allow_writes;
+module_param(allow_writes, bool, 0644);
+MODULE_PARM_DESC(allow_writes, "Allow the traces to overwrite the card");
+
+static struct mmc_card *mmc_block_test_get_card(void)
+{
+	struct request_queue *q = test_iosched_get_req_queue();
+	struct mmc_queue *mq;
+
+	if (!q)
+		return NULL;
+	mq = q->queuedata;
+	return mq ? mq->card : NULL;
+}
+
+static char *mmc_block_test_case_str(struct test_data *td)
+{
+	return (char *)traces[mbtd->test_info.testcase].name;
+}
+
+static int mmc_block_test_prepare(struct test_data *td)
+{
+	struct mmc_req_lat_stats *lat;
+
+	mbtd->card = mmc_block_test_get_card();
+	if (!mbtd->card)
+		return -ENODEV;
+
+	mmc_blk_init_packed_statistics(mbtd->card);
+
+	lat = &mbtd->card->req_lat_stats;
+	spin_lock(&lat->lock);
+	memset(lat->hist, 0, sizeof(lat->hist));
+	memset(lat->max_us, 0, sizeof(lat->max_us));
+	lat->enabled = true;
+	spin_unlock(&lat->lock);
+
+	mbtd->bytes = 0;
+	mbtd->start = ktime_get();
+	return 0;
+}
+
+static int mmc_block_test_run(struct test_data *td)
+{
+	const struct mmc_block_test_trace *t =
+		&traces[mbtd->test_info.testcase];
+	u32 wr_sector = td->start_sector;
+	u32 rd_sector = td->start_sector + READ_AREA_OFFSET;
+	int round, i, ret;
+
+	for (round = 0; round < t->rounds; round++) {
+		for (i = 0; i < t->writes; i++) {
+			ret = test_iosched_add_wr_rd_test_req(0, WRITE,
+					wr_sector, WRITE_BIOS,
+					TEST_PATTERN_5A, NULL);
+			if (ret)
+				return ret;
+			wr_sector += WRITE_BIOS * BIO_SECTORS;
+			mbtd->bytes += WRITE_BIOS * BIO_SECTORS << 9;
+		}
+		for (i = 0; i < t->reads; i++) {
+			ret = test_iosched_add_wr_rd_test_req(0, READ,
+					rd_sector, READ_BIOS,
+					TEST_NO_PATTERN, NULL);
+			if (ret)
+				return ret;
+			rd_sector += READ_BIOS * BIO_SECTORS;
+			mbtd->bytes += READ_BIOS * BIO_SECTORS << 9;
+		}
+	}
+
+	return 0;
+}
+
+static int mmc_block_test_check_result(struct test_data *td)
+{
+	struct mmc_card *card = mbtd->card;
+	struct mmc_req_lat_stats *lat = &card->req_lat_stats;
+	u32 max_rd_us, max_wr_us;
+	s64 us = ktime_us_delta(ktime_get(), mbtd->start);
+
+	/* someone else wrote to the card, the numbers mean nothing */
+	if (td->fs_wr_reqs_during_test) {
+		test_iosched_set_ignore_round(true);
+		return 0;
+	}
+
+	spin_lock(&lat->lock);
+	max_rd_us = lat->max_us[READ];
+	max_wr_us = lat->max_us[WRITE];
+	lat->enabled = false;
+	spin_unlock(&lat->lock);
+
+	test_pr_info("%s: %lu KB in %lld us, %llu KB/s\n",
+		     mmc_block_test_case_str(td), mbtd->bytes >> 10, us,
+		     us > 0 ? div64_u64((u64)(mbtd->bytes >> 10) *
+					USEC_PER_SEC, us) : 0);
+	test_pr_info("%s: max read latency %u us, max write latency %u us\n",
+		     mmc_block_test_case_str(td), max_rd_us, max_wr_us);
+	print_mmc_packing_stats(card);
+
+	return 0;
+}
+
+static ssize_t mmc_block_test_write(struct file *file,
+				    const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	int testcase = (long)file->private_data;
+	unsigned long runs;
+	char kbuf[16];
+	int i, ret;
+
+	if (count >= sizeof(kbuf))
+		return -EINVAL;
+	if (copy_from_user(kbuf, buf, count))
+		return -EFAULT;
+	kbuf[count] = '\0';
+	if (kstrtoul(strstrip(kbuf), 10, &runs) || !runs)
+		return -EINVAL;
+
+	if (!allow_writes) {
+		test_pr_err("%s: allow_writes is off, not touching the card\n",
+			    traces[testcase].name);
+		return -EPERM;
+	}
+
+	memset(&mbtd->test_info, 0, sizeof(mbtd->test_info));
+	mbtd->test_info.testcase = testcase;
+	mbtd->test_info.timeout_msec = TEST_TIMEOUT_MSEC;
+	mbtd->test_info.prepare_test_fn = mmc_block_test_prepare;
+	mbtd->test_info.run_test_fn = mmc_block_test_run;
+	mbtd->test_info.check_test_result_fn = mmc_block_test_check_result;
+	mbtd->test_info.get_test_case_str_fn = mmc_block_test_case_str;
+
+	for (i = 0; i < runs; i++) {
+		test_pr_info("%s: run %d of %lu\n", traces[testcase].name,
+			     i + 1, runs);
+		ret = test_iosched_start_test(&mbtd->test_info);
+		if (ret)
+			return ret;
+	}
+
+	return count;
+}
+
+static const struct file_operations mmc_block_test_fops = {
+	.open = simple_open,
+	.write = mmc_block_test_write,
+};
+
+static void mmc_block_test_debugfs_cleanup(void)
+{
+	int i;
+
+	for (i = 0; i < NUM_TESTCASES; i++) {
+		debugfs_remove(mbtd->debug_files[i]);
+		mbtd->debug_files[i] = NULL;
+	}
+}
+
+static void mmc_block_test_init_fn(void)
+{
+	struct dentry *root = test_iosched_get_debugfs_tests_root();
+	long i;
+
+	if (!root)
+		return;
+
+	for (i = 0; i < NUM_TESTCASES; i++) {
+		mbtd->debug_files[i] = debugfs_create_file(traces[i].name,
+				S_IWUSR, root, (void *)i,
+				&mmc_block_test_fops);
+		if (!mbtd->debug_files[i]) {
+			test_pr_err("%s: failed to create %s\n", __func__,
+				    traces[i].name);
+			mmc_block_test_debugfs_cleanup();
+			return;
+		}
+	}
+}
+
+static void mmc_block_test_exit_fn(void)
+{
+	mmc_block_test_debugfs_cleanup();
+}
+
+static int __init mmc_block_test_init(void)
+{
+	mbtd = kzalloc(sizeof(*mbtd), GFP_KERNEL);
+	if (!mbtd)
+		return -ENOMEM;
+
+	mbtd->bdt.init_fn = mmc_block_test_init_fn;
+	mbtd->bdt.exit_fn = mmc_block_test_exit_fn;
+	INIT_LIST_HEAD(&mbtd->bdt.list);
+	test_iosched_register(&mbtd->bdt);
+
+	return 0;
+}
+
+static void __exit mmc_block_test_exit(void)
+{
+	test_iosched_unregister(&mbtd->bdt);
+	mmc_block_test_debugfs_cleanup();
+	kfree(mbtd);
+}
+
+module_init(mmc_block_test_init);
+module_exit(mmc_block_test_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("MMC block test");
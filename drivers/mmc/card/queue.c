@@ -26,6 +26,15 @@
 
 #define DEFAULT_NUM_REQS_TO_START_PACK 17
 
+/*
+ * Requests taken off the block queue ahead of the one being issued.  Every
+ * staged request is out of the elevator's reach, so keep this small.
+ */
+#define MMC_QUEUE_SQ_DEPTH	8
+
+/* Reads that may overtake the oldest staged write before it is issued. */
+#define MMC_QUEUE_SQ_MAX_BYPASS	16
+
 static int mmc_prep_request(struct request_queue *q, struct request *req)
 {
 	struct mmc_queue *mq = q->queuedata;
@@ -43,6 +52,153 @@ static int mmc_prep_request(struct request_queue *q, struct request *req)
 	return BLKPREP_OK;
 }
 
+static inline bool mmc_req_is_barrier(struct request *req)
+{
+	return req->cmd_flags & (REQ_FLUSH | REQ_DISCARD | REQ_SANITIZE);
+}
+
+/*
+ * The software queue is only used by the queue thread, always with the
+ * queue lock held.  Requests may be reordered within it, but never across
+ * a flush, discard or sanitize, and no request is staged behind one.
+ */
+static void mmc_queue_refill(struct mmc_queue *mq)
+{
+	struct request *req;
+
+	while (mq->sq_count < MMC_QUEUE_SQ_DEPTH) {
+		if (!list_empty(&mq->sq_list) &&
+		    mmc_req_is_barrier(list_entry_rq(mq->sq_list.prev)))
+			break;
+
+		req = blk_fetch_request(mq->queue);
+		if (!req)
+			break;
+
+		list_add_tail(&req->queuelist, &mq->sq_list);
+		mq->sq_count++;
+	}
+}
+
+static void mmc_queue_unstage(struct mmc_queue *mq, struct request *req)
+{
+	list_del_init(&req->queuelist);
+	mq->sq_count--;
+}
+
+static struct request *mmc_queue_sync_read(struct mmc_queue *mq)
+{
+	struct request *req;
+
+	list_for_each_entry(req, &mq->sq_list, queuelist) {
+		if (mmc_req_is_barrier(req))
+			break;
+		if (rq_data_dir(req) == READ && rq_is_sync(req))
+			return req;
+	}
+
+	return NULL;
+}
+
+/*
+ * Next request for the queue thread: a synchronous read goes ahead of
+ * background writes, as long as the oldest write has not been passed over
+ * too often already.
+ */
+static struct request *mmc_queue_fetch(struct mmc_queue *mq)
+{
+	struct request *req = NULL;
+
+	mmc_queue_refill(mq);
+	if (list_empty(&mq->sq_list))
+		return NULL;
+
+	if (rq_data_dir(list_entry_rq(mq->sq_list.next)) == WRITE &&
+	    mq->sq_bypass < MMC_QUEUE_SQ_MAX_BYPASS)
+		req = mmc_queue_sync_read(mq);
+
+	if (req) {
+		mq->sq_bypass++;
+	} else {
+		req = list_entry_rq(mq->sq_list.next);
+		mq->sq_bypass = 0;
+	}
+
+	mmc_queue_unstage(mq, req);
+	return req;
+}
+
+/* Oldest staged request, for packing; the queue lock must be held. */
+struct request *mmc_queue_fetch_next(struct mmc_queue *mq)
+{
+	struct request *req;
+
+	mmc_queue_refill(mq);
+	if (list_empty(&mq->sq_list))
+		return NULL;
+
+	req = list_entry_rq(mq->sq_list.next);
+	mmc_queue_unstage(mq, req);
+	return req;
+}
+
+/*
+ * Staged read starting at @pos, so that it can be merged into the read
+ * ending there; the queue lock must be held.
+ */
+struct request *mmc_queue_fetch_read_at(struct mmc_queue *mq, sector_t pos)
+{
+	struct request *req;
+
+	mmc_queue_refill(mq);
+
+	list_for_each_entry(req, &mq->sq_list, queuelist) {
+		if (mmc_req_is_barrier(req))
+			break;
+		if (rq_data_dir(req) == READ && blk_rq_pos(req) == pos) {
+			mmc_queue_unstage(mq, req);
+			return req;
+		}
+	}
+
+	return NULL;
+}
+
+/* Whether a read waits in the software queue; the queue lock must be held. */
+bool mmc_queue_read_pending(struct mmc_queue *mq)
+{
+	struct request *req;
+
+	list_for_each_entry(req, &mq->sq_list, queuelist)
+		if (rq_data_dir(req) == READ)
+			return true;
+
+	return false;
+}
+
+/* Writes ready to be packed; the queue lock must be held. */
+unsigned int mmc_queue_staged_writes(struct mmc_queue *mq)
+{
+	struct request *req;
+	unsigned int writes = 0;
+
+	list_for_each_entry(req, &mq->sq_list, queuelist) {
+		if (mmc_req_is_barrier(req))
+			break;
+		if (rq_data_dir(req) == WRITE)
+			writes++;
+	}
+
+	return writes;
+}
+
+/* Put a fetched request back in front; the queue lock must be held. */
+void mmc_queue_requeue(struct mmc_queue *mq, struct request *req)
+{
+	list_add(&req->queuelist, &mq->sq_list);
+	mq->sq_count++;
+}
+
 static int mmc_queue_thread(void *d)
 {
 	struct mmc_queue *mq = d;
@@ -58,7 +214,7 @@ static int mmc_queue_thread(void *d)
 
 		spin_lock_irq(q->queue_lock);
 		set_current_state(TASK_INTERRUPTIBLE);
-		req = blk_fetch_request(q);
+		req = mmc_queue_fetch(mq);
 		mq->mqrq_cur->req = req;
 		spin_unlock_irq(q->queue_lock);
 
@@ -107,7 +263,7 @@ static int sd_queue_thread(void *d)
 
 		spin_lock_irq(q->queue_lock);
 		set_current_state(TASK_INTERRUPTIBLE);
-		req = blk_fetch_request(q);
+		req = mmc_queue_fetch(mq);
 		mq->mqrq_cur->req = req;
 		spin_unlock_irq(q->queue_lock);
 
@@ -220,10 +376,12 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 	memset(&mq->mqrq_prev, 0, sizeof(mq->mqrq_prev));
 	INIT_LIST_HEAD(&mqrq_cur->packed_list);
 	INIT_LIST_HEAD(&mqrq_prev->packed_list);
+	INIT_LIST_HEAD(&mq->sq_list);
 	mq->mqrq_cur = mqrq_cur;
 	mq->mqrq_prev = mqrq_prev;
 	mq->queue->queuedata = mq;
 	mq->num_wr_reqs_to_start_packing = DEFAULT_NUM_REQS_TO_START_PACK;
+	mq->wr_pack_max = card->ext_csd.max_packed_writes;
 
 	blk_queue_prep_rq(mq->queue, mmc_prep_request);
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
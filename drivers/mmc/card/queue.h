@@ -26,6 +26,7 @@ enum mmc_blk_status {
 enum mmc_packed_cmd {
 	MMC_PACKED_NONE = 0,
 	MMC_PACKED_WRITE,
+	MMC_PACKED_READ,
 };
 
 struct mmc_queue_req {
@@ -42,6 +43,7 @@ struct mmc_queue_req {
 	enum mmc_packed_cmd	packed_cmd;
 	int		packed_fail_idx;
 	u8		packed_num;
+	ktime_t		issue_time;
 };
 
 struct mmc_queue {
@@ -55,6 +57,14 @@ struct mmc_queue {
 	struct mmc_queue_req	mqrq[2];
 	struct mmc_queue_req	*mqrq_cur;
 	struct mmc_queue_req	*mqrq_prev;
+	struct list_head	sq_list;
+	unsigned int		sq_count;
+	unsigned int		sq_bypass;
+	unsigned int		wr_pack_max;
+	unsigned int		wr_tput[2];
+	unsigned int		rd_lat_after_pack;
+	bool			last_was_packed;
+	ktime_t			last_done;
 	bool			wr_packing_enabled;
 	int			num_of_potential_packed_wr_reqs;
 	int			num_wr_reqs_to_start_packing;
@@ -73,6 +83,12 @@ extern unsigned int mmc_queue_map_sg(struct mmc_queue *,
 extern void mmc_queue_bounce_pre(struct mmc_queue_req *);
 extern void mmc_queue_bounce_post(struct mmc_queue_req *);
 
+extern struct request *mmc_queue_fetch_next(struct mmc_queue *);
+extern struct request *mmc_queue_fetch_read_at(struct mmc_queue *, sector_t);
+extern void mmc_queue_requeue(struct mmc_queue *, struct request *);
+extern bool mmc_queue_read_pending(struct mmc_queue *);
+extern unsigned int mmc_queue_staged_writes(struct mmc_queue *);
+
 extern void print_mmc_packing_stats(struct mmc_card *card);
 extern int mmc_schedule_card_removal_work(struct delayed_work *work,
                                     unsigned long delay);
@@ -429,6 +429,13 @@ static ssize_t mmc_wr_pack_stats_read(struct file *filp, char __user *ubuf,
 			pack_stats->pack_stop_reason[THRESHOLD]);
 		strlcat(ubuf, temp_buf, cnt);
 	}
+	if (pack_stats->pack_stop_reason[READ_PENDING]) {
+		snprintf(temp_buf, TEMP_BUF_SIZE,
+			 "%s: %d times: read pending\n",
+			mmc_hostname(card->host),
+			pack_stats->pack_stop_reason[READ_PENDING]);
+		strlcat(ubuf, temp_buf, cnt);
+	}
 
 	spin_unlock(&pack_stats->lock);
 
@@ -473,6 +480,71 @@ static const struct file_operations mmc_dbg_wr_pack_stats_fops = {
 	.write		= mmc_wr_pack_stats_write,
 };
 
+static int mmc_req_lat_stats_show(struct seq_file *s, void *data)
+{
+	struct mmc_card *card = s->private;
+	struct mmc_req_lat_stats *stats = &card->req_lat_stats;
+	int i;
+
+	if (!stats->enabled) {
+		seq_puts(s, "request latency statistics are disabled\n");
+		return 0;
+	}
+
+	spin_lock(&stats->lock);
+	seq_printf(s, "%10s %10s %10s\n", "usecs", "reads", "writes");
+	for (i = 0; i < MMC_LAT_BUCKETS; i++) {
+		if (i < MMC_LAT_BUCKETS - 1)
+			seq_printf(s, "<%9u", 64 << i);
+		else
+			seq_printf(s, ">=%8u", 64 << (i - 1));
+		seq_printf(s, " %10u %10u\n", stats->hist[READ][i],
+			   stats->hist[WRITE][i]);
+	}
+	seq_printf(s, "%10s %10u %10u\n", "max", stats->max_us[READ],
+		   stats->max_us[WRITE]);
+	spin_unlock(&stats->lock);
+
+	return 0;
+}
+
+static int mmc_req_lat_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_req_lat_stats_show, inode->i_private);
+}
+
+static ssize_t mmc_req_lat_stats_write(struct file *filp,
+				       const char __user *ubuf, size_t cnt,
+				       loff_t *ppos)
+{
+	struct mmc_card *card = ((struct seq_file *)filp->private_data)->private;
+	struct mmc_req_lat_stats *stats = &card->req_lat_stats;
+	unsigned long value;
+	int err;
+
+	err = kstrtoul_from_user(ubuf, cnt, 0, &value);
+	if (err)
+		return err;
+
+	spin_lock(&stats->lock);
+	if (value) {
+		memset(stats->hist, 0, sizeof(stats->hist));
+		memset(stats->max_us, 0, sizeof(stats->max_us));
+	}
+	stats->enabled = value;
+	spin_unlock(&stats->lock);
+
+	return cnt;
+}
+
+static const struct file_operations mmc_dbg_req_lat_stats_fops = {
+	.open		= mmc_req_lat_stats_open,
+	.read		= seq_read,
+	.write		= mmc_req_lat_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void mmc_add_card_debugfs(struct mmc_card *card)
 {
 	struct mmc_host	*host = card->host;
@@ -509,6 +581,12 @@ void mmc_add_card_debugfs(struct mmc_card *card)
 					 &mmc_dbg_wr_pack_stats_fops))
 			goto err;
 
+	if (mmc_card_mmc(card) || mmc_card_sd(card))
+		if (!debugfs_create_file("req_lat_stats", S_IRUSR | S_IWUSR,
+					 root, card,
+					 &mmc_dbg_req_lat_stats_fops))
+			goto err;
+
 	return;
 
 err:
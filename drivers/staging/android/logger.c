@@ -21,6 +21,7 @@
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
@@ -29,23 +30,53 @@
 
 #include <asm/ioctls.h>
 
+#define LOGGER_ENTRY_MAX_LEN	(sizeof(struct logger_entry) + \
+				 LOGGER_ENTRY_MAX_PAYLOAD)
+
+/*
+ * Number of writes that may be copying into the ring at the same time.
+ * Further writers wait for the oldest one to commit.
+ */
+#define LOGGER_MAX_INFLIGHT	32
+
+/*
+ * Writers reserve space for an entry under log->lock, copy the entry in
+ * without holding any lock and then commit it.  Entries become visible
+ * to readers in reservation order: c_off only moves past an entry once
+ * it and every entry reserved before it have been committed.
+ *
+ * log->lock protects w_off, c_off, head, the sequence counters and the
+ * readers list, and is never held across a user copy.
+ */
 struct logger_log {
 	unsigned char		*buffer;
+	struct logger_mmap_index *index;	
 	struct miscdevice	misc;	
 	wait_queue_head_t	wq;	
+	wait_queue_head_t	commit_wq;	
 	struct list_head	readers; 
-	struct mutex		mutex;	
+	spinlock_t		lock;	
 	size_t			w_off;	
+	size_t			c_off;	
 	size_t			head;	
 	size_t			size;	
+	unsigned int		r_seq;	
+	unsigned int		c_seq;	
+	struct {
+		size_t		end;
+		bool		done;
+	} inflight[LOGGER_MAX_INFLIGHT];
 };
 
 struct logger_reader {
 	struct logger_log	*log;	
 	struct list_head	list;	
+	struct mutex		mutex;	
 	size_t			r_off;	
 	bool			r_all;	
 	int			r_ver;	
+	unsigned char		*scratch;	
+	size_t			wake_bytes;	
 };
 
 size_t logger_offset(struct logger_log *log, size_t n)
@@ -118,43 +149,36 @@ static ssize_t copy_header_to_user(int ver, struct logger_entry *entry,
 	return copy_to_user(buf, hdr, hdr_len);
 }
 
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static void copy_from_log(struct logger_log *log, void *dst, size_t off,
+			  size_t count)
 {
-	struct logger_entry scratch;
-	struct logger_entry *entry;
-	size_t len;
-	size_t msg_start;
+	size_t len = min(count, log->size - off);
+
+	memcpy(dst, log->buffer + off, len);
+	if (count != len)
+		memcpy(dst + len, log->buffer, count - len);
+}
+
+static ssize_t do_read_log_to_user(struct logger_reader *reader,
+				   char __user *buf, size_t count)
+{
+	struct logger_entry *entry = (struct logger_entry *)reader->scratch;
 
-	entry = get_entry_header(log, reader->r_off, &scratch);
 	if (copy_header_to_user(reader->r_ver, entry, buf))
 		return -EFAULT;
 
 	count -= get_user_hdr_len(reader->r_ver);
 	buf += get_user_hdr_len(reader->r_ver);
-	msg_start = logger_offset(log,
-		reader->r_off + sizeof(struct logger_entry));
-
-	len = min(count, log->size - msg_start);
-	if (copy_to_user(buf, log->buffer + msg_start, len))
+	if (copy_to_user(buf, entry->msg, count))
 		return -EFAULT;
 
-	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
-
-	reader->r_off = logger_offset(log, reader->r_off +
-		sizeof(struct logger_entry) + count);
-
 	return count + get_user_hdr_len(reader->r_ver);
 }
 
 static size_t get_next_entry_by_uid(struct logger_log *log,
 		size_t off, uid_t euid)
 {
-	while (off != log->w_off) {
+	while (off != log->c_off) {
 		struct logger_entry *entry;
 		struct logger_entry scratch;
 		size_t next_len;
@@ -176,17 +200,19 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	size_t off, next;
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
+	mutex_lock(&reader->mutex);
 start:
 	while (1) {
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		ret = (log->c_off == reader->r_off);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -205,17 +231,17 @@ start:
 
 	finish_wait(&log->wq, &wait);
 	if (ret)
-		return ret;
+		goto out;
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 
 	if (!reader->r_all)
 		reader->r_off = get_next_entry_by_uid(log,
 			reader->r_off, current_euid());
 
 	
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+	if (unlikely(log->c_off == reader->r_off)) {
+		spin_unlock(&log->lock);
 		goto start;
 	}
 
@@ -223,15 +249,42 @@ start:
 	ret = get_user_hdr_len(reader->r_ver) +
 		get_entry_msg_len(log, reader->r_off);
 	if (count < ret) {
+		spin_unlock(&log->lock);
 		ret = -EINVAL;
 		goto out;
 	}
 
-	
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	/*
+	 * Snapshot the entry so the user copy happens without log->lock;
+	 * writers may overwrite the ring slot as soon as it is dropped.  A
+	 * length the scratch buffer cannot hold means the reader lost track
+	 * of the entry boundaries, so it is moved to the tail.
+	 */
+	off = reader->r_off;
+	count = get_entry_msg_len(log, off);
+	if (unlikely(count > LOGGER_ENTRY_MAX_PAYLOAD)) {
+		reader->r_off = log->c_off;
+		spin_unlock(&log->lock);
+		ret = -EFAULT;
+		goto out;
+	}
+	count += sizeof(struct logger_entry);
+	copy_from_log(log, reader->scratch, off, count);
+	next = logger_offset(log, off + count);
+	spin_unlock(&log->lock);
+
+	ret = do_read_log_to_user(reader, buf, ret);
+
+	/* consume the entry unless a writer already pushed us past it */
+	if (ret >= 0) {
+		spin_lock(&log->lock);
+		if (reader->r_off == off)
+			reader->r_off = next;
+		spin_unlock(&log->lock);
+	}
 
 out:
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -265,6 +318,17 @@ static inline int is_between(size_t a, size_t b, size_t c)
 	return 0;
 }
 
+/*
+ * Moves the head forward, publishing it to mmap readers before any of
+ * the space it frees can be reused.
+ */
+static void logger_set_head(struct logger_log *log, size_t head)
+{
+	log->index->head_pos += logger_offset(log, head - log->head);
+	log->head = head;
+	smp_wmb();
+}
+
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
 	size_t old = log->w_off;
@@ -272,60 +336,158 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 	struct logger_reader *reader;
 
 	if (is_between(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
+		logger_set_head(log, get_next_entry(log, log->head, len));
 
 	list_for_each_entry(reader, &log->readers, list)
 		if (is_between(old, new, reader->r_off))
 			reader->r_off = get_next_entry(log, reader->r_off, len);
 }
 
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log(struct logger_log *log, size_t off,
+			 const void *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log, log->w_off + count);
-
 }
 
-static ssize_t do_write_log_from_user(struct logger_log *log,
+static ssize_t do_write_log_from_user(struct logger_log *log, size_t off,
 				      const void __user *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
+	len = min(count, log->size - off);
+	if (len && copy_from_user(log->buffer + off, buf, len))
 		return -EFAULT;
 
 	if (count != len)
 		if (copy_from_user(log->buffer, buf + len, count - len))
 			return -EFAULT;
 
-	log->w_off = logger_offset(log, log->w_off + count);
-
 	return count;
 }
 
+/*
+ * A new reservation must not wrap onto entries that are still being
+ * copied in, and there must be a free in-flight slot for it.
+ */
+static bool logger_can_reserve(struct logger_log *log, size_t len)
+{
+	return log->r_seq - log->c_seq < LOGGER_MAX_INFLIGHT &&
+		logger_offset(log, log->w_off - log->c_off) + len < log->size;
+}
+
+static bool logger_can_reserve_locked(struct logger_log *log, size_t len)
+{
+	bool ret;
+
+	spin_lock(&log->lock);
+	ret = logger_can_reserve(log, len);
+	spin_unlock(&log->lock);
+
+	return ret;
+}
+
+/*
+ * Reserves @header->len bytes of payload plus the header at the tail of
+ * the ring and stamps @header with the reservation time, so ring order
+ * is also timestamp order.  The sequence number of the reservation is
+ * returned in @seq and the start offset of the entry in @off.
+ *
+ * A writer still copying in its entry holds back every reservation that
+ * would wrap onto it, and all of them once LOGGER_MAX_INFLIGHT are
+ * pending, so the wait for space can be interrupted.
+ */
+static int logger_reserve(struct logger_log *log, struct logger_entry *header,
+			  unsigned int *seq, size_t *off)
+{
+	size_t len = sizeof(struct logger_entry) + header->len;
+	struct timespec now;
+
+	spin_lock(&log->lock);
+	while (unlikely(!logger_can_reserve(log, len))) {
+		spin_unlock(&log->lock);
+		if (wait_event_interruptible(log->commit_wq,
+				logger_can_reserve_locked(log, len)))
+			return -ERESTARTSYS;
+		spin_lock(&log->lock);
+	}
+
+	now = current_kernel_time();
+	header->sec = now.tv_sec;
+	header->nsec = now.tv_nsec;
+
+	fix_up_readers(log, len);
+
+	*off = log->w_off;
+	log->w_off = logger_offset(log, log->w_off + len);
+	*seq = log->r_seq++;
+	log->inflight[*seq % LOGGER_MAX_INFLIGHT].end = log->w_off;
+	log->inflight[*seq % LOGGER_MAX_INFLIGHT].done = false;
+	spin_unlock(&log->lock);
+
+	return 0;
+}
+
+static void logger_commit(struct logger_log *log, unsigned int seq)
+{
+	size_t old_c_off;
+
+	spin_lock(&log->lock);
+	old_c_off = log->c_off;
+	log->inflight[seq % LOGGER_MAX_INFLIGHT].done = true;
+	while (log->c_seq != log->r_seq &&
+	       log->inflight[log->c_seq % LOGGER_MAX_INFLIGHT].done) {
+		log->c_off = log->inflight[log->c_seq % LOGGER_MAX_INFLIGHT].end;
+		log->c_seq++;
+	}
+	if (log->c_off != old_c_off) {
+		/* entry data must be visible before the new tail */
+		smp_wmb();
+		log->index->tail_pos += logger_offset(log,
+					log->c_off - old_c_off);
+	}
+	if (waitqueue_active(&log->commit_wq))
+		wake_up(&log->commit_wq);
+	spin_unlock(&log->lock);
+
+	if (log->c_off != old_c_off)
+		wake_up_interruptible(&log->wq);
+}
+
+/*
+ * Completes a reservation whose payload could not be copied in.  The
+ * space is never given back: older reservations may still be copying,
+ * and the head and the mmap head_pos only ever move forward, so the rest
+ * of the payload is zeroed and the entry committed in order.
+ */
+static void logger_abort(struct logger_log *log, unsigned int seq,
+			 size_t off, size_t len, size_t copied)
+{
+	off = logger_offset(log, off + sizeof(struct logger_entry) + copied);
+	len -= copied;
+	copied = min(len, log->size - off);
+	memset(log->buffer + off, 0, copied);
+	if (len != copied)
+		memset(log->buffer, 0, len - copied);
+	logger_commit(log, seq);
+}
+
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
-	struct timespec now;
+	unsigned int seq;
+	size_t off;
 	ssize_t ret = 0;
 
-	now = current_kernel_time();
-
 	header.pid = current->tgid;
 	header.tid = current->pid;
-	header.sec = now.tv_sec;
-	header.nsec = now.tv_nsec;
 	header.euid = current_euid();
 	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
 	header.hdr_size = sizeof(struct logger_entry);
@@ -334,11 +496,11 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+	ret = logger_reserve(log, &header, &seq, &off);
+	if (unlikely(ret))
+		return ret;
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	do_write_log(log, off, &header, sizeof(struct logger_entry));
 
 	while (nr_segs-- > 0) {
 		size_t len;
@@ -348,10 +510,11 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 		len = min_t(size_t, iov->iov_len, header.len - ret);
 
 		
-		nr = do_write_log_from_user(log, iov->iov_base, len);
+		nr = do_write_log_from_user(log, logger_offset(log,
+				off + sizeof(struct logger_entry) + ret),
+				iov->iov_base, len);
 		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
+			logger_abort(log, seq, off, header.len, ret);
 			return nr;
 		}
 
@@ -359,10 +522,7 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 		ret += nr;
 	}
 
-	mutex_unlock(&log->mutex);
-
-	
-	wake_up_interruptible(&log->wq);
+	logger_commit(log, seq);
 
 	return ret;
 }
@@ -389,17 +549,25 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->scratch = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->scratch) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
+		reader->wake_bytes = 0;
 		reader->r_ver = 1;
 		reader->r_all = in_egroup_p(inode->i_gid) ||
 			capable(CAP_SYSLOG);
 
 		INIT_LIST_HEAD(&reader->list);
+		mutex_init(&reader->mutex);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -414,10 +582,11 @@ static int logger_release(struct inode *ignored, struct file *file)
 		struct logger_reader *reader = file->private_data;
 		struct logger_log *log = reader->log;
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		list_del(&reader->list);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
+		kfree(reader->scratch);
 		kfree(reader);
 	}
 
@@ -438,14 +607,15 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 	if (!reader->r_all)
 		reader->r_off = get_next_entry_by_uid(log,
 			reader->r_off, current_euid());
 
-	if (log->w_off != reader->r_off)
+	if (log->c_off != reader->r_off &&
+	    logger_offset(log, log->c_off - reader->r_off) >= reader->wake_bytes)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -463,6 +633,69 @@ static long logger_set_version(struct logger_reader *reader, void __user *arg)
 	return 0;
 }
 
+/*
+ * Moves the reader to @pos, an entry position previously read from the
+ * mmap index, so an mmap consumer can tell us what it has drained and
+ * poll only reports data it has not seen.  The walk runs forward from
+ * the reader's current offset, so its cost is bounded by the batch.
+ */
+static long logger_set_read_pos(struct logger_log *log,
+				struct logger_reader *reader, __u32 pos)
+{
+	size_t target = logger_offset(log, pos);
+	size_t off = reader->r_off;
+
+	if (log->index->tail_pos - pos > log->index->tail_pos -
+					 log->index->head_pos)
+		return -EINVAL;
+
+	while (off != target) {
+		if (off == log->c_off)
+			return -EINVAL;
+		off = logger_offset(log, off + sizeof(struct logger_entry) +
+				    get_entry_msg_len(log, off));
+	}
+	reader->r_off = target;
+
+	return 0;
+}
+
+static int logger_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct logger_reader *reader = file->private_data;
+	struct logger_log *log;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	unsigned long ring;
+	int ret;
+
+	if (!(file->f_mode & FMODE_READ))
+		return -EBADF;
+
+	/* the mapping bypasses per-uid filtering */
+	log = reader->log;
+	if (!reader->r_all)
+		return -EPERM;
+
+	if (vma->vm_pgoff || size > PAGE_SIZE + log->size)
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND | VM_RESERVED;
+
+	ret = remap_pfn_range(vma, vma->vm_start,
+			      virt_to_phys(log->index) >> PAGE_SHIFT,
+			      min(size, PAGE_SIZE), vma->vm_page_prot);
+	if (ret || size <= PAGE_SIZE)
+		return ret;
+
+	ring = vma->vm_start + PAGE_SIZE;
+	return remap_pfn_range(vma, ring,
+			       virt_to_phys(log->buffer) >> PAGE_SHIFT,
+			       vma->vm_end - ring, vma->vm_page_prot);
+}
+
 static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
@@ -470,7 +703,18 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	long ret = -EINVAL;
 	void __user *argp = (void __user *) arg;
 
-	mutex_lock(&log->mutex);
+	/* takes a user copy, so it can't run under log->lock */
+	if (cmd == LOGGER_SET_VERSION) {
+		if (!(file->f_mode & FMODE_READ))
+			return -EBADF;
+		reader = file->private_data;
+		mutex_lock(&reader->mutex);
+		ret = logger_set_version(reader, argp);
+		mutex_unlock(&reader->mutex);
+		return ret;
+	}
+
+	spin_lock(&log->lock);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -482,10 +726,10 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
+		if (log->c_off >= reader->r_off)
+			ret = log->c_off - reader->r_off;
 		else
-			ret = (log->size - reader->r_off) + log->w_off;
+			ret = (log->size - reader->r_off) + log->c_off;
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -498,7 +742,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			reader->r_off = get_next_entry_by_uid(log,
 				reader->r_off, current_euid());
 
-		if (log->w_off != reader->r_off)
+		if (log->c_off != reader->r_off)
 			ret = get_user_hdr_len(reader->r_ver) +
 				get_entry_msg_len(log, reader->r_off);
 		else
@@ -510,8 +754,8 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+			reader->r_off = log->c_off;
+		logger_set_head(log, log->c_off);
 		ret = 0;
 		break;
 	case LOGGER_GET_VERSION:
@@ -522,17 +766,32 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		reader = file->private_data;
 		ret = reader->r_ver;
 		break;
-	case LOGGER_SET_VERSION:
+	case LOGGER_SET_WAKEUP_THRESHOLD:
 		if (!(file->f_mode & FMODE_READ)) {
 			ret = -EBADF;
 			break;
 		}
+		if (arg > log->size / 2)
+			break;
 		reader = file->private_data;
-		ret = logger_set_version(reader, argp);
+		reader->wake_bytes = arg;
+		ret = 0;
+		break;
+	case LOGGER_SET_READ_POS:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		if (!reader->r_all) {
+			ret = -EPERM;
+			break;
+		}
+		ret = logger_set_read_pos(log, reader, arg);
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -542,6 +801,7 @@ static const struct file_operations logger_fops = {
 	.read = logger_read,
 	.aio_write = logger_aio_write,
 	.poll = logger_poll,
+	.mmap = logger_mmap,
 	.unlocked_ioctl = logger_ioctl,
 	.compat_ioctl = logger_ioctl,
 	.open = logger_open,
@@ -549,7 +809,7 @@ static const struct file_operations logger_fops = {
 };
 
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
+static unsigned char _buf_ ## VAR[SIZE] __aligned(PAGE_SIZE); \
 static struct logger_log VAR = { \
 	.buffer = _buf_ ## VAR, \
 	.misc = { \
@@ -559,9 +819,11 @@ static struct logger_log VAR = { \
 		.parent = NULL, \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
+	.commit_wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .commit_wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
+	.c_off = 0, \
 	.head = 0, \
 	.size = SIZE, \
 };
@@ -588,10 +850,16 @@ static int __init init_log(struct logger_log *log)
 {
 	int ret;
 
+	log->index = (struct logger_mmap_index *)get_zeroed_page(GFP_KERNEL);
+	if (unlikely(!log->index))
+		return -ENOMEM;
+	log->index->size = log->size;
+
 	ret = misc_register(&log->misc);
 	if (unlikely(ret)) {
 		printk(KERN_ERR "logger: failed to register misc "
 		       "device for log '%s'!\n", log->misc.name);
+		free_page((unsigned long)log->index);
 		return ret;
 	}
 
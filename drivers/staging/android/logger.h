@@ -48,6 +48,25 @@ struct logger_entry {
 
 #define LOGGER_ENTRY_MAX_PAYLOAD	4076
 
+/*
+ * Readers in the log group may mmap a log read-only.  The first page of
+ * the mapping holds a struct logger_mmap_index and the ring buffer
+ * follows at an offset of one page.
+ *
+ * head_pos and tail_pos count bytes ever dropped from and committed to
+ * the ring; an entry at position pos lives at ring offset pos % size.
+ * Entries between head_pos and tail_pos are complete.  A consumer reads
+ * tail_pos, copies entries out, and then re-reads head_pos: anything it
+ * copied from before head_pos may have been overwritten and must be
+ * discarded.  Neither counter ever moves backwards, not even when a write
+ * fails halfway: its entry is committed with the missing bytes zeroed.
+ */
+struct logger_mmap_index {
+	__u32		size;		
+	__u32		head_pos;	
+	__u32		tail_pos;	
+};
+
 #define __LOGGERIO	0xAE
 
 #define LOGGER_GET_LOG_BUF_SIZE		_IO(__LOGGERIO, 1) 
@@ -56,5 +75,7 @@ struct logger_entry {
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) 
 #define LOGGER_GET_VERSION		_IO(__LOGGERIO, 5) 
 #define LOGGER_SET_VERSION		_IO(__LOGGERIO, 6) 
+#define LOGGER_SET_WAKEUP_THRESHOLD	_IO(__LOGGERIO, 7) 
+#define LOGGER_SET_READ_POS		_IO(__LOGGERIO, 8) 
 
 #endif 
@@ -17,6 +17,11 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * /dev/lowmem_pressure reports memory pressure before it gets that far.
+ * Writing "low", "medium" or "critical" selects the lowest level a reader
+ * is interested in; poll() then signals POLLIN and read() returns one
+ * line describing the latest event at or above that level.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -37,6 +42,18 @@
 #include <linux/sched.h>
 #include <linux/rcupdate.h>
 #include <linux/notifier.h>
+#include <linux/bitops.h>
+#include <linux/ktime.h>
+#include <linux/pid_namespace.h>
+#include <linux/spinlock.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+#include <linux/uaccess.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/lowmemorykiller.h>
 
 extern void show_meminfo(void);
 static uint32_t lowmem_debug_level = 2;
@@ -56,6 +73,77 @@ static int lowmem_minfree[6] = {
 static int lowmem_minfree_size = 4;
 
 static unsigned long lowmem_deathpending_timeout;
+static pid_t lowmem_deathpending_pid;
+
+/*
+ * Thread group leaders are kept on one list per oom_score_adj value,
+ * indexed from OOM_SCORE_ADJ_MAX down, with a bitmap of the non-empty
+ * lists.  The lists follow fork, exec, exit and every oom_score_adj
+ * change, so the shrinker finds its victim without walking the task
+ * list.  Each entry caches the RSS seen when it was last bucketed or
+ * picked.  The cache goes stale as soon as the task execs or grows, so
+ * the bucket a victim is picked from has its RSS re-read first.
+ */
+#define LOWMEM_NR_BUCKETS	(OOM_SCORE_ADJ_MAX - OOM_SCORE_ADJ_MIN + 1)
+#define lowmem_bucket(adj)	(OOM_SCORE_ADJ_MAX - (adj))
+
+static DEFINE_SPINLOCK(lowmem_lock);
+static struct hlist_head lowmem_buckets[LOWMEM_NR_BUCKETS];
+static DECLARE_BITMAP(lowmem_bucket_map, LOWMEM_NR_BUCKETS);
+static unsigned int lowmem_nr_tasks;
+
+static uint32_t lowmem_kill_count;
+static uint32_t lowmem_kill_latency_us;
+static uint32_t lowmem_kill_latency_max_us;
+static uint32_t lowmem_scans_avoided;
+
+enum {
+	LOWMEM_PRESSURE_NONE,
+	LOWMEM_PRESSURE_LOW,
+	LOWMEM_PRESSURE_MEDIUM,
+	LOWMEM_PRESSURE_CRITICAL,
+	LOWMEM_PRESSURE_NR_LEVELS,
+};
+
+static const char * const lowmem_pressure_names[] = {
+	[LOWMEM_PRESSURE_NONE]		= "none",
+	[LOWMEM_PRESSURE_LOW]		= "low",
+	[LOWMEM_PRESSURE_MEDIUM]	= "medium",
+	[LOWMEM_PRESSURE_CRITICAL]	= "critical",
+};
+
+/*
+ * Reclaim reports pages scanned and reclaimed.  Once a window's worth
+ * has been scanned, the share of scanned pages that could not be
+ * reclaimed and the free/file counts lowmem_shrink uses, with the
+ * minfree thresholds scaled up by pressure_margin percent so the
+ * event comes ahead of the kill, give the level of a new event.
+ */
+#define LOWMEM_PRESSURE_WIN	(SWAP_CLUSTER_MAX * 16)
+
+static uint32_t lowmem_pressure_medium = 60;
+static uint32_t lowmem_pressure_critical = 95;
+static uint32_t lowmem_pressure_margin = 125;
+
+struct lowmem_pressure_event {
+	unsigned int	seq;
+	int		level;
+	unsigned int	pressure;
+	int		other_free;
+	int		other_file;
+	ktime_t		time;
+};
+
+static DEFINE_SPINLOCK(lowmem_pressure_lock);
+static DECLARE_WAIT_QUEUE_HEAD(lowmem_pressure_wait);
+static unsigned long lowmem_pressure_scanned;
+static unsigned long lowmem_pressure_reclaimed;
+static struct lowmem_pressure_event lowmem_pressure_last;
+
+struct lowmem_pressure_reader {
+	int		min_level;
+	unsigned int	seq;
+};
 
 #define lowmem_print(level, x...)			\
 	do {						\
@@ -83,33 +171,388 @@ static void dump_tasks(void)
        }
 }
 
+static void lowmem_task_insert(struct task_struct *p, unsigned long rss)
+{
+	int bucket = lowmem_bucket(p->signal->oom_score_adj);
+
+	p->lmk_adj = p->signal->oom_score_adj;
+	p->lmk_rss = rss;
+	hlist_add_head(&p->lmk_node, &lowmem_buckets[bucket]);
+	__set_bit(bucket, lowmem_bucket_map);
+	lowmem_nr_tasks++;
+}
+
+static void lowmem_task_remove(struct task_struct *p)
+{
+	int bucket = lowmem_bucket(p->lmk_adj);
+
+	hlist_del_init(&p->lmk_node);
+	if (hlist_empty(&lowmem_buckets[bucket]))
+		__clear_bit(bucket, lowmem_bucket_map);
+	lowmem_nr_tasks--;
+}
+
+/* Called with tasklist_lock held for writing */
+void lowmem_task_fork(struct task_struct *p)
+{
+	INIT_HLIST_NODE(&p->lmk_node);
+	if (!thread_group_leader(p) || (p->flags & PF_KTHREAD))
+		return;
+
+	spin_lock(&lowmem_lock);
+	lowmem_task_insert(p, p->mm ? get_mm_rss(p->mm) : 0);
+	spin_unlock(&lowmem_lock);
+}
+
+/* Called with tasklist_lock held for writing */
+void lowmem_task_exit(struct task_struct *p)
+{
+	spin_lock(&lowmem_lock);
+	if (!hlist_unhashed(&p->lmk_node))
+		lowmem_task_remove(p);
+	spin_unlock(&lowmem_lock);
+}
+
+/* A non-leader thread took over the thread group in exec */
+void lowmem_task_replace(struct task_struct *old, struct task_struct *new)
+{
+	spin_lock(&lowmem_lock);
+	if (!hlist_unhashed(&old->lmk_node)) {
+		unsigned long rss = old->lmk_rss;
+
+		lowmem_task_remove(old);
+		lowmem_task_insert(new, rss);
+	}
+	spin_unlock(&lowmem_lock);
+}
+
+/*
+ * Moves the thread group of @p to the bucket for its current
+ * oom_score_adj.  The caller holds the siglock of @p and keeps @p->mm
+ * stable.
+ */
+void lowmem_adj_update(struct task_struct *p)
+{
+	unsigned long rss = p->mm ? get_mm_rss(p->mm) : 0;
+	struct task_struct *leader;
+
+	spin_lock(&lowmem_lock);
+	leader = p->group_leader;
+	if (!hlist_unhashed(&leader->lmk_node)) {
+		lowmem_task_remove(leader);
+		lowmem_task_insert(leader, rss);
+	}
+	spin_unlock(&lowmem_lock);
+}
+
+/*
+ * Re-reads the RSS of thread group @p under lowmem_lock.  proc takes
+ * task_lock before lowmem_lock, so task_lock is only tried here; if it
+ * is contended, the cached value is kept.
+ */
+static unsigned long lowmem_task_rss(struct task_struct *p)
+{
+	struct task_struct *t = p;
+	unsigned long rss = 0;
+
+	rcu_read_lock();
+	do {
+		if (!spin_trylock(&t->alloc_lock)) {
+			rss = p->lmk_rss;
+			break;
+		}
+		if (t->mm) {
+			rss = get_mm_rss(t->mm);
+			spin_unlock(&t->alloc_lock);
+			break;
+		}
+		spin_unlock(&t->alloc_lock);
+	} while_each_thread(p, t);
+	rcu_read_unlock();
+
+	return rss;
+}
+
+static void lowmem_set_rss(struct task_struct *p, unsigned long rss)
+{
+	spin_lock(&lowmem_lock);
+	if (!hlist_unhashed(&p->lmk_node))
+		p->lmk_rss = rss;
+	spin_unlock(&lowmem_lock);
+}
+
+/*
+ * Picks the thread group with the largest RSS from the highest bucket at
+ * or above @min_score_adj that holds a task with an mm.  The RSS of
+ * every task in the buckets looked at is refreshed on the way.
+ */
+static struct task_struct *lowmem_select(int min_score_adj,
+					 unsigned int *scanned)
+{
+	struct task_struct *p, *selected = NULL;
+	struct hlist_node *pos;
+	int bucket;
+
+	spin_lock(&lowmem_lock);
+	for_each_set_bit(bucket, lowmem_bucket_map,
+			 lowmem_bucket(min_score_adj) + 1) {
+		hlist_for_each_entry(p, pos, &lowmem_buckets[bucket],
+				     lmk_node) {
+			(*scanned)++;
+			p->lmk_rss = lowmem_task_rss(p);
+			if (p->lmk_rss &&
+			    (!selected || p->lmk_rss > selected->lmk_rss))
+				selected = p;
+		}
+		if (selected)
+			break;
+	}
+	if (selected)
+		get_task_struct(selected);
+	spin_unlock(&lowmem_lock);
+
+	return selected;
+}
+
+static bool lowmem_death_pending(void)
+{
+	struct task_struct *p;
+	bool ret = false;
+
+	if (!lowmem_deathpending_pid ||
+	    time_after(jiffies, lowmem_deathpending_timeout))
+		return false;
+
+	rcu_read_lock();
+	p = find_task_by_pid_ns(lowmem_deathpending_pid, &init_pid_ns);
+	if (p && test_tsk_thread_flag(p, TIF_MEMDIE)) {
+		lowmem_print(2, "%d (%s), oom_adj %d score_adj %d, is exiting, return\n"
+				, p->pid, p->comm, p->signal->oom_adj, p->signal->oom_score_adj);
+		ret = true;
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+
+static void lowmem_other_pages(int *other_free, int *other_file)
+{
+	*other_free = global_page_state(NR_FREE_PAGES);
+	*other_file = global_page_state(NR_FILE_PAGES) -
+		global_page_state(NR_SHMEM) - global_page_state(NR_MLOCK);
+}
+
+/*
+ * Returns the index of the first minfree level, scaled by @scale
+ * percent, that both counts are under, or -1 if there is none.
+ */
+static int lowmem_minfree_index(int other_free, int other_file, int scale,
+				int *array_size)
+{
+	int i;
+
+	*array_size = ARRAY_SIZE(lowmem_adj);
+	if (lowmem_adj_size < *array_size)
+		*array_size = lowmem_adj_size;
+	if (lowmem_minfree_size < *array_size)
+		*array_size = lowmem_minfree_size;
+	for (i = 0; i < *array_size; i++) {
+		int minfree = lowmem_minfree[i] * scale / 100;
+
+		if (other_free < minfree && other_file < minfree)
+			return i;
+	}
+
+	return -1;
+}
+
+void lowmem_vmpressure(unsigned long scanned, unsigned long reclaimed)
+{
+	struct lowmem_pressure_event *ev = &lowmem_pressure_last;
+	int array_size;
+	int level;
+	int i;
+
+	spin_lock(&lowmem_pressure_lock);
+	lowmem_pressure_scanned += scanned;
+	lowmem_pressure_reclaimed += reclaimed;
+	if (lowmem_pressure_scanned < LOWMEM_PRESSURE_WIN) {
+		spin_unlock(&lowmem_pressure_lock);
+		return;
+	}
+
+	scanned = lowmem_pressure_scanned;
+	reclaimed = min(lowmem_pressure_reclaimed, scanned);
+	lowmem_pressure_scanned = 0;
+	lowmem_pressure_reclaimed = 0;
+
+	ev->pressure = (scanned - reclaimed) * 100 / scanned;
+	if (ev->pressure >= lowmem_pressure_critical)
+		level = LOWMEM_PRESSURE_CRITICAL;
+	else if (ev->pressure >= lowmem_pressure_medium)
+		level = LOWMEM_PRESSURE_MEDIUM;
+	else
+		level = LOWMEM_PRESSURE_LOW;
+
+	lowmem_other_pages(&ev->other_free, &ev->other_file);
+	i = lowmem_minfree_index(ev->other_free, ev->other_file,
+				 lowmem_pressure_margin, &array_size);
+	if (i == 0)
+		level = LOWMEM_PRESSURE_CRITICAL;
+	else if (i > 0 && i < array_size - 1)
+		level = max(level, LOWMEM_PRESSURE_MEDIUM);
+
+	ev->level = level;
+	ev->time = ktime_get();
+	ev->seq++;
+	spin_unlock(&lowmem_pressure_lock);
+
+	if (waitqueue_active(&lowmem_pressure_wait))
+		wake_up_interruptible(&lowmem_pressure_wait);
+}
+
+static bool lowmem_pressure_pending(struct lowmem_pressure_reader *reader,
+				    struct lowmem_pressure_event *ev)
+{
+	bool ret;
+
+	spin_lock(&lowmem_pressure_lock);
+	ret = lowmem_pressure_last.seq != reader->seq &&
+		lowmem_pressure_last.level >= reader->min_level;
+	if (ret && ev)
+		*ev = lowmem_pressure_last;
+	spin_unlock(&lowmem_pressure_lock);
+
+	return ret;
+}
+
+static int lowmem_pressure_open(struct inode *inode, struct file *file)
+{
+	struct lowmem_pressure_reader *reader;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	reader->min_level = LOWMEM_PRESSURE_LOW;
+	spin_lock(&lowmem_pressure_lock);
+	reader->seq = lowmem_pressure_last.seq;
+	spin_unlock(&lowmem_pressure_lock);
+	file->private_data = reader;
+
+	return nonseekable_open(inode, file);
+}
+
+static int lowmem_pressure_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+static ssize_t lowmem_pressure_read(struct file *file, char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct lowmem_pressure_reader *reader = file->private_data;
+	struct lowmem_pressure_event ev;
+	char line[128];
+	int len;
+	int ret;
+
+	while (!lowmem_pressure_pending(reader, &ev)) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(lowmem_pressure_wait,
+				lowmem_pressure_pending(reader, NULL));
+		if (ret)
+			return ret;
+	}
+
+	len = scnprintf(line, sizeof(line),
+			"level=%s pressure=%u free=%d file=%d time=%lld\n",
+			lowmem_pressure_names[ev.level], ev.pressure,
+			ev.other_free, ev.other_file, ktime_to_ns(ev.time));
+	if (count < len)
+		return -EINVAL;
+	if (copy_to_user(buf, line, len))
+		return -EFAULT;
+	reader->seq = ev.seq;
+
+	return len;
+}
+
+static ssize_t lowmem_pressure_write(struct file *file,
+				     const char __user *buf, size_t count,
+				     loff_t *ppos)
+{
+	struct lowmem_pressure_reader *reader = file->private_data;
+	char level[16];
+	int i;
+
+	if (count >= sizeof(level))
+		return -EINVAL;
+	if (copy_from_user(level, buf, count))
+		return -EFAULT;
+	level[count] = '\0';
+
+	for (i = LOWMEM_PRESSURE_LOW; i < LOWMEM_PRESSURE_NR_LEVELS; i++) {
+		if (!strcmp(strim(level), lowmem_pressure_names[i])) {
+			reader->min_level = i;
+			return count;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static unsigned int lowmem_pressure_poll(struct file *file, poll_table *wait)
+{
+	struct lowmem_pressure_reader *reader = file->private_data;
+
+	poll_wait(file, &lowmem_pressure_wait, wait);
+	if (lowmem_pressure_pending(reader, NULL))
+		return POLLIN | POLLRDNORM;
+
+	return 0;
+}
+
+static const struct file_operations lowmem_pressure_fops = {
+	.owner = THIS_MODULE,
+	.open = lowmem_pressure_open,
+	.release = lowmem_pressure_release,
+	.read = lowmem_pressure_read,
+	.write = lowmem_pressure_write,
+	.poll = lowmem_pressure_poll,
+	.llseek = no_llseek,
+};
+
+static struct miscdevice lowmem_pressure_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "lowmem_pressure",
+	.fops = &lowmem_pressure_fops,
+};
+
 static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
-	struct task_struct *tsk;
+	struct task_struct *p;
 	struct task_struct *selected = NULL;
+	ktime_t start = ktime_get();
+	ktime_t latency;
 	int rem = 0;
-	int tasksize;
+	int tasksize = 0;
 	int i;
 	int min_score_adj = OOM_SCORE_ADJ_MAX + 1;
-	int selected_tasksize = 0;
 	int selected_oom_score_adj;
-	int selected_oom_adj = 0;
-	int array_size = ARRAY_SIZE(lowmem_adj);
-	int other_free = global_page_state(NR_FREE_PAGES);
-	int other_file = global_page_state(NR_FILE_PAGES) -
-		global_page_state(NR_SHMEM) - global_page_state(NR_MLOCK);
+	int selected_oom_adj;
+	unsigned int scanned = 0;
+	unsigned int latency_us;
+	int array_size;
+	int other_free;
+	int other_file;
 
-	if (lowmem_adj_size < array_size)
-		array_size = lowmem_adj_size;
-	if (lowmem_minfree_size < array_size)
-		array_size = lowmem_minfree_size;
-	for (i = 0; i < array_size; i++) {
-		if (other_free < lowmem_minfree[i] &&
-		    other_file < lowmem_minfree[i]) {
-			min_score_adj = lowmem_adj[i];
-			break;
-		}
-	}
+	lowmem_other_pages(&other_free, &other_file);
+	i = lowmem_minfree_index(other_free, other_file, 100, &array_size);
+	if (i >= 0)
+		min_score_adj = lowmem_adj[i];
 	if (sc->nr_to_scan > 0)
 		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d\n",
 				sc->nr_to_scan, sc->gfp_mask, other_free,
@@ -123,68 +566,59 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			     sc->nr_to_scan, sc->gfp_mask, rem);
 		return rem;
 	}
-	selected_oom_score_adj = min_score_adj;
-
-	rcu_read_lock();
-	for_each_process(tsk) {
-		struct task_struct *p;
-		int oom_score_adj;
-
-		if (tsk->flags & PF_KTHREAD)
-			continue;
+	if (min_score_adj < OOM_SCORE_ADJ_MIN)
+		min_score_adj = OOM_SCORE_ADJ_MIN;
 
-		p = find_lock_task_mm(tsk);
-		if (!p)
-			continue;
+	if (lowmem_death_pending())
+		return 0;
 
-		if (test_tsk_thread_flag(p, TIF_MEMDIE) &&
-		    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
-			lowmem_print(2, "%d (%s), oom_adj %d score_adj %d, is exiting, return\n"
-					, p->pid, p->comm, p->signal->oom_adj, p->signal->oom_score_adj);
+	/* the victim may have dropped its mm since it was picked */
+	while ((selected = lowmem_select(min_score_adj, &scanned))) {
+		p = find_lock_task_mm(selected);
+		if (p) {
+			tasksize = get_mm_rss(p->mm);
 			task_unlock(p);
-			rcu_read_unlock();
-			return 0;
-		}
-		oom_score_adj = p->signal->oom_score_adj;
-		if (oom_score_adj < min_score_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(p->mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_score_adj < selected_oom_score_adj)
-				continue;
-			if (oom_score_adj == selected_oom_score_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
+		} else {
+			tasksize = 0;
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_score_adj = oom_score_adj;
-		selected_oom_adj = p->signal->oom_adj;
-		lowmem_print(2, "select %d (%s), oom_adj %d score_adj %d, size %d, to kill\n",
-			     p->pid, p->comm, selected_oom_adj, oom_score_adj, tasksize);
+		lowmem_set_rss(selected, tasksize);
+		if (tasksize > 0)
+			break;
+		put_task_struct(selected);
 	}
+	if (lowmem_nr_tasks > scanned)
+		lowmem_scans_avoided += lowmem_nr_tasks - scanned;
+
 	if (selected) {
+		selected_oom_score_adj = selected->signal->oom_score_adj;
+		selected_oom_adj = selected->signal->oom_adj;
 		lowmem_print(1, "send sigkill to %d (%s), oom_adj %d, score_adj %d, size %d\n",
 			     selected->pid, selected->comm, selected_oom_adj,
-			     selected_oom_score_adj, selected_tasksize);
+			     selected_oom_score_adj, tasksize);
+		lowmem_deathpending_pid = selected->pid;
 		lowmem_deathpending_timeout = jiffies + HZ;
-		if (selected_oom_adj < 7)
-		{
+		send_sig(SIGKILL, selected, 0);
+		set_tsk_thread_flag(selected, TIF_MEMDIE);
+		rem -= tasksize;
+
+		latency = ktime_sub(ktime_get(), start);
+		latency_us = ktime_to_us(latency);
+		lowmem_kill_count++;
+		lowmem_kill_latency_us += latency_us;
+		if (latency_us > lowmem_kill_latency_max_us)
+			lowmem_kill_latency_max_us = latency_us;
+		trace_lowmemory_kill(selected, selected_oom_score_adj, tasksize,
+				     other_free, other_file, scanned,
+				     ktime_to_ns(latency));
+		put_task_struct(selected);
+
+		if (selected_oom_adj < 7) {
 			show_meminfo();
 			dump_tasks();
 		}
-		send_sig(SIGKILL, selected, 0);
-		set_tsk_thread_flag(selected, TIF_MEMDIE);
-		rem -= selected_tasksize;
 	}
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
-	rcu_read_unlock();
 	return rem;
 }
 
@@ -195,6 +629,11 @@ static struct shrinker lowmem_shrinker = {
 
 static int __init lowmem_init(void)
 {
+	int ret;
+
+	ret = misc_register(&lowmem_pressure_misc);
+	if (ret)
+		return ret;
 	register_shrinker(&lowmem_shrinker);
 	return 0;
 }
@@ -202,6 +641,7 @@ static int __init lowmem_init(void)
 static void __exit lowmem_exit(void)
 {
 	unregister_shrinker(&lowmem_shrinker);
+	misc_deregister(&lowmem_pressure_misc);
 }
 
 module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
@@ -210,6 +650,17 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(kill_count, lowmem_kill_count, uint, S_IRUGO);
+module_param_named(kill_latency_us, lowmem_kill_latency_us, uint, S_IRUGO);
+module_param_named(kill_latency_max_us, lowmem_kill_latency_max_us, uint,
+		   S_IRUGO);
+module_param_named(scans_avoided, lowmem_scans_avoided, uint, S_IRUGO);
+module_param_named(pressure_medium, lowmem_pressure_medium, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(pressure_critical, lowmem_pressure_critical, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(pressure_margin, lowmem_pressure_margin, uint,
+		   S_IRUGO | S_IWUSR);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
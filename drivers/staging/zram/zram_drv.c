@@ -25,11 +25,15 @@
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
+#include <linux/completion.h>
 #include <linux/device.h>
+#include <linux/fs.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
+#include <linux/crypto.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
@@ -133,41 +137,244 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+static struct zram_hash *zram_dedup_hash(struct zram *zram, u32 checksum)
+{
+	return &zram->hash[checksum & (zram->hash_size - 1)];
+}
+
+static u32 zram_dedup_checksum(unsigned char *mem)
+{
+	return jhash2((u32 *)mem, PAGE_SIZE / sizeof(u32), 0);
+}
+
+static int zram_dedup_match(struct zram *zram, struct zram_comp_stream *zstrm,
+			    struct zram_entry *entry, unsigned char *mem)
+{
+	int ret;
+	unsigned int clen = PAGE_SIZE;
+	unsigned char *cmem;
+
+	cmem = zs_map_object(zram->mem_pool, entry->handle);
+	ret = crypto_comp_decompress(zstrm->tfm,
+				     cmem + sizeof(struct zobj_header),
+				     entry->size, zstrm->buffer, &clen);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return !ret && clen == PAGE_SIZE &&
+		!memcmp(mem, zstrm->buffer, PAGE_SIZE);
+}
+
+/*
+ * Look for an object holding the same contents as @mem and take a
+ * reference to it. Candidates are confirmed by decompressing them into
+ * the stream buffer, which is still cheaper than compressing @mem.
+ */
+static struct zram_entry *zram_dedup_find(struct zram *zram,
+		struct zram_comp_stream *zstrm, unsigned char *mem,
+		u32 checksum)
+{
+	struct zram_hash *hash = zram_dedup_hash(zram, checksum);
+	struct zram_entry *entry;
+	struct rb_node *node, *prev;
+
+	spin_lock(&hash->lock);
+	node = hash->rb_root.rb_node;
+	while (node) {
+		entry = rb_entry(node, struct zram_entry, rb_node);
+		if (checksum == entry->checksum)
+			break;
+		node = checksum < entry->checksum ?
+			node->rb_left : node->rb_right;
+	}
+
+	/* Entries with equal checksums are adjacent in the tree */
+	while (node && (prev = rb_prev(node)) &&
+	       rb_entry(prev, struct zram_entry, rb_node)->checksum ==
+	       checksum)
+		node = prev;
+
+	for (; node; node = rb_next(node)) {
+		entry = rb_entry(node, struct zram_entry, rb_node);
+		if (entry->checksum != checksum)
+			break;
+		if (zram_dedup_match(zram, zstrm, entry, mem)) {
+			entry->refcount++;
+			spin_unlock(&hash->lock);
+			return entry;
+		}
+	}
+	spin_unlock(&hash->lock);
+
+	return NULL;
+}
+
+static struct zram_entry *zram_dedup_new(struct zram *zram, void *handle,
+					 u16 size, u32 checksum)
+{
+	struct zram_hash *hash = zram_dedup_hash(zram, checksum);
+	struct rb_node **rb_link, *parent = NULL;
+	struct zram_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->refcount = 1;
+	entry->handle = handle;
+	entry->size = size;
+
+	spin_lock(&hash->lock);
+	rb_link = &hash->rb_root.rb_node;
+	while (*rb_link) {
+		parent = *rb_link;
+		if (checksum < rb_entry(parent, struct zram_entry,
+					rb_node)->checksum)
+			rb_link = &parent->rb_left;
+		else
+			rb_link = &parent->rb_right;
+	}
+	rb_link_node(&entry->rb_node, parent, rb_link);
+	rb_insert_color(&entry->rb_node, &hash->rb_root);
+	spin_unlock(&hash->lock);
+
+	return entry;
+}
+
+static void zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_hash *hash = zram_dedup_hash(zram, entry->checksum);
+	unsigned long refcount;
+	u16 size = entry->size;
+
+	spin_lock(&hash->lock);
+	refcount = --entry->refcount;
+	if (!refcount)
+		rb_erase(&entry->rb_node, &hash->rb_root);
+	spin_unlock(&hash->lock);
+
+	if (refcount) {
+		zram_stat64_sub(zram, &zram->stats.dup_data_size, size);
+		return;
+	}
+
+	zs_free(zram->mem_pool, entry->handle);
+	zram_stat64_sub(zram, &zram->stats.compr_size, size);
+	kfree(entry);
+}
+
+/* zsmalloc handle of a compressed slot, looking through dedup entries */
+static void *zram_slot_handle(struct zram *zram, u32 index)
+{
+	void *handle = zram->table[index].handle;
+
+	if (zram_test_flag(zram, index, ZRAM_DEDUP))
+		return ((struct zram_entry *)handle)->handle;
+	return handle;
+}
+
+/* Block 0 is never handed out so that a written back handle is non-NULL */
+static unsigned long zram_alloc_block(struct zram *zram)
+{
+	unsigned long blk;
+
+	do {
+		blk = find_next_zero_bit(zram->bitmap, zram->nr_bd_pages, 1);
+		if (blk >= zram->nr_bd_pages)
+			return 0;
+	} while (test_and_set_bit(blk, zram->bitmap));
+
+	return blk;
+}
+
+static void zram_free_block(struct zram *zram, unsigned long blk)
+{
+	WARN_ON_ONCE(!test_and_clear_bit(blk, zram->bitmap));
+}
+
+static void zram_bdev_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+static int zram_bdev_rw(struct zram *zram, struct page *page,
+			unsigned long blk, int rw)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct bio *bio;
+	int ret;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_sector = (sector_t)blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = zram->backing_dev;
+	bio->bi_end_io = zram_bdev_end_io;
+	bio->bi_private = &done;
+	if (bio_add_page(bio, page, PAGE_SIZE, 0) != PAGE_SIZE) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	submit_bio(rw == READ ? READ_SYNC : WRITE_SYNC, bio);
+	wait_for_completion(&done);
+
+	ret = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+
+	if (!ret)
+		zram_stat64_inc(zram, rw == READ ? &zram->stats.bd_reads :
+					&zram->stats.bd_writes);
+	return ret;
+}
+
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	void *handle = zram->table[index].handle;
+	u16 size = zram->table[index].size;
 
 	if (unlikely(!handle)) {
 		/*
 		 * No memory is allocated for zero filled pages.
 		 * Simply clear zero page flag.
 		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
+		if (zram_test_flag(zram, index, ZRAM_ZERO))
 			zram_stat_dec(&zram->stats.pages_zero);
-		}
+		zram->table[index].flags = 0;
 		return;
 	}
 
+	if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+		zram_free_block(zram, (unsigned long)handle);
+		zram_stat_dec(&zram->stats.bd_count);
+		goto out;
+	}
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		__free_page(handle);
-		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
-		goto out;
+		zram_stat64_sub(zram, &zram->stats.compr_size, size);
+		goto out_stored;
 	}
 
-	zs_free(zram->mem_pool, handle);
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_dedup_put(zram, handle);
+	} else {
+		zs_free(zram->mem_pool, handle);
+		zram_stat64_sub(zram, &zram->stats.compr_size, size);
+	}
 
-	if (zram->table[index].size <= PAGE_SIZE / 2)
+	if (size <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
-out:
-	zram_stat64_sub(zram, &zram->stats.compr_size,
-			zram->table[index].size);
+out_stored:
 	zram_stat_dec(&zram->stats.pages_stored);
-
+out:
+	/* Also clears ZRAM_UNDER_WB, telling writeback the slot changed */
 	zram->table[index].handle = NULL;
 	zram->table[index].size = 0;
+	zram->table[index].flags = 0;
 }
 
 static void handle_zero_page(struct bio_vec *bvec)
@@ -203,17 +410,150 @@ static inline int is_partial_io(struct bio_vec *bvec)
 	return bvec->bv_len != PAGE_SIZE;
 }
 
+static struct zram_comp_stream *zram_comp_stream_get(struct zram *zram)
+{
+	struct zram_comp_stream *zstrm;
+
+	for (;;) {
+		spin_lock(&zram->streams_lock);
+		if (!list_empty(&zram->idle_streams)) {
+			zstrm = list_first_entry(&zram->idle_streams,
+					struct zram_comp_stream, list);
+			list_del(&zstrm->list);
+			spin_unlock(&zram->streams_lock);
+			return zstrm;
+		}
+		spin_unlock(&zram->streams_lock);
+
+		wait_event(zram->streams_wait,
+			   !list_empty_careful(&zram->idle_streams));
+	}
+}
+
+static void zram_comp_stream_put(struct zram *zram,
+				 struct zram_comp_stream *zstrm)
+{
+	spin_lock(&zram->streams_lock);
+	list_add(&zstrm->list, &zram->idle_streams);
+	spin_unlock(&zram->streams_lock);
+
+	wake_up(&zram->streams_wait);
+}
+
+static void zram_comp_streams_destroy(struct zram *zram)
+{
+	struct zram_comp_stream *zstrm, *tmp;
+
+	list_for_each_entry_safe(zstrm, tmp, &zram->idle_streams, list) {
+		list_del(&zstrm->list);
+		crypto_free_comp(zstrm->tfm);
+		free_pages((unsigned long)zstrm->buffer, 1);
+		kfree(zstrm);
+	}
+	zram->num_comp_streams = 0;
+}
+
+static int zram_comp_streams_create(struct zram *zram)
+{
+	struct zram_comp_stream *zstrm;
+	unsigned int i, num;
+
+	num = zram->max_comp_streams ?: num_online_cpus();
+	for (i = 0; i < num; i++) {
+		zstrm = kzalloc(sizeof(*zstrm), GFP_KERNEL);
+		if (!zstrm)
+			goto fail;
+
+		zstrm->tfm = crypto_alloc_comp(zram->compressor, 0, 0);
+		if (IS_ERR(zstrm->tfm)) {
+			kfree(zstrm);
+			goto fail;
+		}
+		/*
+		 * Two pages: compressing an incompressible page can produce
+		 * slightly more than PAGE_SIZE bytes.
+		 */
+		zstrm->buffer =
+			(void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+		if (!zstrm->buffer) {
+			crypto_free_comp(zstrm->tfm);
+			kfree(zstrm);
+			goto fail;
+		}
+
+		list_add(&zstrm->list, &zram->idle_streams);
+		zram->num_comp_streams++;
+	}
+
+	return 0;
+
+fail:
+	zram_comp_streams_destroy(zram);
+	return -ENOMEM;
+}
+
+static int zram_read_from_bdev(struct zram *zram, struct bio_vec *bvec,
+			       u32 index, int offset)
+{
+	int ret;
+	struct page *page;
+	unsigned char *user_mem, *mem;
+	unsigned long blk = (unsigned long)zram->table[index].handle;
+
+	if (!is_partial_io(bvec)) {
+		ret = zram_bdev_rw(zram, bvec->bv_page, blk, READ);
+		goto out;
+	}
+
+	page = alloc_page(GFP_NOIO);
+	if (!page) {
+		pr_info("Error allocating temp memory!\n");
+		return -ENOMEM;
+	}
+
+	ret = zram_bdev_rw(zram, page, blk, READ);
+	if (!ret) {
+		user_mem = kmap_atomic(bvec->bv_page);
+		mem = kmap_atomic(page);
+		memcpy(user_mem + bvec->bv_offset, mem + offset,
+		       bvec->bv_len);
+		kunmap_atomic(mem);
+		kunmap_atomic(user_mem);
+	}
+	__free_page(page);
+
+out:
+	if (unlikely(ret)) {
+		pr_err("Backing device read failed! err=%d, page=%u\n",
+		       ret, index);
+		zram_stat64_inc(zram, &zram->stats.failed_reads);
+		return ret;
+	}
+
+	flush_dcache_page(bvec->bv_page);
+	return 0;
+}
+
 static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 			  u32 index, int offset, struct bio *bio)
 {
 	int ret;
-	size_t clen;
+	unsigned int clen;
+	void *handle;
 	struct page *page;
 	struct zobj_header *zheader;
+	struct zram_comp_stream *zstrm;
 	unsigned char *user_mem, *cmem, *uncmem = NULL;
 
 	page = bvec->bv_page;
 
+	/*
+	 * Readers share zram->lock, so several may clear this bit at once,
+	 * but they all store the same value.  Every other flag change,
+	 * including frees from swap_slot_free_notify, takes the write lock.
+	 */
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+
 	if (zram_test_flag(zram, index, ZRAM_ZERO)) {
 		handle_zero_page(bvec);
 		return 0;
@@ -227,6 +567,9 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 		return 0;
 	}
 
+	if (unlikely(zram_test_flag(zram, index, ZRAM_WB)))
+		return zram_read_from_bdev(zram, bvec, index, offset);
+
 	/* Page is stored uncompressed since it's incompressible */
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		handle_uncompressed_page(zram, bvec, index, offset);
@@ -242,16 +585,20 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 		}
 	}
 
+	/* tfms keep per-call state, so decompression needs a stream too */
+	zstrm = zram_comp_stream_get(zram);
+
 	user_mem = kmap_atomic(page);
 	if (!is_partial_io(bvec))
 		uncmem = user_mem;
 	clen = PAGE_SIZE;
 
-	cmem = zs_map_object(zram->mem_pool, zram->table[index].handle);
+	handle = zram_slot_handle(zram, index);
+	cmem = zs_map_object(zram->mem_pool, handle);
 
-	ret = lzo1x_decompress_safe(cmem + sizeof(*zheader),
-				    zram->table[index].size,
-				    uncmem, &clen);
+	ret = crypto_comp_decompress(zstrm->tfm, cmem + sizeof(*zheader),
+				     zram->table[index].size,
+				     uncmem, &clen);
 
 	if (is_partial_io(bvec)) {
 		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
@@ -259,11 +606,12 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 		kfree(uncmem);
 	}
 
-	zs_unmap_object(zram->mem_pool, zram->table[index].handle);
+	zs_unmap_object(zram->mem_pool, handle);
 	kunmap_atomic(user_mem);
+	zram_comp_stream_put(zram, zstrm);
 
 	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
 		zram_stat64_inc(zram, &zram->stats.failed_reads);
 		return ret;
@@ -277,8 +625,11 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
 {
 	int ret;
-	size_t clen = PAGE_SIZE;
+	unsigned int clen = PAGE_SIZE;
+	void *handle;
+	struct page *page;
 	struct zobj_header *zheader;
+	struct zram_comp_stream *zstrm;
 	unsigned char *cmem;
 
 	if (zram_test_flag(zram, index, ZRAM_ZERO) ||
@@ -287,22 +638,43 @@ static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
 		return 0;
 	}
 
-	cmem = zs_map_object(zram->mem_pool, zram->table[index].handle);
+	if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+		page = alloc_page(GFP_NOIO);
+		if (!page)
+			return -ENOMEM;
+		ret = zram_bdev_rw(zram, page,
+				   (unsigned long)zram->table[index].handle,
+				   READ);
+		if (!ret) {
+			cmem = kmap_atomic(page);
+			memcpy(mem, cmem, PAGE_SIZE);
+			kunmap_atomic(cmem);
+		}
+		__free_page(page);
+		if (unlikely(ret))
+			zram_stat64_inc(zram, &zram->stats.failed_reads);
+		return ret;
+	}
 
 	/* Page is stored uncompressed since it's incompressible */
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		cmem = kmap_atomic(zram->table[index].handle);
 		memcpy(mem, cmem, PAGE_SIZE);
 		kunmap_atomic(cmem);
 		return 0;
 	}
 
-	ret = lzo1x_decompress_safe(cmem + sizeof(*zheader),
-				    zram->table[index].size,
-				    mem, &clen);
-	zs_unmap_object(zram->mem_pool, zram->table[index].handle);
+	zstrm = zram_comp_stream_get(zram);
+	handle = zram_slot_handle(zram, index);
+	cmem = zs_map_object(zram->mem_pool, handle);
+	ret = crypto_comp_decompress(zstrm->tfm, cmem + sizeof(*zheader),
+				     zram->table[index].size,
+				     mem, &clen);
+	zs_unmap_object(zram->mem_pool, handle);
+	zram_comp_stream_put(zram, zstrm);
 
 	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
 		zram_stat64_inc(zram, &zram->stats.failed_reads);
 		return ret;
@@ -311,19 +683,25 @@ static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
 	return 0;
 }
 
+/*
+ * Compression runs on a stream taken from the device pool and the object
+ * is filled in before zram->lock is taken, so only the table update is
+ * serialized against other readers and writers.
+ */
 static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			   int offset)
 {
 	int ret;
-	u32 store_offset;
-	size_t clen;
+	u32 checksum = 0;
+	unsigned int clen;
 	void *handle;
-	struct zobj_header *zheader;
-	struct page *page, *page_store;
+	struct page *page, *page_store = NULL;
+	struct zram_entry *entry = NULL;
+	struct zram_comp_stream *zstrm;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
+	int dup = 0;
 
 	page = bvec->bv_page;
-	src = zram->compress_buffer;
 
 	if (is_partial_io(bvec)) {
 		/*
@@ -336,20 +714,17 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			ret = -ENOMEM;
 			goto out;
 		}
+		down_read(&zram->lock);
 		ret = zram_read_before_write(zram, uncmem, index);
+		up_read(&zram->lock);
 		if (ret) {
 			kfree(uncmem);
 			goto out;
 		}
 	}
 
-	/*
-	 * System overwrites unused sectors. Free memory associated
-	 * with this sector now.
-	 */
-	if (zram->table[index].handle ||
-	    zram_test_flag(zram, index, ZRAM_ZERO))
-		zram_free_page(zram, index);
+	zstrm = zram_comp_stream_get(zram);
+	src = zstrm->buffer;
 
 	user_mem = kmap_atomic(page);
 
@@ -363,21 +738,45 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		kunmap_atomic(user_mem);
 		if (is_partial_io(bvec))
 			kfree(uncmem);
+		zram_comp_stream_put(zram, zstrm);
+
+		down_write(&zram->lock);
+		clear_bit(index, zram->free_pending);
+		if (zram->table[index].handle ||
+		    zram_test_flag(zram, index, ZRAM_ZERO))
+			zram_free_page(zram, index);
 		zram_stat_inc(&zram->stats.pages_zero);
 		zram_set_flag(zram, index, ZRAM_ZERO);
-		ret = 0;
-		goto out;
+		up_write(&zram->lock);
+		return 0;
 	}
 
-	ret = lzo1x_1_compress(uncmem, PAGE_SIZE, src, &clen,
-			       zram->compress_workmem);
+	if (zram->use_dedup) {
+		checksum = zram_dedup_checksum(uncmem);
+		entry = zram_dedup_find(zram, zstrm, uncmem, checksum);
+		if (entry) {
+			kunmap_atomic(user_mem);
+			if (is_partial_io(bvec))
+				kfree(uncmem);
+			zram_comp_stream_put(zram, zstrm);
+
+			handle = entry;
+			clen = entry->size;
+			dup = 1;
+			goto update;
+		}
+	}
+
+	clen = 2 * PAGE_SIZE;
+	ret = crypto_comp_compress(zstrm->tfm, uncmem, PAGE_SIZE, src, &clen);
 
 	kunmap_atomic(user_mem);
 	if (is_partial_io(bvec))
 			kfree(uncmem);
 
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Compression failed! err=%d\n", ret);
+		zram_comp_stream_put(zram, zstrm);
 		goto out;
 	}
 
@@ -387,6 +786,8 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	 * errors which has side effect of hanging the system.
 	 */
 	if (unlikely(clen > max_zpage_size)) {
+		zram_comp_stream_put(zram, zstrm);
+
 		clen = PAGE_SIZE;
 		page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
 		if (unlikely(!page_store)) {
@@ -396,52 +797,67 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			goto out;
 		}
 
-		store_offset = 0;
-		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_inc(&zram->stats.pages_expand);
 		handle = page_store;
 		src = kmap_atomic(page);
 		cmem = kmap_atomic(page_store);
-		goto memstore;
-	}
-
-	handle = zs_malloc(zram->mem_pool, clen + sizeof(*zheader));
-	if (!handle) {
-		pr_info("Error allocating memory for compressed "
-			"page: %u, size=%zu\n", index, clen);
-		ret = -ENOMEM;
-		goto out;
-	}
-	cmem = zs_map_object(zram->mem_pool, handle);
-
-memstore:
-#if 0
-	/* Back-reference needed for memory defragmentation */
-	if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-		zheader = (struct zobj_header *)cmem;
-		zheader->table_idx = index;
-		cmem += sizeof(*zheader);
-	}
-#endif
-
-	memcpy(cmem, src, clen);
-
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		memcpy(cmem, src, clen);
 		kunmap_atomic(cmem);
 		kunmap_atomic(src);
 	} else {
+		handle = zs_malloc(zram->mem_pool,
+				   clen + sizeof(struct zobj_header));
+		if (!handle) {
+			pr_info("Error allocating memory for compressed "
+				"page: %u, size=%u\n", index, clen);
+			zram_comp_stream_put(zram, zstrm);
+			ret = -ENOMEM;
+			goto out;
+		}
+		cmem = zs_map_object(zram->mem_pool, handle);
+		memcpy(cmem, src, clen);
 		zs_unmap_object(zram->mem_pool, handle);
+		zram_comp_stream_put(zram, zstrm);
+
+		/* Without an entry the object is simply not shared */
+		if (zram->use_dedup) {
+			entry = zram_dedup_new(zram, handle, clen, checksum);
+			if (entry)
+				handle = entry;
+		}
 	}
 
+update:
+	down_write(&zram->lock);
+
+	/*
+	 * System overwrites unused sectors. Free memory associated
+	 * with this sector now, which also settles a deferred free.
+	 */
+	clear_bit(index, zram->free_pending);
+	if (zram->table[index].handle ||
+	    zram_test_flag(zram, index, ZRAM_ZERO))
+		zram_free_page(zram, index);
+
 	zram->table[index].handle = handle;
 	zram->table[index].size = clen;
+	if (page_store) {
+		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+		zram_stat_inc(&zram->stats.pages_expand);
+	}
+	if (entry)
+		zram_set_flag(zram, index, ZRAM_DEDUP);
 
 	/* Update stats */
-	zram_stat64_add(zram, &zram->stats.compr_size, clen);
+	if (dup)
+		zram_stat64_add(zram, &zram->stats.dup_data_size, clen);
+	else
+		zram_stat64_add(zram, &zram->stats.compr_size, clen);
 	zram_stat_inc(&zram->stats.pages_stored);
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_inc(&zram->stats.good_compress);
 
+	up_write(&zram->lock);
+
 	return 0;
 
 out:
@@ -460,9 +876,7 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 		ret = zram_bvec_read(zram, bvec, index, offset, bio);
 		up_read(&zram->lock);
 	} else {
-		down_write(&zram->lock);
 		ret = zram_bvec_write(zram, bvec, index, offset);
-		up_write(&zram->lock);
 	}
 
 	return ret;
@@ -577,34 +991,195 @@ error:
 	bio_io_error(bio);
 }
 
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	int ret;
+	unsigned long nr_pages, *bitmap;
+	struct block_device *bdev;
+	char *name;
+
+	name = kstrdup(path, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+
+	bdev = blkdev_get_by_path(name, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				  zram);
+	if (IS_ERR(bdev)) {
+		ret = PTR_ERR(bdev);
+		goto free_name;
+	}
+
+	/* Block 0 is reserved, so at least two pages are needed */
+	nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (nr_pages < 2) {
+		ret = -EINVAL;
+		goto put_bdev;
+	}
+
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		ret = -ENOMEM;
+		goto put_bdev;
+	}
+
+	zram_reset_backing_dev(zram);
+	zram->backing_dev = bdev;
+	zram->backing_dev_path = name;
+	zram->bitmap = bitmap;
+	zram->nr_bd_pages = nr_pages;
+
+	pr_info("setup backing device %s\n", name);
+	return 0;
+
+put_bdev:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+free_name:
+	kfree(name);
+	return ret;
+}
+
+void zram_reset_backing_dev(struct zram *zram)
+{
+	if (!zram->backing_dev)
+		return;
+
+	blkdev_put(zram->backing_dev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	zram->backing_dev = NULL;
+	kfree(zram->backing_dev_path);
+	zram->backing_dev_path = NULL;
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+	zram->nr_bd_pages = 0;
+}
+
+void zram_mark_idle(struct zram *zram)
+{
+	size_t index;
+
+	down_write(&zram->lock);
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		if (zram->table[index].handle &&
+		    !zram_test_flag(zram, index, ZRAM_WB))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+	}
+	up_write(&zram->lock);
+}
+
+static int zram_wb_candidate(struct zram *zram, u32 index,
+			     enum zram_wb_mode mode)
+{
+	void *handle = zram->table[index].handle;
+
+	if (!handle || zram_test_flag(zram, index, ZRAM_WB) ||
+	    zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+	    test_bit(index, zram->free_pending))
+		return 0;
+
+	if (mode == ZRAM_WB_HUGE)
+		return zram_test_flag(zram, index, ZRAM_UNCOMPRESSED);
+
+	if (!zram_test_flag(zram, index, ZRAM_IDLE))
+		return 0;
+
+	/* Writing out a shared object frees nothing while others use it */
+	if (zram_test_flag(zram, index, ZRAM_DEDUP) &&
+	    ACCESS_ONCE(((struct zram_entry *)handle)->refcount) > 1)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Move the slots selected by @mode to the backing device. Each page is
+ * read under zram->lock and written out without it; the slot is only
+ * switched over if nothing freed or rewrote it meanwhile, which would
+ * have cleared ZRAM_UNDER_WB.
+ */
+int zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	int ret = 0;
+	size_t index;
+	unsigned long blk = 0;
+	struct page *page;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		if (!blk) {
+			blk = zram_alloc_block(zram);
+			if (!blk) {
+				ret = -ENOSPC;
+				break;
+			}
+		}
+
+		down_write(&zram->lock);
+		if (!zram_wb_candidate(zram, index, mode)) {
+			up_write(&zram->lock);
+			continue;
+		}
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		ret = zram_read_before_write(zram, page_address(page), index);
+		up_write(&zram->lock);
+
+		if (!ret)
+			ret = zram_bdev_rw(zram, page, blk, WRITE);
+
+		down_write(&zram->lock);
+		if (zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			if (!ret) {
+				zram_free_page(zram, index);
+				zram->table[index].handle = (void *)blk;
+				zram_set_flag(zram, index, ZRAM_WB);
+				zram_stat_inc(&zram->stats.bd_count);
+				blk = 0;
+			}
+		}
+		up_write(&zram->lock);
+
+		if (ret)
+			break;
+	}
+
+	if (blk)
+		zram_free_block(zram, blk);
+	__free_page(page);
+
+	return ret;
+}
+
 void __zram_reset_device(struct zram *zram)
 {
 	size_t index;
 
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
+	cancel_work_sync(&zram->free_work);
 
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Free various per-device buffers */
+	zram_comp_streams_destroy(zram);
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		void *handle = zram->table[index].handle;
-		if (!handle)
-			continue;
-
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(handle);
-		else
-			zs_free(zram->mem_pool, handle);
+		if (zram->table[index].handle)
+			zram_free_page(zram, index);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
+	vfree(zram->free_pending);
+	zram->free_pending = NULL;
+
+	vfree(zram->hash);
+	zram->hash = NULL;
+	zram->hash_size = 0;
+
+	zram_reset_backing_dev(zram);
+
 	zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
@@ -624,7 +1199,7 @@ void zram_reset_device(struct zram *zram)
 int zram_init_device(struct zram *zram)
 {
 	int ret;
-	size_t num_pages;
+	size_t i, num_pages;
 
 	down_write(&zram->init_lock);
 
@@ -635,18 +1210,9 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail_no_table;
-	}
-
-	zram->compress_buffer =
-		(void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
+	ret = zram_comp_streams_create(zram);
+	if (ret) {
+		pr_err("Error allocating compression streams!\n");
 		goto fail_no_table;
 	}
 
@@ -658,12 +1224,36 @@ int zram_init_device(struct zram *zram)
 		goto fail_no_table;
 	}
 
+	zram->free_pending = vzalloc(BITS_TO_LONGS(num_pages) *
+				     sizeof(unsigned long));
+	if (!zram->free_pending) {
+		pr_err("Error allocating zram free bitmap\n");
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	if (zram->use_dedup) {
+		zram->hash_size = roundup_pow_of_two(
+				max_t(size_t, num_pages >> ZRAM_HASH_SHIFT, 1));
+		zram->hash = vmalloc(zram->hash_size * sizeof(*zram->hash));
+		if (!zram->hash) {
+			pr_err("Error allocating dedup hash table\n");
+			ret = -ENOMEM;
+			goto fail;
+		}
+		for (i = 0; i < zram->hash_size; i++) {
+			spin_lock_init(&zram->hash[i].lock);
+			zram->hash[i].rb_root = RB_ROOT;
+		}
+	}
+
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = zs_create_pool("zram", GFP_NOIO | __GFP_HIGHMEM);
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name,
+					GFP_NOIO | __GFP_HIGHMEM);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -686,13 +1276,38 @@ fail:
 	return ret;
 }
 
+static void zram_free_pending(struct work_struct *work)
+{
+	struct zram *zram = container_of(work, struct zram, free_work);
+	unsigned long index;
+
+	down_write(&zram->lock);
+	for_each_set_bit(index, zram->free_pending,
+			 zram->disksize >> PAGE_SHIFT) {
+		clear_bit(index, zram->free_pending);
+		zram_free_page(zram, index);
+	}
+	up_write(&zram->lock);
+}
+
+/*
+ * Called under swap_lock, so it cannot sleep on zram->lock.  If the lock
+ * is busy the slot is marked and freed from a work item instead; a later
+ * write to the slot frees its contents itself and drops the mark.
+ */
 static void zram_slot_free_notify(struct block_device *bdev,
 				unsigned long index)
 {
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
-	zram_free_page(zram, index);
+	if (down_write_trylock(&zram->lock)) {
+		zram_free_page(zram, index);
+		up_write(&zram->lock);
+	} else {
+		set_bit(index, zram->free_pending);
+		schedule_work(&zram->free_work);
+	}
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -707,7 +1322,13 @@ static int create_device(struct zram *zram, int device_id)
 
 	init_rwsem(&zram->lock);
 	init_rwsem(&zram->init_lock);
+	INIT_WORK(&zram->free_work, zram_free_pending);
 	spin_lock_init(&zram->stat64_lock);
+	INIT_LIST_HEAD(&zram->idle_streams);
+	strlcpy(zram->compressor, default_compressor,
+		sizeof(zram->compressor));
+	spin_lock_init(&zram->streams_lock);
+	init_waitqueue_head(&zram->streams_wait);
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -844,6 +1465,7 @@ static void __exit zram_exit(void)
 		destroy_device(zram);
 		if (zram->init_done)
 			zram_reset_device(zram);
+		zram_reset_backing_dev(zram);
 	}
 
 	unregister_blkdev(zram_major, "zram");
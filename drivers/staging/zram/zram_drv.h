@@ -17,6 +17,11 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/rbtree.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/crypto.h>
 
 #include "../zsmalloc/zsmalloc.h"
 
@@ -43,12 +48,21 @@ struct zobj_header {
 /* Default zram disk size: 25% of total RAM */
 static const unsigned default_disksize_perc_ram = 25;
 
+/* Default compression algorithm, any crypto API compressor can be used */
+static const char default_compressor[] = "lzo";
+
 /*
  * Pages that compress to size greater than this are stored
  * uncompressed in memory.
  */
 static const size_t max_zpage_size = PAGE_SIZE / 4 * 3;
 
+/*
+ * Same-page merging hashes entries into one rb-tree per this many
+ * disk pages.
+ */
+#define ZRAM_HASH_SHIFT		10
+
 /*
  * NOTE: max_zpage_size must be less than or equal to:
  *   ZS_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
@@ -74,6 +88,18 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO,
 
+	/* handle points to a struct zram_entry shared with other slots */
+	ZRAM_DEDUP,
+
+	/* Page was written back, handle holds its backing device block */
+	ZRAM_WB,
+
+	/* Page was not accessed since the device was last marked idle */
+	ZRAM_IDLE,
+
+	/* Page is being written back to the backing device */
+	ZRAM_UNDER_WB,
+
 	__NR_ZRAM_PAGEFLAGS,
 };
 
@@ -99,15 +125,68 @@ struct zram_stats {
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
+	u64 dup_data_size;	/* compressed bytes saved by same-page merging */
+	u64 bd_reads;		/* pages read from the backing device */
+	u64 bd_writes;		/* pages written to the backing device */
+	u32 bd_count;		/* no. of pages currently written back */
+};
+
+/*
+ * A compressed object shared by every slot that stores the same page
+ * contents. Entries are looked up by a checksum of the uncompressed page.
+ */
+struct zram_entry {
+	struct rb_node rb_node;
+	u32 checksum;
+	unsigned long refcount;	/* protected by the zram_hash lock */
+	void *handle;		/* zsmalloc object */
+	u16 size;		/* object size (excluding header) */
+};
+
+struct zram_hash {
+	spinlock_t lock;
+	struct rb_root rb_root;
+};
+
+/* Slots picked by a writeback request */
+enum zram_wb_mode {
+	ZRAM_WB_HUGE,	/* pages stored uncompressed */
+	ZRAM_WB_IDLE,	/* pages not accessed since marked idle */
+};
+
+/*
+ * Compression transform and output buffer. A device keeps a pool
+ * of these, one per online CPU by default, so concurrent writes only
+ * serialize on the table update and not on compression itself.
+ */
+struct zram_comp_stream {
+	struct crypto_comp *tfm;
+	void *buffer;
+	struct list_head list;
 };
 
 struct zram {
 	struct zs_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct list_head idle_streams;
+	spinlock_t streams_lock;	/* protect idle_streams */
+	wait_queue_head_t streams_wait;
+	unsigned int max_comp_streams;	/* 0: one per online CPU */
+	unsigned int num_comp_streams;
+	char compressor[CRYPTO_MAX_ALG_NAME];	/* crypto API algorithm */
+	int use_dedup;			/* merge pages with equal contents */
+	struct zram_hash *hash;
+	size_t hash_size;		/* power of two */
+	/* Optional backing device idle or incompressible pages move to */
+	struct block_device *backing_dev;
+	char *backing_dev_path;
+	unsigned long *bitmap;		/* allocated backing device blocks */
+	unsigned long nr_bd_pages;
 	struct table *table;
+	/* Slots freed by swap while zram->lock was contended */
+	unsigned long *free_pending;
+	struct work_struct free_work;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct rw_semaphore lock; /* protect compression buffers and table
+	struct rw_semaphore lock; /* protect table and 32-bit stats
 				   * against concurrent read and writes */
 	struct request_queue *queue;
 	struct gendisk *disk;
@@ -131,5 +210,9 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void __zram_reset_device(struct zram *zram);
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_reset_backing_dev(struct zram *zram);
+extern void zram_mark_idle(struct zram *zram);
+extern int zram_writeback(struct zram *zram, enum zram_wb_mode mode);
 
 #endif
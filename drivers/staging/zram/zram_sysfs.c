@@ -15,6 +15,10 @@
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/mm.h>
+#include <linux/cpumask.h>
+#include <linux/crypto.h>
+#include <linux/slab.h>
+#include <linux/string.h>
 
 #include "zram_drv.h"
 
@@ -76,6 +80,231 @@ static ssize_t disksize_store(struct device *dev,
 	return len;
 }
 
+static ssize_t max_comp_streams_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned int num;
+
+	down_read(&zram->init_lock);
+	if (zram->init_done)
+		num = zram->num_comp_streams;
+	else
+		num = zram->max_comp_streams ?: num_online_cpus();
+	up_read(&zram->init_lock);
+
+	return sprintf(buf, "%u\n", num);
+}
+
+static ssize_t max_comp_streams_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned int num;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = kstrtouint(buf, 10, &num);
+	if (ret)
+		return ret;
+	if (!num)
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		up_write(&zram->init_lock);
+		pr_info("Cannot change max compression streams for "
+			"initialized device\n");
+		return -EBUSY;
+	}
+	zram->max_comp_streams = num;
+	up_write(&zram->init_lock);
+
+	return len;
+}
+
+/* Offered in comp_algorithm when the crypto API has them */
+static const char * const zram_compressors[] = {
+	"lzo",
+	"lz4",
+	"deflate",
+};
+
+static ssize_t comp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t sz = 0;
+	int i;
+
+	down_read(&zram->init_lock);
+	for (i = 0; i < ARRAY_SIZE(zram_compressors); i++) {
+		if (!strcmp(zram->compressor, zram_compressors[i]))
+			sz += sprintf(buf + sz, "[%s] ", zram_compressors[i]);
+		else if (crypto_has_comp(zram_compressors[i], 0, 0))
+			sz += sprintf(buf + sz, "%s ", zram_compressors[i]);
+	}
+	up_read(&zram->init_lock);
+
+	if (sz)
+		buf[sz - 1] = '\n';
+	return sz;
+}
+
+static ssize_t comp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	char name[CRYPTO_MAX_ALG_NAME];
+
+	strlcpy(name, buf, sizeof(name));
+	strim(name);
+	if (!crypto_has_comp(name, 0, 0))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		up_write(&zram->init_lock);
+		pr_info("Cannot change compression algorithm for "
+			"initialized device\n");
+		return -EBUSY;
+	}
+	strlcpy(zram->compressor, name, sizeof(zram->compressor));
+	up_write(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%d\n", zram->use_dedup);
+}
+
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned int val;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		up_write(&zram->init_lock);
+		pr_info("Cannot change dedup for initialized device\n");
+		return -EBUSY;
+	}
+	zram->use_dedup = !!val;
+	up_write(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t sz;
+
+	down_read(&zram->init_lock);
+	sz = sprintf(buf, "%s\n", zram->backing_dev_path ?: "none");
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret = 0;
+	char *path, *name;
+	struct zram *zram = dev_to_zram(dev);
+
+	path = kstrndup(buf, len, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+	name = strim(path);
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		pr_info("Cannot change backing device for "
+			"initialized device\n");
+		ret = -EBUSY;
+	} else if (!strcmp(name, "none")) {
+		zram_reset_backing_dev(zram);
+	} else {
+		ret = zram_set_backing_dev(zram, name);
+	}
+	up_write(&zram->init_lock);
+
+	kfree(path);
+	return ret ? ret : len;
+}
+
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret = -EINVAL;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (!sysfs_streq(buf, "all"))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (zram->init_done) {
+		zram_mark_idle(zram);
+		ret = len;
+	}
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	enum zram_wb_mode mode;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (sysfs_streq(buf, "huge"))
+		mode = ZRAM_WB_HUGE;
+	else if (sysfs_streq(buf, "idle"))
+		mode = ZRAM_WB_IDLE;
+	else
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!zram->init_done || !zram->backing_dev)
+		ret = -EINVAL;
+	else
+		ret = zram_writeback(zram, mode);
+	up_read(&zram->init_lock);
+
+	return ret ? ret : len;
+}
+
+static ssize_t compact_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	if (!zram->init_done) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+	zs_compact(zram->mem_pool);
+	up_read(&zram->init_lock);
+
+	return len;
+}
+
 static ssize_t initstate_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -180,6 +409,55 @@ static ssize_t compr_data_size_show(struct device *dev,
 		zram_stat64_read(zram, &zram->stats.compr_size));
 }
 
+static ssize_t pages_compacted_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	unsigned long val = 0;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	if (zram->init_done)
+		val = zs_get_pages_compacted(zram->mem_pool);
+	up_read(&zram->init_lock);
+
+	return sprintf(buf, "%lu\n", val);
+}
+
+static ssize_t dup_data_size_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.dup_data_size));
+}
+
+static ssize_t bd_count_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%u\n", zram->stats.bd_count);
+}
+
+static ssize_t bd_reads_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.bd_reads));
+}
+
+static ssize_t bd_writes_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.bd_writes));
+}
+
 static ssize_t mem_used_total_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -197,6 +475,17 @@ static ssize_t mem_used_total_show(struct device *dev,
 static DEVICE_ATTR(disksize, S_IRUGO | S_IWUSR,
 		disksize_show, disksize_store);
 static DEVICE_ATTR(initstate, S_IRUGO, initstate_show, NULL);
+static DEVICE_ATTR(max_comp_streams, S_IRUGO | S_IWUSR,
+		max_comp_streams_show, max_comp_streams_store);
+static DEVICE_ATTR(comp_algorithm, S_IRUGO | S_IWUSR,
+		comp_algorithm_show, comp_algorithm_store);
+static DEVICE_ATTR(use_dedup, S_IRUGO | S_IWUSR,
+		use_dedup_show, use_dedup_store);
+static DEVICE_ATTR(backing_dev, S_IRUGO | S_IWUSR,
+		backing_dev_show, backing_dev_store);
+static DEVICE_ATTR(idle, S_IWUSR, NULL, idle_store);
+static DEVICE_ATTR(writeback, S_IWUSR, NULL, writeback_store);
+static DEVICE_ATTR(compact, S_IWUSR, NULL, compact_store);
 static DEVICE_ATTR(reset, S_IWUSR, NULL, reset_store);
 static DEVICE_ATTR(num_reads, S_IRUGO, num_reads_show, NULL);
 static DEVICE_ATTR(num_writes, S_IRUGO, num_writes_show, NULL);
@@ -206,10 +495,22 @@ static DEVICE_ATTR(zero_pages, S_IRUGO, zero_pages_show, NULL);
 static DEVICE_ATTR(orig_data_size, S_IRUGO, orig_data_size_show, NULL);
 static DEVICE_ATTR(compr_data_size, S_IRUGO, compr_data_size_show, NULL);
 static DEVICE_ATTR(mem_used_total, S_IRUGO, mem_used_total_show, NULL);
+static DEVICE_ATTR(pages_compacted, S_IRUGO, pages_compacted_show, NULL);
+static DEVICE_ATTR(dup_data_size, S_IRUGO, dup_data_size_show, NULL);
+static DEVICE_ATTR(bd_count, S_IRUGO, bd_count_show, NULL);
+static DEVICE_ATTR(bd_reads, S_IRUGO, bd_reads_show, NULL);
+static DEVICE_ATTR(bd_writes, S_IRUGO, bd_writes_show, NULL);
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
 	&dev_attr_initstate.attr,
+	&dev_attr_max_comp_streams.attr,
+	&dev_attr_comp_algorithm.attr,
+	&dev_attr_use_dedup.attr,
+	&dev_attr_backing_dev.attr,
+	&dev_attr_idle.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_compact.attr,
 	&dev_attr_reset.attr,
 	&dev_attr_num_reads.attr,
 	&dev_attr_num_writes.attr,
@@ -219,6 +520,11 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_orig_data_size.attr,
 	&dev_attr_compr_data_size.attr,
 	&dev_attr_mem_used_total.attr,
+	&dev_attr_pages_compacted.attr,
+	&dev_attr_dup_data_size.attr,
+	&dev_attr_bd_count.attr,
+	&dev_attr_bd_reads.attr,
+	&dev_attr_bd_writes.attr,
 	NULL,
 };
 
@@ -17,13 +17,15 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
+#include <linux/debugfs.h>
 #include <linux/errno.h>
 #include <linux/highmem.h>
 #include <linux/init.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/string.h>
 #include <linux/slab.h>
-#include <asm/tlbflush.h>
-#include <asm/pgtable.h>
 #include <linux/cpumask.h>
 #include <linux/cpu.h>
 #include <linux/vmalloc.h>
@@ -40,9 +42,12 @@
 #define CLASS_IDX_MASK	((1 << CLASS_IDX_BITS) - 1)
 #define FULLNESS_MASK	((1 << FULLNESS_BITS) - 1)
 
-/* per-cpu VM mapping areas for zspage accesses that cross page boundaries */
+/* per-cpu buffers for zspage accesses that cross page boundaries */
 static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
 
+/* Handles are words holding an object's current location */
+static struct kmem_cache *zs_handle_cachep;
+
 static int is_first_page(struct page *page)
 {
 	return test_bit(PG_private, &page->flags);
@@ -122,6 +127,7 @@ static void insert_zspage(struct page *page, struct size_class *class,
 		list_add_tail(&page->lru, &(*head)->lru);
 
 	*head = page;
+	class->zspage_count[fullness]++;
 }
 
 static void remove_zspage(struct page *page, struct size_class *class,
@@ -143,6 +149,7 @@ static void remove_zspage(struct page *page, struct size_class *class,
 					struct page, lru);
 
 	list_del_init(&page->lru);
+	class->zspage_count[fullness]--;
 }
 
 static enum fullness_group fix_fullness_group(struct zs_pool *pool,
@@ -230,30 +237,60 @@ static struct page *get_next_page(struct page *page)
 	return next;
 }
 
-/* Encode <page, obj_idx> as a single handle value */
-static void *obj_location_to_handle(struct page *page, unsigned long obj_idx)
+/* Encode <page, obj_idx> as a single location value */
+static unsigned long location_to_obj(struct page *page, unsigned long obj_idx)
 {
-	unsigned long handle;
+	unsigned long obj;
 
 	if (!page) {
 		BUG_ON(obj_idx);
-		return NULL;
+		return 0;
 	}
 
-	handle = page_to_pfn(page) << OBJ_INDEX_BITS;
-	handle |= (obj_idx & OBJ_INDEX_MASK);
+	obj = page_to_pfn(page) << OBJ_INDEX_BITS;
+	obj |= (obj_idx & OBJ_INDEX_MASK);
+	obj <<= OBJ_TAG_BITS;
 
-	return (void *)handle;
+	return obj;
 }
 
-/* Decode <page, obj_idx> pair from the given object handle */
-static void obj_handle_to_location(void *handle, struct page **page,
+/* Decode <page, obj_idx> pair from the given object location */
+static void obj_to_location(unsigned long obj, struct page **page,
 				unsigned long *obj_idx)
 {
-	unsigned long hval = (unsigned long)handle;
+	obj >>= OBJ_TAG_BITS;
+	*page = pfn_to_page(obj >> OBJ_INDEX_BITS);
+	*obj_idx = obj & OBJ_INDEX_MASK;
+}
+
+/* Only stable while the handle is pinned or its class lock is held */
+static unsigned long handle_to_obj(void *handle)
+{
+	return ACCESS_ONCE(*(unsigned long *)handle) &
+		~(1UL << HANDLE_PIN_BIT);
+}
+
+/* Point @handle at @obj, keeping the pin bit, which the caller holds */
+static void record_obj(void *handle, unsigned long obj)
+{
+	unsigned long *p = handle;
 
-	*page = pfn_to_page(hval >> OBJ_INDEX_BITS);
-	*obj_idx = hval & OBJ_INDEX_MASK;
+	ACCESS_ONCE(*p) = obj | (*p & (1UL << HANDLE_PIN_BIT));
+}
+
+static void pin_tag(void *handle)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static int trypin_tag(void *handle)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static void unpin_tag(void *handle)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, (unsigned long *)handle);
 }
 
 static unsigned long obj_idx_to_offset(struct page *page,
@@ -330,7 +367,7 @@ static void init_zspage(struct page *first_page, struct size_class *class)
 		for (i = 1; i <= objs_on_page; i++) {
 			off += class->size;
 			if (off < PAGE_SIZE) {
-				link->next = obj_location_to_handle(page, i);
+				link->next = location_to_obj(page, i);
 				link += class->size / sizeof(*link);
 			}
 		}
@@ -341,7 +378,7 @@ static void init_zspage(struct page *first_page, struct size_class *class)
 		 * page (if present)
 		 */
 		next_page = get_next_page(page);
-		link->next = obj_location_to_handle(next_page, 0);
+		link->next = location_to_obj(next_page, 0);
 		kunmap_atomic(link);
 		page = next_page;
 		off = (off + class->size) % PAGE_SIZE;
@@ -396,7 +433,7 @@ static struct page *alloc_zspage(struct size_class *class, gfp_t flags)
 
 	init_zspage(first_page, class);
 
-	first_page->freelist = obj_location_to_handle(first_page, 0);
+	first_page->freelist = (void *)location_to_obj(first_page, 0);
 	/* Maximum number of objects we can store in this zspage */
 	first_page->objects = class->zspage_order * PAGE_SIZE / class->size;
 
@@ -425,6 +462,493 @@ static struct page *find_get_zspage(struct size_class *class)
 	return page;
 }
 
+/*
+ * Take the first free object of a zspage and store @handle in its
+ * header. Called with class->lock held.
+ */
+static unsigned long obj_malloc(struct page *first_page,
+				struct size_class *class, void *handle)
+{
+	unsigned long obj;
+	struct link_free *link;
+	struct page *m_page;
+	unsigned long m_objidx, m_offset;
+
+	obj = (unsigned long)first_page->freelist;
+	obj_to_location(obj, &m_page, &m_objidx);
+	m_offset = obj_idx_to_offset(m_page, m_objidx, class->size);
+
+	link = (struct link_free *)kmap_atomic(m_page) +
+					m_offset / sizeof(*link);
+	first_page->freelist = (void *)link->next;
+	link->next = (unsigned long)handle | OBJ_ALLOCATED_TAG;
+	kunmap_atomic(link);
+
+	first_page->inuse++;
+	class->objs_inuse++;
+
+	return obj;
+}
+
+/* Called with class->lock held */
+static void obj_free(struct size_class *class, unsigned long obj)
+{
+	struct link_free *link;
+	struct page *first_page, *f_page;
+	unsigned long f_objidx, f_offset;
+
+	obj_to_location(obj, &f_page, &f_objidx);
+	first_page = get_first_page(f_page);
+	f_offset = obj_idx_to_offset(f_page, f_objidx, class->size);
+
+	/* Insert this object in containing zspage's freelist */
+	link = (struct link_free *)((unsigned char *)kmap_atomic(f_page)
+							+ f_offset);
+	link->next = (unsigned long)first_page->freelist;
+	kunmap_atomic(link);
+	first_page->freelist = (void *)obj;
+
+	first_page->inuse--;
+	class->objs_inuse--;
+}
+
+/*
+ * Compaction
+ *
+ * Objects are moved out of sparsely used zspages into the free slots
+ * of other zspages of the same class; source zspages left empty are
+ * freed. Both zspages are taken off the fullness lists for the move and
+ * everything happens under class->lock. Objects pinned by a concurrent
+ * map or free are skipped, so a source zspage may have to stay.
+ */
+struct zs_compact_control {
+	/* Source page being scanned and the index to resume from */
+	struct page *s_page;
+	int index;
+	/* First page of the destination zspage */
+	struct page *d_page;
+};
+
+/* Number of pages that could be freed by packing this class tightly */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	unsigned long obj_allocated, obj_wasted;
+
+	obj_allocated = (unsigned long)class->pages_allocated /
+			class->zspage_order * class->objs_per_zspage;
+	obj_wasted = obj_allocated - class->objs_inuse;
+
+	return obj_wasted / class->objs_per_zspage * class->zspage_order;
+}
+
+/*
+ * Find the next allocated object at or after *index on @page and pin
+ * its handle. Objects starting on the last page of a zspage must end
+ * on it too; anything after them is unused space.
+ */
+static void *find_alloced_obj(struct size_class *class, struct page *page,
+				int *index)
+{
+	unsigned long head, offset = 0;
+	int idx = *index;
+	void *handle = NULL;
+	unsigned char *addr;
+
+	if (!is_first_page(page))
+		offset = page->index;
+	offset += class->size * idx;
+
+	addr = kmap_atomic(page);
+	while (offset < PAGE_SIZE && (!is_last_page(page) ||
+				      offset + class->size <= PAGE_SIZE)) {
+		head = ((struct link_free *)(addr + offset))->next;
+		if (head & OBJ_ALLOCATED_TAG) {
+			handle = (void *)(head & ~OBJ_ALLOCATED_TAG);
+			if (trypin_tag(handle))
+				break;
+			handle = NULL;
+		}
+		offset += class->size;
+		idx++;
+	}
+	kunmap_atomic(addr);
+
+	*index = idx;
+	return handle;
+}
+
+/* Copy an object, either end of which may span two pages */
+static void zs_object_copy(unsigned long dst, unsigned long src,
+				struct size_class *class)
+{
+	struct page *s_page, *d_page;
+	unsigned long s_objidx, d_objidx;
+	unsigned long s_off, d_off;
+	unsigned char *s_addr, *d_addr;
+	int s_size, d_size, size;
+	int written = 0;
+
+	s_size = d_size = class->size;
+
+	obj_to_location(src, &s_page, &s_objidx);
+	obj_to_location(dst, &d_page, &d_objidx);
+
+	s_off = obj_idx_to_offset(s_page, s_objidx, class->size);
+	d_off = obj_idx_to_offset(d_page, d_objidx, class->size);
+
+	if (s_off + class->size > PAGE_SIZE)
+		s_size = PAGE_SIZE - s_off;
+	if (d_off + class->size > PAGE_SIZE)
+		d_size = PAGE_SIZE - d_off;
+
+	s_addr = kmap_atomic(s_page);
+	d_addr = kmap_atomic(d_page);
+
+	for (;;) {
+		size = min(s_size, d_size);
+		memcpy(d_addr + d_off, s_addr + s_off, size);
+		written += size;
+
+		if (written == class->size)
+			break;
+
+		s_off += size;
+		s_size -= size;
+		d_off += size;
+		d_size -= size;
+
+		/* kmap_atomic() mappings must be released in reverse order */
+		if (s_off >= PAGE_SIZE) {
+			kunmap_atomic(d_addr);
+			kunmap_atomic(s_addr);
+			s_page = get_next_page(s_page);
+			BUG_ON(!s_page);
+			s_addr = kmap_atomic(s_page);
+			d_addr = kmap_atomic(d_page);
+			s_size = class->size - written;
+			s_off = 0;
+		}
+
+		if (d_off >= PAGE_SIZE) {
+			kunmap_atomic(d_addr);
+			d_page = get_next_page(d_page);
+			BUG_ON(!d_page);
+			d_addr = kmap_atomic(d_page);
+			d_size = class->size - written;
+			d_off = 0;
+		}
+	}
+
+	kunmap_atomic(d_addr);
+	kunmap_atomic(s_addr);
+}
+
+/*
+ * Move objects from cc->s_page onwards into cc->d_page. Returns 0 once
+ * the source zspage has been scanned to the end, or -ENOMEM when the
+ * destination zspage fills up first.
+ */
+static int migrate_zspage(struct size_class *class,
+				struct zs_compact_control *cc)
+{
+	void *handle;
+	unsigned long used_obj, free_obj;
+	struct page *s_page = cc->s_page;
+	struct page *d_page = cc->d_page;
+	int index = cc->index;
+	int ret = 0;
+
+	for (;;) {
+		handle = find_alloced_obj(class, s_page, &index);
+		if (!handle) {
+			s_page = get_next_page(s_page);
+			if (!s_page)
+				break;
+			index = 0;
+			continue;
+		}
+
+		if (d_page->inuse == d_page->objects) {
+			unpin_tag(handle);
+			ret = -ENOMEM;
+			break;
+		}
+
+		used_obj = handle_to_obj(handle);
+		free_obj = obj_malloc(d_page, class, handle);
+		zs_object_copy(free_obj, used_obj, class);
+		index++;
+		record_obj(handle, free_obj);
+		unpin_tag(handle);
+		obj_free(class, used_obj);
+	}
+
+	cc->s_page = s_page;
+	cc->index = index;
+
+	return ret;
+}
+
+static struct page *isolate_source_page(struct size_class *class)
+{
+	struct page *page;
+
+	page = class->fullness_list[ZS_ALMOST_EMPTY];
+	if (page)
+		remove_zspage(page, class, ZS_ALMOST_EMPTY);
+
+	return page;
+}
+
+static struct page *isolate_target_page(struct size_class *class)
+{
+	int i;
+	struct page *page;
+
+	for (i = 0; i < _ZS_NR_FULLNESS_GROUPS; i++) {
+		page = class->fullness_list[i];
+		if (page) {
+			remove_zspage(page, class, i);
+			return page;
+		}
+	}
+
+	return NULL;
+}
+
+static enum fullness_group putback_zspage(struct size_class *class,
+					  struct page *first_page)
+{
+	enum fullness_group fullness;
+
+	fullness = get_fullness_group(first_page);
+	insert_zspage(first_page, class, fullness);
+	set_zspage_mapping(first_page, class->index, fullness);
+
+	return fullness;
+}
+
+/* Stops once @nr_to_free pages are freed, or at most one zspage more */
+static unsigned long __zs_compact(struct size_class *class,
+				  unsigned long nr_to_free)
+{
+	struct zs_compact_control cc;
+	struct page *src_page, *dst_page;
+	unsigned long nr_freed = 0;
+
+	spin_lock(&class->lock);
+	while (nr_freed < nr_to_free && zs_can_compact(class) &&
+	       (src_page = isolate_source_page(class))) {
+		cc.s_page = src_page;
+		cc.index = 0;
+
+		while ((dst_page = isolate_target_page(class))) {
+			cc.d_page = dst_page;
+			if (!migrate_zspage(class, &cc))
+				break;
+			putback_zspage(class, dst_page);
+		}
+
+		if (dst_page)
+			putback_zspage(class, dst_page);
+
+		if (putback_zspage(class, src_page) == ZS_EMPTY) {
+			class->pages_allocated -= class->zspage_order;
+			class->pages_compacted += class->zspage_order;
+			nr_freed += class->zspage_order;
+			free_zspage(src_page);
+		}
+
+		/* Ran out of destination space */
+		if (!dst_page)
+			break;
+
+		spin_unlock(&class->lock);
+		cond_resched();
+		spin_lock(&class->lock);
+	}
+	spin_unlock(&class->lock);
+
+	return nr_freed;
+}
+
+static unsigned long zs_compact_pool(struct zs_pool *pool,
+				     unsigned long nr_to_free)
+{
+	int i;
+	unsigned long nr_freed = 0;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0 && nr_freed < nr_to_free; i--)
+		nr_freed += __zs_compact(&pool->size_class[i],
+					 nr_to_free - nr_freed);
+
+	atomic_long_add(nr_freed, &pool->pages_compacted);
+
+	return nr_freed;
+}
+
+/**
+ * zs_compact - Free zspages by moving objects between them.
+ * @pool: pool to compact
+ *
+ * Returns the number of pages freed.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	return zs_compact_pool(pool, ULONG_MAX);
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+unsigned long zs_get_pages_compacted(struct zs_pool *pool)
+{
+	return atomic_long_read(&pool->pages_compacted);
+}
+EXPORT_SYMBOL_GPL(zs_get_pages_compacted);
+
+static int zs_shrinker_shrink(struct shrinker *shrinker,
+				struct shrink_control *sc)
+{
+	int i;
+	unsigned long pages = 0;
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+					    shrinker);
+
+	if (sc->nr_to_scan)
+		zs_compact_pool(pool, sc->nr_to_scan);
+
+	/*
+	 * pages_allocated is 64-bit and objs_inuse must not be newer than
+	 * it, so each class is read under its lock.
+	 */
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock(&class->lock);
+		pages += zs_can_compact(class);
+		spin_unlock(&class->lock);
+	}
+
+	return min_t(unsigned long, pages, INT_MAX);
+}
+
+#ifdef CONFIG_ZSMALLOC_STAT
+static struct dentry *zs_stat_root;
+
+static int zs_stats_classes_show(struct seq_file *s, void *v)
+{
+	int i;
+	struct zs_pool *pool = s->private;
+	unsigned long almost_full, almost_empty, obj_allocated, obj_used;
+	unsigned long pages_used, compacted;
+	unsigned long total_objs = 0, total_used_objs = 0;
+	unsigned long total_pages = 0, total_compacted = 0;
+
+	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s %10s\n",
+		   "class", "size", "almost_full", "almost_empty",
+		   "obj_allocated", "obj_used", "pages_used",
+		   "pages_per_zspage", "compacted");
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock(&class->lock);
+		almost_full = class->zspage_count[ZS_ALMOST_FULL];
+		almost_empty = class->zspage_count[ZS_ALMOST_EMPTY];
+		pages_used = class->pages_allocated;
+		obj_allocated = pages_used / class->zspage_order *
+				class->objs_per_zspage;
+		obj_used = class->objs_inuse;
+		compacted = class->pages_compacted;
+		spin_unlock(&class->lock);
+
+		if (!pages_used && !compacted)
+			continue;
+
+		seq_printf(s, " %5u %5u %11lu %12lu %13lu %10lu %10lu %16d %10lu\n",
+			   i, class->size, almost_full, almost_empty,
+			   obj_allocated, obj_used, pages_used,
+			   class->zspage_order, compacted);
+
+		total_objs += obj_allocated;
+		total_used_objs += obj_used;
+		total_pages += pages_used;
+		total_compacted += compacted;
+	}
+
+	seq_puts(s, "\n");
+	seq_printf(s, " %5s %5s %11s %12s %13lu %10lu %10lu %16s %10lu\n",
+		   "Total", "", "", "", total_objs, total_used_objs,
+		   total_pages, "", total_compacted);
+
+	return 0;
+}
+
+static int zs_stats_classes_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_stats_classes_show, inode->i_private);
+}
+
+static const struct file_operations zs_stats_classes_fops = {
+	.open		= zs_stats_classes_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void zs_stat_init(void)
+{
+	zs_stat_root = debugfs_create_dir("zsmalloc", NULL);
+	if (!zs_stat_root)
+		pr_warning("debugfs 'zsmalloc' stat dir creation failed\n");
+}
+
+static void zs_stat_exit(void)
+{
+	debugfs_remove_recursive(zs_stat_root);
+}
+
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+	struct dentry *entry;
+
+	if (!zs_stat_root)
+		return;
+
+	entry = debugfs_create_dir(pool->name, zs_stat_root);
+	if (!entry) {
+		pr_warning("debugfs dir <%s> creation failed\n", pool->name);
+		return;
+	}
+	pool->stat_dentry = entry;
+
+	if (!debugfs_create_file("classes", S_IFREG | S_IRUGO,
+				 pool->stat_dentry, pool,
+				 &zs_stats_classes_fops))
+		pr_warning("%s: debugfs file entry <classes> creation "
+			   "failed\n", pool->name);
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+	debugfs_remove_recursive(pool->stat_dentry);
+}
+#else
+static void zs_stat_init(void)
+{
+}
+
+static void zs_stat_exit(void)
+{
+}
+
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+}
+#endif
 
 static int zs_cpu_notifier(struct notifier_block *nb, unsigned long action,
 				void *pcpu)
@@ -435,18 +959,17 @@ static int zs_cpu_notifier(struct notifier_block *nb, unsigned long action,
 	switch (action) {
 	case CPU_UP_PREPARE:
 		area = &per_cpu(zs_map_area, cpu);
-		if (area->vm)
+		if (area->vm_buf)
 			break;
-		area->vm = alloc_vm_area(2 * PAGE_SIZE, area->vm_ptes);
-		if (!area->vm)
+		area->vm_buf = (char *)__get_free_page(GFP_KERNEL);
+		if (!area->vm_buf)
 			return notifier_from_errno(-ENOMEM);
 		break;
 	case CPU_DEAD:
 	case CPU_UP_CANCELED:
 		area = &per_cpu(zs_map_area, cpu);
-		if (area->vm)
-			free_vm_area(area->vm);
-		area->vm = NULL;
+		free_page((unsigned long)area->vm_buf);
+		area->vm_buf = NULL;
 		break;
 	}
 
@@ -464,12 +987,24 @@ static void zs_exit(void)
 	for_each_online_cpu(cpu)
 		zs_cpu_notifier(NULL, CPU_DEAD, (void *)(long)cpu);
 	unregister_cpu_notifier(&zs_cpu_nb);
+
+	zs_stat_exit();
+	if (zs_handle_cachep)
+		kmem_cache_destroy(zs_handle_cachep);
+	zs_handle_cachep = NULL;
 }
 
 static int zs_init(void)
 {
 	int cpu, ret;
 
+	zs_handle_cachep = kmem_cache_create("zs_handle", ZS_HANDLE_SIZE,
+					     0, 0, NULL);
+	if (!zs_handle_cachep)
+		return -ENOMEM;
+
+	zs_stat_init();
+
 	register_cpu_notifier(&zs_cpu_nb);
 	for_each_online_cpu(cpu) {
 		ret = zs_cpu_notifier(NULL, CPU_UP_PREPARE, (void *)(long)cpu);
@@ -508,11 +1043,19 @@ struct zs_pool *zs_create_pool(const char *name, gfp_t flags)
 		class->index = i;
 		spin_lock_init(&class->lock);
 		class->zspage_order = get_zspage_order(size);
-
+		class->objs_per_zspage = class->zspage_order * PAGE_SIZE /
+					 size;
 	}
 
 	pool->flags = flags;
 	pool->name = name;
+	atomic_long_set(&pool->pages_compacted, 0);
+
+	pool->shrinker.shrink = zs_shrinker_shrink;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	zs_pool_stat_create(pool);
 
 	return pool;
 }
@@ -522,6 +1065,9 @@ void zs_destroy_pool(struct zs_pool *pool)
 {
 	int i;
 
+	unregister_shrinker(&pool->shrinker);
+	zs_pool_stat_destroy(pool);
+
 	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
 		int fg;
 		struct size_class *class = &pool->size_class[i];
@@ -542,28 +1088,32 @@ EXPORT_SYMBOL_GPL(zs_destroy_pool);
  * zs_malloc - Allocate block of given size from pool.
  * @pool: pool to allocate from
  * @size: size of block to allocate
- * @page: page no. that holds the object
- * @offset: location of object within page
  *
- * On success, <page, offset> identifies block allocated
- * and 0 is returned. On failure, <page, offset> is set to
- * 0 and -ENOMEM is returned.
+ * On success, a handle to the allocated block is returned; it must
+ * be mapped with zs_map_object() to access the block. On failure,
+ * NULL is returned.
  *
- * Allocation requests with size > ZS_MAX_ALLOC_SIZE will fail.
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * will fail.
  */
 void *zs_malloc(struct zs_pool *pool, size_t size)
 {
-	void *obj;
-	struct link_free *link;
+	void *handle;
+	unsigned long obj;
 	int class_idx;
 	struct size_class *class;
+	struct page *first_page;
 
-	struct page *first_page, *m_page;
-	unsigned long m_objidx, m_offset;
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return NULL;
 
-	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+	handle = kmem_cache_alloc(zs_handle_cachep,
+				  pool->flags & ~__GFP_HIGHMEM);
+	if (unlikely(!handle))
 		return NULL;
 
+	/* The object header holds the handle */
+	size += ZS_HANDLE_SIZE;
 	class_idx = get_size_class_index(size);
 	class = &pool->size_class[class_idx];
 	BUG_ON(class_idx != class->index);
@@ -574,79 +1124,108 @@ void *zs_malloc(struct zs_pool *pool, size_t size)
 	if (!first_page) {
 		spin_unlock(&class->lock);
 		first_page = alloc_zspage(class, pool->flags);
-		if (unlikely(!first_page))
+		if (unlikely(!first_page)) {
+			kmem_cache_free(zs_handle_cachep, handle);
 			return NULL;
+		}
 
 		set_zspage_mapping(first_page, class->index, ZS_EMPTY);
 		spin_lock(&class->lock);
 		class->pages_allocated += class->zspage_order;
 	}
 
-	obj = first_page->freelist;
-	obj_handle_to_location(obj, &m_page, &m_objidx);
-	m_offset = obj_idx_to_offset(m_page, m_objidx, class->size);
-
-	link = (struct link_free *)kmap_atomic(m_page) +
-					m_offset / sizeof(*link);
-	first_page->freelist = link->next;
-	memset(link, POISON_INUSE, sizeof(*link));
-	kunmap_atomic(link);
+	obj = obj_malloc(first_page, class, handle);
+	/* Compaction may look at this handle as soon as the lock drops */
+	*(unsigned long *)handle = obj;
 
-	first_page->inuse++;
 	/* Now move the zspage to another fullness group, if required */
 	fix_fullness_group(pool, first_page);
 	spin_unlock(&class->lock);
 
-	return obj;
+	return handle;
 }
 EXPORT_SYMBOL_GPL(zs_malloc);
 
-void zs_free(struct zs_pool *pool, void *obj)
+void zs_free(struct zs_pool *pool, void *handle)
 {
-	struct link_free *link;
+	unsigned long obj, f_objidx;
 	struct page *first_page, *f_page;
-	unsigned long f_objidx, f_offset;
 
 	int class_idx;
 	struct size_class *class;
 	enum fullness_group fullness;
 
-	if (unlikely(!obj))
+	if (unlikely(!handle))
 		return;
 
-	obj_handle_to_location(obj, &f_page, &f_objidx);
+	/* Pinning keeps compaction from moving the object under us */
+	pin_tag(handle);
+	obj = handle_to_obj(handle);
+	obj_to_location(obj, &f_page, &f_objidx);
 	first_page = get_first_page(f_page);
 
 	get_zspage_mapping(first_page, &class_idx, &fullness);
 	class = &pool->size_class[class_idx];
-	f_offset = obj_idx_to_offset(f_page, f_objidx, class->size);
 
 	spin_lock(&class->lock);
-
-	/* Insert this object in containing zspage's freelist */
-	link = (struct link_free *)((unsigned char *)kmap_atomic(f_page)
-							+ f_offset);
-	link->next = first_page->freelist;
-	kunmap_atomic(link);
-	first_page->freelist = obj;
-
-	first_page->inuse--;
+	obj_free(class, obj);
 	fullness = fix_fullness_group(pool, first_page);
 
 	if (fullness == ZS_EMPTY)
 		class->pages_allocated -= class->zspage_order;
 
 	spin_unlock(&class->lock);
+	unpin_tag(handle);
 
 	if (fullness == ZS_EMPTY)
 		free_zspage(first_page);
+
+	kmem_cache_free(zs_handle_cachep, handle);
 }
 EXPORT_SYMBOL_GPL(zs_free);
 
+/*
+ * An object that spans two pages is copied into a per-cpu buffer on map
+ * and back on unmap, so no page table has to be edited.
+ */
+static void zs_copy_map_object(char *buf, struct page *page,
+				unsigned long off, int size)
+{
+	int first = PAGE_SIZE - off;
+	char *addr;
+
+	addr = kmap_atomic(page);
+	memcpy(buf, addr + off, first);
+	kunmap_atomic(addr);
+
+	addr = kmap_atomic(get_next_page(page));
+	memcpy(buf + first, addr, size - first);
+	kunmap_atomic(addr);
+}
+
+static void zs_copy_unmap_object(char *buf, struct page *page,
+				unsigned long off, int size)
+{
+	int first = PAGE_SIZE - off;
+	char *addr;
+
+	addr = kmap_atomic(page);
+	memcpy(addr + off, buf, first);
+	kunmap_atomic(addr);
+
+	addr = kmap_atomic(get_next_page(page));
+	memcpy(addr, buf + first, size - first);
+	kunmap_atomic(addr);
+}
+
+/*
+ * The object stays pinned, and so cannot be migrated, until it is
+ * unmapped. Like kmap_atomic(), the caller must not sleep meanwhile.
+ */
 void *zs_map_object(struct zs_pool *pool, void *handle)
 {
 	struct page *page;
-	unsigned long obj_idx, off;
+	unsigned long obj, obj_idx, off;
 
 	unsigned int class_idx;
 	enum fullness_group fg;
@@ -655,7 +1234,9 @@ void *zs_map_object(struct zs_pool *pool, void *handle)
 
 	BUG_ON(!handle);
 
-	obj_handle_to_location(handle, &page, &obj_idx);
+	pin_tag(handle);
+	obj = handle_to_obj(handle);
+	obj_to_location(obj, &page, &obj_idx);
 	get_zspage_mapping(get_first_page(page), &class_idx, &fg);
 	class = &pool->size_class[class_idx];
 	off = obj_idx_to_offset(page, obj_idx, class->size);
@@ -664,29 +1245,21 @@ void *zs_map_object(struct zs_pool *pool, void *handle)
 	if (off + class->size <= PAGE_SIZE) {
 		/* this object is contained entirely within a page */
 		area->vm_addr = kmap_atomic(page);
-	} else {
-		/* this object spans two pages */
-		struct page *nextp;
-
-		nextp = get_next_page(page);
-		BUG_ON(!nextp);
-
-
-		set_pte(area->vm_ptes[0], mk_pte(page, PAGE_KERNEL));
-		set_pte(area->vm_ptes[1], mk_pte(nextp, PAGE_KERNEL));
-
-		/* We pre-allocated VM area so mapping can never fail */
-		area->vm_addr = area->vm->addr;
+		return area->vm_addr + off + ZS_HANDLE_SIZE;
 	}
 
-	return area->vm_addr + off;
+	/* this object spans two pages */
+	BUG_ON(!get_next_page(page));
+	zs_copy_map_object(area->vm_buf, page, off, class->size);
+
+	return area->vm_buf + ZS_HANDLE_SIZE;
 }
 EXPORT_SYMBOL_GPL(zs_map_object);
 
 void zs_unmap_object(struct zs_pool *pool, void *handle)
 {
 	struct page *page;
-	unsigned long obj_idx, off;
+	unsigned long obj, obj_idx, off;
 
 	unsigned int class_idx;
 	enum fullness_group fg;
@@ -695,21 +1268,19 @@ void zs_unmap_object(struct zs_pool *pool, void *handle)
 
 	BUG_ON(!handle);
 
-	obj_handle_to_location(handle, &page, &obj_idx);
+	obj = handle_to_obj(handle);
+	obj_to_location(obj, &page, &obj_idx);
 	get_zspage_mapping(get_first_page(page), &class_idx, &fg);
 	class = &pool->size_class[class_idx];
 	off = obj_idx_to_offset(page, obj_idx, class->size);
 
 	area = &__get_cpu_var(zs_map_area);
-	if (off + class->size <= PAGE_SIZE) {
+	if (off + class->size <= PAGE_SIZE)
 		kunmap_atomic(area->vm_addr);
-	} else {
-		set_pte(area->vm_ptes[0], __pte(0));
-		set_pte(area->vm_ptes[1], __pte(0));
-		__flush_tlb_one((unsigned long)area->vm_addr);
-		__flush_tlb_one((unsigned long)area->vm_addr + PAGE_SIZE);
-	}
+	else
+		zs_copy_unmap_object(area->vm_buf, page, off, class->size);
 	put_cpu_var(zs_map_area);
+	unpin_tag(handle);
 }
 EXPORT_SYMBOL_GPL(zs_unmap_object);
 
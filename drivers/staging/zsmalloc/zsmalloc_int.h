@@ -14,6 +14,7 @@
 #define _ZS_MALLOC_INT_H_
 
 #include <linux/kernel.h>
+#include <linux/shrinker.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
 
@@ -33,15 +34,27 @@
 #define ZS_MAX_PAGES_PER_ZSPAGE (_AC(1, UL) << ZS_MAX_ZSPAGE_ORDER)
 
 /*
- * Object location (<PFN>, <obj_idx>) is encoded as
- * as single (void *) handle value.
+ * Object location (<PFN>, <obj_idx>) is encoded as a single
+ * unsigned long value, shifted left by OBJ_TAG_BITS.
  *
  * Note that object index <obj_idx> is relative to system
  * page <PFN> it is stored in, so for each sub-page belonging
  * to a zspage, obj_idx starts with 0.
  *
  * This is made more complicated by various memory models and PAE.
+ *
+ * Handles returned to users point to a word holding the location, so
+ * that compaction can move objects. Every allocated object starts with
+ * its handle, tagged with OBJ_ALLOCATED_TAG, which tells allocated
+ * objects from free ones (free objects start with a link_free) and lets
+ * compaction find the handle to update. Bit HANDLE_PIN_BIT of the word a
+ * handle points to is a bit spinlock held while the object is mapped,
+ * freed or migrated.
  */
+#define OBJ_TAG_BITS		1
+#define OBJ_ALLOCATED_TAG	1
+#define HANDLE_PIN_BIT		0
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
 
 #ifndef MAX_PHYSMEM_BITS
 #ifdef CONFIG_HIGHMEM64G
@@ -55,7 +68,7 @@
 #endif
 #endif
 #define _PFN_BITS		(MAX_PHYSMEM_BITS - PAGE_SHIFT)
-#define OBJ_INDEX_BITS	(BITS_PER_LONG - _PFN_BITS)
+#define OBJ_INDEX_BITS	(BITS_PER_LONG - _PFN_BITS - OBJ_TAG_BITS)
 #define OBJ_INDEX_MASK	((_AC(1, UL) << OBJ_INDEX_BITS) - 1)
 
 #define MAX(a, b) ((a) >= (b) ? (a) : (b))
@@ -110,9 +123,8 @@ enum fullness_group {
 static const int fullness_threshold_frac = 4;
 
 struct mapping_area {
-	struct vm_struct *vm;
-	pte_t *vm_ptes[2];
-	char *vm_addr;
+	char *vm_buf; /* copy buffer for objects that span two pages */
+	char *vm_addr; /* address of kmap_atomic()'ed pages */
 };
 
 struct size_class {
@@ -128,8 +140,14 @@ struct size_class {
 
 	spinlock_t lock;
 
+	/* Number of objects a zspage of this class can hold */
+	int objs_per_zspage;
+
 	/* stats */
 	u64 pages_allocated;
+	unsigned long objs_inuse;
+	unsigned long zspage_count[_ZS_NR_FULLNESS_GROUPS];
+	unsigned long pages_compacted;
 
 	struct page *fullness_list[_ZS_NR_FULLNESS_GROUPS];
 };
@@ -141,8 +159,8 @@ struct size_class {
  * This must be power of 2 and less than or equal to ZS_ALIGN
  */
 struct link_free {
-	/* Handle of next free chunk (encodes <PFN, obj_idx>) */
-	void *next;
+	/* Location of next free chunk (encodes <PFN, obj_idx>) */
+	unsigned long next;
 };
 
 struct zs_pool {
@@ -150,6 +168,14 @@ struct zs_pool {
 
 	gfp_t flags;	/* allocation flags used when growing pool */
 	const char *name;
+
+	/* Compacts the pool under memory pressure */
+	struct shrinker shrinker;
+	atomic_long_t pages_compacted;
+
+#ifdef CONFIG_ZSMALLOC_STAT
+	struct dentry *stat_dentry;
+#endif
 };
 
 #endif
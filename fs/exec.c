@@ -797,6 +797,7 @@ static int de_thread(struct task_struct *tsk)
 
 		tsk->group_leader = tsk;
 		leader->group_leader = tsk;
+		lowmem_task_replace(leader, tsk);
 
 		tsk->exit_signal = SIGCHLD;
 		leader->exit_signal = -1;
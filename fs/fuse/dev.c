@@ -26,7 +26,7 @@ MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_chan *fuse_get_chan(struct file *file)
 {
 	return file->private_data;
 }
@@ -183,6 +183,9 @@ void fuse_put_request(struct fuse_conn *fc, struct fuse_req *req)
 		if (req->waiting)
 			atomic_dec(&fc->num_waiting);
 
+		if (req->passthrough_filp)
+			fput(req->passthrough_filp);
+
 		if (req->stolen_file)
 			put_reserved_req(fc, req);
 		else
@@ -204,26 +207,108 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 
 static u64 fuse_get_unique(struct fuse_conn *fc)
 {
-	fc->reqctr++;
-	
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
+	u64 unique;
+
+	/* zero is reserved for notifications */
+	do {
+		unique = atomic64_inc_return(&fc->reqctr);
+	} while (unlikely(!unique));
 
-	return fc->reqctr;
+	return unique;
 }
 
-static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
+void fuse_chan_init(struct fuse_chan *ch, struct fuse_conn *fc)
+{
+	memset(ch, 0, sizeof(*ch));
+	ch->fc = fc;
+	spin_lock_init(&ch->lock);
+	init_waitqueue_head(&ch->waitq);
+	INIT_LIST_HEAD(&ch->pending);
+	INIT_LIST_HEAD(&ch->processing);
+	INIT_LIST_HEAD(&ch->io);
+	INIT_LIST_HEAD(&ch->interrupts);
+	INIT_LIST_HEAD(&ch->entry);
+	ch->connected = 1;
+}
+
+/*
+ * Returns the channel bound to the current CPU, or the main channel if
+ * the daemon did not bind one.  Being preempted after the lookup only
+ * means the request is served by another CPU's channel.
+ */
+static struct fuse_chan *fuse_select_chan(struct fuse_conn *fc)
+{
+	struct fuse_chan **cpu_chan = ACCESS_ONCE(fc->cpu_chan);
+	struct fuse_chan *ch = NULL;
+
+	if (cpu_chan) {
+		smp_read_barrier_depends();
+		ch = ACCESS_ONCE(cpu_chan[raw_smp_processor_id()]);
+	}
+
+	return ch ? ch : &fc->main_chan;
+}
+
+/*
+ * Locks the channel a new request should go to.  A cloned channel
+ * which is being released is skipped in favour of the main channel,
+ * which only goes away with the connection itself.  The clone is freed
+ * after an RCU grace period, so it can still be locked and checked here.
+ */
+static struct fuse_chan *fuse_lock_chan(struct fuse_conn *fc)
+{
+	struct fuse_chan *ch;
+
+	rcu_read_lock();
+	ch = fuse_select_chan(fc);
+	spin_lock(&ch->lock);
+	if (unlikely(!ch->connected && ch != &fc->main_chan)) {
+		spin_unlock(&ch->lock);
+		ch = &fc->main_chan;
+		spin_lock(&ch->lock);
+	}
+	rcu_read_unlock();
+
+	return ch;
+}
+
+/*
+ * Locks the channel a queued request currently belongs to.  Pending
+ * requests of a released clone move to the main channel, and finished
+ * ones are handed to it by request_end(), so recheck after taking the
+ * lock.  A clone that was just left is only freed after an RCU grace
+ * period, which keeps locking it here safe.
+ */
+static struct fuse_chan *lock_req_chan(struct fuse_req *req)
+{
+	struct fuse_chan *ch;
+
+	rcu_read_lock();
+	for (;;) {
+		ch = ACCESS_ONCE(req->chan);
+		spin_lock(&ch->lock);
+		if (likely(ch == req->chan))
+			break;
+		spin_unlock(&ch->lock);
+	}
+	rcu_read_unlock();
+
+	return ch;
+}
+
+static void queue_request(struct fuse_chan *ch, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &ch->pending);
+	req->chan = ch;
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
-		atomic_inc(&fc->num_waiting);
+		atomic_inc(&ch->fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	wake_up(&ch->waitq);
+	kill_fasync(&ch->fasync, SIGIO, POLL_IN);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
@@ -234,10 +319,12 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 
 	spin_lock(&fc->lock);
 	if (fc->connected) {
+		struct fuse_chan *ch = fuse_select_chan(fc);
+
 		fc->forget_list_tail->next = forget;
 		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+		wake_up(&ch->waitq);
+		kill_fasync(&ch->fasync, SIGIO, POLL_IN);
 	} else {
 		kfree(forget);
 	}
@@ -249,24 +336,23 @@ static void flush_bg_queue(struct fuse_conn *fc)
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
+		struct fuse_chan *ch;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
 		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		ch = fuse_lock_chan(fc);
+		queue_request(ch, req);
+		spin_unlock(&ch->lock);
 	}
 }
 
-static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
+static void request_complete(struct fuse_conn *fc, struct fuse_req *req,
+			     void (*end) (struct fuse_conn *, struct fuse_req *))
 {
-	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
-	req->end = NULL;
-	list_del(&req->list);
-	list_del(&req->intr_entry);
-	req->state = FUSE_REQ_FINISHED;
 	if (req->background) {
+		spin_lock(&fc->lock);
 		if (fc->num_background == fc->max_background) {
 			fc->blocked = 0;
 			wake_up_all(&fc->blocked_waitq);
@@ -279,50 +365,68 @@ __releases(fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
 	fuse_put_request(fc, req);
 }
 
-static void wait_answer_interruptible(struct fuse_conn *fc,
-				      struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+/*
+ * Background accounting is done under fc->lock, which nests outside
+ * the channel lock, so the channel is unlocked first.  The waiter may
+ * still lock req->chan after this, and a cloned channel can be freed
+ * as soon as its file is closed, so the request is moved to the main
+ * channel here.
+ */
+static void request_end(struct fuse_conn *fc, struct fuse_chan *ch,
+			struct fuse_req *req)
+__releases(ch->lock)
+{
+	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
+	req->end = NULL;
+	list_del(&req->list);
+	list_del(&req->intr_entry);
+	req->chan = &fc->main_chan;
+	req->state = FUSE_REQ_FINISHED;
+	spin_unlock(&ch->lock);
+	request_complete(fc, req, end);
+}
+
+static void wait_answer_interruptible(struct fuse_req *req)
 {
 	if (signal_pending(current))
 		return;
 
-	spin_unlock(&fc->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
 }
 
-static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
+static void queue_interrupt(struct fuse_chan *ch, struct fuse_req *req)
 {
-	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	list_add_tail(&req->intr_entry, &ch->interrupts);
+	wake_up(&ch->waitq);
+	kill_fasync(&ch->fasync, SIGIO, POLL_IN);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
 {
+	struct fuse_chan *ch;
+
 	if (!fc->no_interrupt) {
 		
-		wait_answer_interruptible(fc, req);
+		wait_answer_interruptible(req);
 
+		ch = lock_req_chan(req);
 		if (req->aborted)
 			goto aborted;
 		if (req->state == FUSE_REQ_FINISHED)
-			return;
+			goto out_unlock;
 
 		req->interrupted = 1;
 		if (req->state == FUSE_REQ_SENT)
-			queue_interrupt(fc, req);
+			queue_interrupt(ch, req);
+		spin_unlock(&ch->lock);
 	}
 
 	if (!req->force) {
@@ -330,58 +434,63 @@ __acquires(fc->lock)
 
 		
 		block_sigs(&oldset);
-		wait_answer_interruptible(fc, req);
+		wait_answer_interruptible(req);
 		restore_sigs(&oldset);
 
+		ch = lock_req_chan(req);
 		if (req->aborted)
 			goto aborted;
 		if (req->state == FUSE_REQ_FINISHED)
-			return;
+			goto out_unlock;
 
 		
 		if (req->state == FUSE_REQ_PENDING) {
 			list_del(&req->list);
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
-			return;
+			goto out_unlock;
 		}
+		spin_unlock(&ch->lock);
 	}
 
-	spin_unlock(&fc->lock);
-
 	while (req->state != FUSE_REQ_FINISHED)
 		wait_event_freezable(req->waitq,
 				     req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
 
+	ch = lock_req_chan(req);
 	if (!req->aborted)
-		return;
+		goto out_unlock;
 
  aborted:
 	BUG_ON(req->state != FUSE_REQ_FINISHED);
-	if (req->locked) {
-		spin_unlock(&fc->lock);
-		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
-	}
+	spin_unlock(&ch->lock);
+	wait_event(req->waitq, !req->locked);
+	return;
+
+ out_unlock:
+	spin_unlock(&ch->lock);
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_chan *ch;
+
 	req->isreply = 1;
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	ch = fuse_lock_chan(fc);
+	if (!fc->connected || !ch->connected)
 		req->out.h.error = -ENOTCONN;
 	else if (fc->conn_error)
 		req->out.h.error = -ECONNREFUSED;
 	else {
 		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		queue_request(ch, req);
 		__fuse_get_request(req);
+		spin_unlock(&ch->lock);
 
 		request_wait_answer(fc, req);
+		return;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 }
 EXPORT_SYMBOL_GPL(fuse_request_send);
 
@@ -403,13 +512,19 @@ static void fuse_request_send_nowait_locked(struct fuse_conn *fc,
 
 static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 {
+	void (*end) (struct fuse_conn *, struct fuse_req *);
+
 	spin_lock(&fc->lock);
 	if (fc->connected) {
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
 		req->out.h.error = -ENOTCONN;
-		request_end(fc, req);
+		req->state = FUSE_REQ_FINISHED;
+		end = req->end;
+		req->end = NULL;
+		request_complete(fc, req, end);
 	}
 }
 
@@ -423,16 +538,17 @@ EXPORT_SYMBOL_GPL(fuse_request_send_background);
 static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
+	struct fuse_chan *ch;
 	int err = -ENODEV;
 
 	req->isreply = 0;
 	req->in.h.unique = unique;
-	spin_lock(&fc->lock);
-	if (fc->connected) {
-		queue_request(fc, req);
+	ch = fuse_lock_chan(fc);
+	if (fc->connected && ch->connected) {
+		queue_request(ch, req);
 		err = 0;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 
 	return err;
 }
@@ -444,33 +560,33 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 	fuse_request_send_nowait_locked(fc, req);
 }
 
-static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
+static int lock_request(struct fuse_chan *ch, struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&ch->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
 	}
 	return err;
 }
 
-static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
+static void unlock_request(struct fuse_chan *ch, struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&ch->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
 	}
 }
 
 struct fuse_copy_state {
-	struct fuse_conn *fc;
+	struct fuse_chan *ch;
 	int write;
 	struct fuse_req *req;
 	const struct iovec *iov;
@@ -487,12 +603,12 @@ struct fuse_copy_state {
 	unsigned move_pages:1;
 };
 
-static void fuse_copy_init(struct fuse_copy_state *cs, struct fuse_conn *fc,
+static void fuse_copy_init(struct fuse_copy_state *cs, struct fuse_chan *ch,
 			   int write,
 			   const struct iovec *iov, unsigned long nr_segs)
 {
 	memset(cs, 0, sizeof(*cs));
-	cs->fc = fc;
+	cs->ch = ch;
 	cs->write = write;
 	cs->iov = iov;
 	cs->nr_segs = nr_segs;
@@ -527,7 +643,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 	unsigned long offset;
 	int err;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->ch, cs->req);
 	fuse_copy_finish(cs);
 	if (cs->pipebufs) {
 		struct pipe_buffer *buf = cs->pipebufs;
@@ -585,7 +701,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 		cs->addr += cs->len;
 	}
 
-	return lock_request(cs->fc, cs->req);
+	return lock_request(cs->ch, cs->req);
 }
 
 static int fuse_copy_do(struct fuse_copy_state *cs, void **val, unsigned *size)
@@ -632,7 +748,7 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 	struct address_space *mapping;
 	pgoff_t index;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->ch, cs->req);
 	fuse_copy_finish(cs);
 
 	err = buf->ops->confirm(cs->pipe, buf);
@@ -685,12 +801,12 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 		lru_cache_add_file(newpage);
 
 	err = 0;
-	spin_lock(&cs->fc->lock);
+	spin_lock(&cs->ch->lock);
 	if (cs->req->aborted)
 		err = -ENOENT;
 	else
 		*pagep = newpage;
-	spin_unlock(&cs->fc->lock);
+	spin_unlock(&cs->ch->lock);
 
 	if (err) {
 		unlock_page(newpage);
@@ -710,7 +826,7 @@ out_fallback:
 	cs->mapaddr = buf->ops->map(cs->pipe, buf, 1);
 	cs->buf = cs->mapaddr + buf->offset;
 
-	err = lock_request(cs->fc, cs->req);
+	err = lock_request(cs->ch, cs->req);
 	if (err)
 		return err;
 
@@ -725,7 +841,7 @@ static int fuse_ref_page(struct fuse_copy_state *cs, struct page *page,
 	if (cs->nr_segs == cs->pipe->buffers)
 		return -EIO;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->ch, cs->req);
 	fuse_copy_finish(cs);
 
 	buf = cs->pipebufs;
@@ -836,35 +952,41 @@ static int forget_pending(struct fuse_conn *fc)
 	return fc->forget_list_head.next != NULL;
 }
 
-static int request_pending(struct fuse_conn *fc)
+static int request_pending(struct fuse_chan *ch)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
-		forget_pending(fc);
+	return !list_empty(&ch->pending) || !list_empty(&ch->interrupts) ||
+		forget_pending(ch->fc);
 }
 
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void request_wait(struct fuse_chan *ch)
+__releases(ch->lock)
+__acquires(ch->lock)
 {
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
+	add_wait_queue_exclusive(&ch->waitq, &wait);
+	for (;;) {
+		/*
+		 * Forgets are queued under fc->lock, not ch->lock, so the
+		 * task state has to be set before looking for them.
+		 */
 		set_current_state(TASK_INTERRUPTIBLE);
+		if (!ch->connected || request_pending(ch))
+			break;
 		if (signal_pending(current))
 			break;
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
 		schedule();
-		spin_lock(&fc->lock);
+		spin_lock(&ch->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	remove_wait_queue(&ch->waitq, &wait);
 }
 
-static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
+static int fuse_read_interrupt(struct fuse_chan *ch, struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
-__releases(fc->lock)
+__releases(ch->lock)
 {
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
@@ -872,7 +994,7 @@ __releases(fc->lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fc);
+	req->intr_unique = fuse_get_unique(ch->fc);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -880,7 +1002,7 @@ __releases(fc->lock)
 	ih.unique = req->intr_unique;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 	if (nbytes < reqsize)
 		return -EINVAL;
 
@@ -1006,46 +1128,54 @@ __releases(fc->lock)
 		return fuse_read_batch_forget(fc, cs, nbytes);
 }
 
-static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_chan *ch, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
+	struct fuse_conn *fc = ch->fc;
 	int err;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fc->lock);
+	spin_lock(&ch->lock);
 	err = -EAGAIN;
-	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
+	if ((file->f_flags & O_NONBLOCK) && ch->connected &&
+	    !request_pending(ch))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(ch);
 	err = -ENODEV;
-	if (!fc->connected)
+	if (!ch->connected)
 		goto err_unlock;
 	err = -ERESTARTSYS;
-	if (!request_pending(fc))
+	if (!request_pending(ch))
 		goto err_unlock;
 
-	if (!list_empty(&fc->interrupts)) {
-		req = list_entry(fc->interrupts.next, struct fuse_req,
+	if (!list_empty(&ch->interrupts)) {
+		req = list_entry(ch->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fc, cs, nbytes, req);
+		return fuse_read_interrupt(ch, cs, nbytes, req);
 	}
 
+	/* forgets are shared by all channels and queued under fc->lock */
 	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
-			return fuse_read_forget(fc, cs, nbytes);
+		if (list_empty(&ch->pending) || ch->forget_batch-- > 0) {
+			spin_unlock(&ch->lock);
+			spin_lock(&fc->lock);
+			if (forget_pending(fc))
+				return fuse_read_forget(fc, cs, nbytes);
+			spin_unlock(&fc->lock);
+			goto restart;
+		}
 
-		if (fc->forget_batch <= -8)
-			fc->forget_batch = 16;
+		if (ch->forget_batch <= -8)
+			ch->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = list_entry(ch->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &ch->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -1055,40 +1185,40 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		
 		if (in->h.opcode == FUSE_SETXATTR)
 			req->out.h.error = -E2BIG;
-		request_end(fc, req);
+		request_end(fc, ch, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 	cs->req = req;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
 	fuse_copy_finish(cs);
-	spin_lock(&fc->lock);
+	spin_lock(&ch->lock);
 	req->locked = 0;
 	if (req->aborted) {
-		request_end(fc, req);
+		request_end(fc, ch, req);
 		return -ENODEV;
 	}
 	if (err) {
 		req->out.h.error = -EIO;
-		request_end(fc, req);
+		request_end(fc, ch, req);
 		return err;
 	}
 	if (!req->isreply)
-		request_end(fc, req);
+		request_end(fc, ch, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list, &ch->processing);
 		if (req->interrupted)
-			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+			queue_interrupt(ch, req);
+		spin_unlock(&ch->lock);
 	}
 	return reqsize;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 	return err;
 }
 
@@ -1097,13 +1227,13 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_chan *ch = fuse_get_chan(file);
+	if (!ch)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 1, iov, nr_segs);
+	fuse_copy_init(&cs, ch, 1, iov, nr_segs);
 
-	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_read(ch, file, &cs, iov_length(iov, nr_segs));
 }
 
 static int fuse_dev_pipe_buf_steal(struct pipe_inode_info *pipe,
@@ -1131,18 +1261,18 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	int do_wakeup = 0;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(in);
-	if (!fc)
+	struct fuse_chan *ch = fuse_get_chan(in);
+	if (!ch)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
-	fuse_copy_init(&cs, fc, 1, NULL, 0);
+	fuse_copy_init(&cs, ch, 1, NULL, 0);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fc, in, &cs, len);
+	ret = fuse_dev_do_read(ch, in, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1565,11 +1695,11 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 	}
 }
 
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+static struct fuse_req *request_find(struct fuse_chan *ch, u64 unique)
 {
 	struct list_head *entry;
 
-	list_for_each(entry, &fc->processing) {
+	list_for_each(entry, &ch->processing) {
 		struct fuse_req *req;
 		req = list_entry(entry, struct fuse_req, list);
 		if (req->in.h.unique == unique || req->intr_unique == unique)
@@ -1601,9 +1731,10 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
 			      out->page_zeroing);
 }
 
-static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
+static ssize_t fuse_dev_do_write(struct fuse_chan *ch,
 				 struct fuse_copy_state *cs, size_t nbytes)
 {
+	struct fuse_conn *fc = ch->fc;
 	int err;
 	struct fuse_req *req;
 	struct fuse_out_header oh;
@@ -1628,20 +1759,21 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
+	/* replies go to the channel the request was read from */
+	spin_lock(&ch->lock);
 	err = -ENOENT;
-	if (!fc->connected)
+	if (!ch->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(ch, oh.unique);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
 		fuse_copy_finish(cs);
-		spin_lock(&fc->lock);
-		request_end(fc, req);
+		spin_lock(&ch->lock);
+		request_end(fc, ch, req);
 		return -ENOENT;
 	}
 	
@@ -1653,38 +1785,40 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 		if (oh.error == -ENOSYS)
 			fc->no_interrupt = 1;
 		else if (oh.error == -EAGAIN)
-			queue_interrupt(fc, req);
+			queue_interrupt(ch, req);
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
 		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &ch->io);
 	req->out.h = oh;
 	req->locked = 1;
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
+	if (!err && fc->passthrough)
+		fuse_passthrough_setup(fc, req);
 
-	spin_lock(&fc->lock);
+	spin_lock(&ch->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
 			err = -ENOENT;
 	} else if (!req->aborted)
 		req->out.h.error = -EIO;
-	request_end(fc, req);
+	request_end(fc, ch, req);
 
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
  err_finish:
 	fuse_copy_finish(cs);
 	return err;
@@ -1694,13 +1828,13 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 			      unsigned long nr_segs, loff_t pos)
 {
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(iocb->ki_filp);
-	if (!fc)
+	struct fuse_chan *ch = fuse_get_chan(iocb->ki_filp);
+	if (!ch)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 0, iov, nr_segs);
+	fuse_copy_init(&cs, ch, 0, iov, nr_segs);
 
-	return fuse_dev_do_write(fc, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_write(ch, &cs, iov_length(iov, nr_segs));
 }
 
 static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
@@ -1711,12 +1845,12 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	unsigned idx;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc;
+	struct fuse_chan *ch;
 	size_t rem;
 	ssize_t ret;
 
-	fc = fuse_get_conn(out);
-	if (!fc)
+	ch = fuse_get_chan(out);
+	if (!ch)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
@@ -1763,14 +1897,14 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	}
 	pipe_unlock(pipe);
 
-	fuse_copy_init(&cs, fc, 0, NULL, nbuf);
+	fuse_copy_init(&cs, ch, 0, NULL, nbuf);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
 
 	if (flags & SPLICE_F_MOVE)
 		cs.move_pages = 1;
 
-	ret = fuse_dev_do_write(fc, &cs, len);
+	ret = fuse_dev_do_write(ch, &cs, len);
 
 	for (idx = 0; idx < nbuf; idx++) {
 		struct pipe_buffer *buf = &bufs[idx];
@@ -1784,71 +1918,72 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_chan *ch = fuse_get_chan(file);
+	if (!ch)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	poll_wait(file, &ch->waitq, wait);
 
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	spin_lock(&ch->lock);
+	if (!ch->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (request_pending(ch))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 
 	return mask;
 }
 
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_requests(struct fuse_conn *fc, struct fuse_chan *ch,
+			 struct list_head *head)
+__releases(ch->lock)
+__acquires(ch->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
-		request_end(fc, req);
-		spin_lock(&fc->lock);
+		request_end(fc, ch, req);
+		spin_lock(&ch->lock);
 	}
 }
 
-static void end_io_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_io_requests(struct fuse_conn *fc, struct fuse_chan *ch)
+__releases(ch->lock)
+__acquires(ch->lock)
 {
-	while (!list_empty(&fc->io)) {
+	while (!list_empty(&ch->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(ch->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
 		req->out.h.error = -ECONNABORTED;
+		req->chan = &fc->main_chan;
 		req->state = FUSE_REQ_FINISHED;
 		list_del_init(&req->list);
 		wake_up(&req->waitq);
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&ch->lock);
 			wait_event(req->waitq, !req->locked);
 			end(fc, req);
 			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			spin_lock(&ch->lock);
 		}
 	}
 }
 
-static void end_queued_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_chan_requests(struct fuse_chan *ch)
 {
-	fc->max_background = UINT_MAX;
-	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
-	end_requests(fc, &fc->processing);
-	while (forget_pending(fc))
-		kfree(dequeue_forget(fc, 1, NULL));
+	struct fuse_conn *fc = ch->fc;
+
+	spin_lock(&ch->lock);
+	end_io_requests(fc, ch);
+	end_requests(fc, ch, &ch->pending);
+	end_requests(fc, ch, &ch->processing);
+	spin_unlock(&ch->lock);
 }
 
 static void end_polls(struct fuse_conn *fc)
@@ -1866,34 +2001,134 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/*
+ * Marks every channel disconnected and wakes up the daemon threads
+ * reading them.  Called with fc->lock held, which keeps the list of
+ * channels stable.
+ */
+void fuse_kill_chans(struct fuse_conn *fc)
+{
+	struct fuse_chan *ch;
+
+	list_for_each_entry(ch, &fc->chans, entry) {
+		spin_lock(&ch->lock);
+		ch->connected = 0;
+		wake_up_all(&ch->waitq);
+		kill_fasync(&ch->fasync, SIGIO, POLL_IN);
+		spin_unlock(&ch->lock);
+	}
+}
+
+void fuse_free_chans(struct fuse_conn *fc)
+{
+	struct fuse_chan *ch, *next;
+
+	list_for_each_entry_safe(ch, next, &fc->chans, entry) {
+		if (ch != &fc->main_chan)
+			kfree(ch);
+	}
+	kfree(fc->cpu_chan);
+}
+
+static void end_conn_requests(struct fuse_conn *fc)
+__releases(fc->lock)
+{
+	struct fuse_chan *ch;
+
+	fc->max_background = UINT_MAX;
+	flush_bg_queue(fc);
+	fc->connected = 0;
+	fc->blocked = 0;
+	while (forget_pending(fc))
+		kfree(dequeue_forget(fc, 1, NULL));
+	end_polls(fc);
+	fuse_kill_chans(fc);
+	spin_unlock(&fc->lock);
+
+	/* no channel is cloned once the connection is down */
+	list_for_each_entry(ch, &fc->chans, entry)
+		end_chan_requests(ch);
+	wake_up_all(&fc->blocked_waitq);
+}
+
 void fuse_abort_conn(struct fuse_conn *fc)
 {
 	spin_lock(&fc->lock);
+	if (fc->connected)
+		end_conn_requests(fc);
+	else
+		spin_unlock(&fc->lock);
+}
+EXPORT_SYMBOL_GPL(fuse_abort_conn);
+
+/*
+ * A cloned channel going away hands its unread requests over to the
+ * main channel.  Requests already read from it can only be answered
+ * through it, so those are failed.  Every request is moved off the
+ * clone first, so that it can be unlinked and freed.
+ */
+static void fuse_chan_release(struct fuse_chan *ch)
+{
+	struct fuse_conn *fc = ch->fc;
+	struct fuse_chan *main_chan = &fc->main_chan;
+	struct fuse_req *req;
+	LIST_HEAD(failed);
+	int unlinked = 0;
+	int cpu;
+
+	spin_lock(&fc->lock);
+	if (fc->cpu_chan) {
+		for_each_possible_cpu(cpu) {
+			if (fc->cpu_chan[cpu] == ch)
+				fc->cpu_chan[cpu] = NULL;
+		}
+	}
+	/* end_conn_requests() walks the list unlocked once fc is down */
 	if (fc->connected) {
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_io_requests(fc);
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->waitq);
-		wake_up_all(&fc->blocked_waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+		list_del(&ch->entry);
+		unlinked = 1;
 	}
 	spin_unlock(&fc->lock);
+
+	spin_lock(&ch->lock);
+	ch->connected = 0;
+	spin_lock_nested(&main_chan->lock, SINGLE_DEPTH_NESTING);
+	if (main_chan->connected && !list_empty(&ch->pending)) {
+		list_for_each_entry(req, &ch->pending, list)
+			req->chan = main_chan;
+		list_splice_tail_init(&ch->pending, &main_chan->pending);
+		wake_up(&main_chan->waitq);
+		kill_fasync(&main_chan->fasync, SIGIO, POLL_IN);
+	}
+	list_splice_tail_init(&ch->pending, &failed);
+	list_splice_tail_init(&ch->processing, &failed);
+	list_for_each_entry(req, &failed, list)
+		req->chan = main_chan;
+	while (!list_empty(&ch->interrupts))
+		list_del_init(ch->interrupts.next);
+	spin_unlock(&ch->lock);
+	end_requests(fc, main_chan, &failed);
+	spin_unlock(&main_chan->lock);
+
+	if (unlinked) {
+		synchronize_rcu();
+		kfree(ch);
+	}
+	fuse_conn_put(fc);
 }
-EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
+	struct fuse_chan *ch = fuse_get_chan(file);
+	if (ch) {
+		struct fuse_conn *fc = ch->fc;
+
+		if (ch != &fc->main_chan) {
+			fuse_chan_release(ch);
+			return 0;
+		}
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
-		spin_unlock(&fc->lock);
+		end_conn_requests(fc);
 		fuse_conn_put(fc);
 	}
 
@@ -1903,12 +2138,123 @@ EXPORT_SYMBOL_GPL(fuse_dev_release);
 
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_chan *ch = fuse_get_chan(file);
+	if (!ch)
 		return -EPERM;
 
 	
-	return fasync_helper(fd, file, on, &fc->fasync);
+	return fasync_helper(fd, file, on, &ch->fasync);
+}
+
+static int fuse_dev_clone(struct file *file, struct file *old)
+{
+	struct fuse_chan *old_ch;
+	struct fuse_chan *ch;
+	struct fuse_conn *fc;
+	int err;
+
+	ch = kmalloc(sizeof(*ch), GFP_KERNEL);
+	if (!ch)
+		return -ENOMEM;
+
+	/* fuse_fill_super() sets private_data under the same mutex */
+	mutex_lock(&fuse_mutex);
+	err = -EINVAL;
+	old_ch = fuse_get_chan(old);
+	if (file->private_data || !old_ch)
+		goto out_unlock;
+
+	fc = old_ch->fc;
+	fuse_chan_init(ch, fc);
+	err = -ENODEV;
+	spin_lock(&fc->lock);
+	if (fc->connected) {
+		list_add_tail(&ch->entry, &fc->chans);
+		err = 0;
+	}
+	spin_unlock(&fc->lock);
+	if (err)
+		goto out_unlock;
+
+	file->private_data = ch;
+	fuse_conn_get(fc);
+	ch = NULL;
+
+ out_unlock:
+	mutex_unlock(&fuse_mutex);
+	kfree(ch);
+	return err;
+}
+
+static int fuse_dev_bind_cpu(struct fuse_chan *ch, unsigned int cpu)
+{
+	struct fuse_conn *fc = ch->fc;
+	struct fuse_chan **cpu_chan = NULL;
+	int err = 0;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	if (!ACCESS_ONCE(fc->cpu_chan)) {
+		cpu_chan = kcalloc(nr_cpu_ids, sizeof(*cpu_chan), GFP_KERNEL);
+		if (!cpu_chan)
+			return -ENOMEM;
+	}
+
+	spin_lock(&fc->lock);
+	if (!fc->cpu_chan && cpu_chan) {
+		/* fuse_select_chan() looks at the map without fc->lock */
+		smp_wmb();
+		fc->cpu_chan = cpu_chan;
+		cpu_chan = NULL;
+	}
+	if (ch->connected)
+		fc->cpu_chan[cpu] = ch;
+	else
+		err = -ENODEV;
+	spin_unlock(&fc->lock);
+
+	kfree(cpu_chan);
+	return err;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct fuse_chan *ch;
+	struct file *old;
+	u32 val;
+	int err;
+
+	switch (cmd) {
+	case FUSE_DEV_IOC_CLONE:
+		if (get_user(val, (u32 __user *) arg))
+			return -EFAULT;
+
+		old = fget(val);
+		if (!old)
+			return -EBADF;
+
+		err = -EINVAL;
+		if (old->f_op == &fuse_dev_operations &&
+		    file->f_op == &fuse_dev_operations)
+			err = fuse_dev_clone(file, old);
+		fput(old);
+		return err;
+
+	case FUSE_DEV_IOC_BIND_CPU:
+		if (get_user(val, (u32 __user *) arg))
+			return -EFAULT;
+
+		ch = fuse_get_chan(file);
+		if (!ch)
+			return -EPERM;
+
+		return fuse_dev_bind_cpu(ch, val);
+
+	default:
+		return -ENOTTY;
+	}
 }
 
 const struct file_operations fuse_dev_operations = {
@@ -1923,6 +2269,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
@@ -35,6 +35,8 @@
 
 #define FUSE_ALLOW_OTHER         (1 << 1)
 
+#define FUSE_SUPER_MAGIC 0x65735546
+
 extern struct list_head fuse_conn_list;
 
 extern struct mutex fuse_mutex;
@@ -83,9 +85,18 @@ struct fuse_inode {
 
 	
 	struct list_head writepages;
+
+	
+	unsigned long state;
+};
+
+enum {
+	/* i_mtime changed locally and not yet sent to the filesystem */
+	FUSE_I_MTIME_DIRTY,
 };
 
 struct fuse_conn;
+struct fuse_chan;
 
 struct fuse_file {
 	
@@ -120,6 +131,9 @@ struct fuse_file {
 
 	
 	bool flock:1;
+
+	
+	struct file *passthrough_filp;
 };
 
 struct fuse_in_arg {
@@ -185,6 +199,9 @@ struct fuse_req {
 	struct list_head intr_entry;
 
 	
+	struct fuse_chan *chan;
+
+	
 	atomic_t count;
 
 	
@@ -271,6 +288,44 @@ struct fuse_req {
 
 	
 	struct file *stolen_file;
+
+	
+	struct file *passthrough_filp;
+};
+
+struct fuse_chan {
+	
+	struct fuse_conn *fc;
+
+	
+	spinlock_t lock;
+
+	
+	wait_queue_head_t waitq;
+
+	
+	struct list_head pending;
+
+	
+	struct list_head processing;
+
+	
+	struct list_head io;
+
+	
+	struct list_head interrupts;
+
+	
+	int forget_batch;
+
+	
+	unsigned connected;
+
+	
+	struct fasync_struct *fasync;
+
+	
+	struct list_head entry;
 };
 
 struct fuse_conn {
@@ -299,16 +354,13 @@ struct fuse_conn {
 	unsigned max_write;
 
 	
-	wait_queue_head_t waitq;
+	struct fuse_chan main_chan;
 
 	
-	struct list_head pending;
+	struct list_head chans;
 
 	
-	struct list_head processing;
-
-	
-	struct list_head io;
+	struct fuse_chan **cpu_chan;
 
 	
 	u64 khctr;
@@ -332,15 +384,9 @@ struct fuse_conn {
 	struct list_head bg_queue;
 
 	
-	struct list_head interrupts;
-
-	
 	struct fuse_forget_link forget_list_head;
 	struct fuse_forget_link *forget_list_tail;
 
-	
-	int forget_batch;
-
 	int blocked;
 
 	
@@ -350,7 +396,7 @@ struct fuse_conn {
 	wait_queue_head_t reserved_req_waitq;
 
 	
-	u64 reqctr;
+	atomic64_t reqctr;
 
 	unsigned connected;
 
@@ -421,6 +467,12 @@ struct fuse_conn {
 	unsigned no_flock:1;
 
 	
+	unsigned writeback_cache:1;
+
+	
+	unsigned passthrough:1;
+
+	
 	atomic_t num_waiting;
 
 	
@@ -442,9 +494,6 @@ struct fuse_conn {
 	int ctl_ndents;
 
 	
-	struct fasync_struct *fasync;
-
-	
 	u32 scramble_key[4];
 
 	
@@ -563,6 +612,12 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 
 void fuse_abort_conn(struct fuse_conn *fc);
 
+void fuse_chan_init(struct fuse_chan *ch, struct fuse_conn *fc);
+
+void fuse_kill_chans(struct fuse_conn *fc);
+
+void fuse_free_chans(struct fuse_conn *fc);
+
 void fuse_invalidate_attr(struct inode *inode);
 
 void fuse_invalidate_entry_cache(struct dentry *entry);
@@ -614,4 +669,19 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+int fuse_write_inode(struct inode *inode, struct writeback_control *wbc);
+
+int fuse_flush_mtime(struct inode *inode, struct fuse_file *ff);
+
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req);
+void fuse_passthrough_open(struct file *file);
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif 
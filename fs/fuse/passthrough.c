@@ -0,0 +1,206 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2001-2008  Miklos Szeredi <miklos@szeredi.hu>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/aio.h>
+#include <linux/file.h>
+#include <linux/fsnotify.h>
+#include <linux/mm.h>
+#include <linux/uio.h>
+
+/*
+ * Called in the context of the daemon writing the reply to an OPEN or
+ * CREATE request, which is the only place where the file descriptor it
+ * names can be resolved.  If the backing file is unsuitable the flag is
+ * cleared and the file is served through the daemon as usual.
+ *
+ * The backing file is reopened rather than shared with the daemon, as
+ * its O_APPEND flag is changed to follow the file on the FUSE mount.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_open_out *outarg;
+	struct file *lower, *filp;
+	struct inode *lower_inode;
+
+	if (req->in.h.opcode == FUSE_OPEN)
+		outarg = req->out.args[0].value;
+	else if (req->in.h.opcode == FUSE_CREATE)
+		outarg = req->out.args[1].value;
+	else
+		return;
+
+	if (req->out.h.error || !(outarg->open_flags & FOPEN_PASSTHROUGH))
+		return;
+
+	outarg->open_flags &= ~FOPEN_PASSTHROUGH;
+	if (outarg->open_flags & FOPEN_DIRECT_IO)
+		return;
+
+	lower = fget(outarg->passthrough_fd);
+	if (!lower)
+		return;
+
+	lower_inode = lower->f_dentry->d_inode;
+	if (!S_ISREG(lower_inode->i_mode) ||
+	    lower_inode->i_sb->s_magic == FUSE_SUPER_MAGIC ||
+	    !lower->f_op || !lower->f_op->aio_read ||
+	    !lower->f_op->aio_write) {
+		fput(lower);
+		return;
+	}
+
+	filp = dentry_open(dget(lower->f_path.dentry),
+			   mntget(lower->f_path.mnt), lower->f_flags,
+			   lower->f_cred);
+	fput(lower);
+	if (IS_ERR(filp))
+		return;
+
+	outarg->open_flags |= FOPEN_PASSTHROUGH;
+	req->passthrough_filp = filp;
+}
+
+/*
+ * The backing file was opened by the daemon, so it must allow at least
+ * what the file opened on the FUSE mount allows.
+ */
+void fuse_passthrough_open(struct file *file)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough_filp;
+	fmode_t mode = file->f_mode & (FMODE_READ | FMODE_WRITE);
+
+	if (lower && (lower->f_mode & mode) != mode) {
+		ff->passthrough_filp = NULL;
+		fput(lower);
+	}
+}
+
+static ssize_t fuse_passthrough_rw(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos, int rw)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file->f_dentry->d_inode;
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough_filp;
+	const struct cred *old_cred;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	init_sync_kiocb(&kiocb, lower);
+	kiocb.ki_left = iov_length(iov, nr_segs);
+	kiocb.ki_nbytes = kiocb.ki_left;
+
+	old_cred = override_creds(lower->f_cred);
+	if (rw == WRITE) {
+		/*
+		 * An appending write must find the end of the file under the
+		 * lower inode's lock, so leave that to the lower filesystem.
+		 */
+		if ((file->f_flags ^ lower->f_flags) & O_APPEND) {
+			spin_lock(&lower->f_lock);
+			if (file->f_flags & O_APPEND)
+				lower->f_flags |= O_APPEND;
+			else
+				lower->f_flags &= ~O_APPEND;
+			spin_unlock(&lower->f_lock);
+		}
+		kiocb.ki_pos = pos;
+		ret = lower->f_op->aio_write(&kiocb, iov, nr_segs, pos);
+	} else {
+		kiocb.ki_pos = pos;
+		ret = lower->f_op->aio_read(&kiocb, iov, nr_segs, pos);
+	}
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+
+	if (ret > 0 && rw == WRITE &&
+	    ((file->f_flags & O_DSYNC) || IS_SYNC(inode))) {
+		int err = vfs_fsync_range(lower, kiocb.ki_pos - ret,
+					  kiocb.ki_pos - 1,
+					  (file->f_flags & __O_SYNC) ? 0 : 1);
+		if (err)
+			ret = err;
+	}
+	revert_creds(old_cred);
+
+	if (ret > 0) {
+		iocb->ki_pos = kiocb.ki_pos;
+		if (rw == WRITE) {
+			fsnotify_modify(lower);
+			fuse_write_update_size(inode, kiocb.ki_pos);
+			fuse_invalidate_attr(inode);
+		} else {
+			fsnotify_access(lower);
+		}
+	}
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos)
+{
+	return fuse_passthrough_rw(iocb, iov, nr_segs, pos, READ);
+}
+
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos)
+{
+	return fuse_passthrough_rw(iocb, iov, nr_segs, pos, WRITE);
+}
+
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags)
+{
+	struct fuse_file *ff = in->private_data;
+	struct file *lower = ff->passthrough_filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!lower->f_op->splice_read)
+		return -EINVAL;
+
+	old_cred = override_creds(lower->f_cred);
+	ret = lower->f_op->splice_read(lower, ppos, pipe, len, flags);
+	revert_creds(old_cred);
+	if (ret > 0)
+		fsnotify_access(lower);
+
+	return ret;
+}
+
+/*
+ * The mapping is handed over to the backing file, so page faults never
+ * reach FUSE.  mmap_region() drops the reference on vma->vm_file if we
+ * fail, so only switch it once the backing file accepted the mapping.
+ */
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough_filp;
+	int err;
+
+	if (!lower->f_op->mmap)
+		return -ENODEV;
+
+	vma->vm_file = lower;
+	get_file(lower);
+	err = lower->f_op->mmap(lower, vma);
+	if (err) {
+		vma->vm_file = file;
+		fput(lower);
+		return err;
+	}
+	fput(file);
+
+	return 0;
+}
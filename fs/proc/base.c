@@ -915,6 +915,7 @@ static ssize_t oom_adjust_write(struct file *file, const char __user *buf,
 		task->signal->oom_score_adj = (oom_adjust * OOM_SCORE_ADJ_MAX) /
 								-OOM_DISABLE;
 	trace_oom_score_adj_update(task);
+	lowmem_adj_update(task);
 err_sighand:
 	unlock_task_sighand(task, &flags);
 err_task_lock:
@@ -1028,6 +1029,7 @@ static ssize_t oom_score_adj_write(struct file *file, const char __user *buf,
 	if (has_capability_noaudit(current, CAP_SYS_RESOURCE))
 		task->signal->oom_score_adj_min = oom_score_adj;
 	trace_oom_score_adj_update(task);
+	lowmem_adj_update(task);
 	if (task->signal->oom_score_adj == OOM_SCORE_ADJ_MIN)
 		task->signal->oom_adj = OOM_DISABLE;
 	else
@@ -102,7 +102,7 @@ struct request {
 	struct gendisk *rq_disk;
 	struct hd_struct *part;
 	unsigned long start_time;
-#ifdef CONFIG_BLK_CGROUP
+#if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_DEV_LATENCY_HIST)
 	unsigned long long start_time_ns;
 	unsigned long long io_start_time_ns;    
 #endif
@@ -227,6 +227,26 @@ struct queue_limits {
 	unsigned char		discard_zeroes_data;
 };
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+enum blk_lat_type {
+	BLK_LAT_READ,
+	BLK_LAT_WRITE,
+	BLK_LAT_SYNC_WRITE,
+	BLK_LAT_DISCARD,
+	BLK_LAT_TYPES,
+};
+
+/* bucket i counts latencies below 2^i usecs, the last one everything else */
+#define BLK_LAT_BUCKETS		24
+
+struct blk_lat_hist {
+	unsigned int		queue[BLK_LAT_TYPES][BLK_LAT_BUCKETS];
+	unsigned int		service[BLK_LAT_TYPES][BLK_LAT_BUCKETS];
+	u64			queue_ns[BLK_LAT_TYPES];
+	u64			service_ns[BLK_LAT_TYPES];
+};
+#endif
+
 struct request_queue {
 	struct list_head	queue_head;
 	struct request		*last_merge;
@@ -293,6 +313,9 @@ struct request_queue {
 	int			node;
 #ifdef CONFIG_BLK_DEV_IO_TRACE
 	struct blk_trace	*blk_trace;
+#endif
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	struct blk_lat_hist __percpu *lat_hist;
 #endif
 	unsigned int		flush_flags;
 	unsigned int		flush_not_queueable:1;
@@ -1010,7 +1033,7 @@ static inline void put_dev_sector(Sector p)
 struct work_struct;
 int kblockd_schedule_work(struct request_queue *q, struct work_struct *work);
 
-#ifdef CONFIG_BLK_CGROUP
+#if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_DEV_LATENCY_HIST)
 static inline void set_start_time_ns(struct request *req)
 {
 	preempt_disable();
@@ -18,6 +18,7 @@
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 #include <linux/list.h>
+#include <linux/ktime.h>
 #endif
 
 enum {
@@ -31,6 +32,10 @@ struct early_suspend {
 	int level;
 	void (*suspend)(struct early_suspend *h);
 	void (*resume)(struct early_suspend *h);
+	ktime_t suspend_time;
+	ktime_t max_suspend_time;
+	ktime_t resume_time;
+	ktime_t max_resume_time;
 #endif
 };
 
@@ -0,0 +1,32 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ *  LZ4 Kernel Interface
+ *
+ *  Compressor and decompressor for the LZ4 block format, as described in
+ *  https://github.com/lz4/lz4/blob/master/doc/lz4_Block_format.md
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#define LZ4_MEM_COMPRESS	(4096 * sizeof(u32))
+
+#define lz4_compressbound(isize)	((isize) + ((isize) / 255) + 16)
+
+/*
+ * Returns 0 on success, or -1 if the output did not fit in *dst_len
+ * bytes.  On success *dst_len is set to the compressed size.
+ */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * Decompresses a complete block into at most *dest_len bytes.  Returns 0
+ * and sets *dest_len to the decompressed size, or -1 if the input is
+ * malformed or would overrun the output.
+ */
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len);
+#endif
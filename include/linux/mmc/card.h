@@ -224,6 +224,7 @@ enum mmc_packed_stop_reasons {
 	EMPTY_QUEUE,
 	REL_WRITE,
 	THRESHOLD,
+	READ_PENDING,
 	MAX_REASONS,
 };
 
@@ -235,6 +236,15 @@ struct mmc_wr_pack_stats {
 	bool print_in_read;
 };
 
+#define MMC_LAT_BUCKETS		16
+
+struct mmc_req_lat_stats {
+	u32 hist[2][MMC_LAT_BUCKETS];
+	u32 max_us[2];
+	spinlock_t lock;
+	bool enabled;
+};
+
 struct mmc_card {
 	struct mmc_host		*host;		
 	struct device		dev;		
@@ -321,6 +331,7 @@ struct mmc_card {
 	unsigned int		wr_perf; 
 
 	struct mmc_wr_pack_stats wr_pack_stats; 
+	struct mmc_req_lat_stats req_lat_stats;
 };
 
 static inline void mmc_part_add(struct mmc_card *card, unsigned int size,
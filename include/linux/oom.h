@@ -53,6 +53,37 @@ static inline void oom_killer_enable(void)
 
 extern struct task_struct *find_lock_task_mm(struct task_struct *p);
 
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+extern void lowmem_task_fork(struct task_struct *p);
+extern void lowmem_task_exit(struct task_struct *p);
+extern void lowmem_task_replace(struct task_struct *old,
+				struct task_struct *new);
+extern void lowmem_adj_update(struct task_struct *p);
+extern void lowmem_vmpressure(unsigned long scanned, unsigned long reclaimed);
+#else
+static inline void lowmem_task_fork(struct task_struct *p)
+{
+}
+
+static inline void lowmem_task_exit(struct task_struct *p)
+{
+}
+
+static inline void lowmem_task_replace(struct task_struct *old,
+				       struct task_struct *new)
+{
+}
+
+static inline void lowmem_adj_update(struct task_struct *p)
+{
+}
+
+static inline void lowmem_vmpressure(unsigned long scanned,
+				     unsigned long reclaimed)
+{
+}
+#endif
+
 extern int sysctl_oom_dump_tasks;
 extern int sysctl_oom_kill_allocating_task;
 extern int sysctl_panic_on_oom;
@@ -29,3 +29,11 @@ struct rq_data {
 extern spinlock_t rq_lock;
 extern struct rq_data rq_info;
 extern struct workqueue_struct *rq_wq;
+
+#ifdef CONFIG_MSM_MPDECISION
+extern void msm_mpdec_tick(void);
+extern void msm_mpdec_set_cpu_limits(int min_cpus, int max_cpus);
+#else
+static inline void msm_mpdec_tick(void) { }
+static inline void msm_mpdec_set_cpu_limits(int min_cpus, int max_cpus) { }
+#endif
@@ -876,6 +876,7 @@ struct sched_class {
 
 #ifdef CONFIG_SMP
 	int  (*select_task_rq)(struct task_struct *p, int sd_flag, int flags);
+	void (*migrate_task_rq)(struct task_struct *p, int next_cpu);
 
 	void (*pre_schedule) (struct rq *this_rq, struct task_struct *task);
 	void (*post_schedule) (struct rq *this_rq);
@@ -946,6 +947,18 @@ struct sched_statistics {
 };
 #endif
 
+struct sched_avg {
+	/*
+	 * Time, in ~1us units, that the entity was runnable and that has
+	 * passed, both decayed geometrically so that a period of ~1ms that
+	 * is 32 periods old counts half as much as the current one.
+	 */
+	u32 runnable_avg_sum, runnable_avg_period;
+	u64 last_runnable_update;
+	s64 decay_count;
+	unsigned long load_avg_contrib;
+};
+
 struct sched_entity {
 	struct load_weight	load;		
 	struct rb_node		run_node;
@@ -970,6 +983,10 @@ struct sched_entity {
 	
 	struct cfs_rq		*my_q;
 #endif
+
+#ifdef CONFIG_SMP
+	struct sched_avg	avg;
+#endif
 };
 
 struct sched_rt_entity {
@@ -1051,6 +1068,12 @@ struct task_struct {
 #ifdef CONFIG_SMP
 	struct plist_node pushable_tasks;
 #endif
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	/* thread group leaders only, see lowmemorykiller.c */
+	struct hlist_node lmk_node;
+	int lmk_adj;
+	unsigned long lmk_rss;
+#endif
 
 	struct mm_struct *mm, *active_mm;
 #ifdef CONFIG_COMPAT_BRK
@@ -2301,6 +2324,22 @@ static inline unsigned long rlimit_max(unsigned int limit)
 	return task_rlimit_max(current, limit);
 }
 
+#ifdef CONFIG_CPU_FREQ
+#define SCHED_CPUFREQ_RT	(1U << 0)
+
+/*
+ * Called by the scheduler, with the runqueue locked, whenever the
+ * utilization of a CPU changes.  @util is out of SCHED_POWER_SCALE.
+ */
+struct update_util_data {
+	void (*func)(struct update_util_data *data, u64 time,
+		     unsigned long util, unsigned int flags);
+};
+
+extern void cpufreq_set_update_util_data(int cpu,
+					 struct update_util_data *data);
+#endif
+
 #ifdef CONFIG_CGROUP_TIMER_SLACK
 extern unsigned long task_get_effective_timer_slack(struct task_struct *tsk);
 #else
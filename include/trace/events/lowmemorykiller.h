@@ -0,0 +1,47 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lowmemorykiller
+
+#if !defined(_TRACE_LOWMEMORYKILLER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LOWMEMORYKILLER_H
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(lowmemory_kill,
+
+	TP_PROTO(struct task_struct *task, int oom_score_adj, int tasksize,
+		 int other_free, int other_file, unsigned int scanned,
+		 s64 latency_ns),
+
+	TP_ARGS(task, oom_score_adj, tasksize, other_free, other_file,
+		scanned, latency_ns),
+
+	TP_STRUCT__entry(
+		__field(	pid_t,	pid)
+		__array(	char,	comm,	TASK_COMM_LEN )
+		__field(	int,	oom_score_adj)
+		__field(	int,	tasksize)
+		__field(	int,	other_free)
+		__field(	int,	other_file)
+		__field(	unsigned int,	scanned)
+		__field(	s64,	latency_ns)
+	),
+
+	TP_fast_assign(
+		__entry->pid = task->pid;
+		memcpy(__entry->comm, task->comm, TASK_COMM_LEN);
+		__entry->oom_score_adj = oom_score_adj;
+		__entry->tasksize = tasksize;
+		__entry->other_free = other_free;
+		__entry->other_file = other_file;
+		__entry->scanned = scanned;
+		__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("pid=%d comm=%s oom_score_adj=%d tasksize=%d free=%d file=%d scanned=%u latency=%lldns",
+		__entry->pid, __entry->comm, __entry->oom_score_adj,
+		__entry->tasksize, __entry->other_free, __entry->other_file,
+		__entry->scanned, __entry->latency_ns)
+);
+
+#endif
+
+#include <trace/define_trace.h>
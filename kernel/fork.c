@@ -1286,6 +1286,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 			__this_cpu_inc(process_counts);
 		}
 		attach_pid(p, PIDTYPE_PID, pid);
+		lowmem_task_fork(p);
 		nr_threads++;
 	}
 
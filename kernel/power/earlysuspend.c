@@ -13,10 +13,13 @@
  *
  */
 
+#include <linux/async.h>
+#include <linux/debugfs.h>
 #include <linux/earlysuspend.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/rtc.h>
+#include <linux/seq_file.h>
 #include <linux/wakelock.h>
 #include <linux/workqueue.h>
 #include <linux/cpu.h>
@@ -43,6 +46,9 @@ static int debug_mask = DEBUG_USER_STATE;
 
 module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 
+static int async_handlers = 1;
+module_param(async_handlers, int, S_IRUGO | S_IWUSR | S_IWGRP);
+
 static DEFINE_MUTEX(early_suspend_lock);
 static LIST_HEAD(early_suspend_handlers);
 static void early_suspend(struct work_struct *work);
@@ -56,6 +62,9 @@ enum {
 	SUSPEND_REQUESTED_AND_SUSPENDED = SUSPEND_REQUESTED | SUSPENDED,
 };
 static int state;
+static LIST_HEAD(early_suspend_domain);
+static ktime_t early_suspend_time;
+static ktime_t late_resume_time;
 #ifdef CONFIG_HTC_ONMODE_CHARGING
 static LIST_HEAD(onchg_suspend_handlers);
 static void onchg_suspend(struct work_struct *work);
@@ -137,9 +146,89 @@ void unregister_early_suspend(struct early_suspend *handler)
 }
 EXPORT_SYMBOL(unregister_early_suspend);
 
-static void early_suspend(struct work_struct *work)
+static void call_handler(struct early_suspend *h, int resume)
+{
+	ktime_t start, delta;
+
+	if (debug_mask & DEBUG_VERBOSE)
+		pr_info("%s: calling %pf\n",
+			resume ? "late_resume" : "early_suspend",
+			resume ? h->resume : h->suspend);
+
+	start = ktime_get();
+	if (resume)
+		h->resume(h);
+	else
+		h->suspend(h);
+	delta = ktime_sub(ktime_get(), start);
+
+	if (resume) {
+		h->resume_time = delta;
+		if (delta.tv64 > h->max_resume_time.tv64)
+			h->max_resume_time = delta;
+	} else {
+		h->suspend_time = delta;
+		if (delta.tv64 > h->max_suspend_time.tv64)
+			h->max_suspend_time = delta;
+	}
+}
+
+static void call_suspend_async(void *data, async_cookie_t cookie)
+{
+	call_handler(data, 0);
+}
+
+static void call_resume_async(void *data, async_cookie_t cookie)
+{
+	call_handler(data, 1);
+}
+
+static void schedule_handler(struct early_suspend *h, int resume,
+			     int parallel, int *level)
+{
+	if (!(resume ? h->resume : h->suspend))
+		return;
+
+	if (!parallel) {
+		call_handler(h, resume);
+		return;
+	}
+
+	if (h->level != *level) {
+		async_synchronize_full_domain(&early_suspend_domain);
+		*level = h->level;
+	}
+	async_schedule_domain(resume ? call_resume_async : call_suspend_async,
+			      h, &early_suspend_domain);
+}
+
+/*
+ * Suspend handlers run in list order and resume handlers in reverse.  The
+ * handlers of one level run concurrently, and a level is finished before
+ * the next one starts, so the time of a level is that of its slowest
+ * handler.  Called with early_suspend_lock held.
+ */
+static ktime_t call_handlers(struct list_head *handlers, int resume)
 {
 	struct early_suspend *pos;
+	int parallel = async_handlers;
+	int level = INT_MIN;
+	ktime_t start = ktime_get();
+
+	if (resume) {
+		list_for_each_entry_reverse(pos, handlers, link)
+			schedule_handler(pos, resume, parallel, &level);
+	} else {
+		list_for_each_entry(pos, handlers, link)
+			schedule_handler(pos, resume, parallel, &level);
+	}
+	async_synchronize_full_domain(&early_suspend_domain);
+
+	return ktime_sub(ktime_get(), start);
+}
+
+static void early_suspend(struct work_struct *work)
+{
 	unsigned long irqflags;
 	int abort = 0;
 
@@ -167,13 +256,7 @@ static void early_suspend(struct work_struct *work)
 
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("early_suspend: call handlers\n");
-	list_for_each_entry(pos, &early_suspend_handlers, link) {
-		if (pos->suspend != NULL) {
-			if (debug_mask & DEBUG_VERBOSE)
-				pr_info("early_suspend: calling %pf\n", pos->suspend);
-			pos->suspend(pos);
-		}
-	}
+	early_suspend_time = call_handlers(&early_suspend_handlers, 0);
 	boost_cpu_speed(0);
 	mutex_unlock(&early_suspend_lock);
 
@@ -197,7 +280,6 @@ abort:
 
 static void late_resume(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
 
@@ -224,14 +306,7 @@ static void late_resume(struct work_struct *work)
 
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("late_resume: call handlers\n");
-	list_for_each_entry_reverse(pos, &early_suspend_handlers, link) {
-		if (pos->resume != NULL) {
-			if (debug_mask & DEBUG_VERBOSE)
-				pr_info("late_resume: calling %pf\n", pos->resume);
-
-			pos->resume(pos);
-		}
-	}
+	late_resume_time = call_handlers(&early_suspend_handlers, 1);
 
 	boost_cpu_speed(0);
 
@@ -272,7 +347,6 @@ EXPORT_SYMBOL(unregister_onchg_suspend);
 
 static void onchg_suspend(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
 	pr_info("[R] onchg_suspend start\n");
@@ -295,10 +369,7 @@ static void onchg_suspend(struct work_struct *work)
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("onchg_suspend: call handlers\n");
 
-	list_for_each_entry(pos, &onchg_suspend_handlers, link) {
-		if (pos->suspend != NULL)
-			pos->suspend(pos);
-	}
+	call_handlers(&onchg_suspend_handlers, 0);
 	mutex_unlock(&early_suspend_lock);
 
 abort:
@@ -307,7 +378,6 @@ abort:
 
 static void onchg_resume(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
 	pr_info("[R] onchg_resume start\n");
@@ -327,9 +397,7 @@ static void onchg_resume(struct work_struct *work)
 	}
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("onchg_resume: call handlers\n");
-	list_for_each_entry_reverse(pos, &onchg_suspend_handlers, link)
-		if (pos->resume != NULL)
-			pos->resume(pos);
+	call_handlers(&onchg_suspend_handlers, 1);
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("onchg_resume: done\n");
 abort:
@@ -415,3 +483,55 @@ suspend_state_t get_suspend_state(void)
 {
 	return requested_suspend_state;
 }
+
+static void print_handler_stats(struct seq_file *m, struct early_suspend *h)
+{
+	seq_printf(m, "%d\t%lld\t%lld\t%lld\t%lld\t%pf\n", h->level,
+		   ktime_to_ns(h->suspend_time),
+		   ktime_to_ns(h->max_suspend_time),
+		   ktime_to_ns(h->resume_time),
+		   ktime_to_ns(h->max_resume_time),
+		   h->suspend ? (void *)h->suspend : (void *)h->resume);
+}
+
+static int early_suspend_stats_show(struct seq_file *m, void *unused)
+{
+	struct early_suspend *pos;
+
+	mutex_lock(&early_suspend_lock);
+	seq_printf(m, "early_suspend\t%lld\nlate_resume\t%lld\n",
+		   ktime_to_ns(early_suspend_time),
+		   ktime_to_ns(late_resume_time));
+	seq_puts(m, "level\tsuspend_time\tmax_suspend_time\tresume_time"
+		 "\tmax_resume_time\thandler\n");
+	list_for_each_entry(pos, &early_suspend_handlers, link)
+		print_handler_stats(m, pos);
+#ifdef CONFIG_HTC_ONMODE_CHARGING
+	list_for_each_entry(pos, &onchg_suspend_handlers, link)
+		print_handler_stats(m, pos);
+#endif
+	mutex_unlock(&early_suspend_lock);
+
+	return 0;
+}
+
+static int early_suspend_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, early_suspend_stats_show, NULL);
+}
+
+static const struct file_operations early_suspend_stats_fops = {
+	.open = early_suspend_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init early_suspend_debugfs_init(void)
+{
+	debugfs_create_file("early_suspend_stats", S_IFREG | S_IRUGO,
+			    NULL, NULL, &early_suspend_stats_fops);
+	return 0;
+}
+
+late_initcall(early_suspend_debugfs_init);
@@ -15,6 +15,7 @@
 #include <linux/module.h>
 #include <linux/string.h>
 #include <linux/cpu.h>
+#include <linux/rq_stats.h>
 
 #include "power.h"
 
@@ -156,6 +157,12 @@ static void update_mp_args(const char *attr)
 	spin_unlock_irqrestore(&mp_args_lock, irq_flags);
 }
 
+static void update_mp_cpu_limits(const char *attr)
+{
+	update_mp_args(attr);
+	msm_mpdec_set_cpu_limits(mp_min_cpus_value, mp_max_cpus_value);
+}
+
 define_string_show(mp_nw, mp_nw_arg);
 define_string_store(mp_nw, mp_nw_arg, update_mp_args);
 power_attr(mp_nw);
@@ -177,11 +184,11 @@ define_int_store(mp_decision_ms, mp_decision_ms_value, update_mp_args);
 power_attr(mp_decision_ms);
 
 define_int_show(mp_min_cpus, mp_min_cpus_value);
-define_int_store(mp_min_cpus, mp_min_cpus_value, update_mp_args);
+define_int_store(mp_min_cpus, mp_min_cpus_value, update_mp_cpu_limits);
 power_attr(mp_min_cpus);
 
 define_int_show(mp_max_cpus, mp_max_cpus_value);
-define_int_store(mp_max_cpus, mp_max_cpus_value, update_mp_args);
+define_int_store(mp_max_cpus, mp_max_cpus_value, update_mp_cpu_limits);
 power_attr(mp_max_cpus);
 
 static ssize_t wait_for_mp_args_show(struct kobject *kobj,
@@ -18,6 +18,7 @@
 
 struct pm_qos_object {
 	struct pm_qos_constraints *constraints;
+	struct pm_qos_constraints *cpu_constraints;
 	struct miscdevice pm_qos_power_miscdev;
 	char *name;
 };
@@ -67,11 +68,50 @@ static struct pm_qos_object network_throughput_pm_qos = {
 };
 
 
+/*
+ * The frequency classes also have one list per CPU.  A request added with
+ * pm_qos_add_cpu_request() only bounds that CPU, one added the usual way
+ * bounds all of them; the bound of a CPU is the two combined.
+ */
+static struct pm_qos_constraints cpu_freq_min_cpu_constraints[NR_CPUS];
+static struct pm_qos_constraints cpu_freq_max_cpu_constraints[NR_CPUS];
+
+static BLOCKING_NOTIFIER_HEAD(cpu_freq_min_notifier);
+static struct pm_qos_constraints cpu_freq_min_constraints = {
+	.list = PLIST_HEAD_INIT(cpu_freq_min_constraints.list),
+	.target_value = PM_QOS_CPU_FREQ_MIN_DEFAULT_VALUE,
+	.default_value = PM_QOS_CPU_FREQ_MIN_DEFAULT_VALUE,
+	.type = PM_QOS_MAX,
+	.notifiers = &cpu_freq_min_notifier,
+};
+static struct pm_qos_object cpu_freq_min_pm_qos = {
+	.constraints = &cpu_freq_min_constraints,
+	.cpu_constraints = cpu_freq_min_cpu_constraints,
+	.name = "cpu_freq_min",
+};
+
+static BLOCKING_NOTIFIER_HEAD(cpu_freq_max_notifier);
+static struct pm_qos_constraints cpu_freq_max_constraints = {
+	.list = PLIST_HEAD_INIT(cpu_freq_max_constraints.list),
+	.target_value = PM_QOS_CPU_FREQ_MAX_DEFAULT_VALUE,
+	.default_value = PM_QOS_CPU_FREQ_MAX_DEFAULT_VALUE,
+	.type = PM_QOS_MIN,
+	.notifiers = &cpu_freq_max_notifier,
+};
+static struct pm_qos_object cpu_freq_max_pm_qos = {
+	.constraints = &cpu_freq_max_constraints,
+	.cpu_constraints = cpu_freq_max_cpu_constraints,
+	.name = "cpu_freq_max",
+};
+
+
 static struct pm_qos_object *pm_qos_array[] = {
 	&null_pm_qos,
 	&cpu_dma_pm_qos,
 	&network_lat_pm_qos,
-	&network_throughput_pm_qos
+	&network_throughput_pm_qos,
+	&cpu_freq_min_pm_qos,
+	&cpu_freq_max_pm_qos
 };
 
 static ssize_t pm_qos_power_write(struct file *filp, const char __user *buf,
@@ -117,6 +157,16 @@ static inline void pm_qos_set_value(struct pm_qos_constraints *c, s32 value)
 	c->target_value = value;
 }
 
+static struct pm_qos_constraints *pm_qos_req_constraints(
+		struct pm_qos_request *req)
+{
+	struct pm_qos_object *qos = pm_qos_array[req->pm_qos_class];
+
+	if (req->cpu == PM_QOS_ALL_CPUS)
+		return qos->constraints;
+	return &qos->cpu_constraints[req->cpu];
+}
+
 int pm_qos_update_target(struct pm_qos_constraints *c, struct plist_node *node,
 			 enum pm_qos_req_action action, int value)
 {
@@ -166,6 +216,22 @@ int pm_qos_request(int pm_qos_class)
 }
 EXPORT_SYMBOL_GPL(pm_qos_request);
 
+int pm_qos_cpu_request(int pm_qos_class, int cpu)
+{
+	struct pm_qos_object *qos = pm_qos_array[pm_qos_class];
+	s32 value = pm_qos_read_value(qos->constraints);
+	s32 cpu_value;
+
+	if (!qos->cpu_constraints)
+		return value;
+
+	cpu_value = pm_qos_read_value(&qos->cpu_constraints[cpu]);
+	if (qos->constraints->type == PM_QOS_MIN)
+		return min(value, cpu_value);
+	return max(value, cpu_value);
+}
+EXPORT_SYMBOL_GPL(pm_qos_cpu_request);
+
 int pm_qos_request_active(struct pm_qos_request *req)
 {
 	return req->pm_qos_class != 0;
@@ -193,12 +259,37 @@ void pm_qos_add_request(struct pm_qos_request *req,
 		return;
 	}
 	req->pm_qos_class = pm_qos_class;
+	req->cpu = PM_QOS_ALL_CPUS;
 	INIT_DELAYED_WORK(&req->work, pm_qos_work_fn);
 	pm_qos_update_target(pm_qos_array[pm_qos_class]->constraints,
 			     &req->node, PM_QOS_ADD_REQ, value);
 }
 EXPORT_SYMBOL_GPL(pm_qos_add_request);
 
+void pm_qos_add_cpu_request(struct pm_qos_request *req,
+			    int pm_qos_class, int cpu, s32 value)
+{
+	if (!req)
+		return;
+
+	if (pm_qos_request_active(req)) {
+		WARN(1, KERN_ERR "pm_qos_add_cpu_request() called for already added request\n");
+		return;
+	}
+	if (WARN(!pm_qos_array[pm_qos_class]->cpu_constraints ||
+		 cpu < 0 || cpu >= nr_cpu_ids,
+		 "%s: no constraints of class %d for cpu %d\n", __func__,
+		 pm_qos_class, cpu))
+		return;
+
+	req->pm_qos_class = pm_qos_class;
+	req->cpu = cpu;
+	INIT_DELAYED_WORK(&req->work, pm_qos_work_fn);
+	pm_qos_update_target(pm_qos_req_constraints(req),
+			     &req->node, PM_QOS_ADD_REQ, value);
+}
+EXPORT_SYMBOL_GPL(pm_qos_add_cpu_request);
+
 void pm_qos_update_request(struct pm_qos_request *req,
 			   s32 new_value)
 {
@@ -214,8 +305,7 @@ void pm_qos_update_request(struct pm_qos_request *req,
 		cancel_delayed_work_sync(&req->work);
 
 	if (new_value != req->node.prio)
-		pm_qos_update_target(
-			pm_qos_array[req->pm_qos_class]->constraints,
+		pm_qos_update_target(pm_qos_req_constraints(req),
 			&req->node, PM_QOS_UPDATE_REQ, new_value);
 }
 EXPORT_SYMBOL_GPL(pm_qos_update_request);
@@ -233,8 +323,7 @@ void pm_qos_update_request_timeout(struct pm_qos_request *req, s32 new_value,
 		cancel_delayed_work_sync(&req->work);
 
 	if (new_value != req->node.prio)
-		pm_qos_update_target(
-			pm_qos_array[req->pm_qos_class]->constraints,
+		pm_qos_update_target(pm_qos_req_constraints(req),
 			&req->node, PM_QOS_UPDATE_REQ, new_value);
 
 	schedule_delayed_work(&req->work, usecs_to_jiffies(timeout_us));
@@ -254,7 +343,7 @@ void pm_qos_remove_request(struct pm_qos_request *req)
 	if (delayed_work_pending(&req->work))
 		cancel_delayed_work_sync(&req->work);
 
-	pm_qos_update_target(pm_qos_array[req->pm_qos_class]->constraints,
+	pm_qos_update_target(pm_qos_req_constraints(req),
 			     &req->node, PM_QOS_REMOVE_REQ,
 			     PM_QOS_DEFAULT_VALUE);
 	memset(req, 0, sizeof(*req));
@@ -350,7 +439,7 @@ static ssize_t pm_qos_power_read(struct file *filp, char __user *buf,
 		return -EINVAL;
 
 	spin_lock_irqsave(&pm_qos_lock, flags);
-	value = pm_qos_get_value(pm_qos_array[req->pm_qos_class]->constraints);
+	value = pm_qos_get_value(pm_qos_req_constraints(req));
 	spin_unlock_irqrestore(&pm_qos_lock, flags);
 
 	return simple_read_from_buffer(buf, count, f_pos, &value, sizeof(s32));
@@ -397,6 +486,24 @@ static ssize_t pm_qos_power_write(struct file *filp, const char __user *buf,
 	return count;
 }
 
+static int __init pm_qos_cpu_constraints_init(void)
+{
+	struct pm_qos_constraints *c;
+	int i, cpu;
+
+	for (i = 1; i < PM_QOS_NUM_CLASSES; i++) {
+		if (!pm_qos_array[i]->cpu_constraints)
+			continue;
+		for_each_possible_cpu(cpu) {
+			c = &pm_qos_array[i]->cpu_constraints[cpu];
+			*c = *pm_qos_array[i]->constraints;
+			plist_head_init(&c->list);
+		}
+	}
+
+	return 0;
+}
+pure_initcall(pm_qos_cpu_constraints_init);
 
 static int __init pm_qos_power_init(void)
 {
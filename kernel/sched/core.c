@@ -907,6 +907,8 @@ void set_task_cpu(struct task_struct *p, unsigned int new_cpu)
 	trace_sched_migrate_task(p, new_cpu);
 
 	if (task_cpu(p) != new_cpu) {
+		if (p->sched_class->migrate_task_rq)
+			p->sched_class->migrate_task_rq(p, new_cpu);
 		p->se.nr_migrations++;
 		perf_sw_event(PERF_COUNT_SW_CPU_MIGRATIONS, 1, NULL, 0);
 	}
@@ -1337,6 +1339,13 @@ static void __sched_fork(struct task_struct *p)
 	p->se.vruntime			= 0;
 	INIT_LIST_HEAD(&p->se.group_node);
 
+#ifdef CONFIG_SMP
+	p->se.avg.runnable_avg_period = 0;
+	p->se.avg.runnable_avg_sum = 0;
+	p->se.avg.load_avg_contrib = 0;
+	p->se.avg.decay_count = 0;
+#endif
+
 #ifdef CONFIG_SCHEDSTATS
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
 #endif
@@ -1407,6 +1416,7 @@ void wake_up_new_task(struct task_struct *p)
 
 	raw_spin_lock_irqsave(&p->pi_lock, flags);
 #ifdef CONFIG_SMP
+	init_task_runnable_average(p);
 	set_task_cpu(p, select_task_rq(p, SD_BALANCE_FORK, 0));
 #endif
 
@@ -1884,6 +1894,10 @@ void update_cpu_load(struct rq *this_rq)
 	unsigned long pending_updates;
 	int i, scale;
 
+#ifdef CONFIG_SMP
+	if (sched_feat(LB_LOAD_AVG))
+		this_load = this_rq->cfs.runnable_load_avg;
+#endif
 	this_rq->nr_load_updates++;
 
 	
@@ -2291,6 +2305,75 @@ void thread_group_times(struct task_struct *p, cputime_t *ut, cputime_t *st)
 }
 #endif
 
+#ifdef CONFIG_CPU_FREQ
+DEFINE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/*
+ * Let a cpufreq governor follow the utilization of @cpu, or stop it
+ * with a NULL @data.  The caller has to wait for synchronize_sched()
+ * before freeing what it passed in.
+ */
+void cpufreq_set_update_util_data(int cpu, struct update_util_data *data)
+{
+	struct rq *rq = cpu_rq(cpu);
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&rq->lock, flags);
+	rq->util_stamp = rq->clock;
+	rq->util_avg = 0;
+	rq->util_busy = rq->nr_running > 0;
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), data);
+	raw_spin_unlock_irqrestore(&rq->lock, flags);
+}
+EXPORT_SYMBOL_GPL(cpufreq_set_update_util_data);
+
+/*
+ * The utilization is the share of time the runqueue was not empty,
+ * averaged over periods of 2^18 ns (~262us) and decayed with a half-life
+ * of 32 periods (~8ms).  util_decay_inv[n] is 2^32 * y^n with y^32 = 1/2.
+ *
+ * This is kept apart from rq->avg on purpose: the load tracking average
+ * has a half-life of ~32ms, which suits load balancing but would make
+ * the governor four times slower to follow a burst of work.
+ */
+#define UTIL_PERIOD_SHIFT	18
+
+static const u32 util_decay_inv[32] = {
+	0xffffffff, 0xfa83b2da, 0xf5257d14, 0xefe4b99a, 0xeac0c6e6, 0xe5b906e6,
+	0xe0ccdeeb, 0xdbfbb796, 0xd744fcc9, 0xd2a81d91, 0xce248c14, 0xc9b9bd85,
+	0xc5672a10, 0xc12c4cc9, 0xbd08a39e, 0xb8fbaf46, 0xb504f333, 0xb123f581,
+	0xad583ee9, 0xa9a15ab4, 0xa5fed6a9, 0xa2704302, 0x9ef5325f, 0x9b8d39b9,
+	0x9837f050, 0x94f4efa8, 0x91c3d373, 0x8ea4398a, 0x8b95c1e3, 0x88980e80,
+	0x85aac367, 0x82cd8698,
+};
+
+static unsigned long util_decay(unsigned long val, u64 periods)
+{
+	if (periods >= 32 * BITS_PER_LONG)
+		return 0;
+
+	val >>= (unsigned int)periods / 32;
+	return ((u64)val * util_decay_inv[(unsigned int)periods % 32]) >> 32;
+}
+
+void __cpufreq_update_util(struct rq *rq, struct update_util_data *data,
+			   unsigned int flags)
+{
+	u64 periods = (rq->clock - rq->util_stamp) >> UTIL_PERIOD_SHIFT;
+
+	if (periods) {
+		rq->util_avg = util_decay(rq->util_avg, periods);
+		if (rq->util_busy)
+			rq->util_avg += SCHED_POWER_SCALE -
+				util_decay(SCHED_POWER_SCALE, periods);
+		rq->util_stamp += periods << UTIL_PERIOD_SHIFT;
+	}
+	rq->util_busy = rq->nr_running > 0;
+
+	data->func(data, rq->clock, rq->util_avg, flags);
+}
+#endif
+
 void scheduler_tick(void)
 {
 	int cpu = smp_processor_id();
@@ -2303,6 +2386,7 @@ void scheduler_tick(void)
 	update_rq_clock(rq);
 	update_cpu_load_active(rq);
 	curr->sched_class->task_tick(rq, curr, 0);
+	cpufreq_update_util(rq, rt_task(curr) ? SCHED_CPUFREQ_RT : 0);
 	raw_spin_unlock(&rq->lock);
 
 	perf_event_task_tick();
@@ -16,6 +16,7 @@ static void check_preempt_curr_idle(struct rq *rq, struct task_struct *p, int fl
 static struct task_struct *pick_next_task_idle(struct rq *rq)
 {
 	schedstat_inc(rq, sched_goidle);
+	update_rq_runnable_avg(rq, 1);
 	return rq->idle;
 }
 
@@ -30,10 +31,12 @@ dequeue_task_idle(struct rq *rq, struct task_struct *p, int flags)
 
 static void put_prev_task_idle(struct rq *rq, struct task_struct *prev)
 {
+	update_rq_runnable_avg(rq, 0);
 }
 
 static void task_tick_idle(struct rq *rq, struct task_struct *curr, int queued)
 {
+	update_rq_runnable_avg(rq, 0);
 }
 
 static void set_curr_task_idle(struct rq *rq)
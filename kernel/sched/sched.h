@@ -89,6 +89,10 @@ struct task_group {
 	unsigned long shares;
 
 	atomic_t load_weight;
+#ifdef CONFIG_SMP
+	atomic64_t load_avg;
+	atomic_t runnable_avg;
+#endif
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -177,6 +181,22 @@ struct cfs_rq {
 	unsigned int nr_spread_over;
 #endif
 
+#ifdef CONFIG_SMP
+	/*
+	 * The load_avg_contrib of the entities queued here, and that of the
+	 * ones that went to sleep from here, decayed every ~1ms that passes.
+	 * Entities that sleep keep the decay_counter value they left at and
+	 * catch up on what they missed when they wake up.
+	 */
+	unsigned long runnable_load_avg, blocked_load_avg;
+	atomic64_t decay_counter, removed_load;
+	u64 last_decay;
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	u32 tg_runnable_contrib;
+	u64 tg_load_contrib;
+#endif
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct rq *rq;	
 
@@ -291,6 +311,14 @@ struct rq {
 
 	unsigned long nr_uninterruptible;
 
+	struct sched_avg avg;
+
+#ifdef CONFIG_CPU_FREQ
+	u64 util_stamp;
+	unsigned long util_avg;
+	int util_busy;
+#endif
+
 	struct task_struct *curr, *idle, *stop;
 	unsigned long next_balance;
 	struct mm_struct *prev_mm;
@@ -907,12 +935,35 @@ extern struct sched_entity *__pick_last_entity(struct cfs_rq *cfs_rq);
 extern void print_cfs_stats(struct seq_file *m, int cpu);
 extern void print_rt_stats(struct seq_file *m, int cpu);
 
+extern void update_rq_runnable_avg(struct rq *rq, int runnable);
+extern void init_task_runnable_average(struct task_struct *p);
+
 extern void init_cfs_rq(struct cfs_rq *cfs_rq);
 extern void init_rt_rq(struct rt_rq *rt_rq, struct rq *rq);
 extern void unthrottle_offline_cfs_rqs(struct rq *rq);
 
 extern void account_cfs_bandwidth_used(int enabled, int was_enabled);
 
+#ifdef CONFIG_CPU_FREQ
+DECLARE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+extern void __cpufreq_update_util(struct rq *rq,
+				  struct update_util_data *data,
+				  unsigned int flags);
+
+static inline void cpufreq_update_util(struct rq *rq, unsigned int flags)
+{
+	struct update_util_data *data;
+
+	data = rcu_dereference_sched(per_cpu(cpufreq_update_util_data,
+					     cpu_of(rq)));
+	if (data)
+		__cpufreq_update_util(rq, data, flags);
+}
+#else
+static inline void cpufreq_update_util(struct rq *rq, unsigned int flags) { }
+#endif
+
 #ifdef CONFIG_NO_HZ
 enum rq_nohz_flag_bits {
 	NOHZ_TICK_STOPPED,
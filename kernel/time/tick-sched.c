@@ -621,6 +621,7 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 		if ((rq_info.init == 1) && (tick_do_timer_cpu == cpu)) {
 
 			update_rq_stats();
+			msm_mpdec_tick();
 
 			wakeup_user();
 		}
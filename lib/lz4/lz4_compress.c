@@ -0,0 +1,127 @@
+/*
+ * LZ4 block compressor
+ *
+ * Greedy single-pass compressor producing the LZ4 block format: a hash
+ * table of 4-byte sequences finds match candidates, and runs of misses
+ * make the scan step grow so incompressible data is skipped quickly.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline u32 lz4_hash(u32 seq)
+{
+	return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline unsigned char *lz4_put_length(unsigned char *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	const unsigned char *ip = src, *anchor = src, *ref;
+	const unsigned char * const iend = src + src_len;
+	const unsigned char * const mflimit = iend - MFLIMIT;
+	const unsigned char * const matchlimit = iend - LASTLITERALS;
+	unsigned char *op = dst, *token;
+	unsigned char * const oend = dst + *dst_len;
+	u32 *hash_table = wrkmem;
+	unsigned int misses = 0;
+	size_t lit, mlen;
+
+	memset(hash_table, 0, LZ4_MEM_COMPRESS);
+
+	if (src_len < MFLIMIT + 1)
+		goto last_literals;
+
+	while (ip < mflimit) {
+		const unsigned char *mp, *rp;
+		u32 seq = get_unaligned((const u32 *)ip);
+		u32 h = lz4_hash(seq);
+
+		ref = src + hash_table[h];
+		hash_table[h] = ip - src;
+		if (ref >= ip || ip - ref > MAX_DISTANCE ||
+		    get_unaligned((const u32 *)ref) != seq) {
+			ip += (misses++ >> SKIP_STRENGTH) + 1;
+			continue;
+		}
+		misses = 0;
+
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		mp = ip + MINMATCH;
+		rp = ref + MINMATCH;
+		while (mp < matchlimit && *mp == *rp) {
+			mp++;
+			rp++;
+		}
+
+		lit = ip - anchor;
+		mlen = mp - ip - MINMATCH;
+		if ((size_t)(oend - op) < 1 + lit / 255 + 1 + lit + 2 +
+					  mlen / 255 + 1 + 1 + LASTLITERALS)
+			return -1;
+
+		token = op++;
+		if (lit >= RUN_MASK) {
+			*token = RUN_MASK << ML_BITS;
+			op = lz4_put_length(op, lit - RUN_MASK);
+		} else {
+			*token = lit << ML_BITS;
+		}
+		memcpy(op, anchor, lit);
+		op += lit;
+
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		if (mlen >= ML_MASK) {
+			*token |= ML_MASK;
+			op = lz4_put_length(op, mlen - ML_MASK);
+		} else {
+			*token |= mlen;
+		}
+
+		ip = anchor = mp;
+	}
+
+last_literals:
+	lit = iend - anchor;
+	if ((size_t)(oend - op) < 1 + lit / 255 + 1 + lit)
+		return -1;
+
+	token = op++;
+	if (lit >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, lit - RUN_MASK);
+	} else {
+		*token = lit << ML_BITS;
+	}
+	memcpy(op, anchor, lit);
+	op += lit;
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
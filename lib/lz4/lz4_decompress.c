@@ -0,0 +1,95 @@
+/*
+ * LZ4 block decompressor
+ *
+ * Every length and offset is checked against the input and output
+ * bounds, so malformed input fails instead of overrunning buffers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#endif
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline int lz4_get_length(const unsigned char **ip,
+				 const unsigned char *iend, size_t *len)
+{
+	unsigned char s;
+
+	do {
+		if (*ip >= iend)
+			return -1;
+		s = *(*ip)++;
+		*len += s;
+	} while (s == 255);
+
+	return 0;
+}
+
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len)
+{
+	const unsigned char *ip = src;
+	const unsigned char * const iend = src + src_len;
+	unsigned char *op = dest, *ref;
+	unsigned char * const oend = dest + *dest_len;
+	unsigned int token;
+	size_t len, offset;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		len = token >> ML_BITS;
+		if (len == RUN_MASK && lz4_get_length(&ip, iend, &len))
+			return -1;
+		if (len > (size_t)(iend - ip) || len > (size_t)(oend - op))
+			return -1;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* the last sequence has literals only */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return -1;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (!offset || offset > (size_t)(op - dest))
+			return -1;
+
+		len = token & ML_MASK;
+		if (len == ML_MASK && lz4_get_length(&ip, iend, &len))
+			return -1;
+		len += MINMATCH;
+		if (len > (size_t)(oend - op))
+			return -1;
+
+		ref = op - offset;
+		if (offset >= len) {
+			memcpy(op, ref, len);
+			op += len;
+		} else {
+			/* overlapping match repeats the last offset bytes */
+			while (len--)
+				*op++ = *ref++;
+		}
+	}
+
+	*dest_len = op - dest;
+	return 0;
+}
+#ifndef STATIC
+EXPORT_SYMBOL_GPL(lz4_decompress_unknownoutputsize);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+#endif
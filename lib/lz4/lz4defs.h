@@ -0,0 +1,19 @@
+/*
+ * lz4defs.h -- constants shared by the LZ4 compressor and decompressor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define MINMATCH	4
+#define MFLIMIT		12	/* last match must start this far from the end */
+#define LASTLITERALS	5	/* last bytes are always literals */
+#define MAX_DISTANCE	65535
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_MASK	((1U << (8 - ML_BITS)) - 1)
+
+#define LZ4_HASH_LOG	12
+#define SKIP_STRENGTH	6
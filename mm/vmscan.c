@@ -1136,6 +1136,9 @@ shrink_inactive_list(unsigned long nr_to_scan, struct mem_cgroup_zone *mz,
 
 	free_hot_cold_page_list(&page_list, 1);
 
+	if (global_reclaim(sc))
+		lowmem_vmpressure(nr_scanned, nr_reclaimed);
+
 	if (nr_writeback && nr_writeback >= (nr_taken >> (DEF_PRIORITY-priority)))
 		wait_iff_congested(zone, BLK_RW_ASYNC, HZ/10);
 
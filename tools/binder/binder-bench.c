@@ -0,0 +1,562 @@
+/*
+ * binder-bench: binder transaction throughput and latency benchmark
+ *
+ * Forks a small context manager plus N client/server process pairs.
+ * Every server publishes a binder object through the context manager,
+ * its client looks it up and then issues synchronous transactions
+ * against it as fast as it can.  Each client reports its transaction
+ * rate and round-trip latency; running with increasing -p shows how
+ * well the driver scales with unrelated traffic.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "../../drivers/staging/android/binder.h"
+
+#define BINDER_DEV		"/dev/binder"
+#define BINDER_MAP_SIZE		(128 * 1024)
+#define MAX_PAIRS		64
+#define MAX_PAYLOAD		(16 * 1024)
+#define LAT_BUCKETS		24
+
+/* transaction codes understood by the context manager */
+#define BENCH_ADD_SERVICE	1
+#define BENCH_GET_SERVICE	2
+/* transaction code used between clients and servers */
+#define BENCH_PING		3
+
+struct bench_proc {
+	int fd;
+	void *map;
+	uint32_t rbuf[128];
+	size_t rpos;
+	size_t rlen;
+};
+
+struct bench_add {
+	struct flat_binder_object obj;
+	uint32_t index;
+};
+
+struct bench_result {
+	unsigned long count;
+	unsigned long long elapsed_ns;
+	unsigned long long total_ns;
+	unsigned long long min_ns;
+	unsigned long long max_ns;
+	unsigned long hist[LAT_BUCKETS];	/* log2 of latency in usecs */
+};
+
+static int pairs = 1;
+static unsigned long iterations = 10000;
+static size_t payload = 32;
+static char payload_buf[MAX_PAYLOAD];
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_open(struct bench_proc *bp)
+{
+	struct binder_version vers;
+
+	bp->fd = open(BINDER_DEV, O_RDWR);
+	if (bp->fd < 0)
+		fatal("open " BINDER_DEV);
+	if (ioctl(bp->fd, BINDER_VERSION, &vers) < 0)
+		fatal("BINDER_VERSION");
+	if (vers.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		fprintf(stderr, "binder protocol %ld, expected %d\n",
+			vers.protocol_version, BINDER_CURRENT_PROTOCOL_VERSION);
+		exit(1);
+	}
+	bp->map = mmap(NULL, BINDER_MAP_SIZE, PROT_READ, MAP_PRIVATE,
+		       bp->fd, 0);
+	if (bp->map == MAP_FAILED)
+		fatal("mmap");
+	bp->rpos = bp->rlen = 0;
+}
+
+static void bench_write(struct bench_proc *bp, void *data, size_t len)
+{
+	struct binder_write_read bwr;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_size = len;
+	bwr.write_buffer = (unsigned long)data;
+	while (bwr.write_consumed < bwr.write_size) {
+		if (ioctl(bp->fd, BINDER_WRITE_READ, &bwr) < 0) {
+			if (errno == EINTR)
+				continue;
+			fatal("BINDER_WRITE_READ write");
+		}
+	}
+}
+
+static void bench_cmd(struct bench_proc *bp, uint32_t cmd)
+{
+	bench_write(bp, &cmd, sizeof(cmd));
+}
+
+static void *bench_next(struct bench_proc *bp, size_t len)
+{
+	void *p = (char *)bp->rbuf + bp->rpos;
+
+	if (bp->rpos + len > bp->rlen) {
+		fprintf(stderr, "binder: truncated return buffer\n");
+		exit(1);
+	}
+	bp->rpos += len;
+	return p;
+}
+
+/*
+ * Reads return commands until a transaction or reply arrives, taking
+ * care of the reference counting housekeeping on the way.  Returns the
+ * BR_ code, or BR_DEAD_REPLY/BR_FAILED_REPLY on failure.
+ */
+static uint32_t bench_wait(struct bench_proc *bp,
+			   struct binder_transaction_data *tr)
+{
+	for (;;) {
+		uint32_t cmd;
+
+		if (bp->rpos >= bp->rlen) {
+			struct binder_write_read bwr;
+
+			memset(&bwr, 0, sizeof(bwr));
+			bwr.read_size = sizeof(bp->rbuf);
+			bwr.read_buffer = (unsigned long)bp->rbuf;
+			if (ioctl(bp->fd, BINDER_WRITE_READ, &bwr) < 0) {
+				if (errno == EINTR)
+					continue;
+				fatal("BINDER_WRITE_READ read");
+			}
+			bp->rpos = 0;
+			bp->rlen = bwr.read_consumed;
+			continue;
+		}
+
+		cmd = *(uint32_t *)bench_next(bp, sizeof(uint32_t));
+		switch (cmd) {
+		case BR_NOOP:
+		case BR_TRANSACTION_COMPLETE:
+		case BR_SPAWN_LOOPER:
+			break;
+		case BR_INCREFS:
+		case BR_ACQUIRE: {
+			struct binder_ptr_cookie *pc;
+			struct {
+				uint32_t cmd;
+				struct binder_ptr_cookie pc;
+			} __attribute__((packed)) done;
+
+			pc = bench_next(bp, sizeof(*pc));
+			done.cmd = cmd == BR_INCREFS ?
+				BC_INCREFS_DONE : BC_ACQUIRE_DONE;
+			done.pc = *pc;
+			bench_write(bp, &done, sizeof(done));
+			break;
+		}
+		case BR_RELEASE:
+		case BR_DECREFS:
+			bench_next(bp, sizeof(struct binder_ptr_cookie));
+			break;
+		case BR_DEAD_BINDER:
+		case BR_CLEAR_DEATH_NOTIFICATION_DONE:
+			bench_next(bp, sizeof(void *));
+			break;
+		case BR_TRANSACTION:
+		case BR_REPLY:
+			memcpy(tr, bench_next(bp, sizeof(*tr)), sizeof(*tr));
+			return cmd;
+		case BR_DEAD_REPLY:
+		case BR_FAILED_REPLY:
+			return cmd;
+		default:
+			fprintf(stderr, "binder: unexpected return 0x%x\n", cmd);
+			exit(1);
+		}
+	}
+}
+
+/*
+ * Sends a transaction or reply, freeing the buffer of the one being
+ * answered (if any) in the same write.
+ */
+static void bench_send(struct bench_proc *bp, uint32_t cmd,
+		       const void *free_buf, uint32_t handle, uint32_t code,
+		       const void *data, size_t data_size,
+		       const size_t *offsets, size_t offsets_size)
+{
+	struct {
+		uint32_t free_cmd;
+		const void *free_buf;
+		uint32_t cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) out;
+	void *start = &out;
+	size_t len = sizeof(out);
+
+	memset(&out, 0, sizeof(out));
+	if (free_buf) {
+		out.free_cmd = BC_FREE_BUFFER;
+		out.free_buf = free_buf;
+	} else {
+		start = &out.cmd;
+		len -= offsetof(typeof(out), cmd);
+	}
+	out.cmd = cmd;
+	out.tr.target.handle = handle;
+	out.tr.code = code;
+	out.tr.data_size = data_size;
+	out.tr.offsets_size = offsets_size;
+	out.tr.data.ptr.buffer = data;
+	out.tr.data.ptr.offsets = offsets;
+	bench_write(bp, start, len);
+}
+
+static void bench_free(struct bench_proc *bp, const void *buf)
+{
+	struct {
+		uint32_t cmd;
+		const void *buf;
+	} __attribute__((packed)) out = { BC_FREE_BUFFER, buf };
+
+	bench_write(bp, &out, sizeof(out));
+}
+
+static void bench_acquire(struct bench_proc *bp, uint32_t handle)
+{
+	uint32_t out[2] = { BC_ACQUIRE, handle };
+
+	bench_write(bp, out, sizeof(out));
+}
+
+static void run_context_manager(int ready_fd)
+{
+	struct bench_proc bp;
+	uint32_t handles[MAX_PAIRS];
+	static const uint32_t ok = 0, not_found = 1;
+
+	memset(handles, 0, sizeof(handles));
+	bench_open(&bp);
+	if (ioctl(bp.fd, BINDER_SET_CONTEXT_MGR, 0) < 0)
+		fatal("BINDER_SET_CONTEXT_MGR");
+	bench_cmd(&bp, BC_ENTER_LOOPER);
+	if (write(ready_fd, "", 1) != 1)
+		fatal("write");
+	close(ready_fd);
+
+	for (;;) {
+		struct binder_transaction_data tr;
+		const void *buf;
+		uint32_t index;
+
+		if (bench_wait(&bp, &tr) != BR_TRANSACTION)
+			continue;
+		buf = tr.data.ptr.buffer;
+
+		if (tr.code == BENCH_ADD_SERVICE &&
+		    tr.data_size >= sizeof(struct bench_add) &&
+		    tr.offsets_size >= sizeof(size_t)) {
+			const struct bench_add *add = buf;
+
+			if (add->index < MAX_PAIRS &&
+			    add->obj.type == BINDER_TYPE_HANDLE) {
+				/* keep the ref once the buffer is freed */
+				bench_acquire(&bp, add->obj.handle);
+				handles[add->index] = add->obj.handle;
+			}
+			bench_send(&bp, BC_REPLY, buf, 0, 0,
+				   &ok, sizeof(ok), NULL, 0);
+		} else if (tr.code == BENCH_GET_SERVICE &&
+			   tr.data_size >= sizeof(uint32_t)) {
+			index = *(const uint32_t *)buf;
+			if (index < MAX_PAIRS && handles[index]) {
+				struct flat_binder_object obj;
+				static const size_t offset;
+
+				memset(&obj, 0, sizeof(obj));
+				obj.type = BINDER_TYPE_HANDLE;
+				obj.handle = handles[index];
+				bench_send(&bp, BC_REPLY, buf, 0, 0,
+					   &obj, sizeof(obj),
+					   &offset, sizeof(offset));
+			} else
+				bench_send(&bp, BC_REPLY, buf, 0, 0,
+					   &not_found, sizeof(not_found),
+					   NULL, 0);
+		} else
+			bench_send(&bp, BC_REPLY, buf, 0, 0,
+				   &not_found, sizeof(not_found), NULL, 0);
+	}
+}
+
+static void run_server(int index)
+{
+	struct bench_proc bp;
+	struct binder_transaction_data tr;
+	struct bench_add add;
+	static const size_t offset;
+
+	bench_open(&bp);
+
+	memset(&add, 0, sizeof(add));
+	add.obj.type = BINDER_TYPE_BINDER;
+	add.obj.flags = 0x7f | FLAT_BINDER_FLAG_ACCEPTS_FDS;
+	add.obj.binder = (void *)(unsigned long)(0x1000 + index);
+	add.index = index;
+	bench_send(&bp, BC_TRANSACTION, NULL, 0, BENCH_ADD_SERVICE,
+		   &add, sizeof(add), &offset, sizeof(offset));
+	if (bench_wait(&bp, &tr) != BR_REPLY) {
+		fprintf(stderr, "server %d: register failed\n", index);
+		exit(1);
+	}
+	bench_free(&bp, tr.data.ptr.buffer);
+
+	bench_cmd(&bp, BC_ENTER_LOOPER);
+	for (;;) {
+		if (bench_wait(&bp, &tr) != BR_TRANSACTION)
+			continue;
+		bench_send(&bp, BC_REPLY, tr.data.ptr.buffer, 0, 0,
+			   payload_buf, tr.data_size, NULL, 0);
+	}
+}
+
+static uint32_t lookup_service(struct bench_proc *bp, uint32_t index)
+{
+	struct binder_transaction_data tr;
+	int tries;
+
+	for (tries = 0; tries < 1000; tries++) {
+		const struct flat_binder_object *obj;
+		uint32_t handle = 0;
+
+		bench_send(bp, BC_TRANSACTION, NULL, 0, BENCH_GET_SERVICE,
+			   &index, sizeof(index), NULL, 0);
+		if (bench_wait(bp, &tr) != BR_REPLY) {
+			fprintf(stderr, "client %u: lookup failed\n", index);
+			exit(1);
+		}
+		obj = tr.data.ptr.buffer;
+		if (tr.data_size >= sizeof(*obj) &&
+		    obj->type == BINDER_TYPE_HANDLE) {
+			handle = obj->handle;
+			bench_acquire(bp, handle);
+		}
+		bench_free(bp, tr.data.ptr.buffer);
+		if (handle)
+			return handle;
+		usleep(10000);
+	}
+	fprintf(stderr, "client %u: service never showed up\n", index);
+	exit(1);
+}
+
+static void run_client(int index, int result_fd)
+{
+	struct bench_proc bp;
+	struct bench_result res;
+	struct binder_transaction_data tr;
+	const void *pending = NULL;
+	unsigned long long start;
+	uint32_t handle;
+	unsigned long i;
+
+	bench_open(&bp);
+	handle = lookup_service(&bp, index);
+
+	memset(&res, 0, sizeof(res));
+	res.min_ns = ~0ULL;
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		unsigned long long t0 = now_ns(), lat;
+		unsigned long us;
+		int bucket = 0;
+
+		bench_send(&bp, BC_TRANSACTION, pending, handle, BENCH_PING,
+			   payload_buf, payload, NULL, 0);
+		if (bench_wait(&bp, &tr) != BR_REPLY) {
+			fprintf(stderr, "client %d: transaction failed\n",
+				index);
+			exit(1);
+		}
+		pending = tr.data.ptr.buffer;
+		lat = now_ns() - t0;
+
+		res.count++;
+		res.total_ns += lat;
+		if (lat < res.min_ns)
+			res.min_ns = lat;
+		if (lat > res.max_ns)
+			res.max_ns = lat;
+		for (us = lat / 1000; us && bucket < LAT_BUCKETS - 1; us >>= 1)
+			bucket++;
+		res.hist[bucket]++;
+	}
+	res.elapsed_ns = now_ns() - start;
+	if (pending)
+		bench_free(&bp, pending);
+
+	if (write(result_fd, &res, sizeof(res)) != sizeof(res))
+		fatal("write result");
+	exit(0);
+}
+
+static unsigned long percentile_us(const unsigned long *hist,
+				   unsigned long count, unsigned int pct)
+{
+	unsigned long want = (count * pct + 99) / 100, seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= want)
+			return i ? 1UL << i : 1;
+	}
+	return 1UL << (LAT_BUCKETS - 1);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-p pairs] [-i iterations] [-s payload bytes]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	pid_t mgr, servers[MAX_PAIRS], clients[MAX_PAIRS];
+	struct bench_result total;
+	double rate = 0;
+	int ready[2], results[2];
+	char c;
+	int opt, i, j;
+
+	while ((opt = getopt(argc, argv, "p:i:s:h")) != -1) {
+		switch (opt) {
+		case 'p':
+			pairs = atoi(optarg);
+			break;
+		case 'i':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			payload = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (pairs < 1 || pairs > MAX_PAIRS || payload > MAX_PAYLOAD ||
+	    !iterations)
+		usage(argv[0]);
+
+	if (pipe(ready) < 0 || pipe(results) < 0)
+		fatal("pipe");
+
+	mgr = fork();
+	if (mgr < 0)
+		fatal("fork");
+	if (!mgr) {
+		close(ready[0]);
+		run_context_manager(ready[1]);
+	}
+	close(ready[1]);
+	if (read(ready[0], &c, 1) != 1) {
+		fprintf(stderr, "context manager failed to start\n");
+		return 1;
+	}
+
+	for (i = 0; i < pairs; i++) {
+		servers[i] = fork();
+		if (servers[i] < 0)
+			fatal("fork");
+		if (!servers[i])
+			run_server(i);
+	}
+	for (i = 0; i < pairs; i++) {
+		clients[i] = fork();
+		if (clients[i] < 0)
+			fatal("fork");
+		if (!clients[i])
+			run_client(i, results[1]);
+	}
+	close(results[1]);
+
+	memset(&total, 0, sizeof(total));
+	total.min_ns = ~0ULL;
+	for (i = 0; i < pairs; i++) {
+		struct bench_result res;
+
+		if (read(results[0], &res, sizeof(res)) != sizeof(res)) {
+			fprintf(stderr, "a client died early\n");
+			break;
+		}
+		total.count += res.count;
+		total.total_ns += res.total_ns;
+		if (res.min_ns < total.min_ns)
+			total.min_ns = res.min_ns;
+		if (res.max_ns > total.max_ns)
+			total.max_ns = res.max_ns;
+		for (j = 0; j < LAT_BUCKETS; j++)
+			total.hist[j] += res.hist[j];
+		rate += res.count * 1e9 / res.elapsed_ns;
+	}
+
+	for (i = 0; i < pairs; i++) {
+		waitpid(clients[i], NULL, 0);
+		kill(servers[i], SIGTERM);
+		waitpid(servers[i], NULL, 0);
+	}
+	kill(mgr, SIGTERM);
+	waitpid(mgr, NULL, 0);
+
+	if (!total.count)
+		return 1;
+	printf("pairs %d, payload %zu bytes, %lu transactions\n",
+	       pairs, payload, total.count);
+	printf("throughput: %.0f transactions/s\n", rate);
+	printf("latency usecs: avg %.1f min %.1f max %.1f "
+	       "p50 <%lu p90 <%lu p99 <%lu\n",
+	       total.total_ns / 1000.0 / total.count,
+	       total.min_ns / 1000.0, total.max_ns / 1000.0,
+	       percentile_us(total.hist, total.count, 50),
+	       percentile_us(total.hist, total.count, 90),
+	       percentile_us(total.hist, total.count, 99));
+	return 0;
+}
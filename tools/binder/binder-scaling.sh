@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Run binder-bench with 1 to N client/server pairs and print the total
+# throughput, the throughput per pair and the speedup over a single pair.
+# With a driver that scales, the speedup follows the number of pairs up
+# to the number of CPUs and the per-pair rate stays flat.
+#
+# usage: binder-scaling.sh [max pairs] [iterations]
+#        (default: number of online CPUs, 100000)
+
+set -e
+
+max=${1:-$(getconf _NPROCESSORS_ONLN)}
+iterations=${2:-100000}
+BENCH=${BENCH:-$(dirname "$0")/binder-bench}
+
+[ -x "$BENCH" ] || { echo "$BENCH: not built" >&2; exit 1; }
+
+printf "%5s %14s %14s %8s %10s\n" pairs "total tx/s" "tx/s/pair" speedup \
+	"p99 usecs"
+base=
+p=1
+while [ $p -le "$max" ]; do
+	out=$("$BENCH" -p $p -i "$iterations")
+	rate=$(echo "$out" | awk '/^throughput:/ { print $2 }')
+	p99=$(echo "$out" | awk '/^latency/ { sub("<", "", $NF); print $NF }')
+	[ -n "$base" ] || base=$rate
+	awk -v p=$p -v r="$rate" -v b="$base" -v l="$p99" 'BEGIN {
+		printf "%5d %14.0f %14.0f %7.2fx %10s\n", p, r, r / p, r / b, l
+	}'
+	p=$((p + 1))
+done
@@ -0,0 +1,280 @@
+/*
+ * frame-bench: replay a frame workload under different cpufreq governors
+ *
+ * Every frame period the benchmark does the amount of CPU work the trace
+ * asks for and then sleeps until the next frame, the way a UI thread
+ * renders.  A frame is missed when its work does not finish within the
+ * period.  The trace has one frame per line, the work in microseconds at
+ * the highest frequency; without a trace, light frames alternate with
+ * bursts of heavy ones, like scrolling after a touch.
+ *
+ *   frame-bench -c 0 -t trace.txt ondemand sched
+ *
+ * For each governor the missed frames, frame time percentiles and the
+ * average frequency (from cpufreq stats, when enabled) are printed.  The
+ * work is calibrated with the performance governor first.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_FRAMES		100000
+#define MAX_FREQS		64
+
+static int cpu;
+static unsigned int period_us = 16667;
+static unsigned int *trace;
+static unsigned int nr_frames;
+static double loops_per_us;
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until(unsigned long long ns)
+{
+	struct timespec ts = {
+		.tv_sec = ns / 1000000000ULL,
+		.tv_nsec = ns % 1000000000ULL,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+static void spin(unsigned long loops)
+{
+	volatile unsigned long i;
+
+	for (i = 0; i < loops; i++)
+		;
+}
+
+static char *cpufreq_path(const char *file)
+{
+	static char path[128];
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/cpufreq/%s", cpu, file);
+	return path;
+}
+
+static void set_governor(const char *gov)
+{
+	FILE *f = fopen(cpufreq_path("scaling_governor"), "w");
+
+	if (!f || fprintf(f, "%s\n", gov) < 0 || fclose(f)) {
+		fprintf(stderr, "cannot select governor %s\n", gov);
+		exit(1);
+	}
+}
+
+static void get_governor(char *gov, size_t len)
+{
+	FILE *f = fopen(cpufreq_path("scaling_governor"), "r");
+
+	if (!f || !fgets(gov, len, f))
+		fatal("scaling_governor");
+	gov[strcspn(gov, "\n")] = '\0';
+	fclose(f);
+}
+
+/* time spent at each frequency, in 10ms units; 0 when stats are off */
+static int read_time_in_state(unsigned long *freq, unsigned long long *time)
+{
+	FILE *f = fopen(cpufreq_path("stats/time_in_state"), "r");
+	int n = 0;
+
+	if (!f)
+		return 0;
+	while (n < MAX_FREQS && fscanf(f, "%lu %llu", &freq[n], &time[n]) == 2)
+		n++;
+	fclose(f);
+	return n;
+}
+
+static void calibrate(void)
+{
+	unsigned long loops = 1000000;
+	unsigned long long t0, ns;
+
+	set_governor("performance");
+	sleep(1);
+	do {
+		loops *= 2;
+		t0 = now_ns();
+		spin(loops);
+		ns = now_ns() - t0;
+	} while (ns < 200000000ULL);
+	loops_per_us = (double)loops / (ns / 1000);
+}
+
+static void load_trace(const char *file)
+{
+	unsigned int i, work;
+	FILE *f;
+
+	trace = calloc(MAX_FRAMES, sizeof(*trace));
+	if (!trace)
+		fatal("calloc");
+
+	if (!file) {
+		/* 1s of light frames, then 2s of heavy ones, three times */
+		for (i = 0; i < 540; i++)
+			trace[i] = (i % 180) < 60 ? 2000 : 10000;
+		nr_frames = i;
+		return;
+	}
+
+	f = fopen(file, "r");
+	if (!f)
+		fatal(file);
+	while (nr_frames < MAX_FRAMES && fscanf(f, "%u", &work) == 1)
+		trace[nr_frames++] = work;
+	fclose(f);
+	if (!nr_frames) {
+		fprintf(stderr, "%s: no frames\n", file);
+		exit(1);
+	}
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	const unsigned long long *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+static void run(const char *gov)
+{
+	unsigned long freq[MAX_FREQS], freq2[MAX_FREQS];
+	unsigned long long time[MAX_FREQS], time2[MAX_FREQS];
+	unsigned long long *frame_ns, start, sum = 0, weighted = 0;
+	unsigned int i, missed = 0;
+	int n, n2;
+
+	frame_ns = calloc(nr_frames, sizeof(*frame_ns));
+	if (!frame_ns)
+		fatal("calloc");
+
+	set_governor(gov);
+	sleep(1);
+	n = read_time_in_state(freq, time);
+
+	start = now_ns();
+	for (i = 0; i < nr_frames; i++) {
+		unsigned long long t0 = start + (unsigned long long)i *
+					period_us * 1000;
+
+		sleep_until(t0);
+		spin(trace[i] * loops_per_us);
+		frame_ns[i] = now_ns() - t0;
+		if (frame_ns[i] > period_us * 1000ULL)
+			missed++;
+	}
+
+	n2 = read_time_in_state(freq2, time2);
+
+	qsort(frame_ns, nr_frames, sizeof(*frame_ns), cmp_ull);
+	printf("%-12s missed %5u/%u  p50 %6llu us  p95 %6llu us  max %6llu us",
+	       gov, missed, nr_frames, frame_ns[nr_frames / 2] / 1000,
+	       frame_ns[nr_frames * 95 / 100] / 1000,
+	       frame_ns[nr_frames - 1] / 1000);
+
+	if (n && n == n2) {
+		for (i = 0; i < (unsigned int)n; i++) {
+			sum += time2[i] - time[i];
+			weighted += (time2[i] - time[i]) * freq[i];
+		}
+		if (sum)
+			printf("  avg %7llu kHz", weighted / sum);
+	}
+	printf("\n");
+	free(frame_ns);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-c cpu] [-p period us] [-t trace] [governor...]\n"
+		"  -c  CPU to run on and whose governor is changed (default 0)\n"
+		"  -p  frame period (default 16667)\n"
+		"  -t  file with the work of one frame per line, in usecs\n"
+		"  governors default to ondemand and sched\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	static const char *def_govs[] = { "ondemand", "sched" };
+	const char *trace_file = NULL;
+	char old_gov[64];
+	cpu_set_t set;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "c:p:t:h")) != -1) {
+		switch (opt) {
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 'p':
+			period_us = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			trace_file = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!period_us)
+		usage(argv[0]);
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		fatal("sched_setaffinity");
+
+	load_trace(trace_file);
+	get_governor(old_gov, sizeof(old_gov));
+	calibrate();
+
+	if (optind < argc) {
+		for (i = optind; i < argc; i++)
+			run(argv[i]);
+	} else {
+		for (i = 0; i < 2; i++)
+			run(def_govs[i]);
+	}
+
+	set_governor(old_gov);
+	return 0;
+}
@@ -0,0 +1,270 @@
+/*
+ * dmcrypt-bench: O_DIRECT throughput and latency of block devices
+ *
+ * Reads, and with -w first writes, every block device given on the
+ * command line in fixed size chunks, bypassing the page cache.  Running
+ * it against a RAM disk and against a dm-crypt device stacked on top of
+ * the same RAM disk shows what the encryption costs, with the device
+ * itself taking no time:
+ *
+ *   modprobe brd rd_size=262144
+ *   dmsetup create bench --table "0 `blockdev --getsize /dev/ram0` \
+ *       crypt aes-xts-plain64 `head -c 64 /dev/urandom | xxd -p -c 64` \
+ *       0 /dev/ram0 0"
+ *   dmcrypt-bench -w -p 4 /dev/ram0 /dev/mapper/bench
+ *
+ * Several processes, each working on its own slice of the device, show
+ * how well the encryption is spread over the CPUs.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <linux/fs.h>
+
+#define LAT_BUCKETS		24
+
+struct bench_stat {
+	unsigned long count;
+	unsigned long long max_ns;
+	unsigned long hist[LAT_BUCKETS];	/* log2 of latency in usecs */
+};
+
+static size_t block_size = 128 << 10;
+static unsigned long long total_size = 64ULL << 20;
+static int nr_procs = 1;
+static int do_write;
+
+/* one per process, shared with the parent */
+static struct bench_stat *stats;
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stat_add(struct bench_stat *st, unsigned long long lat)
+{
+	unsigned long long us = lat / 1000;
+	int bucket = 0;
+
+	while (us > 1 && bucket < LAT_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+	st->hist[bucket]++;
+	st->count++;
+	if (lat > st->max_ns)
+		st->max_ns = lat;
+}
+
+static void stat_merge(struct bench_stat *to, const struct bench_stat *from)
+{
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++)
+		to->hist[i] += from->hist[i];
+	to->count += from->count;
+	if (from->max_ns > to->max_ns)
+		to->max_ns = from->max_ns;
+}
+
+static unsigned long percentile_us(const unsigned long *hist,
+				   unsigned long count, unsigned int pct)
+{
+	unsigned long want = (count * pct + 99) / 100, seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= want)
+			return i ? 1UL << i : 1;
+	}
+	return 1UL << (LAT_BUCKETS - 1);
+}
+
+static double rate_mb(unsigned long long bytes, unsigned long long ns)
+{
+	return ns ? (double)bytes / (1 << 20) / ((double)ns / 1e9) : 0;
+}
+
+static void bench_slice(const char *dev, int write, off_t start,
+			unsigned long long len, struct bench_stat *st)
+{
+	unsigned long long done;
+	unsigned long long t0;
+	void *buf;
+	int fd;
+
+	if (posix_memalign(&buf, 4096, block_size))
+		fatal("posix_memalign");
+	memset(buf, 0x5a, block_size);
+
+	fd = open(dev, (write ? O_WRONLY : O_RDONLY) | O_DIRECT);
+	if (fd < 0)
+		fatal(dev);
+
+	for (done = 0; done < len; done += block_size) {
+		ssize_t ret;
+
+		t0 = now_ns();
+		if (write)
+			ret = pwrite(fd, buf, block_size, start + done);
+		else
+			ret = pread(fd, buf, block_size, start + done);
+		if (ret != (ssize_t)block_size)
+			fatal(write ? "pwrite" : "pread");
+		stat_add(st, now_ns() - t0);
+	}
+
+	if (write && fsync(fd))
+		fatal("fsync");
+	close(fd);
+	free(buf);
+}
+
+static void run_pass(const char *dev, int write)
+{
+	unsigned long long slice = total_size / nr_procs / block_size *
+				   block_size;
+	unsigned long long start, ns;
+	struct bench_stat all;
+	int i, status, failed = 0;
+
+	memset(stats, 0, nr_procs * sizeof(*stats));
+	fflush(stdout);
+
+	start = now_ns();
+	for (i = 0; i < nr_procs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			fatal("fork");
+		if (!pid) {
+			bench_slice(dev, write, i * slice, slice, &stats[i]);
+			exit(0);
+		}
+	}
+	while (wait(&status) > 0)
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed = 1;
+	ns = now_ns() - start;
+	if (failed) {
+		fprintf(stderr, "%s: a benchmark process failed\n", dev);
+		exit(1);
+	}
+
+	memset(&all, 0, sizeof(all));
+	for (i = 0; i < nr_procs; i++)
+		stat_merge(&all, &stats[i]);
+
+	printf("  %-5s %8.1f MB/s  p50 %6lu us  p99 %6lu us  max %6llu us\n",
+	       write ? "write" : "read", rate_mb(slice * nr_procs, ns),
+	       percentile_us(all.hist, all.count, 50),
+	       percentile_us(all.hist, all.count, 99), all.max_ns / 1000);
+}
+
+static void bench_dev(const char *dev)
+{
+	unsigned long long size;
+	struct stat st;
+	int fd;
+
+	fd = open(dev, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st))
+		fatal(dev);
+	if (S_ISREG(st.st_mode))
+		size = st.st_size;
+	else if (ioctl(fd, BLKGETSIZE64, &size))
+		fatal("BLKGETSIZE64");
+	close(fd);
+
+	if (size < total_size) {
+		fprintf(stderr, "%s: only %llu MB, use -s to test less\n",
+			dev, size >> 20);
+		exit(1);
+	}
+
+	printf("%s: %d process%s, %zu byte blocks\n", dev, nr_procs,
+	       nr_procs > 1 ? "es" : "", block_size);
+	if (do_write)
+		run_pass(dev, 1);
+	run_pass(dev, 0);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s MB] [-b block bytes] [-p procs] [-w] device...\n"
+		"  -s  amount of data transferred per device and pass (default 64)\n"
+		"  -b  size of every pread() and pwrite() (default 131072)\n"
+		"  -p  number of processes, each with its own slice (default 1)\n"
+		"  -w  write before reading, DESTROYING the contents of the devices\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "s:b:p:wh")) != -1) {
+		switch (opt) {
+		case 's':
+			total_size = strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'b':
+			block_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			nr_procs = atoi(optarg);
+			break;
+		case 'w':
+			do_write = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind >= argc || !block_size || block_size % 4096 ||
+	    nr_procs < 1 || total_size / nr_procs < block_size)
+		usage(argv[0]);
+
+	stats = mmap(NULL, nr_procs * sizeof(*stats), PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED)
+		fatal("mmap");
+
+	for (i = optind; i < argc; i++)
+		bench_dev(argv[i]);
+
+	return 0;
+}
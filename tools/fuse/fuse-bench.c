@@ -0,0 +1,278 @@
+/*
+ * fuse-bench: dd style sequential write and read benchmark
+ *
+ * Writes a number of files in fixed size blocks into every directory
+ * given on the command line, then reads them back.  Running it against
+ * the emulated /sdcard and against the ext4 directory backing it shows
+ * what the FUSE layer costs; the write figure includes the final close,
+ * which is where a writeback cached FUSE mount pushes its data out.
+ * Several processes can run the same workload at once, which shows how
+ * well the daemon serves concurrent requests.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define LAT_BUCKETS		24
+
+struct bench_stat {
+	unsigned long count;
+	unsigned long long max_ns;
+	unsigned long hist[LAT_BUCKETS];	/* log2 of latency in usecs */
+};
+
+static size_t block_size = 4096;
+static unsigned long long total_size = 64ULL << 20;
+static int nr_files = 1;
+static int do_fsync;
+static int drop_caches;
+static int nr_procs = 1;
+static char *buf;
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stat_add(struct bench_stat *st, unsigned long long lat)
+{
+	unsigned long long us = lat / 1000;
+	int bucket = 0;
+
+	while (us > 1 && bucket < LAT_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+	st->hist[bucket]++;
+	st->count++;
+	if (lat > st->max_ns)
+		st->max_ns = lat;
+}
+
+static unsigned long percentile_us(const unsigned long *hist,
+				   unsigned long count, unsigned int pct)
+{
+	unsigned long want = (count * pct + 99) / 100, seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= want)
+			return i ? 1UL << i : 1;
+	}
+	return 1UL << (LAT_BUCKETS - 1);
+}
+
+static double rate_mb(unsigned long long bytes, unsigned long long ns)
+{
+	return ns ? (double)bytes / (1 << 20) / ((double)ns / 1e9) : 0;
+}
+
+static void file_name(char *name, size_t len, const char *dir, int i)
+{
+	snprintf(name, len, "%s/fuse-bench.%d.%d", dir, (int)getpid(), i);
+}
+
+static void drop_page_cache(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0)
+		fatal("open /proc/sys/vm/drop_caches");
+	if (write(fd, "3", 1) != 1)
+		fatal("drop_caches");
+	close(fd);
+}
+
+static void bench_dir(const char *dir)
+{
+	unsigned long long per_file = total_size / nr_files;
+	unsigned long long start, wr_ns, rd_ns, t0;
+	struct bench_stat wr, cl;
+	char name[4096];
+	int i, fd;
+
+	memset(&wr, 0, sizeof(wr));
+	memset(&cl, 0, sizeof(cl));
+
+	start = now_ns();
+	for (i = 0; i < nr_files; i++) {
+		unsigned long long done = 0;
+
+		file_name(name, sizeof(name), dir, i);
+		fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			fatal(name);
+		while (done < per_file) {
+			ssize_t ret;
+
+			t0 = now_ns();
+			ret = write(fd, buf, block_size);
+			if (ret != (ssize_t)block_size)
+				fatal("write");
+			stat_add(&wr, now_ns() - t0);
+			done += ret;
+		}
+		t0 = now_ns();
+		if (do_fsync && fsync(fd))
+			fatal("fsync");
+		if (close(fd))
+			fatal("close");
+		stat_add(&cl, now_ns() - t0);
+	}
+	wr_ns = now_ns() - start;
+
+	if (drop_caches)
+		drop_page_cache();
+
+	start = now_ns();
+	for (i = 0; i < nr_files; i++) {
+		file_name(name, sizeof(name), dir, i);
+		fd = open(name, O_RDONLY);
+		if (fd < 0)
+			fatal(name);
+		while (read(fd, buf, block_size) > 0)
+			;
+		close(fd);
+	}
+	rd_ns = now_ns() - start;
+
+	for (i = 0; i < nr_files; i++) {
+		file_name(name, sizeof(name), dir, i);
+		unlink(name);
+	}
+
+	printf("%s\n", dir);
+	printf("  write %8.1f MB/s  write() p50 %6lu us  p99 %6lu us  max %6llu us\n",
+	       rate_mb(per_file * nr_files, wr_ns),
+	       percentile_us(wr.hist, wr.count, 50),
+	       percentile_us(wr.hist, wr.count, 99), wr.max_ns / 1000);
+	printf("%21s  %s p50 %6lu us  p99 %6lu us  max %6llu us\n",
+	       "", do_fsync ? "fsync()" : "close()",
+	       percentile_us(cl.hist, cl.count, 50),
+	       percentile_us(cl.hist, cl.count, 99), cl.max_ns / 1000);
+	printf("  read  %8.1f MB/s%s\n", rate_mb(per_file * nr_files, rd_ns),
+	       drop_caches ? "" : " (cached)");
+}
+
+static void run_dir(const char *dir)
+{
+	unsigned long long start, bytes;
+	int i, status, failed = 0;
+
+	if (nr_procs == 1) {
+		bench_dir(dir);
+		return;
+	}
+
+	fflush(stdout);
+	start = now_ns();
+	for (i = 0; i < nr_procs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			fatal("fork");
+		if (!pid) {
+			bench_dir(dir);
+			exit(0);
+		}
+	}
+	while (wait(&status) > 0)
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed = 1;
+	if (failed) {
+		fprintf(stderr, "%s: a benchmark process failed\n", dir);
+		exit(1);
+	}
+
+	bytes = 2 * (total_size / nr_files) * nr_files * nr_procs;
+	printf("%s: %d processes, %.1f MB/s written and read back in total\n",
+	       dir, nr_procs, rate_mb(bytes, now_ns() - start));
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s MB] [-b block bytes] [-n files] [-p procs] [-f] [-d] dir...\n"
+		"  -s  total amount of data written per directory (default 64)\n"
+		"  -b  size of every write() and read() (default 4096)\n"
+		"  -n  number of files the data is spread over (default 1)\n"
+		"  -p  number of processes running the workload at once (default 1)\n"
+		"  -f  fsync each file before closing it\n"
+		"  -d  drop the page cache before reading back (needs root)\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "s:b:n:p:fdh")) != -1) {
+		switch (opt) {
+		case 's':
+			total_size = strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'b':
+			block_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nr_files = atoi(optarg);
+			break;
+		case 'p':
+			nr_procs = atoi(optarg);
+			break;
+		case 'f':
+			do_fsync = 1;
+			break;
+		case 'd':
+			drop_caches = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind >= argc || !block_size || nr_files < 1 || nr_procs < 1 ||
+	    total_size / nr_files < block_size)
+		usage(argv[0]);
+
+	buf = malloc(block_size);
+	if (!buf)
+		fatal("malloc");
+	memset(buf, 0x5a, block_size);
+
+	for (i = optind; i < argc; i++)
+		run_dir(argv[i]);
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * ion-bench: ION buffer allocation and free latency benchmark
+ *
+ * Allocates and frees buffers of the sizes a 1080p display and camera
+ * pipeline typically asks for, keeping a small ring of buffers in
+ * flight the way a triple-buffered queue does.  Every ION_IOC_ALLOC and
+ * ION_IOC_FREE is timed separately so the effect of the system heap
+ * page pools shows up in both the allocation and the release path.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "../../include/linux/ion.h"
+
+#define ION_DEV			"/dev/ion"
+#define MAX_DEPTH		16
+#define LAT_BUCKETS		24
+
+struct bench_size {
+	const char *name;
+	size_t len;
+};
+
+/* 1080p buffers, with the 16 line alignment video hardware asks for */
+static const struct bench_size sizes[] = {
+	{ "nv12 1920x1088",	1920 * 1088 * 3 / 2 },
+	{ "rgb565 1920x1080",	1920 * 1080 * 2 },
+	{ "rgba8888 1920x1080",	1920 * 1080 * 4 },
+	{ "rgba8888 1920x1088",	1920 * 1088 * 4 },
+};
+
+struct bench_stat {
+	unsigned long count;
+	unsigned long long total_ns;
+	unsigned long long max_ns;
+	unsigned long hist[LAT_BUCKETS];	/* log2 of latency in usecs */
+};
+
+static unsigned long iterations = 1000;
+static int depth = 3;
+static unsigned int heap_mask = ION_HEAP(ION_SYSTEM_HEAP_ID);
+static unsigned int cache_flags = ION_SET_CACHE(CACHED);
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stat_add(struct bench_stat *st, unsigned long long lat)
+{
+	unsigned long long us = lat / 1000;
+	int bucket = 0;
+
+	while (us > 1 && bucket < LAT_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+	st->hist[bucket]++;
+	st->count++;
+	st->total_ns += lat;
+	if (lat > st->max_ns)
+		st->max_ns = lat;
+}
+
+static unsigned long percentile_us(const unsigned long *hist,
+				   unsigned long count, unsigned int pct)
+{
+	unsigned long want = (count * pct + 99) / 100, seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= want)
+			return i ? 1UL << i : 1;
+	}
+	return 1UL << (LAT_BUCKETS - 1);
+}
+
+static struct ion_handle *bench_alloc(int fd, size_t len,
+				      struct bench_stat *st)
+{
+	struct ion_allocation_data data;
+	unsigned long long t0;
+
+	memset(&data, 0, sizeof(data));
+	data.len = len;
+	data.align = 4096;
+	data.flags = heap_mask | cache_flags;
+
+	t0 = now_ns();
+	if (ioctl(fd, ION_IOC_ALLOC, &data) < 0)
+		fatal("ION_IOC_ALLOC");
+	stat_add(st, now_ns() - t0);
+
+	return data.handle;
+}
+
+static void bench_free(int fd, struct ion_handle *handle,
+		       struct bench_stat *st)
+{
+	struct ion_handle_data data;
+	unsigned long long t0;
+
+	data.handle = handle;
+
+	t0 = now_ns();
+	if (ioctl(fd, ION_IOC_FREE, &data) < 0)
+		fatal("ION_IOC_FREE");
+	stat_add(st, now_ns() - t0);
+}
+
+static void report(const char *what, const struct bench_stat *st)
+{
+	printf("  %-5s  avg %6llu us  p50 %6lu us  p99 %6lu us  max %6llu us\n",
+	       what, st->count ? st->total_ns / st->count / 1000 : 0,
+	       percentile_us(st->hist, st->count, 50),
+	       percentile_us(st->hist, st->count, 99),
+	       st->max_ns / 1000);
+}
+
+static void run_size(int fd, const struct bench_size *sz)
+{
+	struct ion_handle *ring[MAX_DEPTH];
+	struct bench_stat alloc_st, free_st;
+	unsigned long i;
+	int slot;
+
+	memset(&alloc_st, 0, sizeof(alloc_st));
+	memset(&free_st, 0, sizeof(free_st));
+	memset(ring, 0, sizeof(ring));
+
+	for (i = 0; i < iterations; i++) {
+		slot = i % depth;
+		if (ring[slot])
+			bench_free(fd, ring[slot], &free_st);
+		ring[slot] = bench_alloc(fd, sz->len, &alloc_st);
+	}
+	for (slot = 0; slot < depth; slot++)
+		if (ring[slot])
+			bench_free(fd, ring[slot], &free_st);
+
+	printf("%s (%zu KiB), %lu buffers, depth %d\n", sz->name,
+	       sz->len / 1024, iterations, depth);
+	report("alloc", &alloc_st);
+	report("free", &free_st);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-i iterations] [-d depth] [-H heap id] [-u]\n"
+		"  -d  buffers kept in flight, at most %d (default 3)\n"
+		"  -H  heap id to allocate from (default %d, system heap)\n"
+		"  -u  allocate uncached buffers\n",
+		prog, MAX_DEPTH, ION_SYSTEM_HEAP_ID);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "i:d:H:uh")) != -1) {
+		switch (opt) {
+		case 'i':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'H':
+			heap_mask = ION_HEAP(atoi(optarg));
+			break;
+		case 'u':
+			cache_flags = ION_SET_CACHE(UNCACHED);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!iterations || depth < 1 || depth > MAX_DEPTH)
+		usage(argv[0]);
+
+	fd = open(ION_DEV, O_RDONLY);
+	if (fd < 0)
+		fatal("open " ION_DEV);
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		run_size(fd, &sizes[i]);
+
+	close(fd);
+	return 0;
+}
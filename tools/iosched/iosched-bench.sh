@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# Run flash-mixed.fio once per I/O scheduler against a RAM-backed SCSI
+# disk.  brd does not go through an elevator, scsi_debug does, and with
+# delay=0 the device itself takes no time, so any difference in latency
+# is the scheduler's doing.
+#
+# usage: iosched-bench.sh [scheduler...]   (default: noop deadline row cfq)
+
+set -e
+
+dir=$(dirname "$0")
+scheds=${*:-noop deadline row cfq}
+
+modprobe scsi_debug dev_size_mb=256 delay=0
+trap 'sleep 1; rmmod scsi_debug' EXIT
+udevadm settle
+
+DEV=
+for d in /sys/bus/pseudo/drivers/scsi_debug/adapter*/host*/target*/*/block/*; do
+	DEV=/dev/$(basename "$d")
+done
+[ -b "$DEV" ] || { echo "no scsi_debug disk found" >&2; exit 1; }
+export DEV
+queue=/sys/block/$(basename "$DEV")/queue
+
+for s in $scheds; do
+	if ! echo "$s" > "$queue/scheduler" 2>/dev/null; then
+		echo "$s: not available, skipped"
+		continue
+	fi
+	echo "== $s"
+	fio --minimal "$dir/flash-mixed.fio" | awk -F';' '
+		# terse v3: field 3 job name, 8 read iops,
+		# 40 read lat mean (usec), 49 write iops, 81 write lat mean
+		{ printf "  %-13s read %7s iops lat %9s us  write %7s iops lat %9s us\n",
+			$3, $8, $40, $49, $81 }'
+done
@@ -0,0 +1,272 @@
+/*
+ * lowmem-pressure-test: exercise /dev/lowmem_pressure
+ *
+ * Forks a memory hog that keeps allocating and touching anonymous
+ * memory, and listens for pressure events on /dev/lowmem_pressure.
+ * On every event the hog is asked to give back part of what it holds,
+ * the way a framework would trim caches.  For each event we record the
+ * delay from the kernel raising it to us reading it, and from the
+ * kernel raising it to the hog having released memory.  The run ends
+ * after the requested time or when the hog is killed.  Meant for a
+ * throwaway VM or device.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define PRESSURE_DEV		"/dev/lowmem_pressure"
+#define MAX_CHUNKS		4096
+#define NR_LEVELS		4
+
+static const char * const level_names[NR_LEVELS] = {
+	"none", "low", "medium", "critical",
+};
+
+struct lat_stats {
+	unsigned long count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+};
+
+static volatile sig_atomic_t trim_requested;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void lat_add(struct lat_stats *st, uint64_t ns)
+{
+	st->count++;
+	st->total_ns += ns;
+	if (ns > st->max_ns)
+		st->max_ns = ns;
+}
+
+static void lat_print(const char *name, const struct lat_stats *st)
+{
+	if (!st->count) {
+		printf("%-16s no samples\n", name);
+		return;
+	}
+	printf("%-16s n=%lu avg=%.1fus max=%.1fus\n", name, st->count,
+	       st->total_ns / 1000.0 / st->count, st->max_ns / 1000.0);
+}
+
+static void trim_handler(int sig)
+{
+	(void)sig;
+	trim_requested = 1;
+}
+
+/*
+ * Allocates @step bytes every @delay_us, up to @max bytes, and on
+ * SIGUSR1 unmaps @trim percent of the chunks it holds, then reports
+ * back through @done_fd.
+ */
+static void hog(size_t step, size_t max, unsigned int delay_us,
+		unsigned int trim, int done_fd)
+{
+	static void *chunks[MAX_CHUNKS];
+	size_t nr = 0, held = 0;
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = trim_handler;
+	sigaction(SIGUSR1, &sa, NULL);
+
+	for (;;) {
+		if (trim_requested) {
+			size_t drop = nr * trim / 100;
+			char c = 0;
+
+			trim_requested = 0;
+			while (drop--) {
+				munmap(chunks[--nr], step);
+				held -= step;
+			}
+			if (write(done_fd, &c, 1) != 1)
+				_exit(1);
+		}
+
+		if (nr < MAX_CHUNKS && (!max || held + step <= max)) {
+			void *p = mmap(NULL, step, PROT_READ | PROT_WRITE,
+				       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+			if (p != MAP_FAILED) {
+				memset(p, 0x5a, step);
+				chunks[nr++] = p;
+				held += step;
+			}
+		}
+		usleep(delay_us);
+	}
+}
+
+static int parse_event(const char *line, int *level, uint64_t *time_ns)
+{
+	const char *p;
+	int i;
+
+	p = strstr(line, "level=");
+	if (!p)
+		return -1;
+	p += strlen("level=");
+	for (i = 0; i < NR_LEVELS; i++) {
+		size_t len = strlen(level_names[i]);
+
+		if (!strncmp(p, level_names[i], len) && p[len] == ' ')
+			break;
+	}
+	if (i == NR_LEVELS)
+		return -1;
+	*level = i;
+
+	p = strstr(line, "time=");
+	if (!p)
+		return -1;
+	*time_ns = strtoull(p + strlen("time="), NULL, 10);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-l level] [-s step_mb] [-m max_mb] [-d delay_us]\n"
+		"          [-t trim_pct] [-T seconds]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct lat_stats notify = { 0 }, reclaim = { 0 };
+	unsigned long events[NR_LEVELS] = { 0 };
+	const char *min_level = "low";
+	size_t step = 16 << 20, max = 0;
+	unsigned int delay_us = 10000, trim = 25, seconds = 60;
+	int pipefd[2], fd, opt, status, i;
+	uint64_t deadline;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "l:s:m:d:t:T:")) != -1) {
+		switch (opt) {
+		case 'l':
+			min_level = optarg;
+			break;
+		case 's':
+			step = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'm':
+			max = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'd':
+			delay_us = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			trim = strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			seconds = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!step || trim > 100)
+		usage(argv[0]);
+
+	fd = open(PRESSURE_DEV, O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+		perror(PRESSURE_DEV);
+		return 1;
+	}
+	if (write(fd, min_level, strlen(min_level)) < 0) {
+		perror("set level");
+		return 1;
+	}
+
+	if (pipe(pipefd)) {
+		perror("pipe");
+		return 1;
+	}
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (!pid) {
+		close(pipefd[0]);
+		hog(step, max, delay_us, trim, pipefd[1]);
+	}
+	close(pipefd[1]);
+
+	deadline = now_ns() + (uint64_t)seconds * 1000000000ull;
+	while (now_ns() < deadline) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		char line[128], c;
+		uint64_t event_ns;
+		ssize_t len;
+		int level;
+
+		if (waitpid(pid, &status, WNOHANG) == pid) {
+			pid = 0;
+			break;
+		}
+		if (poll(&pfd, 1, 100) <= 0)
+			continue;
+
+		len = read(fd, line, sizeof(line) - 1);
+		if (len <= 0)
+			continue;
+		line[len] = '\0';
+		if (parse_event(line, &level, &event_ns)) {
+			fprintf(stderr, "bad event: %s", line);
+			continue;
+		}
+		lat_add(&notify, now_ns() - event_ns);
+		events[level]++;
+
+		kill(pid, SIGUSR1);
+		if (read(pipefd[0], &c, 1) == 1)
+			lat_add(&reclaim, now_ns() - event_ns);
+	}
+
+	if (pid) {
+		kill(pid, SIGKILL);
+		waitpid(pid, &status, 0);
+		printf("hog survived %u s\n", seconds);
+	} else if (WIFSIGNALED(status)) {
+		printf("hog killed by signal %d\n", WTERMSIG(status));
+	}
+
+	for (i = 1; i < NR_LEVELS; i++)
+		printf("%-16s %lu events\n", level_names[i], events[i]);
+	lat_print("notify", &notify);
+	lat_print("reclaim", &reclaim);
+
+	return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * hotplug-replay: replay a load trace and time the core on/off decisions
+ *
+ * The trace has one step per line, "<threads> <duration ms>": for each step
+ * that many threads spin for that long.  While a step runs, the set of
+ * online cores is polled every millisecond and each change is printed
+ * with the time since the step started, which is the latency of the
+ * hotplug policy in use, in-kernel or the MPDecision daemon.  Without a
+ * trace, a few bursts of growing width are replayed.
+ *
+ *   hotplug-replay -t steps.txt
+ *
+ * With msm_mpdecision, its debugfs stats are printed at the end, and
+ * burst.rq can be fed to its replay file to see the decisions the policy
+ * takes on a run queue trace:
+ *
+ *   cat burst.rq > /sys/kernel/debug/msm_mpdecision/replay
+ *   cat /sys/kernel/debug/msm_mpdecision/replay
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_STEPS		1024
+#define MAX_THREADS		64
+
+#define STATS_FILE	"/sys/kernel/debug/msm_mpdecision/stats"
+
+struct step {
+	unsigned int threads;
+	unsigned int ms;
+};
+
+static struct step steps[MAX_STEPS];
+static unsigned int nr_steps;
+static volatile int stop_spinning;
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int read_online(char *buf, size_t len)
+{
+	FILE *f = fopen("/sys/devices/system/cpu/online", "r");
+
+	if (!f)
+		fatal("/sys/devices/system/cpu/online");
+	if (!fgets(buf, len, f))
+		buf[0] = '\0';
+	fclose(f);
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+static void *spin(void *arg)
+{
+	(void)arg;
+	while (!stop_spinning)
+		;
+	return NULL;
+}
+
+static void load_trace(const char *file)
+{
+	FILE *f;
+
+	if (!file) {
+		/* idle, then bursts one to four threads wide */
+		static const struct step def[] = {
+			{ 0, 1000 }, { 1, 1000 }, { 0, 1000 }, { 2, 1000 },
+			{ 0, 1000 }, { 3, 1000 }, { 4, 1000 }, { 0, 2000 },
+		};
+
+		memcpy(steps, def, sizeof(def));
+		nr_steps = sizeof(def) / sizeof(def[0]);
+		return;
+	}
+
+	f = fopen(file, "r");
+	if (!f)
+		fatal(file);
+	while (nr_steps < MAX_STEPS &&
+	       fscanf(f, "%u %u", &steps[nr_steps].threads,
+		      &steps[nr_steps].ms) == 2) {
+		if (steps[nr_steps].threads > MAX_THREADS)
+			steps[nr_steps].threads = MAX_THREADS;
+		nr_steps++;
+	}
+	fclose(f);
+	if (!nr_steps) {
+		fprintf(stderr, "%s: no steps\n", file);
+		exit(1);
+	}
+}
+
+static void run_step(unsigned int i)
+{
+	pthread_t threads[MAX_THREADS];
+	unsigned long long start, end, t;
+	char online[64], prev[64];
+	unsigned int j;
+
+	read_online(prev, sizeof(prev));
+	printf("step %3u: %2u threads %5u ms, online %s\n", i,
+	       steps[i].threads, steps[i].ms, prev);
+
+	stop_spinning = 0;
+	for (j = 0; j < steps[i].threads; j++)
+		if (pthread_create(&threads[j], NULL, spin, NULL))
+			fatal("pthread_create");
+
+	start = now_us();
+	end = start + steps[i].ms * 1000ULL;
+	while ((t = now_us()) < end) {
+		read_online(online, sizeof(online));
+		if (strcmp(online, prev)) {
+			printf("          %7llu us  online %s\n", t - start,
+			       online);
+			strcpy(prev, online);
+		}
+		usleep(1000);
+	}
+
+	stop_spinning = 1;
+	for (j = 0; j < steps[i].threads; j++)
+		pthread_join(threads[j], NULL);
+}
+
+static void print_stats(void)
+{
+	char line[256];
+	FILE *f = fopen(STATS_FILE, "r");
+
+	if (!f)
+		return;
+	printf("\n%s:\n", STATS_FILE);
+	while (fgets(line, sizeof(line), f))
+		printf("  %s", line);
+	fclose(f);
+}
+
+static void reset_stats(void)
+{
+	FILE *f = fopen(STATS_FILE, "w");
+
+	if (!f)
+		return;
+	fputs("0\n", f);
+	fclose(f);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-t trace]\n"
+		"  -t  file with one \"<threads> <duration ms>\" step per line\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *trace_file = NULL;
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:h")) != -1) {
+		switch (opt) {
+		case 't':
+			trace_file = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	load_trace(trace_file);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	reset_stats();
+
+	for (i = 0; i < nr_steps; i++)
+		run_step(i);
+
+	print_stats();
+	return 0;
+}
@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# Compare load balancing on the decayed per-entity load (LB_LOAD_AVG) with
+# balancing on the instantaneous runqueue weight (NO_LB_LOAD_AVG).  Each
+# mode runs perf bench sched messaging (hackbench) and sched pipe a few
+# times and the median wall time is printed.  Needs CONFIG_SCHED_DEBUG
+# and debugfs.
+#
+# usage: lb-bench.sh [runs]   (default 5)
+
+set -e
+
+runs=${1:-5}
+features=/sys/kernel/debug/sched_features
+PERF=${PERF:-perf}
+
+[ -w "$features" ] || mount -t debugfs none /sys/kernel/debug
+[ -w "$features" ] || { echo "$features: not writable" >&2; exit 1; }
+grep -q LB_LOAD_AVG "$features" || {
+	echo "kernel has no LB_LOAD_AVG feature" >&2; exit 1; }
+
+orig=$(tr ' ' '\n' < "$features" | grep LB_LOAD_AVG)
+trap 'echo $orig > $features' EXIT
+
+# median of the "Total time" perf bench prints over $runs runs
+median() {
+	i=0
+	while [ $i -lt "$runs" ]; do
+		"$PERF" bench sched "$@" |
+			awk '/Total time/ { print $3 }'
+		i=$((i + 1))
+	done | sort -n | awk '{ t[NR] = $1 } END { print t[int((NR + 1) / 2)] }'
+}
+
+for mode in LB_LOAD_AVG NO_LB_LOAD_AVG; do
+	echo $mode > "$features"
+	echo "== $mode"
+	printf "  %-28s %8s s\n" "messaging -g 10 -l 1000" \
+		"$(median messaging -g 10 -l 1000)"
+	printf "  %-28s %8s s\n" "messaging -p -g 20 -l 500" \
+		"$(median messaging -p -g 20 -l 500)"
+	printf "  %-28s %8s s\n" "pipe -l 200000" \
+		"$(median pipe -l 200000)"
+done
@@ -0,0 +1,330 @@
+/*
+ * zram-bench: zram write/read throughput and latency versus CPU count
+ *
+ * For every CPU count from 1 up to -c, forks that many workers, each
+ * pinned to its own CPU, which write and then read back their own
+ * slice of a zram device with O_DIRECT page-sized I/O, the access
+ * pattern swap produces.  Reports MB/s and per-page latency for each
+ * phase, so it shows how far writes to one device scale across cores.
+ * Page contents come from -f (for example a process memory dump) or
+ * from a generator that compresses about 2:1.  The compression ratio the
+ * device reports after each run is printed too, so running the same
+ * dump with each comp_algorithm compares speed against ratio.
+ *
+ * The device must already be initialized (disksize set) and not in
+ * use; its contents are overwritten.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define PAGE_SZ			4096
+#define MAX_WORKERS		64
+#define LAT_BUCKETS		24
+
+struct phase_result {
+	unsigned long count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t elapsed_ns;
+	unsigned long hist[LAT_BUCKETS];	/* log2 of latency in usecs */
+};
+
+struct worker_result {
+	struct phase_result write;
+	struct phase_result read;
+	int failed;
+};
+
+static unsigned char *data;
+static size_t data_pages;
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void record(struct phase_result *res, uint64_t lat)
+{
+	uint64_t us;
+	int bucket = 0;
+
+	res->count++;
+	res->total_ns += lat;
+	if (lat > res->max_ns)
+		res->max_ns = lat;
+	for (us = lat / 1000; us && bucket < LAT_BUCKETS - 1; us >>= 1)
+		bucket++;
+	res->hist[bucket]++;
+}
+
+/* Half random bytes, half runs of a repeated byte: roughly 2:1 */
+static void generate_data(size_t pages)
+{
+	size_t i;
+
+	data_pages = pages;
+	data = malloc(pages * PAGE_SZ);
+	if (!data)
+		fatal("malloc");
+	srandom(1);
+	for (i = 0; i < pages * PAGE_SZ; i += 64) {
+		if ((i / 64) & 1)
+			memset(data + i, (int)(i / 64), 64);
+		else {
+			int j;
+
+			for (j = 0; j < 64; j++)
+				data[i + j] = random();
+		}
+	}
+}
+
+static void load_data(const char *path)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st))
+		fatal(path);
+	data_pages = st.st_size / PAGE_SZ;
+	if (!data_pages) {
+		fprintf(stderr, "%s: shorter than a page\n", path);
+		exit(1);
+	}
+	data = mmap(NULL, data_pages * PAGE_SZ, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		fatal("mmap");
+	close(fd);
+}
+
+static void worker(const char *dev, int cpu, off_t first, size_t pages,
+		   struct worker_result *res)
+{
+	cpu_set_t set;
+	void *buf;
+	uint64_t start, t0;
+	size_t i;
+	int fd;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		fatal("sched_setaffinity");
+
+	fd = open(dev, O_RDWR | O_DIRECT);
+	if (fd < 0)
+		fatal(dev);
+	if (posix_memalign(&buf, PAGE_SZ, PAGE_SZ))
+		fatal("posix_memalign");
+
+	start = now_ns();
+	for (i = 0; i < pages; i++) {
+		memcpy(buf, data + ((first + i) % data_pages) * PAGE_SZ,
+		       PAGE_SZ);
+		t0 = now_ns();
+		if (pwrite(fd, buf, PAGE_SZ, (first + i) * PAGE_SZ) !=
+		    PAGE_SZ) {
+			res->failed = 1;
+			exit(1);
+		}
+		record(&res->write, now_ns() - t0);
+	}
+	res->write.elapsed_ns = now_ns() - start;
+
+	start = now_ns();
+	for (i = 0; i < pages; i++) {
+		t0 = now_ns();
+		if (pread(fd, buf, PAGE_SZ, (first + i) * PAGE_SZ) !=
+		    PAGE_SZ) {
+			res->failed = 1;
+			exit(1);
+		}
+		record(&res->read, now_ns() - t0);
+	}
+	res->read.elapsed_ns = now_ns() - start;
+
+	exit(0);
+}
+
+static unsigned long percentile_us(const unsigned long *hist,
+				   unsigned long count, unsigned int pct)
+{
+	unsigned long want = (count * pct + 99) / 100, seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= want)
+			return i ? 1UL << i : 1;
+	}
+	return 1UL << (LAT_BUCKETS - 1);
+}
+
+static void report(const char *name, int cpus, struct worker_result *res,
+		   int nr)
+{
+	struct phase_result total;
+	uint64_t elapsed = 0;
+	int i, j;
+
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < nr; i++) {
+		struct phase_result *p = name[0] == 'w' ?
+			&res[i].write : &res[i].read;
+
+		total.count += p->count;
+		total.total_ns += p->total_ns;
+		if (p->max_ns > total.max_ns)
+			total.max_ns = p->max_ns;
+		if (p->elapsed_ns > elapsed)
+			elapsed = p->elapsed_ns;
+		for (j = 0; j < LAT_BUCKETS; j++)
+			total.hist[j] += p->hist[j];
+	}
+	if (!total.count || !elapsed)
+		return;
+
+	printf("%4d %-5s %9.1f %9.1f %9.1f %7lu %7lu\n", cpus, name,
+	       total.count * (double)PAGE_SZ / (1 << 20) /
+	       (elapsed / 1e9),
+	       total.total_ns / 1000.0 / total.count,
+	       total.max_ns / 1000.0,
+	       percentile_us(total.hist, total.count, 50),
+	       percentile_us(total.hist, total.count, 99));
+}
+
+static int read_stat(const char *dev, const char *attr,
+		     unsigned long long *val)
+{
+	const char *name = strrchr(dev, '/');
+	char path[256];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "/sys/block/%s/%s",
+		 name ? name + 1 : dev, attr);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	ret = fscanf(f, "%llu", val) == 1 ? 0 : -1;
+	fclose(f);
+	return ret;
+}
+
+static void report_ratio(const char *dev, int cpus)
+{
+	unsigned long long orig, compr;
+
+	if (read_stat(dev, "orig_data_size", &orig) ||
+	    read_stat(dev, "compr_data_size", &compr) || !compr)
+		return;
+	printf("%4d ratio %9.2f\n", cpus, (double)orig / compr);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d device] [-c max_cpus] [-n pages_per_worker]"
+		" [-f data_file]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dev = "/dev/zram0", *file = NULL;
+	int max_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t pages = 16384;
+	struct worker_result *res;
+	int opt, cpus, i, status;
+
+	while ((opt = getopt(argc, argv, "d:c:n:f:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dev = optarg;
+			break;
+		case 'c':
+			max_cpus = atoi(optarg);
+			break;
+		case 'n':
+			pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (max_cpus < 1 || max_cpus > MAX_WORKERS || !pages)
+		usage(argv[0]);
+
+	if (file)
+		load_data(file);
+	else
+		generate_data(1024);
+
+	res = mmap(NULL, MAX_WORKERS * sizeof(*res), PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (res == MAP_FAILED)
+		fatal("mmap");
+
+	printf("cpus phase      MB/s    avg us    max us  p50 us  p99 us\n");
+	for (cpus = 1; cpus <= max_cpus; cpus++) {
+		memset(res, 0, MAX_WORKERS * sizeof(*res));
+		for (i = 0; i < cpus; i++) {
+			pid_t pid = fork();
+
+			if (pid < 0)
+				fatal("fork");
+			if (!pid)
+				worker(dev, i, (off_t)i * pages, pages,
+				       &res[i]);
+		}
+		for (i = 0; i < cpus; i++) {
+			if (wait(&status) < 0)
+				fatal("wait");
+			if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+				fprintf(stderr, "worker failed\n");
+				return 1;
+			}
+		}
+		report("write", cpus, res, cpus);
+		report("read", cpus, res, cpus);
+		report_ratio(dev, cpus);
+	}
+
+	return 0;
+}